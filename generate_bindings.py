@@ -11,6 +11,8 @@ def convert_ts_type(t):
     return 'any'
   if t == 'bool':
     return 'boolean'
+  if t.startswith('vector<'):
+    return convert_ts_type(t[len('vector<'):-1]) + '[]'
   return t
 
 def cpp_to_json_converter(t):
@@ -91,6 +93,10 @@ struct {{ name }} {
   static {{ name }} fromJson(const json& j);
 };
 
+// So messages can be sent in batches, ie. as vector<{{ name }}> fields
+void to_json(json& j, const {{ name }}& message);
+void from_json(const json& j, {{ name }}& message);
+
 {% endfor %}
 
 class IMessageHandler {
@@ -162,11 +168,19 @@ void MessageBindings::sendMessageToWeb(const {{ name }}& message) {
 
 string {{ name }}::toJson() const {
   json j;
+  ::to_json(j, *this);
+  return j.dump();
+}
+
+void to_json(json& j, const {{ name }}& message) {
   j["type"] = "{{ name }}";
   {% for (property_name, property_type) in values %}
-  j["{{ property_name }}"] = {{ cpp_to_json_converter(property_type) }}({{ property_name }});
+  j["{{ property_name }}"] = {{ cpp_to_json_converter(property_type) }}(message.{{ property_name }});
   {% endfor %}
-  return j.dump();
+}
+
+void from_json(const json& j, {{ name }}& message) {
+  message = {{ name }}::fromJson(j);
 }
 
 {{ name }} {{ name }}::fromJson(const json& j) {
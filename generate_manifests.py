@@ -1,52 +1,129 @@
-import os, json
-from pprint import pprint
+import os, struct
 
-all_textures = {}
+# Writes data/textures_manifest.bin: every texture file, and what C++ uses of
+# their shader scripts, as a hash table C++ reads straight from memory. The
+# layout's in src/cpp/texture_manifest.h, and has to match it.
 
-for subdir, dirs, files in os.walk('data/textures'):
-    for file in files:
-      all_textures[os.path.join(subdir, file)] = True
+VERSION = 2
+
+# TextureManifest::File, by extension
+FILES = { '.jpg': 0, '.png': 1, '.tga': 2, '.qtex': 3 }
+
+# TextureManifest::SurfaceParm, the ones C++ uses
+SURFACE_PARMS = {
+  'trans': 1 << 0
+}
+
+# TextureManifest::key()
+def key(path):
+  path = path.replace('\\', '/').lower()
+  if path.startswith('./'):
+    path = path[2:]
+  if path.startswith('data/'):
+    path = path[5:]
+  return os.path.splitext(path)[0]
+
+# TextureManifest::hash(), FNV-1a
+def fnv1a(string):
+  hash = 2166136261
+  for byte in string.encode('utf8'):
+    hash ^= byte
+    hash = (hash * 16777619) & 0xffffffff
+  return hash
 
-texture_to_shader = {}
+# name => { 'files': [path relative to data/, or None, by File], 'surface_parms' }
+textures = {}
+
+def texture(name):
+  return textures.setdefault(key(name), { 'files': [None] * len(FILES), 'surface_parms': 0 })
+
+for subdir, dirs, files in os.walk('data/textures'):
+  for file in files:
+    extension = os.path.splitext(file)[1].lower()
+    if extension in FILES:
+      path = os.path.relpath(os.path.join(subdir, file), 'data').replace(os.sep, '/')
+      texture(path)['files'][FILES[extension]] = path
 
 for subdir, dirs, files in os.walk('data/scripts'):
-    for file in files:
-      f = open(os.path.join(subdir, file), 'r', encoding="utf8", errors='ignore')
-
-      current_texture = None
-      braces = 0
-      shader_source = []
-
-      for line in f:
-        line = line.strip()
-        if line.startswith('//') or len(line) == 0:
-          continue
-        if current_texture:
-          if line == '{':
-            braces += 1
-            if braces == 2:
-              shader_source.append([])
-          elif line == '}':
-            braces -= 1
-          else:
-            if braces == 1:
-              shader_source.append(line.split(' '))
-            elif braces == 2:
-              shader_source[-1].append(line.split(' '))
-            else:
-              assert False
-          if braces == 0:
-            texture_to_shader[current_texture] = shader_source
-            current_texture = None
+  for file in files:
+    f = open(os.path.join(subdir, file), 'r', encoding="utf8", errors='ignore')
+
+    shader = None
+    braces = 0
+
+    for line in f:
+      line = line.split('//')[0].strip()
+      if len(line) == 0:
+        continue
+      tokens = line.split()
+
+      if shader is None:
         if line.startswith('textures'):
-          current_texture = line
+          shader = texture(tokens[0])
+          # Scripts can define a shader twice, and the last one wins
+          shader['surface_parms'] = 0
           braces = 0
-          shader_source = []
-
-file = open('./data/textures_manifest.json', 'w')
-file.truncate(0)
-file.write(json.dumps({
-  'textures': all_textures,
-  'shaders': texture_to_shader
-}))
+        continue
+
+      if line == '{':
+        braces += 1
+      elif line == '}':
+        braces -= 1
+        if braces == 0:
+          shader = None
+      elif braces == 1:
+        if tokens[0].lower() == 'surfaceparm' and len(tokens) > 1:
+          shader['surface_parms'] |= SURFACE_PARMS.get(tokens[1].lower(), 0)
+
+# Strings, null terminated, and the offset of each
+strings = bytearray()
+string_offsets = {}
+def string_offset(string):
+  if string not in string_offsets:
+    string_offsets[string] = len(strings)
+    strings.extend(string.encode('utf8') + b'\0')
+  return string_offsets[string]
+
+entries = bytearray()
+names = sorted(textures)
+for name in names:
+  entry = textures[name]
+  entries.extend(struct.pack('<i' + 'i' * len(FILES) + 'I',
+    string_offset(name),
+    *[string_offset(path) if path else -1 for path in entry['files']],
+    entry['surface_parms']))
+if len(strings) == 0:
+  strings.extend(b'\0')
+
+# Open addressed, at most half full, so most lookups are one probe
+num_buckets = 16
+while num_buckets < len(names) * 2:
+  num_buckets *= 2
+buckets = [(0, -1)] * num_buckets
+for index, name in enumerate(names):
+  hash = fnv1a(name)
+  bucket = hash & (num_buckets - 1)
+  while buckets[bucket][1] != -1:
+    bucket = (bucket + 1) & (num_buckets - 1)
+  buckets[bucket] = (hash, index)
+
+lumps = [
+  b''.join(struct.pack('<Ii', hash, index) for hash, index in buckets),
+  bytes(entries),
+  bytes(strings)
+]
+
+HEADER = '<4siI' + 'ii' * len(lumps)
+offset = struct.calcsize(HEADER)
+direntries = []
+for lump in lumps:
+  direntries += [offset, len(lump)]
+  offset += (len(lump) + 3) & ~3
+
+file = open('./data/textures_manifest.bin', 'wb')
+file.write(struct.pack(HEADER, b'QMAN', VERSION, num_buckets, *direntries))
+for lump in lumps:
+  file.write(lump + b'\0' * (-len(lump) % 4))
 file.close()
+
+print('wrote data/textures_manifest.bin: %d textures' % len(names))
@@ -1,6 +1,6 @@
 
 enums = [
-  ('ResourceType', 'RESOURCE_', ['BSP_FILE', 'IMAGE_FILE']),
+  ('ResourceType', 'RESOURCE_', ['BSP_FILE', 'IMAGE_FILE', 'COOKED_MAP_FILE', 'ARCHIVE_FILE', 'TEXTURE_MANIFEST_FILE']),
 ]
 
 messages = [
@@ -14,10 +14,44 @@ messages = [
 
   ('OSXReady', []),
 
+  # Options from the page's URL, sent by JS once C++ is up: eg.
+  # ?imageUploads=browser (see ResourceManager::ImageUploads)
+  ('SetImageUploads', [
+    ('fromBrowser', 'bool')
+  ]),
+
+  # IMAGE_FILEs' URLs are resolved by C++ to the file to load, through the
+  # texture manifest (see texture_manifest.h), once it's loaded. Before then
+  # (or without one), JS tries the extensions textures come in itself.
+  #
+  # IMAGE_FILEs are scaled down (keeping their aspect ratio) so neither side
+  # is over `maxSize`, if it isn't 0. Textures that stream in their detail
+  # start small, and are asked for again at a larger size when it's needed.
+  # Images are decoded by C++ (see image_decoder.h), except when it asks for
+  # one it couldn't decode again with `decodeInBrowser`, by its resolved URL.
+  # If `texture` isn't 0, the browser decodes the image itself and uploads it
+  # straight into that GL texture instead, and the LoadedTexture it sends back
+  # has no pointer (see ResourceManager::ImageUploads).
+  #
+  # Files found in an archive (see archive.h) are read from it as `length`
+  # bytes from `offset`, and come back as a LoadedArchiveRange. So are
+  # ARCHIVE_FILEs' central directories, where a `length` of 0 means the end
+  # of the file (Archive::kTailLength bytes).
   ('LoadResource', [
     ('url', 'string'),
     ('resourceType', 'ResourceType'),
-    ('resourceID', 'int')
+    ('resourceID', 'int'),
+    ('maxSize', 'int'),
+    ('decodeInBrowser', 'bool'),
+    ('texture', 'int'),
+    ('archive', 'string'),
+    ('offset', 'int'),
+    ('length', 'int')
+  ]),
+
+  # Many LoadResource requests in one message, eg. every texture of a map
+  ('LoadResources', [
+    ('resources', 'vector<LoadResource>')
   ]),
 
   ('LoadShaders', [
@@ -34,24 +68,91 @@ messages = [
     ('fragLength', 'int'),
   ]),
 
+  # `fullWidth` and `fullHeight` are the image's size before it was scaled
+  # down to fit LoadResource's `maxSize`. `pointer` is null if it was uploaded
+  # into the request's `texture`.
   ('LoadedTexture', [
     ('resourceID', 'int'),
     ('pointer', 'void*'),
     ('width', 'int'),
-    ('height', 'int')
+    ('height', 'int'),
+    ('fullWidth', 'int'),
+    ('fullHeight', 'int')
+  ]),
+
+  # A whole .qtex file, loaded in place of the image for a LoadResource
+  ('LoadedCompressedTexture', [
+    ('resourceID', 'int'),
+    ('pointer', 'void*'),
+    ('length', 'int')
+  ]),
+
+  # An image file, still encoded, for C++ to decode. In the native build the
+  # pointer is null and C++ reads the file at `url` itself.
+  ('LoadedImageFile', [
+    ('resourceID', 'int'),
+    ('url', 'string'),
+    ('pointer', 'void*'),
+    ('length', 'int')
+  ]),
+
+  # Bytes read from an archive, which start `offset` bytes into it. `pointer`
+  # is null if they couldn't be read, including when the server ignored the
+  # range and answered with the whole file, or in the native build, where C++
+  # reads archives itself.
+  ('LoadedArchiveRange', [
+    ('resourceID', 'int'),
+    ('pointer', 'void*'),
+    ('offset', 'int'),
+    ('length', 'int'),
+    ('fileLength', 'int')
   ]),
 
   ('MissingTexture', [
     ('resourceID', 'int')
   ]),
 
+  # Sent as the map downloads. `pointer` is allocated for the whole file
+  # up front, and the first `loaded` bytes of it are filled in.
+  ('LoadingBSP', [
+    ('resourceID', 'int'),
+    ('pointer', 'void*'),
+    ('loaded', 'int'),
+    ('length', 'int')
+  ]),
+
   ('LoadedBSP', [
     ('resourceID', 'int'),
-    ('pointer', 'void*')
+    ('pointer', 'void*'),
+    ('length', 'int')
   ]),
 
-  ('LoadedTextureOptions', [
+  ('LoadedCookedMap', [
     ('resourceID', 'int'),
-    ('surfaceParamTrans', 'bool')
+    ('pointer', 'void*'),
+    ('length', 'int')
+  ]),
+
+  # Cooked maps are optional -- the map is cooked in memory instead
+  ('MissingCookedMap', [
+    ('resourceID', 'int')
+  ]),
+
+  # The whole file (natively, C++ maps it itself). `pointer` is null if
+  # there isn't one.
+  ('LoadedTextureManifest', [
+    ('resourceID', 'int'),
+    ('pointer', 'void*'),
+    ('length', 'int')
+  ]),
+
+  # Texture results are sent back in batches rather than one message (or
+  # two) per texture. Handled as if each had been sent on its own.
+  ('LoadedTextures', [
+    ('loaded', 'vector<LoadedTexture>'),
+    ('compressed', 'vector<LoadedCompressedTexture>'),
+    ('files', 'vector<LoadedImageFile>'),
+    ('missing', 'vector<MissingTexture>'),
+    ('ranges', 'vector<LoadedArchiveRange>')
   ])
 ]
\ No newline at end of file
@@ -0,0 +1,48 @@
+import http.server, io, os, re, sys
+
+# `npm run serve`: python3 -m http.server, plus the headers that make the page
+# cross-origin isolated, which the web build's threads (SharedArrayBuffer)
+# need, and single Range requests, which archives are read with (see
+# src/cpp/archive.h). See the README.
+
+class Handler(http.server.SimpleHTTPRequestHandler):
+  def end_headers(self):
+    self.send_header('Cross-Origin-Opener-Policy', 'same-origin')
+    self.send_header('Cross-Origin-Embedder-Policy', 'require-corp')
+    self.send_header('Accept-Ranges', 'bytes')
+    super().end_headers()
+
+  def send_head(self):
+    # eg. "bytes=100-199", or "bytes=-100" for the last 100
+    match = re.fullmatch(r'bytes=(\d*)-(\d*)', self.headers.get('Range', ''))
+    path = self.translate_path(self.path)
+    if not match or match.groups() == ('', '') or not os.path.isfile(path):
+      return super().send_head()
+
+    with open(path, 'rb') as f:
+      length = os.fstat(f.fileno()).st_size
+      first, last = match.groups()
+      if first:
+        start = int(first)
+        end = min(int(last), length - 1) if last else length - 1
+      else:
+        start = max(0, length - int(last))
+        end = length - 1
+      if start > end:
+        self.send_response(416)
+        self.send_header('Content-Range', f'bytes */{length}')
+        self.send_header('Content-Length', '0')
+        self.end_headers()
+        return None
+      f.seek(start)
+      data = f.read(end - start + 1)
+
+    self.send_response(206)
+    self.send_header('Content-Type', self.guess_type(path))
+    self.send_header('Content-Range', f'bytes {start}-{end}/{length}')
+    self.send_header('Content-Length', str(len(data)))
+    self.end_headers()
+    return io.BytesIO(data)
+
+port = int(sys.argv[1]) if len(sys.argv) > 1 else 8000
+http.server.ThreadingHTTPServer(('', port), Handler).serve_forever()
@@ -0,0 +1,223 @@
+// Offline map cooker: turns a .bsp into the render-ready format described in
+// src/cpp/cooked_map.h, compresses maps for transfer (see
+// src/cpp/compressed_file.h), and transcodes textures into GPU compressed
+// formats (see src/cpp/texture_compression.h).
+//
+//   ./output/cook data/aerowalk.bsp data/aerowalk.cooked
+//   ./output/cook --compress data/aerowalk.bsp data/aerowalk.bsp.qz
+//   ./output/cook --benchmark data/*.bsp data/*.cooked
+//   ./output/cook --texture data/textures/base_wall/metal.tga data/textures/base_wall/metal.qtex
+
+#include "support.h"
+#include "bsp.h"
+#include "cooked_map.h"
+#include "compressed_file.h"
+#include "image_decoder.h"
+#include "texture_compression.h"
+
+#include <chrono>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <iterator>
+
+static optional<vector<char>> readFile(const string& path) {
+  std::ifstream input(path, std::ios::binary);
+  if (!input) {
+    cerr << "couldn't open " << path << "\n";
+    return {};
+  }
+  return vector<char>((std::istreambuf_iterator<char>(input)), std::istreambuf_iterator<char>());
+}
+
+// Writes next to the destination and renames, so a half-written file is never
+// picked up
+static bool writeFile(const string& path, const vector<char>& bytes) {
+  const string temporaryPath = path + ".tmp";
+  {
+    std::ofstream output(temporaryPath, std::ios::binary | std::ios::trunc);
+    output.write(bytes.data(), bytes.size());
+    if (!output) {
+      cerr << "couldn't write " << temporaryPath << "\n";
+      return false;
+    }
+  }
+  if (rename(temporaryPath.c_str(), path.c_str()) != 0) {
+    cerr << "couldn't rename " << temporaryPath << " to " << path << "\n";
+    return false;
+  }
+  return true;
+}
+
+// Lump boundaries for BSP and cooked maps, so no compressed chunk spans two
+// lumps. Anything else is just cut into equal chunks.
+static vector<int> lumpBoundaries(const vector<char>& bytes) {
+  const BSP::direntry_t* entries = nullptr;
+  int numEntries = 0;
+
+  const auto* map = (const BSPMap*) bytes.data();
+  const auto* cookedMap = (const CookedMap*) bytes.data();
+  if (bytes.size() >= sizeof(BSPMap) && map->isValid(bytes.size())) {
+    entries = map->direntries;
+    numEntries = BSP::kNumLumps;
+  } else if (bytes.size() >= sizeof(CookedMap) && cookedMap->isValid(bytes.size())) {
+    entries = cookedMap->direntries;
+    numEntries = sizeof(cookedMap->direntries) / sizeof(cookedMap->direntries[0]);
+  }
+
+  vector<int> boundaries;
+  for (int i = 0; i < numEntries; i ++) {
+    boundaries.push_back(entries[i].offset);
+    boundaries.push_back(entries[i].offset + entries[i].length);
+  }
+  return boundaries;
+}
+
+static int cook(const string& inputPath, const string& outputPath) {
+  const auto bytes = readFile(inputPath);
+  if (!bytes) {
+    return EXIT_FAILURE;
+  }
+
+  const auto* map = (const BSPMap*) bytes->data();
+  if (bytes->size() < sizeof(BSPMap) || !map->isValid(bytes->size())) {
+    cerr << inputPath << " isn't a valid BSP file\n";
+    return EXIT_FAILURE;
+  }
+
+  const vector<char> cooked = Cooked::cook(map);
+  if (!writeFile(outputPath, cooked)) {
+    return EXIT_FAILURE;
+  }
+
+  cout << "wrote " << cooked.size() << " bytes to " << outputPath << " (from " << bytes->size() << ")\n";
+  return EXIT_SUCCESS;
+}
+
+static int compress(const string& inputPath, const string& outputPath) {
+  const auto bytes = readFile(inputPath);
+  if (!bytes) {
+    return EXIT_FAILURE;
+  }
+
+  const vector<char> compressed = CompressedFile::compress(bytes->data(), bytes->size(), lumpBoundaries(*bytes));
+  if (!writeFile(outputPath, compressed)) {
+    return EXIT_FAILURE;
+  }
+
+  cout << "wrote " << compressed.size() << " bytes to " << outputPath << " (from " << bytes->size() << ")\n";
+  return EXIT_SUCCESS;
+}
+
+static int compressTexture(const string& inputPath, const string& outputPath) {
+  const auto bytes = readFile(inputPath);
+  if (!bytes) {
+    return EXIT_FAILURE;
+  }
+
+  // The same decoder the game uses (JPEG, PNG & TGA). Anything else is
+  // converted to TGA first, see transcode_textures.py.
+  const optional<ImageDecoder::Image> image = ImageDecoder::decode(bytes->data(), bytes->size());
+  if (!image) {
+    cerr << inputPath << " isn't an image we can read\n";
+    return EXIT_FAILURE;
+  }
+  const int width = image->width;
+  const int height = image->height;
+  const vector<char> compressed = TextureCompression::compress((const unsigned char*) image->pixels, width, height);
+  free(image->pixels);
+  if (!writeFile(outputPath, compressed)) {
+    return EXIT_FAILURE;
+  }
+
+  const auto* header = (const TextureCompression::header_t*) compressed.data();
+  cout << "wrote " << compressed.size() << " bytes to " << outputPath << " (" << width << "x" << height
+    << (header->format == TextureCompression::BC1 ? " BC1" : " BC3") << ", " << header->numLevels << " levels, from "
+    << (size_t) width * height * 4 << " bytes of RGBA)\n";
+  return EXIT_SUCCESS;
+}
+
+static double secondsSince(std::chrono::steady_clock::time_point start) {
+  return std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+}
+
+// Whether decompressing on the client pays for itself: compares the download
+// time saved at a few connection speeds with the time spent decoding.
+static int benchmark(const vector<string>& paths) {
+  const int kRuns = 10;
+  const double kBandwidths[] = { 5, 20, 100 }; // Mbit/s
+
+  for (const string& path : paths) {
+    const auto bytes = readFile(path);
+    if (!bytes) {
+      return EXIT_FAILURE;
+    }
+    const vector<int> boundaries = lumpBoundaries(*bytes);
+
+    auto start = std::chrono::steady_clock::now();
+    vector<char> compressed;
+    for (int run = 0; run < kRuns; run ++) {
+      compressed = CompressedFile::compress(bytes->data(), bytes->size(), boundaries);
+    }
+    const double compressSeconds = secondsSince(start) / kRuns;
+
+    CompressedFile::Decoder header;
+    if (!header.readHeader(compressed.data(), compressed.size())) {
+      cerr << "couldn't read back " << path << "\n";
+      return EXIT_FAILURE;
+    }
+    vector<char> decompressed(header.length());
+
+    start = std::chrono::steady_clock::now();
+    for (int run = 0; run < kRuns; run ++) {
+      CompressedFile::Decoder decoder;
+      if (decoder.decode(compressed.data(), compressed.size(), decompressed.data()) != (int) bytes->size()) {
+        cerr << "couldn't decompress " << path << "\n";
+        return EXIT_FAILURE;
+      }
+    }
+    const double decodeSeconds = secondsSince(start) / kRuns;
+
+    if (memcmp(decompressed.data(), bytes->data(), bytes->size()) != 0) {
+      cerr << path << " didn't survive a round trip\n";
+      return EXIT_FAILURE;
+    }
+
+    const double megabytes = bytes->size() / 1e6;
+    cout << path << ": " << bytes->size() << " -> " << compressed.size() << " bytes ("
+      << (100.0 * compressed.size() / std::max((size_t) 1, bytes->size())) << "%), "
+      << "compress " << megabytes / compressSeconds << " MB/s, "
+      << "decode " << megabytes / decodeSeconds << " MB/s (" << decodeSeconds * 1000 << " ms)\n";
+
+    for (double bandwidth : kBandwidths) {
+      const double bytesPerSecond = bandwidth * 1e6 / 8;
+      const double saved = (bytes->size() - compressed.size()) / bytesPerSecond;
+      cout << "  at " << bandwidth << " Mbit/s: " << saved * 1000 << " ms less transfer, "
+        << (saved - decodeSeconds) * 1000 << " ms net\n";
+    }
+  }
+
+  return EXIT_SUCCESS;
+}
+
+int main(int argc, const char* argv[]) {
+  const string mode = argc > 1 ? argv[1] : "";
+  if (mode == "--compress" && argc == 4) {
+    return compress(argv[2], argv[3]);
+  }
+  if (mode == "--texture" && argc == 4) {
+    return compressTexture(argv[2], argv[3]);
+  }
+  if (mode == "--benchmark" && argc > 2) {
+    return benchmark(vector<string>(argv + 2, argv + argc));
+  }
+  if (argc == 3 && mode.rfind("--", 0) != 0) {
+    return cook(argv[1], argv[2]);
+  }
+
+  cerr << "usage: " << argv[0] << " <map.bsp> <map.cooked>\n"
+    << "       " << argv[0] << " --compress <file> <file.qz>\n"
+    << "       " << argv[0] << " --benchmark <files...>\n"
+    << "       " << argv[0] << " --texture <image (.tga, .jpg or .png)> <image.qtex>\n";
+  return EXIT_FAILURE;
+}
@@ -3,6 +3,7 @@
 #include "support.h"
 #include "binding_helpers.h"
 #include "bindings.h"
+#include "gl_helpers.h"
 #include "resources.h"
 #include "resource_manager.h"
 #include "scenario.h"
@@ -10,6 +11,8 @@
 #include "scenario_physics.h"
 
 App::App() {
+  GLDebug::install();
+
   _messageLogger = make_shared<MessageLogger>();
   MessagesFromWeb::getInstance()->registerHandler(_messageLogger);
 
@@ -17,6 +20,38 @@ App::App() {
   // _currentScenario = make_shared<PopTartScenario>();
   // _currentScenario = make_shared<BSPScenario>();
   _currentScenario = make_shared<PhysicsScenario>();
+
+  // preloadScenario([]() { return make_shared<BSPScenario>("q3dm17"); });
+}
+
+void App::preloadScenario(std::function<shared_ptr<IScenario>()> makeScenario) {
+  ResourceManager::getInstance()->preload([this, makeScenario]() {
+    _nextScenario = makeScenario();
+  });
+}
+
+bool App::swapToPreloaded() {
+  if (!_nextScenario) {
+    return false;
+  }
+  switch (ResourceManager::getInstance()->preloadState()) {
+    case LoadingState::DONE:
+      break;
+    case LoadingState::FAILED:
+      cerr << "next scenario failed to load, staying on this one\n";
+      _nextScenario = nullptr;
+      return false;
+    default:
+      return false;
+  }
+
+  // What it asked for moves up to where it was asked for, for what's still
+  // streaming in
+  ResourceManager::getInstance()->promotePreloaded();
+  _retiredScenario = _currentScenario;
+  _currentScenario = _nextScenario;
+  _nextScenario = nullptr;
+  return true;
 }
 
 void App::loop(GLFWwindow* window) {
@@ -26,21 +61,42 @@ void App::loop(GLFWwindow* window) {
     return;
   }
 
+  // Starts drawing once the scenario has what it needs, while the rest (eg.
+  // the map's textures) streams in. Keeps thinking after that, as textures
+  // go on streaming their detail in and out.
   static bool ready = false;
+  static bool playable = false;
+  _retiredScenario = nullptr; // Its resources are released (or cached) now
+  LoadingState loadingState = ResourceManager::getInstance()->think();
   if (!ready) {
-    LoadingState loadingState = ResourceManager::getInstance()->think();
     switch (loadingState) {
       case LoadingState::FAILED:
         error = true;
         return;
       case LoadingState::DONE:
         ready = true;
-        return;
+        playable = true;
+        break;
+      case LoadingState::STREAMING:
+        playable = true;
+        break;
       default:
-        return;
+        break;
+    }
+    if (!playable) {
+      return;
     }
   }
 
+  // N moves on to the preloaded scenario, once it's ready
+  static bool swapWanted = false;
+  if (glfwGetKey(window, GLFW_KEY_N) == GLFW_PRESS && _nextScenario) {
+    swapWanted = true;
+  }
+  if (swapWanted && (swapToPreloaded() || !_nextScenario)) {
+    swapWanted = false;
+  }
+
   glm::vec2 dir = {0, 0};
   if (glfwGetKey(window, GLFW_KEY_W) == GLFW_PRESS) { dir += glm::vec2(0.0, 1.0); }
   if (glfwGetKey(window, GLFW_KEY_A) == GLFW_PRESS) { dir += glm::vec2(1.0, 0.0); }
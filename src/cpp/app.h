@@ -11,9 +11,21 @@ struct App {
 
   void loop(GLFWwindow* window);
 
+  // Starts loading the next scenario (eg. the next map) in the background
+  // while this one's played. What the two have in common (eg. textures) is
+  // only loaded once.
+  void preloadScenario(std::function<shared_ptr<IScenario>()> makeScenario);
+  // Switches over to it, if it's finished loading. False while it hasn't, or
+  // if there isn't one (including if it failed to load, which drops it).
+  bool swapToPreloaded();
+
 private:
   shared_ptr<MessageLogger> _messageLogger;
   shared_ptr<IScenario> _currentScenario;
+  shared_ptr<IScenario> _nextScenario; // Preloading
+  // The one that was swapped out, torn down a frame later so the swap
+  // itself is quick
+  shared_ptr<IScenario> _retiredScenario;
 };
 
 #endif
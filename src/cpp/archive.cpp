@@ -0,0 +1,206 @@
+#include "archive.h"
+
+#include "inflate.h"
+
+#include <algorithm>
+#include <array>
+#include <cstring>
+
+using namespace Archive;
+
+namespace {
+  const uint32_t kEndOfDirectorySignature = 0x06054b50;
+  const uint32_t kDirectoryEntrySignature = 0x02014b50;
+  const uint32_t kLocalHeaderSignature = 0x04034b50;
+  const int kEndOfDirectoryLength = 22;
+  const int kDirectoryEntryLength = 46;
+  const int kLocalHeaderLength = 30;
+
+  // Zips are little endian, and may not be aligned
+  uint16_t read16(const char* p) {
+    const unsigned char* bytes = (const unsigned char*) p;
+    return bytes[0] | (bytes[1] << 8);
+  }
+
+  uint32_t read32(const char* p) {
+    const unsigned char* bytes = (const unsigned char*) p;
+    return bytes[0] | (bytes[1] << 8) | (bytes[2] << 16) | ((uint32_t) bytes[3] << 24);
+  }
+
+  uint32_t crc32(const char* data, size_t length) {
+    static const std::array<uint32_t, 256> table = []() {
+      std::array<uint32_t, 256> table;
+      for (uint32_t i = 0; i < 256; i ++) {
+        uint32_t crc = i;
+        for (int bit = 0; bit < 8; bit ++) {
+          crc = (crc >> 1) ^ (0xedb88320 & (0 - (crc & 1)));
+        }
+        table[i] = crc;
+      }
+      return table;
+    }();
+
+    uint32_t crc = 0xffffffff;
+    const unsigned char* bytes = (const unsigned char*) data;
+    for (size_t i = 0; i < length; i ++) {
+      crc = table[(crc ^ bytes[i]) & 0xff] ^ (crc >> 8);
+    }
+    return crc ^ 0xffffffff;
+  }
+}
+
+string Archive::normalizePath(const string& path) {
+  string result = path;
+  for (char& c : result) {
+    c = c == '\\' ? '/' : (char) tolower((unsigned char) c);
+  }
+  return result;
+}
+
+bool Directory::read(const char* bytes, size_t offset, size_t length, size_t fileLength) {
+  if (_failed) {
+    return false;
+  }
+
+  // Searched for backwards, since the comment could contain the signature
+  const char* end = nullptr;
+  if (offset + length == fileLength) {
+    for (size_t i = length >= kEndOfDirectoryLength ? length - kEndOfDirectoryLength + 1 : 0; i -- > 0;) {
+      if (read32(bytes + i) == kEndOfDirectorySignature && i + kEndOfDirectoryLength + read16(bytes + i + 20) == length) {
+        end = bytes + i;
+        break;
+      }
+    }
+  }
+  if (!end) {
+    cerr << "archive has no end of central directory record\n";
+    _failed = true;
+    return false;
+  }
+
+  const size_t numEntries = read16(end + 10);
+  const size_t directoryLength = read32(end + 12);
+  const size_t directoryOffset = read32(end + 16);
+  if (numEntries == 0xffff || directoryOffset == 0xffffffff || read16(end + 4) != 0 || read16(end + 6) != 0) {
+    cerr << "archive is ZIP64 or split, which we don't handle\n";
+    _failed = true;
+    return false;
+  }
+  if (directoryOffset + directoryLength > offset + (end - bytes)) {
+    cerr << "archive's central directory is out of bounds\n";
+    _failed = true;
+    return false;
+  }
+  if (directoryOffset < offset) {
+    // Along with the end record again, since that's how we find it
+    _needed = { directoryOffset, fileLength - directoryOffset };
+    return false;
+  }
+
+  const char* directory = bytes + (directoryOffset - offset);
+  const char* directoryEnd = directory + directoryLength;
+  vector<pair<string, Entry>> entries;
+  entries.reserve(numEntries);
+  for (const char* p = directory; p < directoryEnd;) {
+    if (p + kDirectoryEntryLength > directoryEnd || read32(p) != kDirectoryEntrySignature) {
+      cerr << "archive's central directory is corrupt\n";
+      _failed = true;
+      return false;
+    }
+    const uint16_t flags = read16(p + 8);
+    const size_t nameLength = read16(p + 28);
+    const size_t extraLength = read16(p + 30);
+    const size_t commentLength = read16(p + 32);
+    const char* name = p + kDirectoryEntryLength;
+    const char* next = name + nameLength + extraLength + commentLength;
+    if (next > directoryEnd) {
+      cerr << "archive's central directory is corrupt\n";
+      _failed = true;
+      return false;
+    }
+
+    Entry entry;
+    entry.method = read16(p + 10);
+    entry.crc = read32(p + 16);
+    entry.compressedLength = read32(p + 20);
+    entry.length = read32(p + 24);
+    entry.offset = read32(p + 42);
+    entry.end = directoryOffset;
+    p = next;
+
+    const bool isDirectory = nameLength && name[nameLength - 1] == '/';
+    if (isDirectory || (flags & 1) || (entry.method != 0 && entry.method != 8) || entry.offset >= directoryOffset) {
+      continue; // Encrypted, or something we can't extract
+    }
+    entries.push_back({ normalizePath(string(name, nameLength)), entry });
+  }
+
+  // Each entry runs up to the next one, which bounds a read of it without
+  // knowing how long its local header is
+  vector<uint32_t> offsets;
+  offsets.reserve(entries.size());
+  for (const auto& entry : entries) {
+    offsets.push_back(entry.second.offset);
+  }
+  std::sort(offsets.begin(), offsets.end());
+  _entries.reserve(entries.size());
+  for (auto& entry : entries) {
+    const auto next = std::upper_bound(offsets.begin(), offsets.end(), entry.second.offset);
+    if (next != offsets.end()) {
+      entry.second.end = *next;
+    }
+    // A zip can have the same path twice, in which case the last one wins
+    _entries[entry.first] = entry.second;
+  }
+
+  cout << "read archive directory of " << _entries.size() << " entries\n";
+  return true;
+}
+
+const Entry* Directory::find(const string& path) const {
+  const auto it = _entries.find(normalizePath(path));
+  return it == _entries.end() ? nullptr : &it->second;
+}
+
+size_t Directory::bytes() const {
+  size_t bytes = 0;
+  for (const auto& entry : _entries) {
+    bytes += sizeof(entry) + entry.first.size();
+  }
+  return bytes;
+}
+
+optional<pair<char*, size_t>> Archive::extract(const Entry& entry, const char* bytes, size_t offset, size_t length) {
+  if (entry.offset < offset || entry.end > offset + length) {
+    return {};
+  }
+  const char* header = bytes + (entry.offset - offset);
+  const size_t available = entry.end - entry.offset;
+  if (available < kLocalHeaderLength || read32(header) != kLocalHeaderSignature) {
+    return {};
+  }
+  // The local header's extra field can differ from the central directory's
+  const size_t dataOffset = kLocalHeaderLength + read16(header + 26) + read16(header + 28);
+  if (dataOffset > available || entry.compressedLength > available - dataOffset || entry.length > INT32_MAX) {
+    return {};
+  }
+  const char* data = header + dataOffset;
+
+  char* contents = (char*) malloc(std::max(entry.length, 1u));
+  if (entry.method == 0) {
+    if (entry.compressedLength != entry.length) {
+      free(contents);
+      return {};
+    }
+    memcpy(contents, data, entry.length);
+  } else if (Inflate::inflate(data, entry.compressedLength, contents, entry.length) != (int) entry.length) {
+    free(contents);
+    return {};
+  }
+
+  if (crc32(contents, entry.length) != entry.crc) {
+    free(contents);
+    return {};
+  }
+  return make_pair(contents, (size_t) entry.length);
+}
@@ -0,0 +1,69 @@
+#ifndef ARCHIVE_H
+#define ARCHIVE_H
+
+#include "support.h"
+
+// Zip archives, as Quake 3 ships its assets in (.pk3). Only the central
+// directory is read up front -- from the end of the file, parsed once into a
+// hash of paths -- and each entry on its own after that, as a ranged read of
+// just its bytes: a Range request on the web, a slice of the mapped file
+// natively (see ResourceManager). So thousands of small files come from one,
+// and finding one is a single lookup.
+//
+// Entries are stored or deflated (see Inflate). Not ZIP64, or encrypted.
+namespace Archive {
+  // The end of central directory record is in the last this many bytes (it's
+  // 22 bytes, then a comment of up to 64k).
+  const int kTailLength = 22 + 0xffff;
+
+  struct Range {
+    size_t offset;
+    size_t length;
+  };
+
+  struct Entry {
+    uint32_t offset; // Of its local header
+    uint32_t end; // Where the next entry (or the central directory) starts
+    uint32_t compressedLength;
+    uint32_t length;
+    uint32_t crc;
+    uint16_t method; // 0 (stored) or 8 (deflated)
+
+    // What to read to extract() it: its local header, data, and anything
+    // after that up to the next entry
+    Range range() const { return { offset, end - offset }; }
+  };
+
+  // Lower case, with forward slashes: Quake's paths aren't case sensitive.
+  string normalizePath(const string& path);
+
+  struct Directory {
+    // Parses the central directory out of `bytes`, which are `length` bytes
+    // from `offset` into an archive `fileLength` long -- to start with, the
+    // last kTailLength bytes (or all of them). False until it has, with
+    // needed() set to the range to read and pass in next, or if it isn't a
+    // zip file we can read (see failed()).
+    bool read(const char* bytes, size_t offset, size_t length, size_t fileLength);
+    bool failed() const { return _failed; }
+    Range needed() const { return _needed; }
+
+    // `path` is normalized first. Null if there's no such file.
+    const Entry* find(const string& path) const;
+
+    size_t numEntries() const { return _entries.size(); }
+    size_t bytes() const; // Roughly, in memory
+
+  private:
+    unordered_map<string, Entry> _entries;
+    Range _needed = { 0, 0 };
+    bool _failed = false;
+  };
+
+  // The entry's contents, from `bytes`, which are `length` bytes from
+  // `offset` into the archive and cover its range(). Returns a malloc'd
+  // buffer, or nothing if it's corrupt (including a bad CRC). Safe to call
+  // from any thread.
+  optional<pair<char*, size_t>> extract(const Entry& entry, const char* bytes, size_t offset, size_t length);
+}
+
+#endif
@@ -0,0 +1,116 @@
+#include "area_portals.h"
+
+#include "bsp.h"
+
+#include <algorithm>
+
+AreaPortals::AreaPortals(const BSPMap* map): _map(map) {
+  const BSP::leaf_t* leaves = map->leaves();
+  for (int i = 0; i < map->numLeaves(); i ++) {
+    _numAreas = std::max(_numAreas, leaves[i].area + 1);
+  }
+
+  const BSP::model_t* models = map->models();
+  const auto entities = map->parseEntities();
+
+  for (int entityIndex = 0; entityIndex < (int) entities.size(); entityIndex ++) {
+    const auto& entity = entities[entityIndex];
+    const auto classname = entity.find("classname");
+    const auto model = entity.find("model");
+    if (classname == entity.end() || classname->second != "func_door") {
+      continue;
+    }
+    if (model == entity.end() || model->second.size() < 2 || model->second[0] != '*') {
+      continue;
+    }
+
+    const int modelIndex = atoi(model->second.c_str() + 1);
+    if (modelIndex <= 0 || modelIndex >= map->numModels()) {
+      continue;
+    }
+
+    // Same as Quake 3: the door is a portal if its model touches (at least) two areas
+    const BSP::model_t* doorModel = models + modelIndex;
+    vector<int> areas;
+    for (int leafIndex : map->findLeaves(
+        glm::vec3(doorModel->mins[0], doorModel->mins[1], doorModel->mins[2]),
+        glm::vec3(doorModel->maxs[0], doorModel->maxs[1], doorModel->maxs[2]))) {
+      const int area = leaves[leafIndex].area;
+      if (area >= 0 && std::find(areas.begin(), areas.end(), area) == areas.end()) {
+        areas.push_back(area);
+      }
+    }
+
+    if (areas.size() >= 2) {
+      _portals.push_back({ entityIndex, { areas[0], areas[1] }, true });
+    }
+  }
+
+  cout << "found " << _numAreas << " areas and " << _portals.size() << " area portals\n";
+
+  floodAreas();
+}
+
+void AreaPortals::setPortalOpen(int portalIndex, bool open) {
+  AreaPortal& portal = _portals.at(portalIndex);
+  if (portal.open == open) {
+    return;
+  }
+
+  portal.open = open;
+  floodAreas();
+}
+
+void AreaPortals::floodAreas() {
+  _floodNumbers.assign(_numAreas, -1);
+
+  int floodNumber = 0;
+  for (int startArea = 0; startArea < _numAreas; startArea ++) {
+    if (_floodNumbers[startArea] >= 0) {
+      continue;
+    }
+
+    vector<int> stack = { startArea };
+    _floodNumbers[startArea] = floodNumber;
+    while (!stack.empty()) {
+      const int area = stack.back();
+      stack.pop_back();
+
+      for (const AreaPortal& portal : _portals) {
+        if (!portal.open) {
+          continue;
+        }
+        for (int side = 0; side < 2; side ++) {
+          const int other = portal.areas[1 - side];
+          if (portal.areas[side] == area && _floodNumbers[other] < 0) {
+            _floodNumbers[other] = floodNumber;
+            stack.push_back(other);
+          }
+        }
+      }
+    }
+
+    floodNumber ++;
+  }
+
+  _version ++;
+}
+
+int AreaPortals::areaAt(const glm::vec3& position) const {
+  return _map->leaves()[_map->findLeaf(position)].area;
+}
+
+bool AreaPortals::areasConnected(int area0, int area1) const {
+  if (area0 < 0 || area1 < 0 || area0 >= _numAreas || area1 >= _numAreas) {
+    return true;
+  }
+  return _floodNumbers[area0] == _floodNumbers[area1];
+}
+
+bool AreaPortals::isPotentiallyVisible(const glm::vec3& from, const glm::vec3& to) const {
+  const BSP::leaf_t* fromLeaf = _map->leaves() + _map->findLeaf(from);
+  const BSP::leaf_t* toLeaf = _map->leaves() + _map->findLeaf(to);
+
+  return _map->isClusterVisible(fromLeaf->cluster, toLeaf->cluster)
+    && areasConnected(fromLeaf->area, toLeaf->area);
+}
@@ -0,0 +1,59 @@
+#ifndef AREA_PORTALS_H
+#define AREA_PORTALS_H
+
+#include "support.h"
+
+namespace BSP {
+  struct header_t;
+}
+using BSPMap = BSP::header_t;
+
+struct AreaPortal {
+  int entity; // Index into BSP::header_t::parseEntities()
+  int areas[2];
+  bool open;
+};
+
+// Tracks which areas of the map are connected, given which doors are open.
+//
+// q3map splits the map into areas along areaportal brushes, which are placed
+// inside doors. A door whose model touches two areas is the portal between
+// them. Areas that can't be reached from the camera can be skipped entirely,
+// regardless of what the PVS says -- and the same goes for simulation and
+// networking.
+struct AreaPortals {
+  AreaPortals(const BSPMap* map);
+
+  int numAreas() const { return _numAreas; }
+  const vector<AreaPortal>& portals() const { return _portals; }
+
+  // Opens or closes the portal for a door. Portals start out open, since
+  // nothing drives the doors yet.
+  void setPortalOpen(int portalIndex, bool open);
+
+  // The version changes whenever any portal opens or closes.
+  int version() const { return _version; }
+
+  int areaAt(const glm::vec3& position) const;
+
+  // Areas with a negative index (eg. inside walls) are treated as connected to
+  // everything.
+  bool areasConnected(int area0, int area1) const;
+
+  // For gameplay / networking: could something at `to` be seen from `from`?
+  // This is the PVS test plus the area test.
+  bool isPotentiallyVisible(const glm::vec3& from, const glm::vec3& to) const;
+
+private:
+  void floodAreas();
+
+  const BSPMap* _map;
+  int _numAreas = 0;
+  vector<AreaPortal> _portals;
+
+  // Connected areas share a flood number. Only recomputed when a portal changes.
+  vector<int> _floodNumbers;
+  int _version = 0;
+};
+
+#endif
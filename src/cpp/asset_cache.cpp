@@ -0,0 +1,439 @@
+#include "asset_cache.h"
+
+#include "hash.h"
+
+#include <string.h>
+
+#include <algorithm>
+#include <sstream>
+
+#ifdef __APPLE__
+#include <chrono>
+#include <filesystem>
+#include <fstream>
+#include <mutex>
+#include <thread>
+
+namespace fs = std::filesystem;
+#endif
+
+static const uint32_t kAssetCacheMagic = 0x43414351; // "QCAC"
+
+// Written before every entry's contents, and checked by validate()
+struct AssetCacheHeader {
+  uint32_t magic;
+  uint32_t version;
+  uint64_t length; // Of the contents, after the header
+  uint64_t hash;
+};
+
+static bool enabled = true;
+static size_t budget = 512 * 1024 * 1024;
+
+void AssetCache::setEnabled(bool value) {
+  enabled = value;
+}
+
+string AssetCache::key(const string& kind, uint64_t sourceHash, int variant) {
+  std::stringstream stream;
+  stream << kind << "-" << kVersion << "-" << std::hex << sourceHash;
+  if (variant) {
+    stream << "-" << std::dec << variant;
+  }
+  return stream.str();
+}
+
+bool AssetCache::unpack(const string& key, void* entry, size_t& length) {
+  AssetCacheHeader header;
+  if (length < sizeof(header)) {
+    warn << "ignoring truncated asset cache entry " << key << "\n";
+    free(entry);
+    return false;
+  }
+  memcpy(&header, entry, sizeof(header));
+  const char* contents = (const char*) entry + sizeof(header);
+  if (header.magic != kAssetCacheMagic
+      || header.version != AssetCache::kVersion
+      || header.length != length - sizeof(header)
+      || header.hash != Hash::xxh64(contents, header.length)) {
+    warn << "ignoring corrupt asset cache entry " << key << "\n";
+    free(entry);
+    return false;
+  }
+  memmove(entry, contents, header.length);
+  length = header.length;
+  return true;
+}
+
+void* AssetCache::pack(std::initializer_list<Part> parts, size_t& length) {
+  AssetCacheHeader header = { kAssetCacheMagic, AssetCache::kVersion, 0, 0 };
+  for (const Part& part : parts) {
+    header.length += part.length;
+  }
+  char* entry = (char*) malloc(sizeof(header) + header.length);
+  if (entry == nullptr) {
+    return nullptr;
+  }
+  char* contents = entry + sizeof(header);
+  size_t offset = 0;
+  for (const Part& part : parts) {
+    memcpy(contents + offset, part.data, part.length);
+    offset += part.length;
+  }
+  header.hash = Hash::xxh64(contents, header.length);
+  memcpy(entry, &header, sizeof(header));
+  length = sizeof(header) + header.length;
+  return entry;
+}
+
+// Every entry's (packed) length and when it was last used, so the least
+// recently used can be dropped once they add up to more than the budget
+struct IndexEntry {
+  size_t length;
+  int64_t lastUsed;
+};
+static unordered_map<string, IndexEntry> indexEntries;
+static size_t indexedBytes = 0;
+
+static void indexEntry(const string& key, size_t length, int64_t lastUsed) {
+  const auto it = indexEntries.find(key);
+  if (it != indexEntries.end()) {
+    indexedBytes -= it->second.length;
+  }
+  indexEntries[key] = { length, lastUsed };
+  indexedBytes += length;
+}
+
+// Takes the least recently used entries out of the index, until what's left
+// is comfortably under the budget, and returns their keys
+static vector<string> overBudget() {
+  if (indexedBytes <= budget) {
+    return {};
+  }
+
+  vector<pair<int64_t, string>> byAge;
+  for (const auto& entry : indexEntries) {
+    byAge.push_back({ entry.second.lastUsed, entry.first });
+  }
+  std::sort(byAge.begin(), byAge.end());
+
+  vector<string> dropped;
+  for (const auto& entry : byAge) {
+    if (indexedBytes <= budget / 4 * 3) {
+      break;
+    }
+    indexedBytes -= indexEntries[entry.second].length;
+    indexEntries.erase(entry.second);
+    dropped.push_back(entry.second);
+  }
+  return dropped;
+}
+
+#ifdef __APPLE__
+
+// Made once, by whichever thread gets here first (a function-local static's
+// initialization is thread safe)
+static const fs::path& cacheDirectory() {
+  static const fs::path directory = []() {
+    fs::path directory;
+    if (const char* overridePath = getenv("Q_ASSET_CACHE_DIR")) {
+      directory = fs::path(overridePath);
+    } else if (const char* home = getenv("HOME")) {
+      directory = fs::path(home) / "Library" / "Caches" / "q" / "assets";
+    } else {
+      directory = fs::path("cache") / "assets";
+    }
+
+    std::error_code error;
+    fs::create_directories(directory, error);
+    if (error) {
+      cerr << "failed to create asset cache directory " << directory << ": " << error.message() << "\n";
+    }
+    return directory;
+  }();
+  return directory;
+}
+
+static std::mutex indexMutex; // Entries come & go on any thread
+
+static int64_t lastUsedTime(fs::file_time_type time) {
+  return std::chrono::duration_cast<std::chrono::milliseconds>(time.time_since_epoch()).count();
+}
+
+// Natively, the index is the files' sizes and modification times, which
+// loads bump. Call with indexMutex held.
+static void loadIndex() {
+  static bool loaded = false;
+  if (loaded) {
+    return;
+  }
+  loaded = true;
+
+  std::error_code error;
+  for (const fs::directory_entry& file : fs::directory_iterator(cacheDirectory(), error)) {
+    if (file.path().extension() != ".bin") {
+      continue;
+    }
+    std::error_code statError;
+    const size_t length = file.file_size(statError);
+    const fs::file_time_type time = file.last_write_time(statError);
+    if (!statError) {
+      indexEntry(file.path().stem().string(), length, lastUsedTime(time));
+    }
+  }
+}
+
+// Calls `then` there and then: call it off the main thread
+void AssetCache::load(const string& key, std::function<void(void* entry, size_t length)> then) {
+  if (!enabled) {
+    then(nullptr, 0);
+    return;
+  }
+
+  const fs::path path = cacheDirectory() / (key + ".bin");
+  std::ifstream file(path, std::ios::binary | std::ios::ate);
+  if (!file) {
+    then(nullptr, 0);
+    return;
+  }
+  size_t length = file.tellg();
+  file.seekg(0);
+  void* entry = malloc(length);
+  if (entry == nullptr || !file.read((char*) entry, length)) {
+    warn << "failed to read asset cache entry " << key << "\n";
+    free(entry);
+    then(nullptr, 0);
+    return;
+  }
+
+  {
+    std::lock_guard<std::mutex> lock(indexMutex);
+    loadIndex();
+    const fs::file_time_type now = fs::file_time_type::clock::now();
+    std::error_code error;
+    fs::last_write_time(path, now, error);
+    indexEntry(key, length, lastUsedTime(now));
+  }
+  then(entry, length);
+}
+
+void AssetCache::store(const string& key, void* entry, size_t length) {
+  if (!enabled) {
+    free(entry);
+    return;
+  }
+
+  // Write to a temporary file first, so a crash never leaves a half-written
+  // entry. It's this thread's own, in case another's storing the same key.
+  const fs::path path = cacheDirectory() / (key + ".bin");
+  std::ostringstream tempName;
+  tempName << key << "-" << std::this_thread::get_id() << ".tmp";
+  const fs::path tempPath = cacheDirectory() / tempName.str();
+  {
+    std::ofstream file(tempPath, std::ios::binary | std::ios::trunc);
+    file.write((const char*) entry, length);
+    free(entry);
+    if (!file) {
+      warn << "failed to write asset cache entry " << key << "\n";
+      std::error_code error;
+      fs::remove(tempPath, error);
+      return;
+    }
+  }
+
+  std::error_code error;
+  fs::rename(tempPath, path, error);
+  if (error) {
+    warn << "failed to write asset cache entry " << key << ": " << error.message() << "\n";
+    fs::remove(tempPath, error);
+    return;
+  }
+
+  std::lock_guard<std::mutex> lock(indexMutex);
+  loadIndex();
+  indexEntry(key, length, lastUsedTime(fs::file_time_type::clock::now()));
+  for (const string& dropped : overBudget()) {
+    fs::remove(cacheDirectory() / (dropped + ".bin"), error);
+  }
+}
+
+void AssetCache::setBudget(size_t bytes) {
+  std::lock_guard<std::mutex> lock(indexMutex);
+  budget = bytes;
+  loadIndex();
+  std::error_code error;
+  for (const string& dropped : overBudget()) {
+    fs::remove(cacheDirectory() / (dropped + ".bin"), error);
+  }
+}
+
+#else
+
+// Emscripten's IDB store, which keeps each entry as one blob
+static const char* kDatabase = "q-asset-cache";
+
+// On the web, the index is an entry of its own: a line per entry, with its
+// key, length and when it was last used (counted in uses, across sessions).
+// It's written back a second after it changes, so the last second's entries
+// can be missing from it if the page is closed.
+static const string kIndexKey = "index-" + to_string(AssetCache::kVersion);
+enum class IndexState { UNLOADED, LOADING, LOADED };
+static IndexState indexState = IndexState::UNLOADED;
+static bool indexWriteScheduled = false;
+static int64_t uses = 0;
+
+static void onStoreError(void* arg);
+
+static void writeIndex(void*) {
+  indexWriteScheduled = false;
+  std::stringstream stream;
+  for (const auto& entry : indexEntries) {
+    stream << entry.first << " " << entry.second.length << " " << entry.second.lastUsed << "\n";
+  }
+  const string text = stream.str();
+  char* data = (char*) malloc(text.size());
+  if (data == nullptr) {
+    return;
+  }
+  memcpy(data, text.data(), text.size());
+  emscripten_idb_async_store(kDatabase, kIndexKey.c_str(), data, (int) text.size(), data, free, onStoreError);
+}
+
+static void indexChanged() {
+  // Not until it's loaded, or it'd be overwritten with only this session's
+  if (indexState == IndexState::LOADED && !indexWriteScheduled) {
+    indexWriteScheduled = true;
+    emscripten_async_call(writeIndex, nullptr, 1000);
+  }
+}
+
+static void onDeleted(void*) {}
+
+static void trim() {
+  if (indexState != IndexState::LOADED) {
+    return;
+  }
+  for (const string& dropped : overBudget()) {
+    emscripten_idb_async_delete(kDatabase, dropped.c_str(), nullptr, onDeleted, onDeleted);
+  }
+}
+
+// This session's entries were used more recently than any before it
+static void onIndexLoad(void*, void* buffer, int size) {
+  const unordered_map<string, IndexEntry> thisSession = std::move(indexEntries);
+  indexEntries.clear();
+  indexedBytes = 0;
+
+  std::stringstream stream(string((const char*) buffer, size));
+  string key;
+  IndexEntry entry;
+  int64_t latest = 0;
+  while (stream >> key >> entry.length >> entry.lastUsed) {
+    indexEntry(key, entry.length, entry.lastUsed);
+    latest = std::max(latest, entry.lastUsed);
+  }
+  for (const auto& it : thisSession) {
+    indexEntry(it.first, it.second.length, latest + 1 + it.second.lastUsed);
+  }
+  uses += latest + 1;
+
+  indexState = IndexState::LOADED;
+  trim();
+  indexChanged();
+}
+
+static void onIndexLoadError(void*) {
+  indexState = IndexState::LOADED; // There isn't one yet
+  trim();
+  indexChanged();
+}
+
+static void used(const string& key, size_t length) {
+  if (indexState == IndexState::UNLOADED) {
+    indexState = IndexState::LOADING;
+    emscripten_idb_async_load(kDatabase, kIndexKey.c_str(), nullptr, onIndexLoad, onIndexLoadError);
+  }
+  indexEntry(key, length, uses ++);
+  trim();
+  indexChanged();
+}
+
+struct PendingLoad {
+  string key;
+  std::function<void(void* entry, size_t length)> then;
+};
+
+static void onLoad(void* arg, void* buffer, int size) {
+  PendingLoad* pending = (PendingLoad*) arg;
+  // The buffer's freed as soon as we return
+  void* entry = malloc(size);
+  if (entry != nullptr) {
+    memcpy(entry, buffer, size);
+    used(pending->key, size);
+    pending->then(entry, size);
+  } else {
+    pending->then(nullptr, 0);
+  }
+  delete pending;
+}
+
+// Including when there's no such entry
+static void onLoadError(void* arg) {
+  PendingLoad* pending = (PendingLoad*) arg;
+  pending->then(nullptr, 0);
+  delete pending;
+}
+
+void AssetCache::load(const string& key, std::function<void(void* entry, size_t length)> then) {
+  if (!enabled) {
+    then(nullptr, 0);
+    return;
+  }
+  PendingLoad* pending = new PendingLoad { key, std::move(then) };
+  emscripten_idb_async_load(kDatabase, key.c_str(), pending, onLoad, onLoadError);
+}
+
+struct PendingStore {
+  string key;
+  void* entry;
+  size_t length;
+};
+
+static void onStore(void* arg) {
+  PendingStore* pending = (PendingStore*) arg;
+  free(pending->entry);
+  used(pending->key, pending->length);
+  delete pending;
+}
+
+static void onStoreError(void* arg) {
+  static int printLimiter = 0;
+  if (printLimiter++ % 100 == 0) {
+    warn << "failed to store an asset cache entry (out of quota?)\n";
+  }
+  free(arg);
+}
+
+static void onEntryStoreError(void* arg) {
+  PendingStore* pending = (PendingStore*) arg;
+  onStoreError(pending->entry);
+  delete pending;
+}
+
+void AssetCache::store(const string& key, void* entry, size_t length) {
+  if (!enabled) {
+    free(entry);
+    return;
+  }
+  // Freed by the callbacks, once IDB is done with it
+  PendingStore* pending = new PendingStore { key, entry, length };
+  emscripten_idb_async_store(kDatabase, key.c_str(), entry, (int) length, pending, onStore, onEntryStoreError);
+}
+
+void AssetCache::setBudget(size_t bytes) {
+  budget = bytes;
+  trim();
+  indexChanged();
+}
+
+#endif
@@ -0,0 +1,58 @@
+#ifndef ASSET_CACHE_H
+#define ASSET_CACHE_H
+
+#include "support.h"
+
+#include <initializer_list>
+
+// Keeps what's made from downloaded files -- decoded images, maps cooked in
+// memory -- across sessions, so later ones can skip the work. Keys are content
+// addressed: they're made from a hash of the source (see key()), so an edited
+// file just misses instead of needing to be invalidated. Each entry also
+// carries a hash of its contents, checked when it's read back, so a torn write
+// or a corrupt entry is a miss too.
+//
+// Kept in IndexedDB on the web (through Emscripten's IDB store), and natively
+// as files under ~/Library/Caches/q/assets (or $Q_ASSET_CACHE_DIR). Once the
+// entries add up to more than the budget, the least recently used go first.
+//
+// Entries are packed and unpacked by the caller, since that copies & hashes
+// the whole thing: do it off the main thread. Natively, load() and store()
+// read & write files there and then, so call them off the main thread too; on
+// the web they go through IndexedDB, which is only there on the main thread.
+namespace AssetCache {
+  // Bumped whenever what's stored changes, which misses every older entry
+  const int kVersion = 1;
+
+  // eg. key("image", Hash::xxh64(file, length), maxSize)
+  string key(const string& kind, uint64_t sourceHash, int variant = 0);
+
+  // The parts one after the other, behind a header with their hash, in one
+  // block from malloc (null if it couldn't be allocated)
+  struct Part {
+    const void* data;
+    size_t length;
+  };
+  void* pack(std::initializer_list<Part> parts, size_t& length);
+
+  // Moves a packed entry's contents to the front of it, or frees it and
+  // returns false if it's no good
+  bool unpack(const string& key, void* entry, size_t& length);
+
+  // `then` gets the packed entry (from malloc, so it takes it), or null if
+  // there isn't one. Natively it's called right away; on the web, later on
+  // the main thread.
+  void load(const string& key, std::function<void(void* entry, size_t length)> then);
+
+  // Takes `entry`, from pack(). Failures (eg. being over quota) are only
+  // logged.
+  void store(const string& key, void* entry, size_t length);
+
+  // In bytes, 512 MB by default
+  void setBudget(size_t bytes);
+
+  // Everything misses, and nothing is stored, eg. to time a cold start
+  void setEnabled(bool enabled);
+}
+
+#endif
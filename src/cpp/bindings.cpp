@@ -22,12 +22,24 @@ void MessageBindings::sendMessageToWeb(const OSXReady& message) {
   std::string evalString = "window.MessageHandler.handleMessageFromCPP(JSON.stringify(" + json + "));";
   OSXWebView::getInstance()->eval(evalString);
 }
+void MessageBindings::sendMessageToWeb(const SetImageUploads& message) {
+  auto json = message.toJson();
+  std::replace(json.begin(), json.end(), '"', '\'');
+  std::string evalString = "window.MessageHandler.handleMessageFromCPP(JSON.stringify(" + json + "));";
+  OSXWebView::getInstance()->eval(evalString);
+}
 void MessageBindings::sendMessageToWeb(const LoadResource& message) {
   auto json = message.toJson();
   std::replace(json.begin(), json.end(), '"', '\'');
   std::string evalString = "window.MessageHandler.handleMessageFromCPP(JSON.stringify(" + json + "));";
   OSXWebView::getInstance()->eval(evalString);
 }
+void MessageBindings::sendMessageToWeb(const LoadResources& message) {
+  auto json = message.toJson();
+  std::replace(json.begin(), json.end(), '"', '\'');
+  std::string evalString = "window.MessageHandler.handleMessageFromCPP(JSON.stringify(" + json + "));";
+  OSXWebView::getInstance()->eval(evalString);
+}
 void MessageBindings::sendMessageToWeb(const LoadShaders& message) {
   auto json = message.toJson();
   std::replace(json.begin(), json.end(), '"', '\'');
@@ -46,19 +58,61 @@ void MessageBindings::sendMessageToWeb(const LoadedTexture& message) {
   std::string evalString = "window.MessageHandler.handleMessageFromCPP(JSON.stringify(" + json + "));";
   OSXWebView::getInstance()->eval(evalString);
 }
+void MessageBindings::sendMessageToWeb(const LoadedCompressedTexture& message) {
+  auto json = message.toJson();
+  std::replace(json.begin(), json.end(), '"', '\'');
+  std::string evalString = "window.MessageHandler.handleMessageFromCPP(JSON.stringify(" + json + "));";
+  OSXWebView::getInstance()->eval(evalString);
+}
+void MessageBindings::sendMessageToWeb(const LoadedImageFile& message) {
+  auto json = message.toJson();
+  std::replace(json.begin(), json.end(), '"', '\'');
+  std::string evalString = "window.MessageHandler.handleMessageFromCPP(JSON.stringify(" + json + "));";
+  OSXWebView::getInstance()->eval(evalString);
+}
+void MessageBindings::sendMessageToWeb(const LoadedArchiveRange& message) {
+  auto json = message.toJson();
+  std::replace(json.begin(), json.end(), '"', '\'');
+  std::string evalString = "window.MessageHandler.handleMessageFromCPP(JSON.stringify(" + json + "));";
+  OSXWebView::getInstance()->eval(evalString);
+}
 void MessageBindings::sendMessageToWeb(const MissingTexture& message) {
   auto json = message.toJson();
   std::replace(json.begin(), json.end(), '"', '\'');
   std::string evalString = "window.MessageHandler.handleMessageFromCPP(JSON.stringify(" + json + "));";
   OSXWebView::getInstance()->eval(evalString);
 }
+void MessageBindings::sendMessageToWeb(const LoadingBSP& message) {
+  auto json = message.toJson();
+  std::replace(json.begin(), json.end(), '"', '\'');
+  std::string evalString = "window.MessageHandler.handleMessageFromCPP(JSON.stringify(" + json + "));";
+  OSXWebView::getInstance()->eval(evalString);
+}
 void MessageBindings::sendMessageToWeb(const LoadedBSP& message) {
   auto json = message.toJson();
   std::replace(json.begin(), json.end(), '"', '\'');
   std::string evalString = "window.MessageHandler.handleMessageFromCPP(JSON.stringify(" + json + "));";
   OSXWebView::getInstance()->eval(evalString);
 }
-void MessageBindings::sendMessageToWeb(const LoadedTextureOptions& message) {
+void MessageBindings::sendMessageToWeb(const LoadedCookedMap& message) {
+  auto json = message.toJson();
+  std::replace(json.begin(), json.end(), '"', '\'');
+  std::string evalString = "window.MessageHandler.handleMessageFromCPP(JSON.stringify(" + json + "));";
+  OSXWebView::getInstance()->eval(evalString);
+}
+void MessageBindings::sendMessageToWeb(const MissingCookedMap& message) {
+  auto json = message.toJson();
+  std::replace(json.begin(), json.end(), '"', '\'');
+  std::string evalString = "window.MessageHandler.handleMessageFromCPP(JSON.stringify(" + json + "));";
+  OSXWebView::getInstance()->eval(evalString);
+}
+void MessageBindings::sendMessageToWeb(const LoadedTextureManifest& message) {
+  auto json = message.toJson();
+  std::replace(json.begin(), json.end(), '"', '\'');
+  std::string evalString = "window.MessageHandler.handleMessageFromCPP(JSON.stringify(" + json + "));";
+  OSXWebView::getInstance()->eval(evalString);
+}
+void MessageBindings::sendMessageToWeb(const LoadedTextures& message) {
   auto json = message.toJson();
   std::replace(json.begin(), json.end(), '"', '\'');
   std::string evalString = "window.MessageHandler.handleMessageFromCPP(JSON.stringify(" + json + "));";
@@ -92,6 +146,14 @@ void MessageBindings::sendMessageToWeb(const OSXReady& message) {
   }
   MessageHandler.call<void>("handleMessageFromCPP", emscripten::val(message.toJson()));
 }
+void MessageBindings::sendMessageToWeb(const SetImageUploads& message) {
+  emscripten::val MessageHandler = emscripten::val::global("MessageHandler");
+  if (!MessageHandler.as<bool>()) {
+    cerr << "No global MessageHandler\n";
+    return;
+  }
+  MessageHandler.call<void>("handleMessageFromCPP", emscripten::val(message.toJson()));
+}
 void MessageBindings::sendMessageToWeb(const LoadResource& message) {
   emscripten::val MessageHandler = emscripten::val::global("MessageHandler");
   if (!MessageHandler.as<bool>()) {
@@ -100,6 +162,14 @@ void MessageBindings::sendMessageToWeb(const LoadResource& message) {
   }
   MessageHandler.call<void>("handleMessageFromCPP", emscripten::val(message.toJson()));
 }
+void MessageBindings::sendMessageToWeb(const LoadResources& message) {
+  emscripten::val MessageHandler = emscripten::val::global("MessageHandler");
+  if (!MessageHandler.as<bool>()) {
+    cerr << "No global MessageHandler\n";
+    return;
+  }
+  MessageHandler.call<void>("handleMessageFromCPP", emscripten::val(message.toJson()));
+}
 void MessageBindings::sendMessageToWeb(const LoadShaders& message) {
   emscripten::val MessageHandler = emscripten::val::global("MessageHandler");
   if (!MessageHandler.as<bool>()) {
@@ -124,6 +194,30 @@ void MessageBindings::sendMessageToWeb(const LoadedTexture& message) {
   }
   MessageHandler.call<void>("handleMessageFromCPP", emscripten::val(message.toJson()));
 }
+void MessageBindings::sendMessageToWeb(const LoadedCompressedTexture& message) {
+  emscripten::val MessageHandler = emscripten::val::global("MessageHandler");
+  if (!MessageHandler.as<bool>()) {
+    cerr << "No global MessageHandler\n";
+    return;
+  }
+  MessageHandler.call<void>("handleMessageFromCPP", emscripten::val(message.toJson()));
+}
+void MessageBindings::sendMessageToWeb(const LoadedImageFile& message) {
+  emscripten::val MessageHandler = emscripten::val::global("MessageHandler");
+  if (!MessageHandler.as<bool>()) {
+    cerr << "No global MessageHandler\n";
+    return;
+  }
+  MessageHandler.call<void>("handleMessageFromCPP", emscripten::val(message.toJson()));
+}
+void MessageBindings::sendMessageToWeb(const LoadedArchiveRange& message) {
+  emscripten::val MessageHandler = emscripten::val::global("MessageHandler");
+  if (!MessageHandler.as<bool>()) {
+    cerr << "No global MessageHandler\n";
+    return;
+  }
+  MessageHandler.call<void>("handleMessageFromCPP", emscripten::val(message.toJson()));
+}
 void MessageBindings::sendMessageToWeb(const MissingTexture& message) {
   emscripten::val MessageHandler = emscripten::val::global("MessageHandler");
   if (!MessageHandler.as<bool>()) {
@@ -132,6 +226,14 @@ void MessageBindings::sendMessageToWeb(const MissingTexture& message) {
   }
   MessageHandler.call<void>("handleMessageFromCPP", emscripten::val(message.toJson()));
 }
+void MessageBindings::sendMessageToWeb(const LoadingBSP& message) {
+  emscripten::val MessageHandler = emscripten::val::global("MessageHandler");
+  if (!MessageHandler.as<bool>()) {
+    cerr << "No global MessageHandler\n";
+    return;
+  }
+  MessageHandler.call<void>("handleMessageFromCPP", emscripten::val(message.toJson()));
+}
 void MessageBindings::sendMessageToWeb(const LoadedBSP& message) {
   emscripten::val MessageHandler = emscripten::val::global("MessageHandler");
   if (!MessageHandler.as<bool>()) {
@@ -140,7 +242,31 @@ void MessageBindings::sendMessageToWeb(const LoadedBSP& message) {
   }
   MessageHandler.call<void>("handleMessageFromCPP", emscripten::val(message.toJson()));
 }
-void MessageBindings::sendMessageToWeb(const LoadedTextureOptions& message) {
+void MessageBindings::sendMessageToWeb(const LoadedCookedMap& message) {
+  emscripten::val MessageHandler = emscripten::val::global("MessageHandler");
+  if (!MessageHandler.as<bool>()) {
+    cerr << "No global MessageHandler\n";
+    return;
+  }
+  MessageHandler.call<void>("handleMessageFromCPP", emscripten::val(message.toJson()));
+}
+void MessageBindings::sendMessageToWeb(const MissingCookedMap& message) {
+  emscripten::val MessageHandler = emscripten::val::global("MessageHandler");
+  if (!MessageHandler.as<bool>()) {
+    cerr << "No global MessageHandler\n";
+    return;
+  }
+  MessageHandler.call<void>("handleMessageFromCPP", emscripten::val(message.toJson()));
+}
+void MessageBindings::sendMessageToWeb(const LoadedTextureManifest& message) {
+  emscripten::val MessageHandler = emscripten::val::global("MessageHandler");
+  if (!MessageHandler.as<bool>()) {
+    cerr << "No global MessageHandler\n";
+    return;
+  }
+  MessageHandler.call<void>("handleMessageFromCPP", emscripten::val(message.toJson()));
+}
+void MessageBindings::sendMessageToWeb(const LoadedTextures& message) {
   emscripten::val MessageHandler = emscripten::val::global("MessageHandler");
   if (!MessageHandler.as<bool>()) {
     cerr << "No global MessageHandler\n";
@@ -151,10 +277,16 @@ void MessageBindings::sendMessageToWeb(const LoadedTextureOptions& message) {
 #endif
 string TestMessage::toJson() const {
   json j;
-  j["type"] = "TestMessage";
-  j["text"] = (text);
+  ::to_json(j, *this);
   return j.dump();
 }
+void to_json(json& j, const TestMessage& message) {
+  j["type"] = "TestMessage";
+  j["text"] = (message.text);
+}
+void from_json(const json& j, TestMessage& message) {
+  message = TestMessage::fromJson(j);
+}
 TestMessage TestMessage::fromJson(const json& j) {
   return TestMessage {
     (j["text"]),
@@ -162,10 +294,16 @@ TestMessage TestMessage::fromJson(const json& j) {
 }
 string TestPointer::toJson() const {
   json j;
-  j["type"] = "TestPointer";
-  j["pointer"] = MemoryHelpers::cppToJsonPointer(pointer);
+  ::to_json(j, *this);
   return j.dump();
 }
+void to_json(json& j, const TestPointer& message) {
+  j["type"] = "TestPointer";
+  j["pointer"] = MemoryHelpers::cppToJsonPointer(message.pointer);
+}
+void from_json(const json& j, TestPointer& message) {
+  message = TestPointer::fromJson(j);
+}
 TestPointer TestPointer::fromJson(const json& j) {
   return TestPointer {
     MemoryHelpers::jsonToCppPointer(j["pointer"]),
@@ -173,36 +311,100 @@ TestPointer TestPointer::fromJson(const json& j) {
 }
 string OSXReady::toJson() const {
   json j;
-  j["type"] = "OSXReady";
+  ::to_json(j, *this);
   return j.dump();
 }
+void to_json(json& j, const OSXReady& message) {
+  j["type"] = "OSXReady";
+}
+void from_json(const json& j, OSXReady& message) {
+  message = OSXReady::fromJson(j);
+}
 OSXReady OSXReady::fromJson(const json& j) {
   return OSXReady {
   };
 }
+string SetImageUploads::toJson() const {
+  json j;
+  ::to_json(j, *this);
+  return j.dump();
+}
+void to_json(json& j, const SetImageUploads& message) {
+  j["type"] = "SetImageUploads";
+  j["fromBrowser"] = (message.fromBrowser);
+}
+void from_json(const json& j, SetImageUploads& message) {
+  message = SetImageUploads::fromJson(j);
+}
+SetImageUploads SetImageUploads::fromJson(const json& j) {
+  return SetImageUploads {
+    (j["fromBrowser"]),
+  };
+}
 string LoadResource::toJson() const {
   json j;
-  j["type"] = "LoadResource";
-  j["url"] = (url);
-  j["resourceType"] = (resourceType);
-  j["resourceID"] = (resourceID);
+  ::to_json(j, *this);
   return j.dump();
 }
+void to_json(json& j, const LoadResource& message) {
+  j["type"] = "LoadResource";
+  j["url"] = (message.url);
+  j["resourceType"] = (message.resourceType);
+  j["resourceID"] = (message.resourceID);
+  j["maxSize"] = (message.maxSize);
+  j["decodeInBrowser"] = (message.decodeInBrowser);
+  j["texture"] = (message.texture);
+  j["archive"] = (message.archive);
+  j["offset"] = (message.offset);
+  j["length"] = (message.length);
+}
+void from_json(const json& j, LoadResource& message) {
+  message = LoadResource::fromJson(j);
+}
 LoadResource LoadResource::fromJson(const json& j) {
   return LoadResource {
     (j["url"]),
     (j["resourceType"]),
     (j["resourceID"]),
+    (j["maxSize"]),
+    (j["decodeInBrowser"]),
+    (j["texture"]),
+    (j["archive"]),
+    (j["offset"]),
+    (j["length"]),
+  };
+}
+string LoadResources::toJson() const {
+  json j;
+  ::to_json(j, *this);
+  return j.dump();
+}
+void to_json(json& j, const LoadResources& message) {
+  j["type"] = "LoadResources";
+  j["resources"] = (message.resources);
+}
+void from_json(const json& j, LoadResources& message) {
+  message = LoadResources::fromJson(j);
+}
+LoadResources LoadResources::fromJson(const json& j) {
+  return LoadResources {
+    (j["resources"]),
   };
 }
 string LoadShaders::toJson() const {
   json j;
-  j["type"] = "LoadShaders";
-  j["vertUrl"] = (vertUrl);
-  j["fragUrl"] = (fragUrl);
-  j["resourceID"] = (resourceID);
+  ::to_json(j, *this);
   return j.dump();
 }
+void to_json(json& j, const LoadShaders& message) {
+  j["type"] = "LoadShaders";
+  j["vertUrl"] = (message.vertUrl);
+  j["fragUrl"] = (message.fragUrl);
+  j["resourceID"] = (message.resourceID);
+}
+void from_json(const json& j, LoadShaders& message) {
+  message = LoadShaders::fromJson(j);
+}
 LoadShaders LoadShaders::fromJson(const json& j) {
   return LoadShaders {
     (j["vertUrl"]),
@@ -212,14 +414,20 @@ LoadShaders LoadShaders::fromJson(const json& j) {
 }
 string LoadedShaders::toJson() const {
   json j;
-  j["type"] = "LoadedShaders";
-  j["resourceID"] = (resourceID);
-  j["vertPointer"] = MemoryHelpers::cppToJsonPointer(vertPointer);
-  j["fragPointer"] = MemoryHelpers::cppToJsonPointer(fragPointer);
-  j["vertLength"] = (vertLength);
-  j["fragLength"] = (fragLength);
+  ::to_json(j, *this);
   return j.dump();
 }
+void to_json(json& j, const LoadedShaders& message) {
+  j["type"] = "LoadedShaders";
+  j["resourceID"] = (message.resourceID);
+  j["vertPointer"] = MemoryHelpers::cppToJsonPointer(message.vertPointer);
+  j["fragPointer"] = MemoryHelpers::cppToJsonPointer(message.fragPointer);
+  j["vertLength"] = (message.vertLength);
+  j["fragLength"] = (message.fragLength);
+}
+void from_json(const json& j, LoadedShaders& message) {
+  message = LoadedShaders::fromJson(j);
+}
 LoadedShaders LoadedShaders::fromJson(const json& j) {
   return LoadedShaders {
     (j["resourceID"]),
@@ -231,56 +439,243 @@ LoadedShaders LoadedShaders::fromJson(const json& j) {
 }
 string LoadedTexture::toJson() const {
   json j;
-  j["type"] = "LoadedTexture";
-  j["resourceID"] = (resourceID);
-  j["pointer"] = MemoryHelpers::cppToJsonPointer(pointer);
-  j["width"] = (width);
-  j["height"] = (height);
+  ::to_json(j, *this);
   return j.dump();
 }
+void to_json(json& j, const LoadedTexture& message) {
+  j["type"] = "LoadedTexture";
+  j["resourceID"] = (message.resourceID);
+  j["pointer"] = MemoryHelpers::cppToJsonPointer(message.pointer);
+  j["width"] = (message.width);
+  j["height"] = (message.height);
+  j["fullWidth"] = (message.fullWidth);
+  j["fullHeight"] = (message.fullHeight);
+}
+void from_json(const json& j, LoadedTexture& message) {
+  message = LoadedTexture::fromJson(j);
+}
 LoadedTexture LoadedTexture::fromJson(const json& j) {
   return LoadedTexture {
     (j["resourceID"]),
     MemoryHelpers::jsonToCppPointer(j["pointer"]),
     (j["width"]),
     (j["height"]),
+    (j["fullWidth"]),
+    (j["fullHeight"]),
+  };
+}
+string LoadedCompressedTexture::toJson() const {
+  json j;
+  ::to_json(j, *this);
+  return j.dump();
+}
+void to_json(json& j, const LoadedCompressedTexture& message) {
+  j["type"] = "LoadedCompressedTexture";
+  j["resourceID"] = (message.resourceID);
+  j["pointer"] = MemoryHelpers::cppToJsonPointer(message.pointer);
+  j["length"] = (message.length);
+}
+void from_json(const json& j, LoadedCompressedTexture& message) {
+  message = LoadedCompressedTexture::fromJson(j);
+}
+LoadedCompressedTexture LoadedCompressedTexture::fromJson(const json& j) {
+  return LoadedCompressedTexture {
+    (j["resourceID"]),
+    MemoryHelpers::jsonToCppPointer(j["pointer"]),
+    (j["length"]),
+  };
+}
+string LoadedImageFile::toJson() const {
+  json j;
+  ::to_json(j, *this);
+  return j.dump();
+}
+void to_json(json& j, const LoadedImageFile& message) {
+  j["type"] = "LoadedImageFile";
+  j["resourceID"] = (message.resourceID);
+  j["url"] = (message.url);
+  j["pointer"] = MemoryHelpers::cppToJsonPointer(message.pointer);
+  j["length"] = (message.length);
+}
+void from_json(const json& j, LoadedImageFile& message) {
+  message = LoadedImageFile::fromJson(j);
+}
+LoadedImageFile LoadedImageFile::fromJson(const json& j) {
+  return LoadedImageFile {
+    (j["resourceID"]),
+    (j["url"]),
+    MemoryHelpers::jsonToCppPointer(j["pointer"]),
+    (j["length"]),
+  };
+}
+string LoadedArchiveRange::toJson() const {
+  json j;
+  ::to_json(j, *this);
+  return j.dump();
+}
+void to_json(json& j, const LoadedArchiveRange& message) {
+  j["type"] = "LoadedArchiveRange";
+  j["resourceID"] = (message.resourceID);
+  j["pointer"] = MemoryHelpers::cppToJsonPointer(message.pointer);
+  j["offset"] = (message.offset);
+  j["length"] = (message.length);
+  j["fileLength"] = (message.fileLength);
+}
+void from_json(const json& j, LoadedArchiveRange& message) {
+  message = LoadedArchiveRange::fromJson(j);
+}
+LoadedArchiveRange LoadedArchiveRange::fromJson(const json& j) {
+  return LoadedArchiveRange {
+    (j["resourceID"]),
+    MemoryHelpers::jsonToCppPointer(j["pointer"]),
+    (j["offset"]),
+    (j["length"]),
+    (j["fileLength"]),
   };
 }
 string MissingTexture::toJson() const {
   json j;
-  j["type"] = "MissingTexture";
-  j["resourceID"] = (resourceID);
+  ::to_json(j, *this);
   return j.dump();
 }
+void to_json(json& j, const MissingTexture& message) {
+  j["type"] = "MissingTexture";
+  j["resourceID"] = (message.resourceID);
+}
+void from_json(const json& j, MissingTexture& message) {
+  message = MissingTexture::fromJson(j);
+}
 MissingTexture MissingTexture::fromJson(const json& j) {
   return MissingTexture {
     (j["resourceID"]),
   };
 }
+string LoadingBSP::toJson() const {
+  json j;
+  ::to_json(j, *this);
+  return j.dump();
+}
+void to_json(json& j, const LoadingBSP& message) {
+  j["type"] = "LoadingBSP";
+  j["resourceID"] = (message.resourceID);
+  j["pointer"] = MemoryHelpers::cppToJsonPointer(message.pointer);
+  j["loaded"] = (message.loaded);
+  j["length"] = (message.length);
+}
+void from_json(const json& j, LoadingBSP& message) {
+  message = LoadingBSP::fromJson(j);
+}
+LoadingBSP LoadingBSP::fromJson(const json& j) {
+  return LoadingBSP {
+    (j["resourceID"]),
+    MemoryHelpers::jsonToCppPointer(j["pointer"]),
+    (j["loaded"]),
+    (j["length"]),
+  };
+}
 string LoadedBSP::toJson() const {
   json j;
-  j["type"] = "LoadedBSP";
-  j["resourceID"] = (resourceID);
-  j["pointer"] = MemoryHelpers::cppToJsonPointer(pointer);
+  ::to_json(j, *this);
   return j.dump();
 }
+void to_json(json& j, const LoadedBSP& message) {
+  j["type"] = "LoadedBSP";
+  j["resourceID"] = (message.resourceID);
+  j["pointer"] = MemoryHelpers::cppToJsonPointer(message.pointer);
+  j["length"] = (message.length);
+}
+void from_json(const json& j, LoadedBSP& message) {
+  message = LoadedBSP::fromJson(j);
+}
 LoadedBSP LoadedBSP::fromJson(const json& j) {
   return LoadedBSP {
     (j["resourceID"]),
     MemoryHelpers::jsonToCppPointer(j["pointer"]),
+    (j["length"]),
+  };
+}
+string LoadedCookedMap::toJson() const {
+  json j;
+  ::to_json(j, *this);
+  return j.dump();
+}
+void to_json(json& j, const LoadedCookedMap& message) {
+  j["type"] = "LoadedCookedMap";
+  j["resourceID"] = (message.resourceID);
+  j["pointer"] = MemoryHelpers::cppToJsonPointer(message.pointer);
+  j["length"] = (message.length);
+}
+void from_json(const json& j, LoadedCookedMap& message) {
+  message = LoadedCookedMap::fromJson(j);
+}
+LoadedCookedMap LoadedCookedMap::fromJson(const json& j) {
+  return LoadedCookedMap {
+    (j["resourceID"]),
+    MemoryHelpers::jsonToCppPointer(j["pointer"]),
+    (j["length"]),
+  };
+}
+string MissingCookedMap::toJson() const {
+  json j;
+  ::to_json(j, *this);
+  return j.dump();
+}
+void to_json(json& j, const MissingCookedMap& message) {
+  j["type"] = "MissingCookedMap";
+  j["resourceID"] = (message.resourceID);
+}
+void from_json(const json& j, MissingCookedMap& message) {
+  message = MissingCookedMap::fromJson(j);
+}
+MissingCookedMap MissingCookedMap::fromJson(const json& j) {
+  return MissingCookedMap {
+    (j["resourceID"]),
   };
 }
-string LoadedTextureOptions::toJson() const {
+string LoadedTextureManifest::toJson() const {
   json j;
-  j["type"] = "LoadedTextureOptions";
-  j["resourceID"] = (resourceID);
-  j["surfaceParamTrans"] = (surfaceParamTrans);
+  ::to_json(j, *this);
   return j.dump();
 }
-LoadedTextureOptions LoadedTextureOptions::fromJson(const json& j) {
-  return LoadedTextureOptions {
+void to_json(json& j, const LoadedTextureManifest& message) {
+  j["type"] = "LoadedTextureManifest";
+  j["resourceID"] = (message.resourceID);
+  j["pointer"] = MemoryHelpers::cppToJsonPointer(message.pointer);
+  j["length"] = (message.length);
+}
+void from_json(const json& j, LoadedTextureManifest& message) {
+  message = LoadedTextureManifest::fromJson(j);
+}
+LoadedTextureManifest LoadedTextureManifest::fromJson(const json& j) {
+  return LoadedTextureManifest {
     (j["resourceID"]),
-    (j["surfaceParamTrans"]),
+    MemoryHelpers::jsonToCppPointer(j["pointer"]),
+    (j["length"]),
+  };
+}
+string LoadedTextures::toJson() const {
+  json j;
+  ::to_json(j, *this);
+  return j.dump();
+}
+void to_json(json& j, const LoadedTextures& message) {
+  j["type"] = "LoadedTextures";
+  j["loaded"] = (message.loaded);
+  j["compressed"] = (message.compressed);
+  j["files"] = (message.files);
+  j["missing"] = (message.missing);
+  j["ranges"] = (message.ranges);
+}
+void from_json(const json& j, LoadedTextures& message) {
+  message = LoadedTextures::fromJson(j);
+}
+LoadedTextures LoadedTextures::fromJson(const json& j) {
+  return LoadedTextures {
+    (j["loaded"]),
+    (j["compressed"]),
+    (j["files"]),
+    (j["missing"]),
+    (j["ranges"]),
   };
 }
 void MessagesFromWeb::sendMessage(const json& j) {
@@ -302,12 +697,24 @@ void MessagesFromWeb::sendMessage(const json& j) {
       handler->handleMessageFromWeb(message);
     }
   }
+  if (j["type"] == "SetImageUploads") {
+    auto message = SetImageUploads::fromJson(j);
+    for (const auto& handler : _handlers) {
+      handler->handleMessageFromWeb(message);
+    }
+  }
   if (j["type"] == "LoadResource") {
     auto message = LoadResource::fromJson(j);
     for (const auto& handler : _handlers) {
       handler->handleMessageFromWeb(message);
     }
   }
+  if (j["type"] == "LoadResources") {
+    auto message = LoadResources::fromJson(j);
+    for (const auto& handler : _handlers) {
+      handler->handleMessageFromWeb(message);
+    }
+  }
   if (j["type"] == "LoadShaders") {
     auto message = LoadShaders::fromJson(j);
     for (const auto& handler : _handlers) {
@@ -326,20 +733,62 @@ void MessagesFromWeb::sendMessage(const json& j) {
       handler->handleMessageFromWeb(message);
     }
   }
+  if (j["type"] == "LoadedCompressedTexture") {
+    auto message = LoadedCompressedTexture::fromJson(j);
+    for (const auto& handler : _handlers) {
+      handler->handleMessageFromWeb(message);
+    }
+  }
+  if (j["type"] == "LoadedImageFile") {
+    auto message = LoadedImageFile::fromJson(j);
+    for (const auto& handler : _handlers) {
+      handler->handleMessageFromWeb(message);
+    }
+  }
+  if (j["type"] == "LoadedArchiveRange") {
+    auto message = LoadedArchiveRange::fromJson(j);
+    for (const auto& handler : _handlers) {
+      handler->handleMessageFromWeb(message);
+    }
+  }
   if (j["type"] == "MissingTexture") {
     auto message = MissingTexture::fromJson(j);
     for (const auto& handler : _handlers) {
       handler->handleMessageFromWeb(message);
     }
   }
+  if (j["type"] == "LoadingBSP") {
+    auto message = LoadingBSP::fromJson(j);
+    for (const auto& handler : _handlers) {
+      handler->handleMessageFromWeb(message);
+    }
+  }
   if (j["type"] == "LoadedBSP") {
     auto message = LoadedBSP::fromJson(j);
     for (const auto& handler : _handlers) {
       handler->handleMessageFromWeb(message);
     }
   }
-  if (j["type"] == "LoadedTextureOptions") {
-    auto message = LoadedTextureOptions::fromJson(j);
+  if (j["type"] == "LoadedCookedMap") {
+    auto message = LoadedCookedMap::fromJson(j);
+    for (const auto& handler : _handlers) {
+      handler->handleMessageFromWeb(message);
+    }
+  }
+  if (j["type"] == "MissingCookedMap") {
+    auto message = MissingCookedMap::fromJson(j);
+    for (const auto& handler : _handlers) {
+      handler->handleMessageFromWeb(message);
+    }
+  }
+  if (j["type"] == "LoadedTextureManifest") {
+    auto message = LoadedTextureManifest::fromJson(j);
+    for (const auto& handler : _handlers) {
+      handler->handleMessageFromWeb(message);
+    }
+  }
+  if (j["type"] == "LoadedTextures") {
+    auto message = LoadedTextures::fromJson(j);
     for (const auto& handler : _handlers) {
       handler->handleMessageFromWeb(message);
     }
@@ -6,6 +6,9 @@ using namespace nlohmann;
 enum ResourceType {
   BSP_FILE,
   IMAGE_FILE,
+  COOKED_MAP_FILE,
+  ARCHIVE_FILE,
+  TEXTURE_MANIFEST_FILE,
   UNKNOWN
 };
 struct TestMessage {
@@ -13,22 +16,56 @@ struct TestMessage {
   string toJson() const;
   static TestMessage fromJson(const json& j);
 };
+// So messages can be sent in batches, ie. as vector<TestMessage> fields
+void to_json(json& j, const TestMessage& message);
+void from_json(const json& j, TestMessage& message);
 struct TestPointer {
   void* pointer;
   string toJson() const;
   static TestPointer fromJson(const json& j);
 };
+// So messages can be sent in batches, ie. as vector<TestPointer> fields
+void to_json(json& j, const TestPointer& message);
+void from_json(const json& j, TestPointer& message);
 struct OSXReady {
   string toJson() const;
   static OSXReady fromJson(const json& j);
 };
+// So messages can be sent in batches, ie. as vector<OSXReady> fields
+void to_json(json& j, const OSXReady& message);
+void from_json(const json& j, OSXReady& message);
+struct SetImageUploads {
+  bool fromBrowser;
+  string toJson() const;
+  static SetImageUploads fromJson(const json& j);
+};
+// So messages can be sent in batches, ie. as vector<SetImageUploads> fields
+void to_json(json& j, const SetImageUploads& message);
+void from_json(const json& j, SetImageUploads& message);
 struct LoadResource {
   string url;
   ResourceType resourceType;
   int resourceID;
+  int maxSize;
+  bool decodeInBrowser;
+  int texture;
+  string archive;
+  int offset;
+  int length;
   string toJson() const;
   static LoadResource fromJson(const json& j);
 };
+// So messages can be sent in batches, ie. as vector<LoadResource> fields
+void to_json(json& j, const LoadResource& message);
+void from_json(const json& j, LoadResource& message);
+struct LoadResources {
+  vector<LoadResource> resources;
+  string toJson() const;
+  static LoadResources fromJson(const json& j);
+};
+// So messages can be sent in batches, ie. as vector<LoadResources> fields
+void to_json(json& j, const LoadResources& message);
+void from_json(const json& j, LoadResources& message);
 struct LoadShaders {
   string vertUrl;
   string fragUrl;
@@ -36,6 +73,9 @@ struct LoadShaders {
   string toJson() const;
   static LoadShaders fromJson(const json& j);
 };
+// So messages can be sent in batches, ie. as vector<LoadShaders> fields
+void to_json(json& j, const LoadShaders& message);
+void from_json(const json& j, LoadShaders& message);
 struct LoadedShaders {
   int resourceID;
   void* vertPointer;
@@ -45,56 +85,167 @@ struct LoadedShaders {
   string toJson() const;
   static LoadedShaders fromJson(const json& j);
 };
+// So messages can be sent in batches, ie. as vector<LoadedShaders> fields
+void to_json(json& j, const LoadedShaders& message);
+void from_json(const json& j, LoadedShaders& message);
 struct LoadedTexture {
   int resourceID;
   void* pointer;
   int width;
   int height;
+  int fullWidth;
+  int fullHeight;
   string toJson() const;
   static LoadedTexture fromJson(const json& j);
 };
+// So messages can be sent in batches, ie. as vector<LoadedTexture> fields
+void to_json(json& j, const LoadedTexture& message);
+void from_json(const json& j, LoadedTexture& message);
+struct LoadedCompressedTexture {
+  int resourceID;
+  void* pointer;
+  int length;
+  string toJson() const;
+  static LoadedCompressedTexture fromJson(const json& j);
+};
+// So messages can be sent in batches, ie. as vector<LoadedCompressedTexture> fields
+void to_json(json& j, const LoadedCompressedTexture& message);
+void from_json(const json& j, LoadedCompressedTexture& message);
+struct LoadedImageFile {
+  int resourceID;
+  string url;
+  void* pointer;
+  int length;
+  string toJson() const;
+  static LoadedImageFile fromJson(const json& j);
+};
+// So messages can be sent in batches, ie. as vector<LoadedImageFile> fields
+void to_json(json& j, const LoadedImageFile& message);
+void from_json(const json& j, LoadedImageFile& message);
+struct LoadedArchiveRange {
+  int resourceID;
+  void* pointer;
+  int offset;
+  int length;
+  int fileLength;
+  string toJson() const;
+  static LoadedArchiveRange fromJson(const json& j);
+};
+// So messages can be sent in batches, ie. as vector<LoadedArchiveRange> fields
+void to_json(json& j, const LoadedArchiveRange& message);
+void from_json(const json& j, LoadedArchiveRange& message);
 struct MissingTexture {
   int resourceID;
   string toJson() const;
   static MissingTexture fromJson(const json& j);
 };
+// So messages can be sent in batches, ie. as vector<MissingTexture> fields
+void to_json(json& j, const MissingTexture& message);
+void from_json(const json& j, MissingTexture& message);
+struct LoadingBSP {
+  int resourceID;
+  void* pointer;
+  int loaded;
+  int length;
+  string toJson() const;
+  static LoadingBSP fromJson(const json& j);
+};
+// So messages can be sent in batches, ie. as vector<LoadingBSP> fields
+void to_json(json& j, const LoadingBSP& message);
+void from_json(const json& j, LoadingBSP& message);
 struct LoadedBSP {
   int resourceID;
   void* pointer;
+  int length;
   string toJson() const;
   static LoadedBSP fromJson(const json& j);
 };
-struct LoadedTextureOptions {
+// So messages can be sent in batches, ie. as vector<LoadedBSP> fields
+void to_json(json& j, const LoadedBSP& message);
+void from_json(const json& j, LoadedBSP& message);
+struct LoadedCookedMap {
+  int resourceID;
+  void* pointer;
+  int length;
+  string toJson() const;
+  static LoadedCookedMap fromJson(const json& j);
+};
+// So messages can be sent in batches, ie. as vector<LoadedCookedMap> fields
+void to_json(json& j, const LoadedCookedMap& message);
+void from_json(const json& j, LoadedCookedMap& message);
+struct MissingCookedMap {
   int resourceID;
-  bool surfaceParamTrans;
   string toJson() const;
-  static LoadedTextureOptions fromJson(const json& j);
+  static MissingCookedMap fromJson(const json& j);
 };
+// So messages can be sent in batches, ie. as vector<MissingCookedMap> fields
+void to_json(json& j, const MissingCookedMap& message);
+void from_json(const json& j, MissingCookedMap& message);
+struct LoadedTextureManifest {
+  int resourceID;
+  void* pointer;
+  int length;
+  string toJson() const;
+  static LoadedTextureManifest fromJson(const json& j);
+};
+// So messages can be sent in batches, ie. as vector<LoadedTextureManifest> fields
+void to_json(json& j, const LoadedTextureManifest& message);
+void from_json(const json& j, LoadedTextureManifest& message);
+struct LoadedTextures {
+  vector<LoadedTexture> loaded;
+  vector<LoadedCompressedTexture> compressed;
+  vector<LoadedImageFile> files;
+  vector<MissingTexture> missing;
+  vector<LoadedArchiveRange> ranges;
+  string toJson() const;
+  static LoadedTextures fromJson(const json& j);
+};
+// So messages can be sent in batches, ie. as vector<LoadedTextures> fields
+void to_json(json& j, const LoadedTextures& message);
+void from_json(const json& j, LoadedTextures& message);
 class IMessageHandler {
 public:
   virtual ~IMessageHandler() {}
   virtual void handleMessageFromWeb(const TestMessage& message) {}
   virtual void handleMessageFromWeb(const TestPointer& message) {}
   virtual void handleMessageFromWeb(const OSXReady& message) {}
+  virtual void handleMessageFromWeb(const SetImageUploads& message) {}
   virtual void handleMessageFromWeb(const LoadResource& message) {}
+  virtual void handleMessageFromWeb(const LoadResources& message) {}
   virtual void handleMessageFromWeb(const LoadShaders& message) {}
   virtual void handleMessageFromWeb(const LoadedShaders& message) {}
   virtual void handleMessageFromWeb(const LoadedTexture& message) {}
+  virtual void handleMessageFromWeb(const LoadedCompressedTexture& message) {}
+  virtual void handleMessageFromWeb(const LoadedImageFile& message) {}
+  virtual void handleMessageFromWeb(const LoadedArchiveRange& message) {}
   virtual void handleMessageFromWeb(const MissingTexture& message) {}
+  virtual void handleMessageFromWeb(const LoadingBSP& message) {}
   virtual void handleMessageFromWeb(const LoadedBSP& message) {}
-  virtual void handleMessageFromWeb(const LoadedTextureOptions& message) {}
+  virtual void handleMessageFromWeb(const LoadedCookedMap& message) {}
+  virtual void handleMessageFromWeb(const MissingCookedMap& message) {}
+  virtual void handleMessageFromWeb(const LoadedTextureManifest& message) {}
+  virtual void handleMessageFromWeb(const LoadedTextures& message) {}
 };
 namespace MessageBindings {
   void sendMessageToWeb(const TestMessage& message);
   void sendMessageToWeb(const TestPointer& message);
   void sendMessageToWeb(const OSXReady& message);
+  void sendMessageToWeb(const SetImageUploads& message);
   void sendMessageToWeb(const LoadResource& message);
+  void sendMessageToWeb(const LoadResources& message);
   void sendMessageToWeb(const LoadShaders& message);
   void sendMessageToWeb(const LoadedShaders& message);
   void sendMessageToWeb(const LoadedTexture& message);
+  void sendMessageToWeb(const LoadedCompressedTexture& message);
+  void sendMessageToWeb(const LoadedImageFile& message);
+  void sendMessageToWeb(const LoadedArchiveRange& message);
   void sendMessageToWeb(const MissingTexture& message);
+  void sendMessageToWeb(const LoadingBSP& message);
   void sendMessageToWeb(const LoadedBSP& message);
-  void sendMessageToWeb(const LoadedTextureOptions& message);
+  void sendMessageToWeb(const LoadedCookedMap& message);
+  void sendMessageToWeb(const MissingCookedMap& message);
+  void sendMessageToWeb(const LoadedTextureManifest& message);
+  void sendMessageToWeb(const LoadedTextures& message);
 };
 struct MessageLogger : IMessageHandler {
 public:
@@ -107,9 +258,15 @@ public:
   void handleMessageFromWeb(const OSXReady& message) override {
     cout << "TS => CPP w/ " << message.toJson() << "\n";
   }
+  void handleMessageFromWeb(const SetImageUploads& message) override {
+    cout << "TS => CPP w/ " << message.toJson() << "\n";
+  }
   void handleMessageFromWeb(const LoadResource& message) override {
     cout << "TS => CPP w/ " << message.toJson() << "\n";
   }
+  void handleMessageFromWeb(const LoadResources& message) override {
+    cout << "TS => CPP w/ " << message.toJson() << "\n";
+  }
   void handleMessageFromWeb(const LoadShaders& message) override {
     cout << "TS => CPP w/ " << message.toJson() << "\n";
   }
@@ -119,13 +276,34 @@ public:
   void handleMessageFromWeb(const LoadedTexture& message) override {
     cout << "TS => CPP w/ " << message.toJson() << "\n";
   }
+  void handleMessageFromWeb(const LoadedCompressedTexture& message) override {
+    cout << "TS => CPP w/ " << message.toJson() << "\n";
+  }
+  void handleMessageFromWeb(const LoadedImageFile& message) override {
+    cout << "TS => CPP w/ " << message.toJson() << "\n";
+  }
+  void handleMessageFromWeb(const LoadedArchiveRange& message) override {
+    cout << "TS => CPP w/ " << message.toJson() << "\n";
+  }
   void handleMessageFromWeb(const MissingTexture& message) override {
     cout << "TS => CPP w/ " << message.toJson() << "\n";
   }
+  void handleMessageFromWeb(const LoadingBSP& message) override {
+    cout << "TS => CPP w/ " << message.toJson() << "\n";
+  }
   void handleMessageFromWeb(const LoadedBSP& message) override {
     cout << "TS => CPP w/ " << message.toJson() << "\n";
   }
-  void handleMessageFromWeb(const LoadedTextureOptions& message) override {
+  void handleMessageFromWeb(const LoadedCookedMap& message) override {
+    cout << "TS => CPP w/ " << message.toJson() << "\n";
+  }
+  void handleMessageFromWeb(const MissingCookedMap& message) override {
+    cout << "TS => CPP w/ " << message.toJson() << "\n";
+  }
+  void handleMessageFromWeb(const LoadedTextureManifest& message) override {
+    cout << "TS => CPP w/ " << message.toJson() << "\n";
+  }
+  void handleMessageFromWeb(const LoadedTextures& message) override {
     cout << "TS => CPP w/ " << message.toJson() << "\n";
   }
 };
@@ -1,6 +1,9 @@
 #include "bsp.h"
 #include "pprint.hpp"
 
+#include <algorithm>
+#include <cstring>
+
 using namespace BSP;
 
 vertex_t vertex_t::operator+(const vertex_t& rhs) const {
@@ -43,6 +46,160 @@ vertex_t vertex_t::operator*(double rhs) const {
   return result;
 }
 
+int header_t::findLeaf(const glm::vec3& position) const {
+  if (numNodes() == 0) {
+    return 0;
+  }
+
+  const node_t* nodes = this->nodes();
+  const plane_t* planes = this->planes();
+
+  int index = 0;
+  while (index >= 0) {
+    const node_t* node = nodes + index;
+    const plane_t* plane = planes + node->plane;
+    const float distance =
+      plane->normal[0] * position.x +
+      plane->normal[1] * position.y +
+      plane->normal[2] * position.z - plane->dist;
+
+    index = distance >= 0 ? node->children[0] : node->children[1];
+  }
+
+  return -(index + 1);
+}
+
+vector<int> header_t::findLeaves(const glm::vec3& mins, const glm::vec3& maxs) const {
+  vector<int> result;
+  if (numNodes() == 0) {
+    return result;
+  }
+
+  const node_t* nodes = this->nodes();
+  const plane_t* planes = this->planes();
+
+  vector<int> stack = { 0 };
+  while (!stack.empty()) {
+    const int index = stack.back();
+    stack.pop_back();
+
+    if (index < 0) {
+      result.push_back(-(index + 1));
+      continue;
+    }
+
+    const node_t* node = nodes + index;
+    const plane_t* plane = planes + node->plane;
+
+    // Distances of the box corners furthest in front of, and behind the plane
+    float front = -plane->dist;
+    float back = -plane->dist;
+    for (int axis = 0; axis < 3; axis ++) {
+      const float n = plane->normal[axis];
+      front += n * (n > 0 ? maxs[axis] : mins[axis]);
+      back += n * (n > 0 ? mins[axis] : maxs[axis]);
+    }
+
+    if (front >= 0) {
+      stack.push_back(node->children[0]);
+    }
+    if (back < 0) {
+      stack.push_back(node->children[1]);
+    }
+  }
+
+  return result;
+}
+
+bool header_t::isValid(size_t length) const {
+  if (length < sizeof(header_t) || strncmp(magic, "IBSP", 4) != 0) {
+    return false;
+  }
+
+  for (const direntry_t& entry : direntries) {
+    if (entry.offset < 0 || entry.length < 0 || (size_t) entry.offset + (size_t) entry.length > length) {
+      return false;
+    }
+  }
+
+  return true;
+}
+
+size_t header_t::fileLength() const {
+  size_t length = sizeof(header_t);
+  for (const direntry_t& entry : direntries) {
+    length = std::max(length, (size_t) entry.offset + entry.length);
+  }
+  return length;
+}
+
+vector<unordered_map<string, string>> header_t::parseEntities() const {
+  // Looks like: { "classname" "worldspawn" "message" "Aerowalk" } { ... }
+  const char* text = (const char*) this + entitiesEntry()->offset;
+  const char* end = text + entitiesEntry()->length;
+
+  vector<unordered_map<string, string>> entities;
+  vector<string> tokens;
+
+  for (const char* c = text; c < end && *c; c ++) {
+    if (*c == '{') {
+      entities.push_back({});
+      tokens.clear();
+    } else if (*c == '"') {
+      const char* start = ++ c;
+      while (c < end && *c != '"') {
+        c ++;
+      }
+      tokens.push_back(string(start, c));
+      if (tokens.size() == 2 && !entities.empty()) {
+        entities.back()[tokens[0]] = tokens[1];
+        tokens.clear();
+      }
+    }
+  }
+
+  return entities;
+}
+
+optional<header_t::spawn_point_t> header_t::findSpawnPoint() const {
+  // The first info_player_start is kept in case there's no deathmatch one
+  optional<spawn_point_t> start;
+  for (const auto& entity : parseEntities()) {
+    const auto it = entity.find("classname");
+    if (it == entity.end() || !entity.count("origin")) {
+      continue;
+    }
+    const bool deathmatch = it->second == "info_player_deathmatch";
+    if (!deathmatch && (it->second != "info_player_start" || start)) {
+      continue;
+    }
+
+    spawn_point_t spawnPoint = { glm::vec3(0), 0 };
+    if (sscanf(entity.at("origin").c_str(), "%f %f %f", &spawnPoint.origin.x, &spawnPoint.origin.y, &spawnPoint.origin.z) != 3) {
+      continue;
+    }
+    if (entity.count("angle")) {
+      spawnPoint.angle = atof(entity.at("angle").c_str());
+    }
+    if (deathmatch) {
+      return spawnPoint;
+    }
+    start = spawnPoint;
+  }
+
+  return start;
+}
+
+bool header_t::isClusterVisible(int fromCluster, int toCluster) const {
+  const visdata_t* visdata = this->visdata();
+  if (!visdata || fromCluster < 0 || toCluster < 0) {
+    return true;
+  }
+
+  const unsigned char* vecs = (const unsigned char*) (visdata + 1);
+  return vecs[fromCluster * visdata->sz_vecs + toCluster / 8] & (1 << (toCluster % 8));
+}
+
 void header_t::print() const {
   printf("map {\n");
   printf(" magic: %s\n", this->magic);
@@ -11,6 +11,31 @@ namespace BSP {
     BILLBOARD = 4
   };
 
+  // Indices into header_t::direntries
+  enum class Lump : int {
+    ENTITIES = 0,
+    TEXTURES = 1,
+    PLANES = 2,
+    NODES = 3,
+    LEAVES = 4,
+    LEAFFACES = 5,
+    LEAFBRUSHES = 6,
+    MODELS = 7,
+    BRUSHES = 8,
+    BRUSHSIDES = 9,
+    VERTICES = 10,
+    MESHVERTS = 11,
+    EFFECTS = 12,
+    FACES = 13,
+    LIGHTMAPS = 14,
+    LIGHTVOLS = 15,
+    VISDATA = 16
+  };
+  const int kNumLumps = 17;
+
+  // Content flags (texture_t::contents)
+  const int CONTENTS_SOLID = 1;
+
   struct direntry_t {
     int offset;
     int length;
@@ -22,6 +47,42 @@ namespace BSP {
     int contents; // Content flags?
   };
 
+  struct plane_t {
+    float normal[3]; // Plane normal.
+    float dist; // Distance from origin to plane along normal.
+  };
+
+  struct node_t {
+    int plane; // Plane index.
+    int children[2]; // Children indices. Negative numbers are leaf indices: -(leaf+1).
+    int mins[3]; // Integer bounding box min coord.
+    int maxs[3]; // Integer bounding box max coord.
+  };
+
+  struct leaf_t {
+    int cluster; // Visdata cluster index. Negative means the leaf is outside the map.
+    int area; // Areaportal area.
+    int mins[3]; // Integer bounding box min coord.
+    int maxs[3]; // Integer bounding box max coord.
+    int leafface; // First leafface for leaf.
+    int n_leaffaces; // Number of leaffaces for leaf.
+    int leafbrush; // First leafbrush for leaf.
+    int n_leafbrushes; // Number of leafbrushes for leaf.
+  };
+
+  struct leafface_t {
+    int face; // Face index.
+  };
+
+  struct model_t {
+    float mins[3]; // Bounding box min coord.
+    float maxs[3]; // Bounding box max coord.
+    int face; // First face for model.
+    int n_faces; // Number of faces for model.
+    int brush; // First brush for model.
+    int n_brushes; // Number of brushes for model.
+  };
+
   struct vertex_t {
     float position[3];
     float texcoord[2]; // Vertex texture coordinates.
@@ -60,6 +121,12 @@ namespace BSP {
     int offset; // Vertex index offset, relative to first vertex of corresponding face.
   };
 
+  struct visdata_t {
+    int n_vecs; // Number of vectors (one per cluster).
+    int sz_vecs; // Size of each vector, in bytes.
+    // unsigned char vecs[n_vecs * sz_vecs] follows: bit `b` of vector `a` is set if cluster b is visible from cluster a.
+  };
+
   struct lightmap_t {
     unsigned char map[128 * 128 * 3];
   };
@@ -67,7 +134,27 @@ namespace BSP {
   struct header_t {
     char magic[4];
     int version;
-    direntry_t direntries[17];
+    direntry_t direntries[kNumLumps];
+
+    // Checks the magic number and that every lump fits within `length` bytes.
+    // The lump accessors below read straight from the file's memory, so this
+    // must pass before using any of them on untrusted data.
+    bool isValid(size_t length) const;
+
+    // How far the header and lumps reach, ie. the file's length
+    size_t fileLength() const;
+
+    // Entities	Game-related object descriptions, as text.
+    const direntry_t* entitiesEntry() const { return direntries + 0; }
+    vector<unordered_map<string, string>> parseEntities() const;
+
+    // Where the player starts: the first info_player_deathmatch (or
+    // info_player_start), facing `angle` degrees around the z axis.
+    struct spawn_point_t {
+      glm::vec3 origin;
+      float angle;
+    };
+    optional<spawn_point_t> findSpawnPoint() const;
 
     // Surface descriptions (assume these have been converted to OpenGL textures).
     const direntry_t* texturesEntry() const { return direntries + 1; }
@@ -80,18 +167,48 @@ namespace BSP {
 
     // Planes	Planes used by map geometry.
     const direntry_t* planesEntry() const { return direntries + 2; }
+    int numPlanes() const {
+      return planesEntry()->length / sizeof(plane_t);
+    }
+    const plane_t* planes() const {
+      return (const plane_t*) ((char*) this + planesEntry()->offset);
+    }
 
     // Nodes	BSP tree nodes.
     const direntry_t* nodesEntry() const { return direntries + 3; }
+    int numNodes() const {
+      return nodesEntry()->length / sizeof(node_t);
+    }
+    const node_t* nodes() const {
+      return (const node_t*) ((char*) this + nodesEntry()->offset);
+    }
 
     // Leaves	BSP tree leaves.
     const direntry_t* leavesEntry() const { return direntries + 4; }
+    int numLeaves() const {
+      return leavesEntry()->length / sizeof(leaf_t);
+    }
+    const leaf_t* leaves() const {
+      return (const leaf_t*) ((char*) this + leavesEntry()->offset);
+    }
 
     // Leaffaces	Lists of face indices, one list per leaf.
     const direntry_t* leaffacesEntry() const { return direntries + 5; }
+    int numLeaffaces() const {
+      return leaffacesEntry()->length / sizeof(leafface_t);
+    }
+    const leafface_t* leaffaces() const {
+      return (const leafface_t*) ((char*) this + leaffacesEntry()->offset);
+    }
 
     // Models	Descriptions of rigid world geometry in map (we only use model[0]).
     const direntry_t* modelsEntry() const { return direntries + 7; }
+    int numModels() const {
+      return modelsEntry()->length / sizeof(model_t);
+    }
+    const model_t* models() const {
+      return (const model_t*) ((char*) this + modelsEntry()->offset);
+    }
 
     // Vertices	Vertices used to describe faces.
     const direntry_t* verticesEntry() const { return direntries + 10; }
@@ -142,6 +259,22 @@ namespace BSP {
 
     // Visdata	Cluster-cluster visibility data.
     const direntry_t* visdataEntry() const { return direntries + 16; }
+    const visdata_t* visdata() const {
+      if (visdataEntry()->length < (int) sizeof(visdata_t)) {
+        return nullptr;
+      }
+      return (const visdata_t*) ((char*) this + visdataEntry()->offset);
+    }
+
+    // Walks the BSP tree to find the leaf containing `position`.
+    int findLeaf(const glm::vec3& position) const;
+
+    // All the leaves that a box touches.
+    vector<int> findLeaves(const glm::vec3& mins, const glm::vec3& maxs) const;
+
+    // Potentially visible set lookup. Everything is visible from outside the map
+    // (negative clusters), or if the map has no visdata.
+    bool isClusterVisible(int fromCluster, int toCluster) const;
 
     void print() const;
     void printEffects() const;
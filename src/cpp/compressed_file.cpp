@@ -0,0 +1,139 @@
+#include "compressed_file.h"
+
+#include "lz4.h"
+
+#include <algorithm>
+#include <cstring>
+
+using namespace CompressedFile;
+
+bool CompressedFile::isCompressed(const void* data, size_t length) {
+  return length >= 4 && memcmp(data, "QLZ4", 4) == 0;
+}
+
+vector<char> CompressedFile::compress(const char* data, size_t length, vector<int> boundaries) {
+  boundaries.push_back(0);
+  boundaries.push_back(length);
+  std::sort(boundaries.begin(), boundaries.end());
+
+  vector<chunk_t> chunks;
+  for (int i = 0; i + 1 < (int) boundaries.size(); i ++) {
+    const int start = std::max(0, std::min(boundaries[i], (int) length));
+    const int end = std::max(0, std::min(boundaries[i + 1], (int) length));
+    for (int offset = start; offset < end; offset += kMaxChunkLength) {
+      chunks.push_back({ offset, std::min(kMaxChunkLength, end - offset), 0, 0 });
+    }
+  }
+
+  header_t header;
+  memcpy(header.magic, "QLZ4", 4);
+  header.version = kVersion;
+  header.length = length;
+  header.numChunks = chunks.size();
+
+  vector<char> compressed;
+  vector<char> scratch(LZ4::compressBound(kMaxChunkLength));
+  for (chunk_t& chunk : chunks) {
+    const int compressedLength = LZ4::compress(data + chunk.offset, chunk.length, scratch.data(), scratch.size());
+
+    chunk.compressedOffset = sizeof(header_t) + sizeof(chunk_t) * chunks.size() + compressed.size();
+    if (compressedLength < 0 || compressedLength >= chunk.length) {
+      // Doesn't compress, store it as is
+      chunk.compressedLength = chunk.length;
+      compressed.insert(compressed.end(), data + chunk.offset, data + chunk.offset + chunk.length);
+    } else {
+      chunk.compressedLength = compressedLength;
+      compressed.insert(compressed.end(), scratch.data(), scratch.data() + compressedLength);
+    }
+  }
+
+  vector<char> result;
+  result.insert(result.end(), (const char*) &header, (const char*) &header + sizeof(header));
+  result.insert(result.end(), (const char*) chunks.data(), (const char*) (chunks.data() + chunks.size()));
+  result.insert(result.end(), compressed.begin(), compressed.end());
+  return result;
+}
+
+bool Decoder::readHeader(const char* data, size_t available) {
+  if (_failed) {
+    return false;
+  }
+  if (_hasHeader) {
+    return true;
+  }
+  if (available < sizeof(header_t)) {
+    return false;
+  }
+
+  memcpy(&_header, data, sizeof(header_t));
+  if (!isCompressed(data, available) || _header.version != kVersion || _header.length < 0 || _header.numChunks < 0) {
+    _failed = true;
+    return false;
+  }
+
+  const size_t headerLength = sizeof(header_t) + sizeof(chunk_t) * (size_t) _header.numChunks;
+  if (available < headerLength) {
+    return false;
+  }
+
+  _chunks.resize(_header.numChunks);
+  memcpy(_chunks.data(), data + sizeof(header_t), sizeof(chunk_t) * _chunks.size());
+
+  // Chunks have to cover the output in order, for decode() to report a prefix
+  int expectedOffset = 0;
+  for (const chunk_t& chunk : _chunks) {
+    if (chunk.offset != expectedOffset || chunk.length < 0 || chunk.compressedLength < 0 || chunk.compressedOffset < (int) headerLength) {
+      _failed = true;
+      return false;
+    }
+    expectedOffset += chunk.length;
+  }
+  if (expectedOffset != _header.length) {
+    _failed = true;
+    return false;
+  }
+
+  _hasHeader = true;
+  return true;
+}
+
+int Decoder::decode(const char* data, size_t available, char* destination) {
+  if (!readHeader(data, available)) {
+    return _failed ? -1 : 0;
+  }
+
+  for (; _nextChunk < (int) _chunks.size(); _nextChunk ++) {
+    const chunk_t& chunk = _chunks[_nextChunk];
+    if ((size_t) chunk.compressedOffset + chunk.compressedLength > available) {
+      break; // Still downloading
+    }
+
+    const char* source = data + chunk.compressedOffset;
+    char* output = destination + chunk.offset;
+    if (chunk.compressedLength == chunk.length) {
+      memcpy(output, source, chunk.length);
+    } else if (LZ4::decompress(source, chunk.compressedLength, output, chunk.length) != chunk.length) {
+      _failed = true;
+      return -1;
+    }
+
+    _decodedLength = chunk.offset + chunk.length;
+  }
+
+  return _decodedLength;
+}
+
+optional<pair<void*, int>> CompressedFile::decompress(const void* data, size_t length) {
+  Decoder decoder;
+  if (!decoder.readHeader((const char*) data, length)) {
+    return {};
+  }
+
+  void* result = malloc(std::max(decoder.length(), 1));
+  if (decoder.decode((const char*) data, length, (char*) result) != decoder.length()) {
+    free(result);
+    return {};
+  }
+
+  return make_pair(result, decoder.length());
+}
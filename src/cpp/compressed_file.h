@@ -0,0 +1,66 @@
+#ifndef COMPRESSED_FILE_H
+#define COMPRESSED_FILE_H
+
+#include "support.h"
+
+// A file compressed in independent LZ4 chunks, so it can be decompressed
+// while it downloads -- each chunk as soon as its last byte arrives. Chunks
+// never span a lump boundary (of a BSP or cooked map), so every lump is ready
+// as soon as its own chunks are.
+//
+// Made offline by the cook tool (`cook --compress`). The layout is:
+//
+//   header_t, chunk_t[numChunks], compressed data...
+namespace CompressedFile {
+  const int kVersion = 1;
+
+  // Big enough to compress well, small enough to not wait long for
+  const int kMaxChunkLength = 128 * 1024;
+
+  struct header_t {
+    char magic[4]; // "QLZ4"
+    int version;
+    int length; // Uncompressed
+    int numChunks;
+  };
+
+  struct chunk_t {
+    int offset; // In the uncompressed file
+    int length;
+    int compressedOffset; // In the compressed file
+    int compressedLength; // == length when the chunk is stored as is
+  };
+
+  bool isCompressed(const void* data, size_t length);
+
+  // `boundaries` are offsets (eg. lump offsets) that chunks shouldn't span.
+  vector<char> compress(const char* data, size_t length, vector<int> boundaries);
+
+  // Decompresses a file progressively, as more of it arrives.
+  struct Decoder {
+    // False until the header & chunk table have arrived, or if they're
+    // invalid (see failed()).
+    bool readHeader(const char* data, size_t available);
+    bool failed() const { return _failed; }
+
+    int length() const { return _header.length; }
+
+    // Decompresses every chunk that has fully arrived, straight into
+    // `destination` (length() bytes). Returns how many bytes of the output
+    // are ready -- always from the start -- or -1 if the data is corrupt.
+    int decode(const char* data, size_t available, char* destination);
+
+  private:
+    header_t _header = {};
+    vector<chunk_t> _chunks;
+    bool _hasHeader = false;
+    bool _failed = false;
+    int _nextChunk = 0;
+    int _decodedLength = 0;
+  };
+
+  // For files that are already all there. Returns a malloc'd buffer.
+  optional<pair<void*, int>> decompress(const void* data, size_t length);
+}
+
+#endif
@@ -0,0 +1,467 @@
+#include "cooked_map.h"
+
+#include "assert.h"
+#include "hash.h"
+#include "texture_compression.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+
+using namespace Cooked;
+
+uint64_t Cooked::sourceHash(const BSPMap* map) {
+  // The cook bakes in most lumps (lightmaps, textures, the PVS...), and a
+  // re-lit map can keep every lump's size, so it's the whole file
+  return Hash::xxh64(map, map->fileLength());
+}
+
+bool header_t::isValid(size_t length) const {
+  if (length < sizeof(header_t) || strncmp(magic, "QCMP", 4) != 0 || version != kVersion) {
+    return false;
+  }
+
+  for (const BSP::direntry_t& entry : direntries) {
+    if (entry.offset < 0 || entry.length < 0 || (size_t) entry.offset + (size_t) entry.length > length) {
+      return false;
+    }
+  }
+
+  const size_t atlasLength = (size_t) lightmapAtlasWidth * lightmapAtlasHeight * 3;
+  const size_t compressedAtlasLength = TextureCompression::compressedLength(
+    TextureCompression::BC3, lightmapAtlasWidth, lightmapAtlasHeight);
+  return lightmapAtlasEntry()->length == (int) atlasLength
+    && compressedLightmapAtlasEntry()->length == (int) compressedAtlasLength;
+}
+
+bool header_t::matches(const BSPMap* map) const {
+  return sourceHash == Cooked::sourceHash(map);
+}
+
+struct TesselatedPatch {
+  vector<BSP::vertex_t> vertices;
+  vector<int> indices;
+};
+
+static TesselatedPatch tesselatedPatch(int L, const vector<BSP::vertex_t>& controls) {
+  // The body of this method is borrowed from: http://graphics.cs.brown.edu/games/quake/quake3.html#RenderingFaces
+  // Thank you, Morgan McGuire!
+
+  TesselatedPatch result;
+
+  // The number of vertices along a side is 1 + num edges
+  const int L1 = L + 1;
+  result.vertices.resize(L1 * L1);
+
+  // 0 1 2
+  // 3 4 5
+  // 6 7 8
+
+  for (int col = 0; col <= L; ++col) { // Fill in the first row
+    double a = (double)col / L;
+    double b = 1 - a;
+
+    result.vertices[col] =
+        controls[0] * (b * b) +
+        controls[3] * (2 * b * a) +
+        controls[6] * (a * a);
+  }
+
+  for (int row = 1; row <= L; ++row) { // Fill in each next row
+    double a = (double)row / L;
+    double b = 1.0 - a;
+
+    BSP::vertex_t temp[3];
+    const auto helper = [&controls, a, b](int controlRow) {
+      return
+        controls[controlRow * 3 + 0] * (b * b) +
+        controls[controlRow * 3 + 1] * (2 * b * a) +
+        controls[controlRow * 3 + 2] * (a * a);
+    };
+    temp[0] = helper(0);
+    temp[1] = helper(1);
+    temp[2] = helper(2);
+
+    for(int col = 0; col <= L; ++col) {
+      double a = (double)col / L;
+      double b = 1.0 - a;
+
+      result.vertices[row * L1 + col]=
+          temp[0] * (b * b) +
+          temp[1] * (2 * b * a) +
+          temp[2] * (a * a);
+    }
+  }
+
+  // Compute the indices
+  for (int row = 0; row < L; ++row) {
+    for(int col = 0; col < L; ++col)	{
+      result.indices.push_back((row + 0) * L1 + (col + 0));
+      result.indices.push_back((row + 1) * L1 + (col + 0));
+      result.indices.push_back((row + 1) * L1 + (col + 1));
+
+      result.indices.push_back((row + 0) * L1 + (col + 0));
+      result.indices.push_back((row + 1) * L1 + (col + 1));
+      result.indices.push_back((row + 0) * L1 + (col + 1));
+    }
+  }
+
+  return result;
+}
+
+static TesselatedPatch tesselatedFace(const BSPMap* map, const BSP::face_t* face) {
+  assert(face->type == (int) BSP::FaceType::PATCH);
+
+  const BSP::vertex_t* faceVertices = map->vertices() + face->vertex;
+
+  int numVerticesWidth = face->size[0];
+  int numVerticesHeight = face->size[1];
+
+  assert(numVerticesWidth * numVerticesHeight == face->n_vertices);
+
+  int numRows = (numVerticesHeight - 1) / 2;
+  int numCols  = (numVerticesWidth - 1) / 2;
+
+  int tesselationLevel = 7;
+
+  vector<TesselatedPatch> allPatches;
+
+  for (int row = 0; row < numRows; row ++) {
+    for (int col = 0; col < numCols; col ++) {
+      const BSP::vertex_t* patchVertices = faceVertices + row * 2 * numVerticesWidth + col * 2;
+
+      vector<BSP::vertex_t> controlPoints; // this seems readable to me!
+      controlPoints.resize(9);
+      controlPoints[0] = patchVertices[0 * numVerticesWidth + 0];
+      controlPoints[1] = patchVertices[0 * numVerticesWidth + 1];
+      controlPoints[2] = patchVertices[0 * numVerticesWidth + 2];
+      controlPoints[3] = patchVertices[1 * numVerticesWidth + 0];
+      controlPoints[4] = patchVertices[1 * numVerticesWidth + 1];
+      controlPoints[5] = patchVertices[1 * numVerticesWidth + 2];
+      controlPoints[6] = patchVertices[2 * numVerticesWidth + 0];
+      controlPoints[7] = patchVertices[2 * numVerticesWidth + 1];
+      controlPoints[8] = patchVertices[2 * numVerticesWidth + 2];
+
+      allPatches.push_back(tesselatedPatch(tesselationLevel, controlPoints));
+    }
+  }
+
+  TesselatedPatch result;
+
+  for (const TesselatedPatch& patch : allPatches) {
+    int startingVertexIndex = result.vertices.size();
+    result.vertices.insert(result.vertices.end(), patch.vertices.begin(), patch.vertices.end());
+    for (int index : patch.indices) {
+      result.indices.push_back(startingVertexIndex + index);
+    }
+  }
+
+  return result;
+}
+
+// Polygons & meshes as they are, patches tesselated. Indices are relative to
+// the face's first vertex.
+static optional<TesselatedPatch> faceGeometry(const BSPMap* map, const BSP::face_t* face) {
+  if (face->type == (int) BSP::FaceType::POLYGON || face->type == (int) BSP::FaceType::MESH) {
+    const BSP::vertex_t* faceVertices = map->vertices() + face->vertex;
+    const BSP::meshvert_t* faceMeshverts = map->meshverts() + face->meshvert;
+
+    TesselatedPatch result;
+    result.vertices.assign(faceVertices, faceVertices + face->n_vertices);
+    for (int i = 0; i < face->n_meshverts; i ++) {
+      result.indices.push_back(faceMeshverts[i].offset);
+    }
+    return result;
+  } else if (face->type == (int) BSP::FaceType::PATCH) {
+    return tesselatedFace(map, face);
+  }
+
+  return {};
+}
+
+// Tom Forsyth's "Linear-Speed Vertex Cache Optimisation": greedily picks the
+// next triangle by how recently its vertices were used, and how many of their
+// triangles are left (so stragglers get finished off).
+static void optimizeVertexCache(vector<int>& indices, int numVertices) {
+  const int kCacheSize = 32;
+  const int numTriangles = indices.size() / 3;
+
+  vector<vector<int>> trianglesForVertex(numVertices);
+  for (int triangle = 0; triangle < numTriangles; triangle ++) {
+    for (int corner = 0; corner < 3; corner ++) {
+      trianglesForVertex[indices[triangle * 3 + corner]].push_back(triangle);
+    }
+  }
+
+  vector<int> remaining(numVertices);
+  vector<int> cachePosition(numVertices, -1);
+  vector<float> vertexScore(numVertices);
+  for (int vertex = 0; vertex < numVertices; vertex ++) {
+    remaining[vertex] = trianglesForVertex[vertex].size();
+  }
+
+  const auto scoreVertex = [&](int vertex) {
+    if (remaining[vertex] == 0) {
+      return -1.0f;
+    }
+
+    float score = 0;
+    const int position = cachePosition[vertex];
+    if (position >= 0) {
+      // The last triangle's vertices all score the same, whatever order they
+      // were added in
+      score = position < 3 ? 0.75f : powf(1.0f - float(position - 3) / (kCacheSize - 3), 1.5f);
+    }
+    return score + 2.0f * powf(float(remaining[vertex]), -0.5f);
+  };
+
+  vector<bool> added(numTriangles, false);
+  vector<float> triangleScore(numTriangles);
+  const auto scoreTriangle = [&](int triangle) {
+    triangleScore[triangle] =
+      vertexScore[indices[triangle * 3 + 0]] +
+      vertexScore[indices[triangle * 3 + 1]] +
+      vertexScore[indices[triangle * 3 + 2]];
+  };
+
+  for (int vertex = 0; vertex < numVertices; vertex ++) {
+    vertexScore[vertex] = scoreVertex(vertex);
+  }
+  for (int triangle = 0; triangle < numTriangles; triangle ++) {
+    scoreTriangle(triangle);
+  }
+
+  vector<int> cache; // Most recently used first
+  vector<int> result;
+  result.reserve(indices.size());
+
+  for (int step = 0; step < numTriangles; step ++) {
+    // Usually the best triangle uses a cached vertex. If not, start anew from
+    // the best one left.
+    int best = -1;
+    for (int vertex : cache) {
+      for (int triangle : trianglesForVertex[vertex]) {
+        if (!added[triangle] && (best < 0 || triangleScore[triangle] > triangleScore[best])) {
+          best = triangle;
+        }
+      }
+    }
+    if (best < 0) {
+      for (int triangle = 0; triangle < numTriangles; triangle ++) {
+        if (!added[triangle] && (best < 0 || triangleScore[triangle] > triangleScore[best])) {
+          best = triangle;
+        }
+      }
+    }
+
+    added[best] = true;
+    for (int corner = 0; corner < 3; corner ++) {
+      const int vertex = indices[best * 3 + corner];
+      result.push_back(vertex);
+      remaining[vertex] --;
+
+      auto it = std::find(cache.begin(), cache.end(), vertex);
+      if (it != cache.end()) {
+        cache.erase(it);
+      }
+      cache.insert(cache.begin(), vertex);
+    }
+
+    // Everything that moved in (or out of) the cache needs a new score
+    vector<int> changed = cache;
+    while ((int) cache.size() > kCacheSize) {
+      cachePosition[cache.back()] = -1;
+      cache.pop_back();
+    }
+    for (int i = 0; i < (int) cache.size(); i ++) {
+      cachePosition[cache[i]] = i;
+    }
+    for (int vertex : changed) {
+      vertexScore[vertex] = scoreVertex(vertex);
+    }
+    for (int vertex : changed) {
+      for (int triangle : trianglesForVertex[vertex]) {
+        if (!added[triangle]) {
+          scoreTriangle(triangle);
+        }
+      }
+    }
+  }
+
+  indices = result;
+}
+
+// Renumbers the vertices in the order the triangles first use them, so that
+// vertex fetches walk forward through memory. Unused vertices are dropped.
+static void optimizeVertexFetch(TesselatedPatch& geometry) {
+  vector<int> newIndex(geometry.vertices.size(), -1);
+  vector<BSP::vertex_t> vertices;
+  vertices.reserve(geometry.vertices.size());
+
+  for (int& index : geometry.indices) {
+    if (newIndex[index] < 0) {
+      newIndex[index] = vertices.size();
+      vertices.push_back(geometry.vertices[index]);
+    }
+    index = newIndex[index];
+  }
+
+  geometry.vertices = vertices;
+}
+
+struct LightmapAtlas {
+  int columns;
+  int width;
+  int height;
+  int whiteTile;
+  vector<unsigned char> pixels;
+};
+
+static LightmapAtlas packLightmaps(const BSPMap* map) {
+  const int numLightmaps = map->numLightmaps();
+  const int numTiles = numLightmaps + 1;
+
+  LightmapAtlas atlas;
+  atlas.columns = (int) ceil(sqrt((double) numTiles));
+  atlas.width = atlas.columns * kLightmapSize;
+  atlas.height = ((numTiles + atlas.columns - 1) / atlas.columns) * kLightmapSize;
+  atlas.whiteTile = numLightmaps;
+  atlas.pixels.resize(atlas.width * atlas.height * 3, 0);
+
+  const int rowLength = kLightmapSize * 3;
+  for (int tile = 0; tile < numTiles; tile ++) {
+    const int x = (tile % atlas.columns) * kLightmapSize;
+    const int y = (tile / atlas.columns) * kLightmapSize;
+    for (int row = 0; row < kLightmapSize; row ++) {
+      unsigned char* destination = atlas.pixels.data() + ((y + row) * atlas.width + x) * 3;
+      if (tile == atlas.whiteTile) {
+        memset(destination, 255, rowLength);
+      } else {
+        memcpy(destination, map->lightmaps()[tile].map + row * rowLength, rowLength);
+      }
+    }
+  }
+
+  return atlas;
+}
+
+static Cooked::vertex_t cookVertex(const BSP::vertex_t& vertex, const LightmapAtlas& atlas, int lightmapIndex) {
+  Cooked::vertex_t result;
+  memcpy(result.position, vertex.position, sizeof(result.position));
+  memcpy(result.texcoord, vertex.texcoord, sizeof(result.texcoord));
+
+  const bool hasLightmap = lightmapIndex >= 0 && lightmapIndex < atlas.whiteTile;
+  const int tile = hasLightmap ? lightmapIndex : atlas.whiteTile;
+  const int tileX = (tile % atlas.columns) * kLightmapSize;
+  const int tileY = (tile / atlas.columns) * kLightmapSize;
+
+  for (int axis = 0; axis < 2; axis ++) {
+    const float local = hasLightmap ? std::min(std::max(vertex.lmcoord[axis], 0.0f), 1.0f) : 0.5f;
+    const float origin = axis == 0 ? tileX : tileY;
+    const float size = axis == 0 ? atlas.width : atlas.height;
+    const float global = (origin + local * kLightmapSize) / size;
+    result.lmcoord[axis] = (uint16_t) lroundf(global * 65535.0f);
+  }
+
+  return result;
+}
+
+template<typename T>
+static void appendLump(vector<char>& file, BSP::direntry_t& entry, const T* data, size_t count) {
+  // Keep every lump 4-byte aligned
+  while (file.size() % 4 != 0) {
+    file.push_back(0);
+  }
+
+  entry.offset = file.size();
+  entry.length = sizeof(T) * count;
+  file.insert(file.end(), (const char*) data, (const char*) data + entry.length);
+}
+
+vector<char> Cooked::cook(const BSPMap* map) {
+  const BSP::face_t* faces = map->faces();
+  const int numTextures = map->numTextures();
+  const LightmapAtlas atlas = packLightmaps(map);
+
+  // Sort by texture, so each texture is one contiguous batch
+  vector<int> faceOrder;
+  for (int faceIndex = 0; faceIndex < map->numFaces(); faceIndex ++) {
+    faceOrder.push_back(faceIndex);
+  }
+  const auto textureOf = [&](int faceIndex) {
+    const int texture = faces[faceIndex].texture;
+    return texture >= 0 && texture < numTextures ? texture : -1;
+  };
+  std::stable_sort(faceOrder.begin(), faceOrder.end(), [&](int a, int b) {
+    return textureOf(a) < textureOf(b);
+  });
+
+  vector<Cooked::vertex_t> vertices;
+  vector<uint32_t> indices;
+  vector<Cooked::face_t> cookedFaces;
+  vector<Cooked::batch_t> batches;
+
+  for (int faceIndex : faceOrder) {
+    const BSP::face_t* face = faces + faceIndex;
+    optional<TesselatedPatch> geometry = faceGeometry(map, face);
+    if (!geometry || geometry->indices.empty()) {
+      continue;
+    }
+
+    optimizeVertexCache(geometry->indices, geometry->vertices.size());
+    optimizeVertexFetch(*geometry);
+
+    Cooked::face_t cookedFace;
+    cookedFace.face = faceIndex;
+    cookedFace.texture = textureOf(faceIndex);
+    cookedFace.firstIndex = indices.size();
+    cookedFace.numIndices = geometry->indices.size();
+
+    const int firstVertex = vertices.size();
+    for (int i = 0; i < 3; i ++) {
+      cookedFace.mins[i] = INFINITY;
+      cookedFace.maxs[i] = -INFINITY;
+    }
+    for (const BSP::vertex_t& vertex : geometry->vertices) {
+      vertices.push_back(cookVertex(vertex, atlas, face->lm_index));
+      for (int i = 0; i < 3; i ++) {
+        cookedFace.mins[i] = std::min(cookedFace.mins[i], vertex.position[i]);
+        cookedFace.maxs[i] = std::max(cookedFace.maxs[i], vertex.position[i]);
+      }
+    }
+    for (int index : geometry->indices) {
+      indices.push_back(firstVertex + index);
+    }
+
+    if (batches.empty() || batches.back().texture != cookedFace.texture) {
+      batches.push_back({ cookedFace.texture, cookedFace.firstIndex, 0 });
+    }
+    batches.back().numIndices += cookedFace.numIndices;
+
+    cookedFaces.push_back(cookedFace);
+  }
+
+  header_t header;
+  memset(&header, 0, sizeof(header));
+  memcpy(header.magic, "QCMP", 4);
+  header.version = kVersion;
+  header.sourceHash = sourceHash(map);
+  header.lightmapAtlasWidth = atlas.width;
+  header.lightmapAtlasHeight = atlas.height;
+
+  vector<char> file(sizeof(header_t));
+  appendLump(file, header.direntries[0], vertices.data(), vertices.size());
+  appendLump(file, header.direntries[1], indices.data(), indices.size());
+  appendLump(file, header.direntries[2], cookedFaces.data(), cookedFaces.size());
+  appendLump(file, header.direntries[3], batches.data(), batches.size());
+  appendLump(file, header.direntries[4], atlas.pixels.data(), atlas.pixels.size());
+  const vector<char> compressedAtlas = TextureCompression::encodeRGBM(atlas.pixels.data(), atlas.width, atlas.height);
+  appendLump(file, header.direntries[5], compressedAtlas.data(), compressedAtlas.size());
+  memcpy(file.data(), &header, sizeof(header));
+
+  cout << "cooked " << cookedFaces.size() << " faces: " << vertices.size() << " vertices, "
+       << indices.size() / 3 << " triangles, " << batches.size() << " batches, "
+       << atlas.width << "x" << atlas.height << " lightmap atlas\n";
+
+  return file;
+}
@@ -0,0 +1,120 @@
+#ifndef COOKED_MAP_H
+#define COOKED_MAP_H
+
+#include "support.h"
+#include "bsp.h"
+
+// A "render-ready" version of a BSP. Everything RenderableBSP used to do on
+// every load -- tesselating patches, building the world buffers, packing the
+// lightmaps -- is done once, offline, by the cook tool (src/cook):
+//
+//   make output/cook && ./output/cook data/aerowalk.bsp data/aerowalk.cooked
+//
+// The file is laid out like a BSP: a header of lumps, each read straight from
+// memory, so loading is one read (or mmap) plus a few buffer uploads. Maps
+// without a cooked file are cooked in memory when they load.
+//
+// The .bsp is still needed alongside it, for the BSP tree, PVS, entities and
+// collision.
+namespace Cooked {
+  const int kVersion = 3;
+  const int kLightmapSize = 128;
+
+  // 24 bytes, vs 44 for BSP::vertex_t. The renderer doesn't use the normals or
+  // vertex colors.
+  struct vertex_t {
+    float position[3];
+    float texcoord[2];
+    uint16_t lmcoord[2]; // Normalized, within the lightmap atlas
+  };
+
+  // One per renderable face. Faces are sorted by texture, so that every
+  // texture's faces are one contiguous range of indices (see batch_t).
+  struct face_t {
+    int face; // Index into the BSP's faces
+    int texture; // Index into the BSP's textures, or -1
+    int firstIndex;
+    int numIndices;
+    float mins[3]; // Bounding box of the tesselated geometry
+    float maxs[3];
+  };
+
+  // Everything drawn with one texture (the lightmaps are all in one atlas).
+  struct batch_t {
+    int texture;
+    int firstIndex;
+    int numIndices;
+  };
+
+  struct header_t {
+    char magic[4]; // "QCMP"
+    int version;
+    uint64_t sourceHash; // See matches()
+    int lightmapAtlasWidth;
+    int lightmapAtlasHeight;
+    BSP::direntry_t direntries[6];
+
+    bool isValid(size_t length) const;
+
+    // Whether this was cooked from `map`.
+    bool matches(const BSPMap* map) const;
+
+    const BSP::direntry_t* verticesEntry() const { return direntries + 0; }
+    int numVertices() const {
+      return verticesEntry()->length / sizeof(vertex_t);
+    }
+    const vertex_t* vertices() const {
+      return (const vertex_t*) ((char*) this + verticesEntry()->offset);
+    }
+
+    // Indices into vertices(), for GL_TRIANGLES. Each face's triangles are in
+    // vertex cache friendly order.
+    const BSP::direntry_t* indicesEntry() const { return direntries + 1; }
+    int numIndices() const {
+      return indicesEntry()->length / sizeof(uint32_t);
+    }
+    const uint32_t* indices() const {
+      return (const uint32_t*) ((char*) this + indicesEntry()->offset);
+    }
+
+    const BSP::direntry_t* facesEntry() const { return direntries + 2; }
+    int numFaces() const {
+      return facesEntry()->length / sizeof(face_t);
+    }
+    const face_t* faces() const {
+      return (const face_t*) ((char*) this + facesEntry()->offset);
+    }
+
+    const BSP::direntry_t* batchesEntry() const { return direntries + 3; }
+    int numBatches() const {
+      return batchesEntry()->length / sizeof(batch_t);
+    }
+    const batch_t* batches() const {
+      return (const batch_t*) ((char*) this + batchesEntry()->offset);
+    }
+
+    // RGB, lightmapAtlasWidth x lightmapAtlasHeight. The last tile is white,
+    // for faces without a lightmap.
+    const BSP::direntry_t* lightmapAtlasEntry() const { return direntries + 4; }
+    const unsigned char* lightmapAtlas() const {
+      return (const unsigned char*) this + lightmapAtlasEntry()->offset;
+    }
+
+    // The same atlas as BC3 blocks, RGBM encoded (see
+    // TextureCompression::encodeRGBM), for contexts that support S3TC.
+    const BSP::direntry_t* compressedLightmapAtlasEntry() const { return direntries + 5; }
+    const char* compressedLightmapAtlas() const {
+      return (const char*) this + compressedLightmapAtlasEntry()->offset;
+    }
+  };
+
+  // Of the whole map
+  uint64_t sourceHash(const BSPMap* map);
+
+  // Returns the contents of the cooked file.
+  vector<char> cook(const BSPMap* map);
+}
+
+using CookedMap = Cooked::header_t;
+
+#endif
@@ -0,0 +1,106 @@
+#include "frustum.h"
+
+#include "simd.h"
+
+void BoundingBoxes::add(const glm::vec3& mins, const glm::vec3& maxs) {
+  minX.push_back(mins.x);
+  minY.push_back(mins.y);
+  minZ.push_back(mins.z);
+  maxX.push_back(maxs.x);
+  maxY.push_back(maxs.y);
+  maxZ.push_back(maxs.z);
+}
+
+Frustum Frustum::fromViewProjection(const glm::mat4& m) {
+  // Gribb & Hartmann: the planes are sums/differences of the matrix rows. glm
+  // is column-major, so row i is (m[0][i], m[1][i], m[2][i], m[3][i]).
+  const auto row = [&m](int i) {
+    return glm::vec4(m[0][i], m[1][i], m[2][i], m[3][i]);
+  };
+
+  Frustum result;
+  result.planes[0] = row(3) + row(0); // Left
+  result.planes[1] = row(3) - row(0); // Right
+  result.planes[2] = row(3) + row(1); // Bottom
+  result.planes[3] = row(3) - row(1); // Top
+  result.planes[4] = row(3) + row(2); // Near
+  result.planes[5] = row(3) - row(2); // Far
+  return result;
+}
+
+bool Frustum::intersects(const glm::vec3& mins, const glm::vec3& maxs, int& planeMask) const {
+  for (int i = 0; i < 6; i ++) {
+    if (!(planeMask & (1 << i))) {
+      continue;
+    }
+
+    const glm::vec4& plane = planes[i];
+
+    // The corner furthest along the plane normal...
+    const float positive =
+      plane.x * (plane.x > 0 ? maxs.x : mins.x) +
+      plane.y * (plane.y > 0 ? maxs.y : mins.y) +
+      plane.z * (plane.z > 0 ? maxs.z : mins.z) + plane.w;
+    if (positive < 0) {
+      return false;
+    }
+
+    // ... and the one furthest against it
+    const float negative =
+      plane.x * (plane.x > 0 ? mins.x : maxs.x) +
+      plane.y * (plane.y > 0 ? mins.y : maxs.y) +
+      plane.z * (plane.z > 0 ? mins.z : maxs.z) + plane.w;
+    if (negative >= 0) {
+      planeMask &= ~(1 << i);
+    }
+  }
+
+  return true;
+}
+
+static float4 gather(const vector<float>& values, const int* indices) {
+  return float4{ values[indices[0]], values[indices[1]], values[indices[2]], values[indices[3]] };
+}
+
+void Frustum::cull(const BoundingBoxes& boxes, const vector<int>& indices, vector<int>& visible) const {
+  const int count = indices.size();
+
+  for (int start = 0; start < count; start += 4) {
+    // Pad the last batch by repeating its last box
+    int batch[4];
+    for (int lane = 0; lane < 4; lane ++) {
+      batch[lane] = indices[std::min(start + lane, count - 1)];
+    }
+
+    const float4 minX = gather(boxes.minX, batch);
+    const float4 minY = gather(boxes.minY, batch);
+    const float4 minZ = gather(boxes.minZ, batch);
+    const float4 maxX = gather(boxes.maxX, batch);
+    const float4 maxY = gather(boxes.maxY, batch);
+    const float4 maxZ = gather(boxes.maxZ, batch);
+
+    int4 outside = { 0, 0, 0, 0 };
+    for (int i = 0; i < 6; i ++) {
+      const glm::vec4& plane = planes[i];
+
+      // The sign of the normal is the same for all lanes, so picking the
+      // positive vertex is just picking which array to read.
+      const float4 distance =
+        SIMD::splat(plane.x) * (plane.x > 0 ? maxX : minX) +
+        SIMD::splat(plane.y) * (plane.y > 0 ? maxY : minY) +
+        SIMD::splat(plane.z) * (plane.z > 0 ? maxZ : minZ) +
+        SIMD::splat(plane.w);
+
+      outside |= distance < 0;
+      if (SIMD::all(outside)) {
+        break;
+      }
+    }
+
+    for (int lane = 0; lane < 4 && start + lane < count; lane ++) {
+      if (!outside[lane]) {
+        visible.push_back(batch[lane]);
+      }
+    }
+  }
+}
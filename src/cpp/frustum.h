@@ -0,0 +1,38 @@
+#ifndef FRUSTUM_H
+#define FRUSTUM_H
+
+#include "support.h"
+
+// Axis-aligned bounding boxes, stored as a structure of arrays so that several
+// boxes can be tested against a plane at once.
+struct BoundingBoxes {
+  void add(const glm::vec3& mins, const glm::vec3& maxs);
+  int size() const { return minX.size(); }
+
+  glm::vec3 mins(int index) const { return glm::vec3(minX[index], minY[index], minZ[index]); }
+  glm::vec3 maxs(int index) const { return glm::vec3(maxX[index], maxY[index], maxZ[index]); }
+
+  vector<float> minX, minY, minZ;
+  vector<float> maxX, maxY, maxZ;
+};
+
+struct Frustum {
+  static const int kAllPlanes = (1 << 6) - 1;
+
+  static Frustum fromViewProjection(const glm::mat4& viewProjection);
+
+  // Tests a single box against the planes in `planeMask`. Returns false if the
+  // box is completely outside. Otherwise, clears the bits of planes that the box
+  // is completely inside of, so children of this box can skip them.
+  bool intersects(const glm::vec3& mins, const glm::vec3& maxs, int& planeMask) const;
+
+  // Tests `boxes[indices[i]]` four at a time and appends the indices of boxes
+  // that are at least partially inside to `visible`.
+  void cull(const BoundingBoxes& boxes, const vector<int>& indices, vector<int>& visible) const;
+
+  // Left, right, bottom, top, near, far. A point p is inside the plane when
+  // dot(plane.xyz, p) + plane.w >= 0.
+  glm::vec4 planes[6];
+};
+
+#endif
@@ -0,0 +1,98 @@
+#include "gl_debug.h"
+
+#include <atomic>
+
+struct CallSite {
+  const char* filename;
+  int line;
+};
+
+static const int kRecentCallsSize = 32;
+static CallSite recentCalls[kRecentCallsSize] = {};
+static int recentCallsHead = 0;
+
+static bool callbackInstalled = false;
+// Without GL_DEBUG_OUTPUT_SYNCHRONOUS, the callback can run on a driver thread
+static std::atomic<int> errorCount(0);
+static int lastCheckedErrorCount = 0;
+
+#ifdef __APPLE__
+static const char* debugSourceName(GLenum source) {
+  switch (source) {
+    case GL_DEBUG_SOURCE_API: return "API";
+    case GL_DEBUG_SOURCE_WINDOW_SYSTEM: return "WINDOW_SYSTEM";
+    case GL_DEBUG_SOURCE_SHADER_COMPILER: return "SHADER_COMPILER";
+    case GL_DEBUG_SOURCE_THIRD_PARTY: return "THIRD_PARTY";
+    case GL_DEBUG_SOURCE_APPLICATION: return "APPLICATION";
+    default: return "OTHER";
+  }
+}
+
+static void GLAPIENTRY debugMessageCallback(
+  GLenum source, GLenum type, GLuint id, GLenum severity,
+  GLsizei length, const GLchar* message, const void* userParam
+) {
+  if (severity == GL_DEBUG_SEVERITY_NOTIFICATION) {
+    return;
+  }
+
+  const bool isError = type == GL_DEBUG_TYPE_ERROR || severity == GL_DEBUG_SEVERITY_HIGH;
+  cerr << "GL_DEBUG " << debugSourceName(source) << " #" << id << ": " << message << "\n";
+
+  if (isError) {
+    errorCount ++;
+    GLDebug::printRecentCalls();
+  }
+}
+#endif
+
+void GLDebug::install() {
+#ifdef __APPLE__
+  if (GLEW_KHR_debug) {
+    glDebugMessageCallback(debugMessageCallback, nullptr);
+    glEnable(GL_DEBUG_OUTPUT);
+    callbackInstalled = true;
+  } else if (GLEW_ARB_debug_output) {
+    glDebugMessageCallbackARB(debugMessageCallback, nullptr);
+    callbackInstalled = true;
+  }
+
+#ifndef NDEBUG
+  if (callbackInstalled) {
+    // Report errors from inside the offending call, so the stack trace is useful
+    glEnable(GL_DEBUG_OUTPUT_SYNCHRONOUS);
+  }
+#endif
+#else
+  // WebGL doesn't expose KHR_debug, errors are only visible through glGetError.
+#endif
+
+  cout << "GL debug output: " << (callbackInstalled ? "callback" : "unavailable") << "\n";
+}
+
+bool GLDebug::hasCallback() {
+  return callbackInstalled;
+}
+
+bool GLDebug::checkpoint(const char* filename, int line) {
+  recentCalls[recentCallsHead] = { filename, line };
+  recentCallsHead = (recentCallsHead + 1) % kRecentCallsSize;
+
+  const int errors = errorCount.load();
+  if (errors == lastCheckedErrorCount) {
+    return false;
+  }
+
+  lastCheckedErrorCount = errors;
+  return true;
+}
+
+void GLDebug::printRecentCalls() {
+  cerr << "recent GL checkpoints (oldest first):\n";
+  for (int i = 0; i < kRecentCallsSize; i ++) {
+    const CallSite& call = recentCalls[(recentCallsHead + i) % kRecentCallsSize];
+    if (call.filename) {
+      cerr << "  " << call.filename << ":" << call.line << "\n";
+    }
+  }
+}
@@ -0,0 +1,25 @@
+#ifndef GL_DEBUG_H
+#define GL_DEBUG_H
+
+#include "support.h"
+
+// Collects GL errors without stalling the pipeline on glGetError.
+//
+// When the context exposes KHR_debug (or GL_ARB_debug_output), the driver
+// reports errors through a message callback. Every hasErrors() call site is
+// recorded in a small ring buffer, so when an error arrives we can print the
+// calls that led up to it.
+namespace GLDebug {
+  // Installs the message callback if the context supports one. Call this once,
+  // after the GL context has been created.
+  void install();
+  bool hasCallback();
+
+  // Records a call site and returns true if the callback reported any errors
+  // since the previous checkpoint. Never calls glGetError.
+  bool checkpoint(const char* filename, int line);
+
+  void printRecentCalls();
+}
+
+#endif
@@ -1,9 +1,10 @@
 #include "gl_helpers.h"
+#include "program_cache.h"
 
 #include <regex>
 
 bool _hasErrors(const char *filename, int line) {
-  bool errored = false;
+  bool errored = GLDebug::checkpoint(filename, line);
 
   GLenum error;
   while ((error = glGetError()) != GL_NO_ERROR) {
@@ -70,6 +71,11 @@ optional<GLuint> GLHelpers::compileShaderProgram(const char* vert, int vertLengt
     frag = fixedFrag.c_str();
     fragLength -= 3;
   }
+
+  const string cacheKey = ProgramCache::key(vert, vertLength, frag, fragLength);
+  if (optional<GLuint> cachedProgram = ProgramCache::load(cacheKey)) {
+    return cachedProgram;
+  }
 #else
 #endif
 
@@ -91,11 +97,28 @@ optional<GLuint> GLHelpers::compileShaderProgram(const char* vert, int vertLengt
     return {};
   }
 
+#ifdef __APPLE__
+  glProgramParameteri(shaderProgram, GL_PROGRAM_BINARY_RETRIEVABLE_HINT, GL_TRUE);
+#endif
+
   glLinkProgram(shaderProgram);
   if (hasErrors()) {
     return {};
   }
 
+  GLint status;
+  glGetProgramiv(shaderProgram, GL_LINK_STATUS, &status);
+  if (status != GL_TRUE) {
+    char buffer[512];
+    glGetProgramInfoLog(shaderProgram, 512, NULL, buffer);
+    cerr << "Failed to link program: \n" << buffer << "\n\n";
+    return {};
+  }
+
+#ifdef __APPLE__
+  ProgramCache::store(cacheKey, shaderProgram);
+#endif
+
   return shaderProgram;
 }
 
@@ -134,8 +157,57 @@ optional<GLuint> GLHelpers::loadTexture(const void* image, int width, int height
   return tex;
 }
 
+const GLHelpers::CompressedFormats& GLHelpers::compressedFormats() {
+  static optional<CompressedFormats> formats;
+  if (formats) {
+    return *formats;
+  }
+
+  formats = CompressedFormats();
+  GLint numExtensions = 0;
+  glGetIntegerv(GL_NUM_EXTENSIONS, &numExtensions);
+  for (int i = 0; i < numExtensions; i ++) {
+    const char* extension = (const char*) glGetStringi(GL_EXTENSIONS, i);
+    if (!extension) {
+      continue;
+    }
+    // Emscripten reports WebGL's extensions with a GL_ prefix
+    const string name = extension;
+    if (name == "GL_EXT_texture_compression_s3tc" || name == "GL_WEBGL_compressed_texture_s3tc") {
+      formats->s3tc = true;
+    }
+  }
+
+  cout << "compressed texture formats: " << (formats->s3tc ? "S3TC" : "none") << "\n";
+  return *formats;
+}
+
+optional<GLuint> GLHelpers::loadCompressedTexture(const void* blocks, int length, int width, int height, GLenum internalFormat) {
+  GLuint tex;
+  glGenTextures(1, &tex);
+  glBindTexture(GL_TEXTURE_2D, tex);
+
+  glCompressedTexImage2D(GL_TEXTURE_2D, 0, internalFormat, width, height, 0, length, blocks);
+
+  glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_REPEAT);
+  glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_REPEAT);
+  glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+  glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+
+  if (hasErrors()) {
+    warn << "failed to load compressed texture\n";
+    glDeleteTextures(1, &tex);
+    return {};
+  }
+
+  warn << "loaded compressed texture with dimensions " << width << ", " << height << " into " << tex << "\n";
+
+  return tex;
+}
+
 VBO GLHelpers::generateRandomColorsVBO(int num) {
-  float values[num * 3];
+  // On the heap -- this is used for the whole world's vertices at once
+  vector<float> values(num * 3);
   for (int i = 0; i < num * 3; i ++) {
     values[i] = 0.5 + 0.5 * float(rand())/float(RAND_MAX);
   }
@@ -144,7 +216,7 @@ VBO GLHelpers::generateRandomColorsVBO(int num) {
 
   glGenBuffers(1, &(result.buffer));
   glBindBuffer(GL_ARRAY_BUFFER, result.buffer);
-  glBufferData(GL_ARRAY_BUFFER, sizeof(values), values, GL_STATIC_DRAW);
+  glBufferData(GL_ARRAY_BUFFER, sizeof(float) * values.size(), values.data(), GL_STATIC_DRAW);
 
   result.stride = sizeof(float) * 3;
 
@@ -3,8 +3,17 @@
 
 #include "support.h"
 
+#include "gl_debug.h"
+
 bool _hasErrors(const char *filename, int line);
+
+// glGetError forces a pipeline sync, so release builds only look at what the
+// debug callback reported (see GLDebug). Debug builds check after every call.
+#ifdef NDEBUG
+#define hasErrors() GLDebug::checkpoint(__FILE__, __LINE__)
+#else
 #define hasErrors() _hasErrors(__FILE__, __LINE__)
+#endif
 
 struct EBO {
   GLuint buffer;
@@ -27,6 +36,15 @@ namespace GLHelpers {
     GLenum internalFormat = GL_RGBA,
     GLenum format = GL_RGBA,
     GLenum type = GL_UNSIGNED_BYTE);
+
+  // Block-compressed formats the context can sample from. Looked up once.
+  struct CompressedFormats {
+    bool s3tc = false; // BC1 - BC3, see TextureCompression
+  };
+  const CompressedFormats& compressedFormats();
+
+  // One level, no mipmaps. `length` bytes of `blocks` in `internalFormat`.
+  optional<GLuint> loadCompressedTexture(const void* blocks, int length, int width, int height, GLenum internalFormat);
   VBO generateRandomColorsVBO(int num);
 }
 
@@ -0,0 +1,83 @@
+#include "hash.h"
+
+#include <string.h>
+
+static const uint64_t kPrime1 = 11400714785074694791ull;
+static const uint64_t kPrime2 = 14029467366897019727ull;
+static const uint64_t kPrime3 = 1609587929392839161ull;
+static const uint64_t kPrime4 = 9650029242287828579ull;
+static const uint64_t kPrime5 = 2870177450012600261ull;
+
+static inline uint64_t rotl(uint64_t value, int bits) {
+  return (value << bits) | (value >> (64 - bits));
+}
+
+static inline uint64_t read64(const unsigned char* p) {
+  uint64_t value;
+  memcpy(&value, p, sizeof(value));
+  return value;
+}
+
+static inline uint32_t read32(const unsigned char* p) {
+  uint32_t value;
+  memcpy(&value, p, sizeof(value));
+  return value;
+}
+
+static inline uint64_t accumulate(uint64_t acc, uint64_t input) {
+  acc += input * kPrime2;
+  return rotl(acc, 31) * kPrime1;
+}
+
+static inline uint64_t mergeRound(uint64_t acc, uint64_t lane) {
+  acc ^= accumulate(0, lane);
+  return acc * kPrime1 + kPrime4;
+}
+
+uint64_t Hash::xxh64(const void* data, size_t length, uint64_t seed) {
+  const unsigned char* p = (const unsigned char*) data;
+  const unsigned char* end = p + length;
+  uint64_t hash;
+
+  if (length >= 32) {
+    uint64_t v1 = seed + kPrime1 + kPrime2;
+    uint64_t v2 = seed + kPrime2;
+    uint64_t v3 = seed;
+    uint64_t v4 = seed - kPrime1;
+    for (; p + 32 <= end; p += 32) {
+      v1 = accumulate(v1, read64(p));
+      v2 = accumulate(v2, read64(p + 8));
+      v3 = accumulate(v3, read64(p + 16));
+      v4 = accumulate(v4, read64(p + 24));
+    }
+    hash = rotl(v1, 1) + rotl(v2, 7) + rotl(v3, 12) + rotl(v4, 18);
+    hash = mergeRound(hash, v1);
+    hash = mergeRound(hash, v2);
+    hash = mergeRound(hash, v3);
+    hash = mergeRound(hash, v4);
+  } else {
+    hash = seed + kPrime5;
+  }
+  hash += length;
+
+  for (; p + 8 <= end; p += 8) {
+    hash ^= accumulate(0, read64(p));
+    hash = rotl(hash, 27) * kPrime1 + kPrime4;
+  }
+  if (p + 4 <= end) {
+    hash ^= read32(p) * kPrime1;
+    hash = rotl(hash, 23) * kPrime2 + kPrime3;
+    p += 4;
+  }
+  for (; p < end; p ++) {
+    hash ^= *p * kPrime5;
+    hash = rotl(hash, 11) * kPrime1;
+  }
+
+  hash ^= hash >> 33;
+  hash *= kPrime2;
+  hash ^= hash >> 29;
+  hash *= kPrime3;
+  hash ^= hash >> 32;
+  return hash;
+}
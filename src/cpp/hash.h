@@ -0,0 +1,14 @@
+#ifndef HASH_H
+#define HASH_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+namespace Hash {
+  // XXH64: 4 independent lanes over 32 byte stripes, so it goes at close to
+  // memory speed, which matters since we hash every texture as it arrives,
+  // and whole maps. Fast rather than cryptographic.
+  uint64_t xxh64(const void* data, size_t length, uint64_t seed = 0);
+}
+
+#endif
@@ -0,0 +1,927 @@
+#include "image_decoder.h"
+
+#include "inflate.h"
+#include "simd.h"
+
+#include <algorithm>
+#include <cstring>
+#include <memory>
+
+using namespace ImageDecoder;
+
+// Bigger than any texture, small enough that a corrupt header can't make us
+// allocate gigabytes
+static const size_t kMaxPixels = 1 << 26;
+
+static optional<Image> allocateImage(int width, int height) {
+  if (width <= 0 || height <= 0 || (size_t) width * height > kMaxPixels) {
+    return {};
+  }
+  void* pixels = malloc((size_t) width * height * 4);
+  if (!pixels) {
+    return {};
+  }
+  return Image { pixels, width, height, width, height };
+}
+
+//
+// JPEG
+//
+
+namespace {
+  const uint8_t kZigzag[64] = {
+    0, 1, 8, 16, 9, 2, 3, 10, 17, 24, 32, 25, 18, 11, 4, 5,
+    12, 19, 26, 33, 40, 48, 41, 34, 27, 20, 13, 6, 7, 14, 21, 28,
+    35, 42, 49, 56, 57, 50, 43, 36, 29, 22, 15, 23, 30, 37, 44, 51,
+    58, 59, 52, 45, 38, 31, 39, 46, 53, 60, 61, 54, 47, 55, 62, 63
+  };
+
+  const int kFastBits = 9;
+
+  // Codes up to kFastBits long are looked up in one step, longer ones are
+  // compared against the largest code of each length.
+  struct JpegHuffman {
+    uint8_t fastLength[1 << kFastBits]; // 0 if the code is longer
+    uint8_t fastValue[1 << kFastBits];
+    int maxCode[17]; // -1 for lengths without codes
+    int valueOffset[17];
+    uint8_t values[256];
+
+    bool build(const uint8_t counts[16], const uint8_t* symbols, int numSymbols) {
+      memset(fastLength, 0, sizeof(fastLength));
+      memcpy(values, symbols, numSymbols);
+
+      int code = 0;
+      int symbol = 0;
+      for (int length = 1; length <= 16; length ++) {
+        valueOffset[length] = symbol - code;
+        if (code + counts[length - 1] > (1 << length)) {
+          return false; // Over-subscribed, which would run off fastLength
+        }
+        for (int i = 0; i < counts[length - 1]; i ++, code ++, symbol ++) {
+          if (length <= kFastBits) {
+            const int first = code << (kFastBits - length);
+            for (int j = 0; j < (1 << (kFastBits - length)); j ++) {
+              fastLength[first + j] = length;
+              fastValue[first + j] = symbols[symbol];
+            }
+          }
+        }
+        maxCode[length] = counts[length - 1] ? code - 1 : -1;
+        code <<= 1;
+      }
+      return true;
+    }
+  };
+
+  // Most significant bit first. Stuffed zero bytes (after 0xff) are skipped,
+  // and once a marker is reached it reads zeros.
+  struct JpegBits {
+    const uint8_t* data;
+    const uint8_t* end;
+    uint32_t buffer = 0; // Left aligned
+    int count = 0;
+    bool atMarker = false;
+
+    void fill() {
+      while (count <= 24) {
+        uint32_t byte = 0;
+        if (!atMarker && data < end) {
+          byte = *data;
+          if (byte != 0xff) {
+            data ++;
+          } else if (data + 1 < end && data[1] == 0) {
+            data += 2;
+          } else {
+            atMarker = true;
+            byte = 0;
+          }
+        }
+        buffer |= byte << (24 - count);
+        count += 8;
+      }
+    }
+
+    int bits(int n) {
+      if (n == 0) {
+        return 0;
+      }
+      fill();
+      const int value = buffer >> (32 - n);
+      buffer <<= n;
+      count -= n;
+      return value;
+    }
+
+    // A coefficient's `size` bits, as a signed value
+    int extend(int size) {
+      const int value = bits(size);
+      return size && value < (1 << (size - 1)) ? value - (1 << size) + 1 : value;
+    }
+
+    int decode(const JpegHuffman& huffman) {
+      fill();
+      const int fast = buffer >> (32 - kFastBits);
+      if (huffman.fastLength[fast]) {
+        const int length = huffman.fastLength[fast];
+        buffer <<= length;
+        count -= length;
+        return huffman.fastValue[fast];
+      }
+
+      for (int length = kFastBits + 1; length <= 16; length ++) {
+        const int code = buffer >> (32 - length);
+        if (code <= huffman.maxCode[length]) {
+          const int index = code + huffman.valueOffset[length];
+          if (index < 0 || index > 255) {
+            return -1;
+          }
+          buffer <<= length;
+          count -= length;
+          return huffman.values[index];
+        }
+      }
+      return -1;
+    }
+
+    // Skips to just past the next restart marker
+    void restart() {
+      while (data + 1 < end && !(data[0] == 0xff && data[1] >= 0xd0 && data[1] <= 0xd7)) {
+        data ++;
+      }
+      data = std::min(data + 2, end);
+      buffer = 0;
+      count = 0;
+      atMarker = false;
+    }
+  };
+
+  // Integer IDCT (the "islow" one from the IJG's libjpeg: 12 bits of fixed
+  // point precision), columns first.
+  inline int fixed(float x) { return (int) (x * 4096 + 0.5f); }
+
+  #define IDCT_1D(s0, s1, s2, s3, s4, s5, s6, s7) \
+    int p1, p2, p3, p4, p5, t0, t1, t2, t3, x0, x1, x2, x3; \
+    p2 = s2; \
+    p3 = s6; \
+    p1 = (p2 + p3) * fixed(0.5411961f); \
+    t2 = p1 + p3 * fixed(-1.847759065f); \
+    t3 = p1 + p2 * fixed(0.765366865f); \
+    p2 = s0; \
+    p3 = s4; \
+    t0 = (p2 + p3) * 4096; \
+    t1 = (p2 - p3) * 4096; \
+    x0 = t0 + t3; \
+    x3 = t0 - t3; \
+    x1 = t1 + t2; \
+    x2 = t1 - t2; \
+    t0 = s7; \
+    t1 = s5; \
+    t2 = s3; \
+    t3 = s1; \
+    p3 = t0 + t2; \
+    p4 = t1 + t3; \
+    p1 = t0 + t3; \
+    p2 = t1 + t2; \
+    p5 = (p3 + p4) * fixed(1.175875602f); \
+    t0 = t0 * fixed(0.298631336f); \
+    t1 = t1 * fixed(2.053119869f); \
+    t2 = t2 * fixed(3.072711026f); \
+    t3 = t3 * fixed(1.501321110f); \
+    p1 = p5 + p1 * fixed(-0.899976223f); \
+    p2 = p5 + p2 * fixed(-2.562915447f); \
+    p3 = p3 * fixed(-1.961570560f); \
+    p4 = p4 * fixed(-0.390180644f); \
+    t3 += p1 + p4; \
+    t2 += p2 + p3; \
+    t1 += p2 + p4; \
+    t0 += p1 + p3;
+
+  inline uint8_t clampByte(int x) {
+    return (uint8_t) (x < 0 ? 0 : x > 255 ? 255 : x);
+  }
+
+  void idct(const int16_t* input, uint8_t* output, int stride) {
+    int values[64];
+    for (int i = 0; i < 8; i ++) {
+      const int16_t* d = input + i;
+      int* v = values + i;
+      if (!d[8] && !d[16] && !d[24] && !d[32] && !d[40] && !d[48] && !d[56]) {
+        // Only DC in this column
+        const int dc = d[0] * 4;
+        v[0] = v[8] = v[16] = v[24] = v[32] = v[40] = v[48] = v[56] = dc;
+        continue;
+      }
+      IDCT_1D(d[0], d[8], d[16], d[24], d[32], d[40], d[48], d[56])
+      x0 += 512;
+      x1 += 512;
+      x2 += 512;
+      x3 += 512;
+      v[0] = (x0 + t3) >> 10;
+      v[56] = (x0 - t3) >> 10;
+      v[8] = (x1 + t2) >> 10;
+      v[48] = (x1 - t2) >> 10;
+      v[16] = (x2 + t1) >> 10;
+      v[40] = (x2 - t1) >> 10;
+      v[24] = (x3 + t0) >> 10;
+      v[32] = (x3 - t0) >> 10;
+    }
+
+    for (int i = 0; i < 8; i ++) {
+      const int* v = values + i * 8;
+      uint8_t* out = output + i * stride;
+      IDCT_1D(v[0], v[1], v[2], v[3], v[4], v[5], v[6], v[7])
+      // Rounds, and shifts from -128..127 to 0..255
+      x0 += 65536 + (128 << 17);
+      x1 += 65536 + (128 << 17);
+      x2 += 65536 + (128 << 17);
+      x3 += 65536 + (128 << 17);
+      out[0] = clampByte((x0 + t3) >> 17);
+      out[7] = clampByte((x0 - t3) >> 17);
+      out[1] = clampByte((x1 + t2) >> 17);
+      out[6] = clampByte((x1 - t2) >> 17);
+      out[2] = clampByte((x2 + t1) >> 17);
+      out[5] = clampByte((x2 - t1) >> 17);
+      out[3] = clampByte((x3 + t0) >> 17);
+      out[4] = clampByte((x3 - t0) >> 17);
+    }
+  }
+
+  #undef IDCT_1D
+
+  struct JpegComponent {
+    int id;
+    int h; // Sampling factors
+    int v;
+    int quant;
+    int dcTable = 0;
+    int acTable = 0;
+    int dcPrediction = 0;
+    int stride; // Of the plane: whole MCUs across
+    vector<uint8_t> plane;
+  };
+
+  struct JpegDecoder {
+    uint16_t quant[4][64]; // In zigzag order
+    JpegHuffman dc[4];
+    JpegHuffman ac[4];
+    bool hasDc[4] = { false };
+    bool hasAc[4] = { false };
+    JpegComponent components[3];
+    int numComponents = 0;
+    int width = 0;
+    int height = 0;
+    int maxH = 1;
+    int maxV = 1;
+    int mcusWide = 0;
+    int mcusHigh = 0;
+    int restartInterval = 0;
+    bool decodedScan = false;
+
+    bool readQuantTables(const uint8_t* p, int length);
+    bool readHuffmanTables(const uint8_t* p, int length);
+    bool readFrame(const uint8_t* p, int length);
+    const uint8_t* readScan(const uint8_t* p, int length, const uint8_t* data, const uint8_t* end);
+    bool decodeBlock(JpegBits& bits, JpegComponent& component, int blockX, int blockY);
+    optional<Image> toRGBA();
+  };
+
+  bool JpegDecoder::readQuantTables(const uint8_t* p, int length) {
+    while (length > 0) {
+      const int precision = p[0] >> 4;
+      const int table = p[0] & 15;
+      const int size = 1 + 64 * (precision ? 2 : 1);
+      if (table > 3 || precision > 1 || length < size) {
+        return false;
+      }
+      for (int i = 0; i < 64; i ++) {
+        quant[table][i] = precision ? (p[1 + i * 2] << 8 | p[2 + i * 2]) : p[1 + i];
+      }
+      p += size;
+      length -= size;
+    }
+    return true;
+  }
+
+  bool JpegDecoder::readHuffmanTables(const uint8_t* p, int length) {
+    while (length > 0) {
+      if (length < 17) {
+        return false;
+      }
+      const int tableClass = p[0] >> 4;
+      const int table = p[0] & 15;
+      int numSymbols = 0;
+      for (int i = 0; i < 16; i ++) {
+        numSymbols += p[1 + i];
+      }
+      if (tableClass > 1 || table > 3 || numSymbols > 256 || length < 17 + numSymbols) {
+        return false;
+      }
+      JpegHuffman& huffman = tableClass == 0 ? dc[table] : ac[table];
+      if (!huffman.build(p + 1, p + 17, numSymbols)) {
+        return false;
+      }
+      (tableClass == 0 ? hasDc : hasAc)[table] = true;
+      p += 17 + numSymbols;
+      length -= 17 + numSymbols;
+    }
+    return true;
+  }
+
+  bool JpegDecoder::readFrame(const uint8_t* p, int length) {
+    if (length < 6 || p[0] != 8 || width) {
+      return false; // 12 bit, or a second frame
+    }
+    height = p[1] << 8 | p[2];
+    width = p[3] << 8 | p[4];
+    numComponents = p[5];
+    if (!width || !height || (size_t) width * height > kMaxPixels
+        || (numComponents != 1 && numComponents != 3) || length < 6 + numComponents * 3) {
+      return false;
+    }
+
+    for (int i = 0; i < numComponents; i ++) {
+      JpegComponent& component = components[i];
+      component.id = p[6 + i * 3];
+      component.h = p[7 + i * 3] >> 4;
+      component.v = p[7 + i * 3] & 15;
+      component.quant = p[8 + i * 3];
+      if (component.h < 1 || component.h > 4 || component.v < 1 || component.v > 4 || component.quant > 3) {
+        return false;
+      }
+      maxH = std::max(maxH, component.h);
+      maxV = std::max(maxV, component.v);
+    }
+
+    mcusWide = (width + maxH * 8 - 1) / (maxH * 8);
+    mcusHigh = (height + maxV * 8 - 1) / (maxV * 8);
+    for (int i = 0; i < numComponents; i ++) {
+      JpegComponent& component = components[i];
+      component.stride = mcusWide * component.h * 8;
+      component.plane.assign((size_t) component.stride * mcusHigh * component.v * 8, 0);
+    }
+    return true;
+  }
+
+  bool JpegDecoder::decodeBlock(JpegBits& bits, JpegComponent& component, int blockX, int blockY) {
+    const uint16_t* table = quant[component.quant];
+    int16_t coefficients[64] = { 0 };
+
+    const int dcSize = bits.decode(dc[component.dcTable]);
+    if (dcSize < 0 || dcSize > 11) {
+      return false;
+    }
+    component.dcPrediction = (int16_t) (component.dcPrediction + bits.extend(dcSize));
+    coefficients[0] = (int16_t) ((int64_t) component.dcPrediction * table[0]);
+
+    for (int k = 1; k < 64;) {
+      const int symbol = bits.decode(ac[component.acTable]);
+      if (symbol < 0) {
+        return false;
+      }
+      const int run = symbol >> 4;
+      const int size = symbol & 15;
+      if (size == 0) {
+        if (run != 15) {
+          break; // End of block
+        }
+        k += 16;
+        continue;
+      }
+      k += run;
+      if (k > 63 || size > 11) {
+        return false;
+      }
+      coefficients[kZigzag[k]] = (int16_t) (bits.extend(size) * table[k]);
+      k ++;
+    }
+
+    idct(coefficients, component.plane.data() + (size_t) blockY * 8 * component.stride + blockX * 8, component.stride);
+    return true;
+  }
+
+  // Returns where the scan's data ends, or nullptr if it's corrupt
+  const uint8_t* JpegDecoder::readScan(const uint8_t* p, int length, const uint8_t* data, const uint8_t* end) {
+    if (!width || length < 1) {
+      return nullptr;
+    }
+    const int numScanComponents = p[0];
+    if (numScanComponents < 1 || numScanComponents > numComponents || length < 4 + numScanComponents * 2) {
+      return nullptr;
+    }
+
+    JpegComponent* scanComponents[3];
+    for (int i = 0; i < numScanComponents; i ++) {
+      const int id = p[1 + i * 2];
+      const int tables = p[2 + i * 2];
+      JpegComponent* component = nullptr;
+      for (int j = 0; j < numComponents; j ++) {
+        if (components[j].id == id) {
+          component = components + j;
+        }
+      }
+      if (!component || (tables >> 4) > 3 || (tables & 15) > 3 || !hasDc[tables >> 4] || !hasAc[tables & 15]) {
+        return nullptr;
+      }
+      component->dcTable = tables >> 4;
+      component->acTable = tables & 15;
+      component->dcPrediction = 0;
+      scanComponents[i] = component;
+    }
+
+    JpegBits bits = { data, end };
+    int unitsLeft = restartInterval;
+    const auto nextUnit = [&]() {
+      if (restartInterval && -- unitsLeft == 0) {
+        bits.restart();
+        unitsLeft = restartInterval;
+        for (int i = 0; i < numScanComponents; i ++) {
+          scanComponents[i]->dcPrediction = 0;
+        }
+      }
+    };
+
+    if (numScanComponents == 1) {
+      // Not interleaved: just this component's blocks, in order, without
+      // padding out to whole MCUs
+      JpegComponent& component = *scanComponents[0];
+      const int blocksWide = ((width * component.h + maxH - 1) / maxH + 7) / 8;
+      const int blocksHigh = ((height * component.v + maxV - 1) / maxV + 7) / 8;
+      for (int blockY = 0; blockY < blocksHigh; blockY ++) {
+        for (int blockX = 0; blockX < blocksWide; blockX ++) {
+          if (!decodeBlock(bits, component, blockX, blockY)) {
+            return nullptr;
+          }
+          nextUnit();
+        }
+      }
+    } else {
+      for (int mcuY = 0; mcuY < mcusHigh; mcuY ++) {
+        for (int mcuX = 0; mcuX < mcusWide; mcuX ++) {
+          for (int i = 0; i < numScanComponents; i ++) {
+            JpegComponent& component = *scanComponents[i];
+            for (int v = 0; v < component.v; v ++) {
+              for (int h = 0; h < component.h; h ++) {
+                if (!decodeBlock(bits, component, mcuX * component.h + h, mcuY * component.v + v)) {
+                  return nullptr;
+                }
+              }
+            }
+          }
+          nextUnit();
+        }
+      }
+    }
+
+    decodedScan = true;
+    return bits.data;
+  }
+
+  // Upsamples the chroma (by repeating it) and converts YCbCr to RGB, four
+  // pixels at a time
+  optional<Image> JpegDecoder::toRGBA() {
+    optional<Image> image = allocateImage(width, height);
+    if (!image) {
+      return {};
+    }
+
+    const int paddedWidth = (width + 3) & ~3;
+    vector<int32_t> rows(paddedWidth * 3, 0);
+    int32_t* samples[3] = { rows.data(), rows.data() + paddedWidth, rows.data() + paddedWidth * 2 };
+
+    // Components named R, G & B (eg. from some Adobe tools) aren't YCbCr
+    const bool rgb = numComponents == 3 && components[0].id == 'R' && components[1].id == 'G' && components[2].id == 'B';
+
+    for (int y = 0; y < height; y ++) {
+      for (int i = 0; i < numComponents; i ++) {
+        const JpegComponent& component = components[i];
+        const uint8_t* row = component.plane.data() + (size_t) (y * component.v / maxV) * component.stride;
+        for (int x = 0; x < width; x ++) {
+          samples[i][x] = row[x * component.h / maxH];
+        }
+      }
+
+      uint8_t* out = (uint8_t*) image->pixels + (size_t) y * width * 4;
+      for (int x = 0; x < width; x += 4) {
+        int4 r, g, b;
+        const int4 luma = { samples[0][x], samples[0][x + 1], samples[0][x + 2], samples[0][x + 3] };
+        if (numComponents == 1) {
+          r = g = b = luma;
+        } else if (rgb) {
+          r = luma;
+          memcpy(&g, samples[1] + x, sizeof(g));
+          memcpy(&b, samples[2] + x, sizeof(b));
+        } else {
+          int4 cb, cr;
+          memcpy(&cb, samples[1] + x, sizeof(cb));
+          memcpy(&cr, samples[2] + x, sizeof(cr));
+          cb -= SIMD::splat(128);
+          cr -= SIMD::splat(128);
+          // 16 bits of fixed point
+          const int4 half = SIMD::splat(32768);
+          r = luma + ((cr * SIMD::splat(91881) + half) >> 16);
+          g = luma - ((cb * SIMD::splat(22554) + cr * SIMD::splat(46802) - half) >> 16);
+          b = luma + ((cb * SIMD::splat(116130) + half) >> 16);
+        }
+        r = SIMD::clamp(r, 0, 255);
+        g = SIMD::clamp(g, 0, 255);
+        b = SIMD::clamp(b, 0, 255);
+
+        uint8_t pixels[16];
+        for (int lane = 0; lane < 4; lane ++) {
+          pixels[lane * 4 + 0] = r[lane];
+          pixels[lane * 4 + 1] = g[lane];
+          pixels[lane * 4 + 2] = b[lane];
+          pixels[lane * 4 + 3] = 255;
+        }
+        memcpy(out + x * 4, pixels, std::min(4, width - x) * 4);
+      }
+    }
+
+    return image;
+  }
+}
+
+static optional<Image> decodeJPEG(const uint8_t* data, size_t length) {
+  const uint8_t* end = data + length;
+  const uint8_t* p = data + 2; // After the start of image marker
+  auto decoder = std::make_unique<JpegDecoder>();
+
+  while (p + 1 < end) {
+    if (p[0] != 0xff) {
+      p ++;
+      continue;
+    }
+    const int marker = p[1];
+    p += 2;
+    if (marker == 0xff) {
+      p --; // Fill byte
+      continue;
+    }
+    if (marker == 0xd9) {
+      break; // End of image
+    }
+    if (marker == 0x00 || marker == 0x01 || (marker >= 0xd0 && marker <= 0xd7)) {
+      continue; // No segment
+    }
+
+    if (p + 2 > end) {
+      break;
+    }
+    const int segmentLength = p[0] << 8 | p[1];
+    if (segmentLength < 2 || p + segmentLength > end) {
+      break;
+    }
+    const uint8_t* segment = p + 2;
+    const int length = segmentLength - 2;
+    p += segmentLength;
+
+    bool ok = true;
+    switch (marker) {
+      case 0xc0: // Baseline
+      case 0xc1: // Extended sequential
+        ok = decoder->readFrame(segment, length);
+        break;
+      case 0xc4:
+        ok = decoder->readHuffmanTables(segment, length);
+        break;
+      case 0xdb:
+        ok = decoder->readQuantTables(segment, length);
+        break;
+      case 0xdd:
+        ok = length >= 2;
+        if (ok) {
+          decoder->restartInterval = segment[0] << 8 | segment[1];
+        }
+        break;
+      case 0xda:
+        p = decoder->readScan(segment, length, p, end);
+        ok = p != nullptr;
+        break;
+      default:
+        // Progressive, lossless and arithmetic coded frames aren't handled.
+        // Everything else (APPn, comments, ...) is skipped.
+        ok = marker < 0xc0 || marker > 0xcf || marker == 0xc8;
+        break;
+    }
+    if (!ok) {
+      return {};
+    }
+  }
+
+  // Truncated files keep what was decoded
+  if (!decoder->decodedScan) {
+    return {};
+  }
+  return decoder->toRGBA();
+}
+
+//
+// PNG
+//
+
+static uint32_t readBigEndian(const uint8_t* p) {
+  return (uint32_t) p[0] << 24 | p[1] << 16 | p[2] << 8 | p[3];
+}
+
+static uint8_t paeth(int a, int b, int c) {
+  const int p = a + b - c;
+  const int pa = abs(p - a);
+  const int pb = abs(p - b);
+  const int pc = abs(p - c);
+  return pa <= pb && pa <= pc ? a : pb <= pc ? b : c;
+}
+
+static optional<Image> decodePNG(const uint8_t* data, size_t length) {
+  const uint8_t* end = data + length;
+  const uint8_t* p = data + 8; // After the signature
+
+  int width = 0;
+  int height = 0;
+  int depth = 0;
+  int colorType = -1;
+  uint8_t palette[256][4];
+  int paletteSize = 0;
+  int transparent[3] = { -1, -1, -1 }; // Color key, for greyscale & RGB
+  vector<char> compressed;
+
+  while (p + 12 <= end) {
+    const uint32_t chunkLength = readBigEndian(p);
+    const uint8_t* chunk = p + 8;
+    if (chunkLength > (size_t) (end - chunk) - 4) {
+      return {};
+    }
+    const string type((const char*) p + 4, 4);
+    p = chunk + chunkLength + 4; // Skipping the CRC
+
+    if (type == "IHDR") {
+      if (chunkLength < 13) {
+        return {};
+      }
+      width = readBigEndian(chunk);
+      height = readBigEndian(chunk + 4);
+      depth = chunk[8];
+      colorType = chunk[9];
+      if (chunk[10] != 0 || chunk[11] != 0) {
+        return {}; // Unknown compression or filter method
+      }
+      if (chunk[12] != 0) {
+        return {}; // Interlaced
+      }
+    } else if (type == "PLTE") {
+      paletteSize = std::min(256, (int) chunkLength / 3);
+      for (int i = 0; i < paletteSize; i ++) {
+        memcpy(palette[i], chunk + i * 3, 3);
+        palette[i][3] = 255;
+      }
+    } else if (type == "tRNS") {
+      if (colorType == 3) {
+        for (int i = 0; i < std::min(paletteSize, (int) chunkLength); i ++) {
+          palette[i][3] = chunk[i];
+        }
+      } else if (colorType == 0 && chunkLength >= 2) {
+        transparent[0] = chunk[0] << 8 | chunk[1];
+      } else if (colorType == 2 && chunkLength >= 6) {
+        for (int i = 0; i < 3; i ++) {
+          transparent[i] = chunk[i * 2] << 8 | chunk[i * 2 + 1];
+        }
+      }
+    } else if (type == "IDAT") {
+      compressed.insert(compressed.end(), (const char*) chunk, (const char*) chunk + chunkLength);
+    } else if (type == "IEND") {
+      break;
+    }
+  }
+
+  int channels;
+  switch (colorType) {
+    case 0: channels = 1; break; // Greyscale
+    case 2: channels = 3; break; // RGB
+    case 3: channels = 1; break; // Palette
+    case 4: channels = 2; break; // Greyscale & alpha
+    case 6: channels = 4; break; // RGBA
+    default: return {};
+  }
+  const bool lowDepthAllowed = colorType == 0 || colorType == 3;
+  if (!(depth == 8 || (depth == 16 && colorType != 3) || (lowDepthAllowed && (depth == 1 || depth == 2 || depth == 4)))) {
+    return {};
+  }
+  if (colorType == 3 && !paletteSize) {
+    return {};
+  }
+
+  optional<Image> image = allocateImage(width, height);
+  if (!image) {
+    return {};
+  }
+
+  // Each row is a filter type, then the row
+  const size_t stride = ((size_t) width * channels * depth + 7) / 8;
+  const size_t rawLength = (stride + 1) * height;
+  vector<uint8_t> raw(rawLength);
+  if (rawLength > INT32_MAX || compressed.size() > INT32_MAX
+      || Inflate::inflateZlib(compressed.data(), compressed.size(), (char*) raw.data(), rawLength) != (int) rawLength) {
+    free(image->pixels);
+    return {};
+  }
+
+  // Filtered against the byte a pixel to the left (or 1, below 8 bits)
+  const int pixelBytes = std::max(1, channels * depth / 8);
+  vector<uint8_t> previous(stride, 0);
+  uint8_t* out = (uint8_t*) image->pixels;
+  const int maxSample = (1 << depth) - 1;
+  for (int y = 0; y < height; y ++) {
+    const int filter = raw[y * (stride + 1)];
+    uint8_t* row = raw.data() + y * (stride + 1) + 1;
+    for (size_t i = 0; i < stride; i ++) {
+      const int left = i >= (size_t) pixelBytes ? row[i - pixelBytes] : 0;
+      const int up = previous[i];
+      const int upLeft = i >= (size_t) pixelBytes ? previous[i - pixelBytes] : 0;
+      switch (filter) {
+        case 0: break;
+        case 1: row[i] += left; break;
+        case 2: row[i] += up; break;
+        case 3: row[i] += (left + up) / 2; break;
+        case 4: row[i] += paeth(left, up, upLeft); break;
+        default:
+          free(image->pixels);
+          return {};
+      }
+    }
+    memcpy(previous.data(), row, stride);
+
+    for (int x = 0; x < width; x ++) {
+      // Every channel's sample at its own depth, with 16 bit ones kept whole
+      // for the color key, and scaled to 8 bits for the output
+      int values[4];
+      uint8_t scaled[4];
+      for (int channel = 0; channel < channels; channel ++) {
+        const size_t sample = (size_t) x * channels + channel;
+        if (depth == 16) {
+          values[channel] = row[sample * 2] << 8 | row[sample * 2 + 1];
+          scaled[channel] = row[sample * 2];
+        } else if (depth == 8) {
+          values[channel] = scaled[channel] = row[sample];
+        } else {
+          const size_t bit = sample * depth;
+          values[channel] = (row[bit / 8] >> (8 - depth - bit % 8)) & maxSample;
+          scaled[channel] = colorType == 3 ? values[channel] : values[channel] * 255 / maxSample;
+        }
+      }
+
+      uint8_t* pixel = out + ((size_t) y * width + x) * 4;
+      switch (colorType) {
+        case 0:
+          pixel[0] = pixel[1] = pixel[2] = scaled[0];
+          pixel[3] = values[0] == transparent[0] ? 0 : 255;
+          break;
+        case 2:
+          memcpy(pixel, scaled, 3);
+          pixel[3] = values[0] == transparent[0] && values[1] == transparent[1] && values[2] == transparent[2] ? 0 : 255;
+          break;
+        case 3:
+          if (values[0] >= paletteSize) {
+            free(image->pixels);
+            return {};
+          }
+          memcpy(pixel, palette[values[0]], 4);
+          break;
+        case 4:
+          pixel[0] = pixel[1] = pixel[2] = scaled[0];
+          pixel[3] = scaled[1];
+          break;
+        case 6:
+          memcpy(pixel, scaled, 4);
+          break;
+      }
+    }
+  }
+
+  return image;
+}
+
+//
+// TGA
+//
+
+// Uncompressed or RLE true-color / greyscale TGAs (types 2, 10, 3 and 11)
+static optional<Image> decodeTGA(const uint8_t* data, size_t length) {
+  if (length < 18) {
+    return {};
+  }
+  const int idLength = data[0];
+  const int colorMapType = data[1];
+  const int imageType = data[2];
+  const int width = data[12] | data[13] << 8;
+  const int height = data[14] | data[15] << 8;
+  const int bitsPerPixel = data[16];
+  const bool topToBottom = data[17] & 0x20;
+
+  const bool rle = imageType == 10 || imageType == 11;
+  const bool greyscale = imageType == 3 || imageType == 11;
+  const int bytesPerPixel = bitsPerPixel / 8;
+  if (colorMapType != 0 || (imageType != 2 && imageType != 3 && imageType != 10 && imageType != 11)
+      || (greyscale ? bytesPerPixel != 1 : (bytesPerPixel != 3 && bytesPerPixel != 4))) {
+    return {};
+  }
+
+  optional<Image> image = allocateImage(width, height);
+  if (!image) {
+    return {};
+  }
+
+  uint8_t* rgba = (uint8_t*) image->pixels;
+  size_t offset = 18 + idLength;
+  const auto readPixel = [&](size_t pixel) {
+    if (offset + bytesPerPixel > length) {
+      return false;
+    }
+    // Stored BGR(A), bottom row first unless the descriptor says otherwise
+    const size_t row = topToBottom ? pixel / width : height - 1 - pixel / width;
+    uint8_t* destination = rgba + (row * width + pixel % width) * 4;
+    destination[0] = data[offset + (greyscale ? 0 : 2)];
+    destination[1] = data[offset + (greyscale ? 0 : 1)];
+    destination[2] = data[offset];
+    destination[3] = bytesPerPixel == 4 ? data[offset + 3] : 255;
+    return true;
+  };
+
+  const size_t numPixels = (size_t) width * height;
+  size_t pixel = 0;
+  while (pixel < numPixels) {
+    int count = 1;
+    bool repeat = false;
+    if (rle) {
+      if (offset >= length) {
+        free(image->pixels);
+        return {};
+      }
+      repeat = data[offset] & 0x80;
+      count = (data[offset] & 0x7f) + 1;
+      offset ++;
+    }
+    for (int i = 0; i < count && pixel < numPixels; i ++, pixel ++) {
+      if (!readPixel(pixel)) {
+        free(image->pixels);
+        return {};
+      }
+      if (!repeat) {
+        offset += bytesPerPixel;
+      }
+    }
+    if (repeat) {
+      offset += bytesPerPixel;
+    }
+  }
+
+  return image;
+}
+
+void ImageDecoder::halve(const unsigned char* rgba, int width, int height, unsigned char* destination) {
+  const int halfWidth = std::max(1, width / 2);
+  const int halfHeight = std::max(1, height / 2);
+  for (int y = 0; y < halfHeight; y ++) {
+    for (int x = 0; x < halfWidth; x ++) {
+      for (int channel = 0; channel < 4; channel ++) {
+        int sum = 0;
+        for (int i = 0; i < 4; i ++) {
+          const int sourceX = std::min(x * 2 + (i & 1), width - 1);
+          const int sourceY = std::min(y * 2 + (i >> 1), height - 1);
+          sum += rgba[((size_t) sourceY * width + sourceX) * 4 + channel];
+        }
+        destination[((size_t) y * halfWidth + x) * 4 + channel] = (unsigned char) ((sum + 2) / 4);
+      }
+    }
+  }
+}
+
+optional<Image> ImageDecoder::decode(const char* data, size_t length, int maxSize) {
+  const auto* bytes = (const uint8_t*) data;
+  optional<Image> image;
+  if (length >= 2 && bytes[0] == 0xff && bytes[1] == 0xd8) {
+    image = decodeJPEG(bytes, length);
+  } else if (length >= 8 && memcmp(bytes, "\x89PNG\r\n\x1a\n", 8) == 0) {
+    image = decodePNG(bytes, length);
+  } else {
+    image = decodeTGA(bytes, length);
+  }
+  if (!image) {
+    return {};
+  }
+
+  while (maxSize > 0 && std::max(image->width, image->height) > maxSize) {
+    const int halfWidth = std::max(1, image->width / 2);
+    const int halfHeight = std::max(1, image->height / 2);
+    void* half = malloc((size_t) halfWidth * halfHeight * 4);
+    if (!half) {
+      free(image->pixels);
+      return {};
+    }
+    halve((const unsigned char*) image->pixels, image->width, image->height, (unsigned char*) half);
+    free(image->pixels);
+    image->pixels = half;
+    image->width = halfWidth;
+    image->height = halfHeight;
+  }
+  return image;
+}
@@ -0,0 +1,35 @@
+#ifndef IMAGE_DECODER_H
+#define IMAGE_DECODER_H
+
+#include "support.h"
+
+// Decodes textures inside the module, rather than by drawing them to a canvas
+// on the browser's main thread. Safe to call from any thread: the
+// ResourceManager runs it on a WorkerPool. Handles what Quake 3's textures
+// come as:
+//
+//   - JPEG: baseline (and extended sequential), greyscale or YCbCr, any
+//     chroma subsampling. Not progressive.
+//   - PNG: every color type, 1-16 bits per channel. Not interlaced.
+//   - TGA: uncompressed or RLE, true color or greyscale.
+//
+// Anything else is left to the browser (see LoadResource's decodeInBrowser).
+namespace ImageDecoder {
+  struct Image {
+    void* pixels; // RGBA, from malloc
+    int width;
+    int height;
+    int fullWidth; // Before it was scaled down
+    int fullHeight;
+  };
+
+  // Halved (averaging 2x2 pixels) until neither side is over `maxSize`, if
+  // it isn't 0. Unset if the image is corrupt or in a format we don't handle.
+  optional<Image> decode(const char* data, size_t length, int maxSize = 0);
+
+  // Half the size (rounded down, but at least 1), averaging 2x2 pixels, or
+  // fewer along an odd edge. `destination` needs room for the result.
+  void halve(const unsigned char* rgba, int width, int height, unsigned char* destination);
+}
+
+#endif
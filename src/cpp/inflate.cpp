@@ -0,0 +1,318 @@
+#include "inflate.h"
+
+#include <algorithm>
+#include <cstring>
+
+namespace {
+  const int kFastBits = 9;
+  const int kMaxSymbols = 288;
+
+  // Canonical Huffman codes. Codes up to kFastBits long are found in `fast`
+  // with one lookup; longer ones are found by comparing against each
+  // length's range of codes.
+  struct Huffman {
+    uint16_t fast[1 << kFastBits]; // (length << 9) | symbol, or 0
+    uint16_t firstCode[17];
+    uint16_t firstSymbol[17];
+    int maxCode[18]; // Exclusive, left aligned to 16 bits
+    uint8_t sizes[kMaxSymbols];
+    uint16_t symbols[kMaxSymbols];
+
+    bool build(const uint8_t* lengths, int count);
+  };
+
+  int reverseBits(int value, int bits) {
+    int result = 0;
+    for (int i = 0; i < bits; i ++) {
+      result = (result << 1) | ((value >> i) & 1);
+    }
+    return result;
+  }
+
+  bool Huffman::build(const uint8_t* lengths, int count) {
+    memset(fast, 0, sizeof(fast));
+
+    int counts[17] = { 0 };
+    for (int i = 0; i < count; i ++) {
+      counts[lengths[i]] ++;
+    }
+    counts[0] = 0;
+
+    int nextCode[16];
+    int code = 0;
+    int symbol = 0;
+    for (int length = 1; length < 16; length ++) {
+      nextCode[length] = code;
+      firstCode[length] = code;
+      firstSymbol[length] = symbol;
+      code += counts[length];
+      if (counts[length] && code - 1 >= (1 << length)) {
+        return false; // Over-subscribed
+      }
+      maxCode[length] = code << (16 - length);
+      code <<= 1;
+      symbol += counts[length];
+    }
+    maxCode[16] = 0x10000;
+
+    for (int i = 0; i < count; i ++) {
+      const int length = lengths[i];
+      if (!length) {
+        continue;
+      }
+      const int index = nextCode[length] - firstCode[length] + firstSymbol[length];
+      sizes[index] = length;
+      symbols[index] = i;
+      if (length <= kFastBits) {
+        for (int j = reverseBits(nextCode[length], length); j < (1 << kFastBits); j += 1 << length) {
+          fast[j] = (uint16_t) ((length << 9) | i);
+        }
+      }
+      nextCode[length] ++;
+    }
+    return true;
+  }
+
+  // Least significant bit first, as DEFLATE packs them
+  struct BitReader {
+    const uint8_t* data;
+    const uint8_t* end;
+    uint64_t bits = 0;
+    int numBits = 0;
+
+    void refill() {
+      while (numBits <= 56 && data < end) {
+        bits |= (uint64_t) *(data ++) << numBits;
+        numBits += 8;
+      }
+    }
+
+    // -1 if the input ran out
+    int read(int count) {
+      if (numBits < count) {
+        refill();
+        if (numBits < count) {
+          return -1;
+        }
+      }
+      const int value = (int) (bits & ((1ull << count) - 1));
+      bits >>= count;
+      numBits -= count;
+      return value;
+    }
+
+    int decode(const Huffman& huffman) {
+      if (numBits < 16) {
+        refill();
+      }
+      const int entry = huffman.fast[bits & ((1 << kFastBits) - 1)];
+      if (entry) {
+        const int length = entry >> 9;
+        if (length > numBits) {
+          return -1;
+        }
+        bits >>= length;
+        numBits -= length;
+        return entry & 511;
+      }
+
+      const int code = reverseBits((int) (bits & 0xffff), 16);
+      int length = kFastBits + 1;
+      while (code >= huffman.maxCode[length]) {
+        length ++;
+      }
+      if (length >= 16 || length > numBits) {
+        return -1;
+      }
+      const int index = (code >> (16 - length)) - huffman.firstCode[length] + huffman.firstSymbol[length];
+      if (index >= kMaxSymbols || huffman.sizes[index] != length) {
+        return -1;
+      }
+      bits >>= length;
+      numBits -= length;
+      return huffman.symbols[index];
+    }
+  };
+
+  const int kLengthBase[29] = {
+    3, 4, 5, 6, 7, 8, 9, 10, 11, 13, 15, 17, 19, 23, 27, 31,
+    35, 43, 51, 59, 67, 83, 99, 115, 131, 163, 195, 227, 258
+  };
+  const int kLengthExtra[29] = {
+    0, 0, 0, 0, 0, 0, 0, 0, 1, 1, 1, 1, 2, 2, 2, 2, 3, 3, 3, 3, 4, 4, 4, 4, 5, 5, 5, 5, 0
+  };
+  const int kDistanceBase[30] = {
+    1, 2, 3, 4, 5, 7, 9, 13, 17, 25, 33, 49, 65, 97, 129, 193,
+    257, 385, 513, 769, 1025, 1537, 2049, 3073, 4097, 6145, 8193, 12289, 16385, 24577
+  };
+  const int kDistanceExtra[30] = {
+    0, 0, 0, 0, 1, 1, 2, 2, 3, 3, 4, 4, 5, 5, 6, 6, 7, 7, 8, 8, 9, 9, 10, 10, 11, 11, 12, 12, 13, 13
+  };
+
+  bool fixedCodes(Huffman& lengths, Huffman& distances) {
+    uint8_t sizes[kMaxSymbols];
+    for (int i = 0; i < kMaxSymbols; i ++) {
+      sizes[i] = i < 144 ? 8 : i < 256 ? 9 : i < 280 ? 7 : 8;
+    }
+    uint8_t distanceSizes[32];
+    memset(distanceSizes, 5, sizeof(distanceSizes));
+    return lengths.build(sizes, kMaxSymbols) && distances.build(distanceSizes, 32);
+  }
+
+  bool dynamicCodes(BitReader& reader, Huffman& lengths, Huffman& distances) {
+    static const uint8_t kOrder[19] = { 16, 17, 18, 0, 8, 7, 9, 6, 10, 5, 11, 4, 12, 3, 13, 2, 14, 1, 15 };
+
+    const int numLengths = reader.read(5) + 257;
+    const int numDistances = reader.read(5) + 1;
+    const int numCodeLengths = reader.read(4) + 4;
+    if (numLengths < 257 || numDistances < 1 || numCodeLengths < 4 || numLengths > 286 || numDistances > 30) {
+      return false;
+    }
+
+    uint8_t codeLengthSizes[19] = { 0 };
+    for (int i = 0; i < numCodeLengths; i ++) {
+      const int size = reader.read(3);
+      if (size < 0) {
+        return false;
+      }
+      codeLengthSizes[kOrder[i]] = size;
+    }
+    Huffman codeLengths;
+    if (!codeLengths.build(codeLengthSizes, 19)) {
+      return false;
+    }
+
+    // Both tables' lengths are one run, and repeats can cross between them
+    uint8_t sizes[286 + 30];
+    int count = 0;
+    while (count < numLengths + numDistances) {
+      const int symbol = reader.decode(codeLengths);
+      if (symbol < 0) {
+        return false;
+      } else if (symbol < 16) {
+        sizes[count ++] = symbol;
+        continue;
+      }
+
+      // 16 repeats the last length, 17 and 18 are runs of zeros
+      const int extra = reader.read(symbol == 16 ? 2 : symbol == 17 ? 3 : 7);
+      const int repeat = (symbol == 18 ? 11 : 3) + extra;
+      const uint8_t size = symbol == 16 && count > 0 ? sizes[count - 1] : 0;
+      if (extra < 0 || (symbol == 16 && count == 0) || count + repeat > numLengths + numDistances) {
+        return false;
+      }
+      memset(sizes + count, size, repeat);
+      count += repeat;
+    }
+
+    return lengths.build(sizes, numLengths) && distances.build(sizes + numLengths, numDistances);
+  }
+}
+
+int Inflate::inflate(const char* source, int length, char* destination, int capacity) {
+  BitReader reader = { (const uint8_t*) source, (const uint8_t*) source + length };
+  int written = 0;
+
+  Huffman lengths;
+  Huffman distances;
+  bool last = false;
+  while (!last) {
+    last = reader.read(1) == 1;
+    const int type = reader.read(2);
+
+    if (type == 0) {
+      // Stored: byte aligned, then the length and its complement
+      reader.read(reader.numBits % 8);
+      const int storedLength = reader.read(16);
+      const int complement = reader.read(16);
+      if (storedLength < 0 || complement < 0 || (storedLength ^ 0xffff) != complement || written + storedLength > capacity) {
+        return -1;
+      }
+      for (int i = 0; i < storedLength; i ++) {
+        const int byte = reader.read(8);
+        if (byte < 0) {
+          return -1;
+        }
+        destination[written ++] = (char) byte;
+      }
+      continue;
+    }
+
+    if (type == 1 ? !fixedCodes(lengths, distances) : type != 2 || !dynamicCodes(reader, lengths, distances)) {
+      return -1;
+    }
+
+    while (true) {
+      const int symbol = reader.decode(lengths);
+      if (symbol < 0 || symbol > 285) {
+        return -1;
+      }
+      if (symbol < 256) {
+        if (written >= capacity) {
+          return -1;
+        }
+        destination[written ++] = (char) symbol;
+        continue;
+      }
+      if (symbol == 256) {
+        break;
+      }
+
+      const int lengthExtra = reader.read(kLengthExtra[symbol - 257]);
+      const int distanceSymbol = reader.decode(distances);
+      if (lengthExtra < 0 || distanceSymbol < 0 || distanceSymbol >= 30) {
+        return -1;
+      }
+      const int distanceExtra = reader.read(kDistanceExtra[distanceSymbol]);
+      if (distanceExtra < 0) {
+        return -1;
+      }
+      const int matchLength = kLengthBase[symbol - 257] + lengthExtra;
+      const int distance = kDistanceBase[distanceSymbol] + distanceExtra;
+      if (distance > written || written + matchLength > capacity) {
+        return -1;
+      }
+
+      // Byte by byte: the match can overlap what it's writing
+      const char* match = destination + written - distance;
+      for (int i = 0; i < matchLength; i ++) {
+        destination[written + i] = match[i];
+      }
+      written += matchLength;
+    }
+  }
+
+  return written;
+}
+
+int Inflate::inflateZlib(const char* source, int length, char* destination, int capacity) {
+  const auto* bytes = (const uint8_t*) source;
+  if (length < 6) {
+    return -1;
+  }
+  // Deflate, no preset dictionary
+  if ((bytes[0] & 0x0f) != 8 || (bytes[0] * 256 + bytes[1]) % 31 != 0 || (bytes[1] & 0x20)) {
+    return -1;
+  }
+
+  const int written = inflate(source + 2, length - 6, destination, capacity);
+  if (written < 0) {
+    return -1;
+  }
+
+  // Adler-32. Sums can go 5552 bytes before they need reducing.
+  uint32_t a = 1;
+  uint32_t b = 0;
+  for (int start = 0; start < written; start += 5552) {
+    const int end = std::min(written, start + 5552);
+    for (int i = start; i < end; i ++) {
+      a += (uint8_t) destination[i];
+      b += a;
+    }
+    a %= 65521;
+    b %= 65521;
+  }
+  const uint8_t* checksum = bytes + length - 4;
+  const uint32_t expected = (uint32_t) checksum[0] << 24 | checksum[1] << 16 | checksum[2] << 8 | checksum[3];
+  return ((b << 16) | a) == expected ? written : -1;
+}
@@ -0,0 +1,19 @@
+#ifndef INFLATE_H
+#define INFLATE_H
+
+#include "support.h"
+
+// A self-contained DEFLATE (https://www.rfc-editor.org/rfc/rfc1951) decoder,
+// for PNGs, so images can be decoded inside the wasm module (see
+// ImageDecoder). Table driven: most codes are looked up in one step.
+namespace Inflate {
+  // Raw DEFLATE data. Returns the decompressed length, or -1 if the input is
+  // corrupt or doesn't fit in `capacity`. Never reads or writes out of
+  // bounds.
+  int inflate(const char* source, int length, char* destination, int capacity);
+
+  // The same, wrapped in a zlib header and checksum (RFC 1950), as in PNG.
+  int inflateZlib(const char* source, int length, char* destination, int capacity);
+}
+
+#endif
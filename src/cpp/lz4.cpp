@@ -0,0 +1,196 @@
+#include "lz4.h"
+
+#include <cstring>
+
+static const int kMinMatch = 4;
+static const int kMaxOffset = 65535;
+
+// The block format requires the last 5 bytes to be literals, and the last
+// match to start at least 12 bytes before the end
+static const int kLastLiterals = 5;
+static const int kMatchStartLimit = 12;
+
+static const int kHashLog = 16;
+
+static uint32_t read32(const char* pointer) {
+  uint32_t value;
+  memcpy(&value, pointer, sizeof(value));
+  return value;
+}
+
+static int hashSequence(uint32_t sequence) {
+  return (sequence * 2654435761u) >> (32 - kHashLog);
+}
+
+int LZ4::compressBound(int length) {
+  return length + length / 255 + 16;
+}
+
+// Lengths of 15 and above continue in extra bytes of 255, ended by one < 255
+static bool writeLength(char*& output, const char* outputEnd, int length) {
+  for (; length >= 255; length -= 255) {
+    if (output >= outputEnd) {
+      return false;
+    }
+    *output ++ = (char) 255;
+  }
+  if (output >= outputEnd) {
+    return false;
+  }
+  *output ++ = (char) length;
+  return true;
+}
+
+static bool writeSequence(
+  char*& output, const char* outputEnd,
+  const char* literals, int literalLength,
+  int offset, int matchLength // matchLength is 0 for the last sequence
+) {
+  if (output >= outputEnd) {
+    return false;
+  }
+
+  char* token = output ++;
+  const int matchCode = matchLength > 0 ? matchLength - kMinMatch : 0;
+  *token = (char) (((literalLength < 15 ? literalLength : 15) << 4) | (matchCode < 15 ? matchCode : 15));
+
+  if (literalLength >= 15 && !writeLength(output, outputEnd, literalLength - 15)) {
+    return false;
+  }
+  if (output + literalLength > outputEnd) {
+    return false;
+  }
+  memcpy(output, literals, literalLength);
+  output += literalLength;
+
+  if (matchLength == 0) {
+    return true;
+  }
+
+  if (output + 2 > outputEnd) {
+    return false;
+  }
+  *output ++ = (char) (offset & 0xff);
+  *output ++ = (char) (offset >> 8);
+
+  return matchCode < 15 || writeLength(output, outputEnd, matchCode - 15);
+}
+
+int LZ4::compress(const char* source, int length, char* destination, int capacity) {
+  char* output = destination;
+  const char* outputEnd = destination + capacity;
+
+  int anchor = 0;
+  if (length > kMatchStartLimit) {
+    vector<int> table(1 << kHashLog, -1);
+    const int matchStartLimit = length - kMatchStartLimit;
+    const int matchEndLimit = length - kLastLiterals;
+
+    int position = 0;
+    while (position < matchStartLimit) {
+      const uint32_t sequence = read32(source + position);
+      const int h = hashSequence(sequence);
+      const int candidate = table[h];
+      table[h] = position;
+
+      if (candidate < 0 || position - candidate > kMaxOffset || read32(source + candidate) != sequence) {
+        // Skip through incompressible data faster the longer it goes on
+        position += 1 + ((position - anchor) >> 6);
+        continue;
+      }
+
+      int matchLength = kMinMatch;
+      while (position + matchLength < matchEndLimit && source[candidate + matchLength] == source[position + matchLength]) {
+        matchLength ++;
+      }
+
+      if (!writeSequence(output, outputEnd, source + anchor, position - anchor, position - candidate, matchLength)) {
+        return -1;
+      }
+
+      position += matchLength;
+      anchor = position;
+
+      // Helps the next match find something
+      if (position - 2 < matchStartLimit) {
+        table[hashSequence(read32(source + position - 2))] = position - 2;
+      }
+    }
+  }
+
+  if (!writeSequence(output, outputEnd, source + anchor, length - anchor, 0, 0)) {
+    return -1;
+  }
+
+  return output - destination;
+}
+
+// Returns false if the length runs past the end of the input
+static bool readLength(const unsigned char*& input, const unsigned char* inputEnd, int& length) {
+  unsigned char byte;
+  do {
+    if (input >= inputEnd) {
+      return false;
+    }
+    byte = *input ++;
+    length += byte;
+  } while (byte == 255);
+  return true;
+}
+
+int LZ4::decompress(const char* source, int length, char* destination, int capacity) {
+  const unsigned char* input = (const unsigned char*) source;
+  const unsigned char* inputEnd = input + length;
+  char* output = destination;
+  char* outputEnd = destination + capacity;
+
+  while (input < inputEnd) {
+    const unsigned char token = *input ++;
+
+    int literalLength = token >> 4;
+    if (literalLength == 15 && !readLength(input, inputEnd, literalLength)) {
+      return -1;
+    }
+    if (literalLength > inputEnd - input || literalLength > outputEnd - output) {
+      return -1;
+    }
+    memcpy(output, input, literalLength);
+    input += literalLength;
+    output += literalLength;
+
+    if (input == inputEnd) {
+      break; // The last sequence has no match
+    }
+
+    if (inputEnd - input < 2) {
+      return -1;
+    }
+    const int offset = input[0] | (input[1] << 8);
+    input += 2;
+    if (offset == 0 || offset > output - destination) {
+      return -1;
+    }
+
+    int matchLength = token & 15;
+    if (matchLength == 15 && !readLength(input, inputEnd, matchLength)) {
+      return -1;
+    }
+    matchLength += kMinMatch;
+    if (matchLength > outputEnd - output) {
+      return -1;
+    }
+
+    const char* match = output - offset;
+    if (offset >= matchLength) {
+      memcpy(output, match, matchLength);
+    } else {
+      // Overlapping, ie. a repeating pattern: has to go byte by byte
+      for (int i = 0; i < matchLength; i ++) {
+        output[i] = match[i];
+      }
+    }
+    output += matchLength;
+  }
+
+  return output - destination;
+}
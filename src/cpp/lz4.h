@@ -0,0 +1,23 @@
+#ifndef LZ4_H
+#define LZ4_H
+
+#include "support.h"
+
+// A self-contained implementation of the LZ4 block format
+// (https://github.com/lz4/lz4/blob/dev/doc/lz4_Block_format.md), so it's
+// compiled straight into the wasm module. Decoding is fast enough to keep up
+// with any network; the compressor is the simple greedy one, it's only run
+// offline.
+namespace LZ4 {
+  // The most `compress` can write for `length` bytes of input
+  int compressBound(int length);
+
+  // Returns the compressed length, or -1 if `capacity` is too small.
+  int compress(const char* source, int length, char* destination, int capacity);
+
+  // Returns the decompressed length, or -1 if the input is corrupt or doesn't
+  // fit in `capacity`. Never reads or writes out of bounds.
+  int decompress(const char* source, int length, char* destination, int capacity);
+}
+
+#endif
@@ -0,0 +1,51 @@
+#include "mapped_file.h"
+
+// Plain POSIX, so any native build (macOS or Linux) has it
+#ifndef __EMSCRIPTEN__
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <cerrno>
+#include <cstring>
+
+optional<MappedFile::Mapping> MappedFile::map(const string& path, bool readAhead) {
+  const int fd = open(path.c_str(), O_RDONLY);
+  if (fd < 0) {
+    cerr << "couldn't open " << path << ": " << strerror(errno) << "\n";
+    return {};
+  }
+
+  struct stat info;
+  if (fstat(fd, &info) != 0 || info.st_size <= 0) {
+    cerr << "couldn't stat " << path << "\n";
+    close(fd);
+    return {};
+  }
+
+  const size_t length = info.st_size;
+  void* data = mmap(nullptr, length, PROT_READ, MAP_SHARED, fd, 0);
+
+  // The mapping keeps the file alive, we don't need the descriptor anymore
+  close(fd);
+
+  if (data == MAP_FAILED) {
+    cerr << "couldn't map " << path << ": " << strerror(errno) << "\n";
+    return {};
+  }
+
+  if (readAhead) {
+    madvise(data, length, MADV_SEQUENTIAL);
+    madvise(data, length, MADV_WILLNEED);
+  }
+
+  return Mapping { data, length };
+}
+
+void MappedFile::unmap(const Mapping& mapping) {
+  munmap((void*) mapping.data, mapping.length);
+}
+
+#endif
@@ -0,0 +1,23 @@
+#ifndef MAPPED_FILE_H
+#define MAPPED_FILE_H
+
+#include "support.h"
+
+// Read-only memory mapping of a whole file. Only used in the native build --
+// on the web, files are fetched by JS and copied onto the wasm heap.
+//
+// Pages are faulted in on demand and shared with any other process mapping the
+// same file, so opening a large map is constant time.
+namespace MappedFile {
+  struct Mapping {
+    const void* data;
+    size_t length;
+  };
+
+  // `readAhead` hints the kernel to start reading the whole file right away,
+  // front to back.
+  optional<Mapping> map(const string& path, bool readAhead = true);
+  void unmap(const Mapping& mapping);
+}
+
+#endif
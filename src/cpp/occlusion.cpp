@@ -0,0 +1,294 @@
+#include "occlusion.h"
+
+#include "bsp.h"
+#include "simd.h"
+
+#include <algorithm>
+#include <chrono>
+
+// Aerowalk-sized walls are thousands of square units. Anything smaller than this
+// rarely hides enough to be worth the fill rate.
+static const float kMinOccluderArea = 32.0f * 32.0f;
+static const int kMaxOccluders = 4096;
+
+// Occluders are rasterized conservatively (see rasterize()), but boxes still
+// need to be this far behind one (in NDC depth) to be culled, for rounding.
+static const float kDepthBias = 0.0005f;
+
+static double millisecondsSince(chrono::steady_clock::time_point start) {
+  return chrono::duration<double, milli>(chrono::steady_clock::now() - start).count();
+}
+
+OcclusionCuller::OcclusionCuller(vector<Triangle> occluders, double budgetMilliseconds)
+  : _occluders(std::move(occluders)), _budgetMilliseconds(budgetMilliseconds) {
+  int width = kWidth;
+  int height = kHeight;
+  while (true) {
+    _pyramid.push_back({ width, height, vector<float>(width * height, 1.0f) });
+    if (width == 1 && height == 1) {
+      break;
+    }
+    width = (width + 1) / 2;
+    height = (height + 1) / 2;
+  }
+
+  _stats.occluders = _occluders.size();
+  cout << "occlusion culler using " << _occluders.size() << " occluder triangles\n";
+}
+
+vector<OcclusionCuller::Triangle> OcclusionCuller::findOccluders(const BSPMap* map, const function<bool(int)>& isOpaque) {
+  const BSP::face_t* faces = map->faces();
+  const BSP::vertex_t* vertices = map->vertices();
+  const BSP::meshvert_t* meshverts = map->meshverts();
+  const BSP::texture_t* textures = map->textures();
+  const int numTextures = map->numTextures();
+
+  vector<pair<float, Triangle>> candidates;
+
+  for (int faceIndex = 0; faceIndex < map->numFaces(); faceIndex ++) {
+    const BSP::face_t* face = faces + faceIndex;
+
+    // Patches and meshes are curved or detail geometry, and rarely big enough.
+    if (face->type != (int) BSP::FaceType::POLYGON) {
+      continue;
+    }
+    if (face->texture < 0 || face->texture >= numTextures) {
+      continue;
+    }
+    if (!(textures[face->texture].contents & BSP::CONTENTS_SOLID) || !isOpaque(faceIndex)) {
+      continue;
+    }
+
+    const BSP::vertex_t* faceVertices = vertices + face->vertex;
+    const BSP::meshvert_t* faceMeshverts = meshverts + face->meshvert;
+    for (int i = 0; i + 2 < face->n_meshverts; i += 3) {
+      Triangle triangle;
+      for (int j = 0; j < 3; j ++) {
+        const float* position = faceVertices[faceMeshverts[i + j].offset].position;
+        triangle.vertices[j] = glm::vec3(position[0], position[1], position[2]);
+      }
+
+      const float area = 0.5f * glm::length(glm::cross(
+        triangle.vertices[1] - triangle.vertices[0],
+        triangle.vertices[2] - triangle.vertices[0]));
+
+      if (area >= kMinOccluderArea) {
+        candidates.push_back({ area, triangle });
+      }
+    }
+  }
+
+  // Biggest first, so if we run out of budget we've drawn the most useful ones
+  std::sort(candidates.begin(), candidates.end(), [](const auto& a, const auto& b) {
+    return a.first > b.first;
+  });
+
+  vector<Triangle> result;
+  for (int i = 0; i < (int) candidates.size() && i < kMaxOccluders; i ++) {
+    result.push_back(candidates[i].second);
+  }
+  return result;
+}
+
+void OcclusionCuller::update(const glm::mat4& viewProjection) {
+  const auto start = chrono::steady_clock::now();
+
+  _viewProjection = viewProjection;
+  _stats.rasterized = 0;
+  _stats.tested = 0;
+  _stats.culled = 0;
+
+  std::fill(_pyramid[0].depths.begin(), _pyramid[0].depths.end(), 1.0f);
+
+  for (int i = 0; i < (int) _occluders.size(); i ++) {
+    if (i % 16 == 0 && millisecondsSince(start) > _budgetMilliseconds) {
+      break;
+    }
+
+    const Triangle& triangle = _occluders[i];
+    rasterize(
+      viewProjection * glm::vec4(triangle.vertices[0], 1.0f),
+      viewProjection * glm::vec4(triangle.vertices[1], 1.0f),
+      viewProjection * glm::vec4(triangle.vertices[2], 1.0f));
+    _stats.rasterized ++;
+  }
+
+  buildPyramid();
+
+  _stats.milliseconds = millisecondsSince(start);
+}
+
+void OcclusionCuller::rasterize(const glm::vec4& clip0, const glm::vec4& clip1, const glm::vec4& clip2) {
+  // Skip triangles that cross the near plane instead of clipping them.
+  if (clip0.z < -clip0.w || clip1.z < -clip1.w || clip2.z < -clip2.w) {
+    return;
+  }
+
+  // To screen space: x & y in depth-buffer pixels, z in NDC
+  glm::vec3 v[3];
+  const glm::vec4* clips[3] = { &clip0, &clip1, &clip2 };
+  for (int i = 0; i < 3; i ++) {
+    const glm::vec4& clip = *clips[i];
+    v[i] = glm::vec3(
+      (clip.x / clip.w * 0.5f + 0.5f) * kWidth,
+      (clip.y / clip.w * 0.5f + 0.5f) * kHeight,
+      clip.z / clip.w);
+  }
+
+  const auto edge = [](const glm::vec3& a, const glm::vec3& b, const glm::vec3& p) {
+    return (b.x - a.x) * (p.y - a.y) - (b.y - a.y) * (p.x - a.x);
+  };
+
+  float area = edge(v[0], v[1], v[2]);
+  if (fabs(area) < 1e-6f) {
+    return;
+  }
+  // Occluders are two-sided, so just fix up the winding
+  if (area < 0) {
+    std::swap(v[1], v[2]);
+    area = -area;
+  }
+
+  int minX = std::max(0, (int) floor(std::min({ v[0].x, v[1].x, v[2].x })));
+  int maxX = std::min(kWidth - 1, (int) ceil(std::max({ v[0].x, v[1].x, v[2].x })));
+  int minY = std::max(0, (int) floor(std::min({ v[0].y, v[1].y, v[2].y })));
+  int maxY = std::min(kHeight - 1, (int) ceil(std::max({ v[0].y, v[1].y, v[2].y })));
+  if (minX > maxX || minY > maxY) {
+    return;
+  }
+  minX &= ~3; // Process 4 pixels at a time, aligned to the row
+
+  // Each edge function is A * x + B * y + C, positive on the inside.
+  struct EdgeEquation { float a, b, c; };
+  const auto edgeEquation = [](const glm::vec3& a, const glm::vec3& b) {
+    return EdgeEquation { a.y - b.y, b.x - a.x, a.x * b.y - a.y * b.x };
+  };
+  const EdgeEquation e0 = edgeEquation(v[1], v[2]);
+  const EdgeEquation e1 = edgeEquation(v[2], v[0]);
+  const EdgeEquation e2 = edgeEquation(v[0], v[1]);
+
+  // Depth is linear in screen space: z = (e0 * z0 + e1 * z1 + e2 * z2) / area
+  const float zA = (e0.a * v[0].z + e1.a * v[1].z + e2.a * v[2].z) / area;
+  const float zB = (e0.b * v[0].z + e1.b * v[1].z + e2.b * v[2].z) / area;
+  const float zC = (e0.c * v[0].z + e1.c * v[1].z + e2.c * v[2].z) / area;
+
+  // Occluders have to be conservative, since boxes are tested against every
+  // pixel they touch: a pixel's only written if all of it's inside the
+  // triangle (each edge pulled in by half a pixel, measured from its centre),
+  // with the farthest depth the triangle has within it
+  const auto inset = [](const EdgeEquation& e) {
+    return 0.5f * (fabs(e.a) + fabs(e.b));
+  };
+  const float inset0 = inset(e0), inset1 = inset(e1), inset2 = inset(e2);
+  const float zInset = 0.5f * (fabs(zA) + fabs(zB));
+
+  const float4 laneOffsets = { 0.5f, 1.5f, 2.5f, 3.5f };
+  float* depths = _pyramid[0].depths.data();
+
+  for (int y = minY; y <= maxY; y ++) {
+    const float py = y + 0.5f;
+    const float4 row0 = SIMD::splat(e0.b * py + e0.c - inset0);
+    const float4 row1 = SIMD::splat(e1.b * py + e1.c - inset1);
+    const float4 row2 = SIMD::splat(e2.b * py + e2.c - inset2);
+    const float4 rowZ = SIMD::splat(zB * py + zC + zInset);
+
+    for (int x = minX; x <= maxX; x += 4) {
+      const float4 px = SIMD::splat((float) x) + laneOffsets;
+      const float4 w0 = SIMD::splat(e0.a) * px + row0;
+      const float4 w1 = SIMD::splat(e1.a) * px + row1;
+      const float4 w2 = SIMD::splat(e2.a) * px + row2;
+
+      const int4 inside = (w0 >= 0) & (w1 >= 0) & (w2 >= 0);
+      if (!SIMD::any(inside)) {
+        continue;
+      }
+
+      const float4 z = SIMD::splat(zA) * px + rowZ;
+      float* pointer = depths + y * kWidth + x;
+      const float4 previous = SIMD::load(pointer);
+      SIMD::store(pointer, SIMD::select(inside, SIMD::min(previous, z), previous));
+    }
+  }
+}
+
+void OcclusionCuller::buildPyramid() {
+  for (int level = 1; level < (int) _pyramid.size(); level ++) {
+    const Level& source = _pyramid[level - 1];
+    Level& destination = _pyramid[level];
+
+    for (int y = 0; y < destination.height; y ++) {
+      const int y0 = y * 2;
+      const int y1 = std::min(y0 + 1, source.height - 1);
+
+      for (int x = 0; x < destination.width; x ++) {
+        const int x0 = x * 2;
+        const int x1 = std::min(x0 + 1, source.width - 1);
+
+        destination.depths[y * destination.width + x] = std::max({
+          source.depths[y0 * source.width + x0],
+          source.depths[y0 * source.width + x1],
+          source.depths[y1 * source.width + x0],
+          source.depths[y1 * source.width + x1]
+        });
+      }
+    }
+  }
+}
+
+bool OcclusionCuller::isVisible(const glm::vec3& mins, const glm::vec3& maxs) {
+  _stats.tested ++;
+
+  float minX = INFINITY, minY = INFINITY, minZ = INFINITY;
+  float maxX = -INFINITY, maxY = -INFINITY;
+
+  for (int corner = 0; corner < 8; corner ++) {
+    const glm::vec4 clip = _viewProjection * glm::vec4(
+      (corner & 1) ? maxs.x : mins.x,
+      (corner & 2) ? maxs.y : mins.y,
+      (corner & 4) ? maxs.z : mins.z,
+      1.0f);
+
+    // The box reaches behind the camera, so it can't be behind anything
+    if (clip.z < -clip.w) {
+      return true;
+    }
+
+    const float x = (clip.x / clip.w * 0.5f + 0.5f) * kWidth;
+    const float y = (clip.y / clip.w * 0.5f + 0.5f) * kHeight;
+    minX = std::min(minX, x);
+    maxX = std::max(maxX, x);
+    minY = std::min(minY, y);
+    maxY = std::max(maxY, y);
+    minZ = std::min(minZ, clip.z / clip.w);
+  }
+
+  int x0 = std::max(0, (int) floor(minX));
+  int x1 = std::min(kWidth - 1, (int) floor(maxX));
+  int y0 = std::max(0, (int) floor(minY));
+  int y1 = std::min(kHeight - 1, (int) floor(maxY));
+
+  // Off screen -- that's for the frustum culler to decide
+  if (x0 > x1 || y0 > y1) {
+    return true;
+  }
+
+  // Pick the level where the box covers at most a handful of texels
+  int level = 0;
+  int extent = std::max(x1 - x0, y1 - y0);
+  while (extent > 4 && level + 1 < (int) _pyramid.size()) {
+    extent >>= 1;
+    level ++;
+  }
+
+  const Level& hiZ = _pyramid[level];
+  for (int y = y0 >> level; y <= (y1 >> level); y ++) {
+    for (int x = x0 >> level; x <= (x1 >> level); x ++) {
+      if (minZ - kDepthBias < hiZ.depths[y * hiZ.width + x]) {
+        return true;
+      }
+    }
+  }
+
+  _stats.culled ++;
+  return false;
+}
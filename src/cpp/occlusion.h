@@ -0,0 +1,70 @@
+#ifndef OCCLUSION_H
+#define OCCLUSION_H
+
+#include "support.h"
+
+namespace BSP {
+  struct header_t;
+}
+using BSPMap = BSP::header_t;
+
+struct OcclusionStats {
+  int occluders = 0; // Total number of occluder triangles
+  int rasterized = 0; // Occluder triangles drawn this frame (less if we ran out of budget)
+  int tested = 0;
+  int culled = 0;
+  double milliseconds = 0;
+};
+
+// A CPU-side occlusion culler. Each frame, the largest world triangles are
+// rasterized into a low-resolution depth buffer, a hierarchical-Z pyramid is
+// built on top of it, and bounding boxes can then be tested against that
+// pyramid before anything is sent to the GPU.
+//
+// Everything here errs on the side of "visible": occluders that cross the near
+// plane are skipped, boxes that cross it always pass, and we stop rasterizing
+// occluders (not testing boxes) once the frame budget runs out.
+struct OcclusionCuller {
+  static const int kWidth = 256;
+  static const int kHeight = 160;
+
+  struct Triangle {
+    glm::vec3 vertices[3];
+  };
+
+  OcclusionCuller(vector<Triangle> occluders, double budgetMilliseconds = 1.0);
+
+  // Picks large, solid, opaque triangles out of the world geometry.
+  // `isOpaque(faceIndex)` lets the caller filter out translucent surfaces.
+  static vector<Triangle> findOccluders(const BSPMap* map, const function<bool(int)>& isOpaque);
+
+  // Rasterizes the occluders and rebuilds the hierarchical-Z pyramid.
+  void update(const glm::mat4& viewProjection);
+
+  // Returns false only if the whole box is hidden behind occluders.
+  bool isVisible(const glm::vec3& mins, const glm::vec3& maxs);
+
+  const OcclusionStats& stats() const { return _stats; }
+
+private:
+  void rasterize(const glm::vec4& v0, const glm::vec4& v1, const glm::vec4& v2);
+  void buildPyramid();
+
+  vector<Triangle> _occluders;
+  double _budgetMilliseconds;
+
+  glm::mat4 _viewProjection;
+
+  // Level 0 is the depth buffer itself (kWidth x kHeight). Each level after that
+  // halves the resolution and keeps the farthest depth of the texels it covers.
+  struct Level {
+    int width;
+    int height;
+    vector<float> depths;
+  };
+  vector<Level> _pyramid;
+
+  OcclusionStats _stats;
+};
+
+#endif
@@ -0,0 +1,200 @@
+#include "program_cache.h"
+
+#ifdef __APPLE__
+
+#include "gl_helpers.h"
+
+#include <algorithm>
+#include <filesystem>
+#include <fstream>
+#include <iomanip>
+#include <sstream>
+
+namespace fs = std::filesystem;
+
+static const uint32_t kProgramCacheMagic = 0x47525051; // "QPRG"
+static const uint32_t kProgramCacheVersion = 1;
+
+struct ProgramCacheHeader {
+  uint32_t magic;
+  uint32_t version;
+  uint32_t format;
+  uint32_t length;
+};
+
+static uint64_t fnv1a(const char* data, size_t length, uint64_t hash = 14695981039346656037ull) {
+  for (size_t i = 0; i < length; i ++) {
+    hash ^= (unsigned char) data[i];
+    hash *= 1099511628211ull;
+  }
+  return hash;
+}
+
+// Always 16 digits, which is how stale driver directories are told apart
+// from anything else in the root (see isDriverDirectory())
+static string toHex(uint64_t value) {
+  std::stringstream stream;
+  stream << std::hex << std::setw(16) << std::setfill('0') << value;
+  return stream.str();
+}
+
+static bool isDriverDirectory(const fs::directory_entry& entry) {
+  std::error_code error;
+  const string name = entry.path().filename().string();
+  return entry.is_directory(error) && name.size() == 16
+    && std::all_of(name.begin(), name.end(), [](char c) { return isxdigit((unsigned char) c); });
+}
+
+static string glString(GLenum name) {
+  const GLubyte* value = glGetString(name);
+  return value ? string((const char*) value) : string();
+}
+
+static bool supportsProgramBinaries() {
+  static optional<bool> supported;
+  if (!supported) {
+    GLint numFormats = 0;
+    glGetIntegerv(GL_NUM_PROGRAM_BINARY_FORMATS, &numFormats);
+    supported = !hasErrors() && numFormats > 0;
+    if (!*supported) {
+      cout << "program binaries aren't supported by this driver, skipping the program cache\n";
+    }
+  }
+  return *supported;
+}
+
+// The directory is keyed on the driver, so if any of these strings change we
+// start from an empty directory and remove the stale ones. Only directories
+// we made are removed, since the root may be shared (Q_PROGRAM_CACHE_DIR).
+static const fs::path& cacheDirectory() {
+  static optional<fs::path> directory;
+  if (directory) {
+    return *directory;
+  }
+
+  fs::path root;
+  if (const char* overridePath = getenv("Q_PROGRAM_CACHE_DIR")) {
+    root = overridePath;
+  } else if (const char* home = getenv("HOME")) {
+    root = fs::path(home) / "Library" / "Caches" / "q" / "programs";
+  } else {
+    root = fs::path("cache") / "programs";
+  }
+
+  const string driver = glString(GL_VENDOR) + "\n" + glString(GL_RENDERER) + "\n" + glString(GL_VERSION);
+  directory = root / toHex(fnv1a(driver.data(), driver.size()));
+
+  std::error_code error;
+  if (!fs::exists(*directory, error)) {
+    if (fs::exists(root, error)) {
+      for (const auto& entry : fs::directory_iterator(root, error)) {
+        if (!isDriverDirectory(entry)) {
+          continue;
+        }
+        cout << "removing stale program cache " << entry.path() << "\n";
+        fs::remove_all(entry.path(), error);
+      }
+    }
+    fs::create_directories(*directory, error);
+    if (error) {
+      cerr << "failed to create program cache directory " << *directory << ": " << error.message() << "\n";
+    }
+  }
+
+  return *directory;
+}
+
+string ProgramCache::key(const char* vert, int vertLength, const char* frag, int fragLength) {
+  uint64_t hash = fnv1a(vert, vertLength);
+  hash = fnv1a("\0", 1, hash);
+  hash = fnv1a(frag, fragLength, hash);
+  return toHex(hash);
+}
+
+optional<GLuint> ProgramCache::load(const string& key) {
+  if (!supportsProgramBinaries()) {
+    return {};
+  }
+
+  std::ifstream file(cacheDirectory() / (key + ".bin"), std::ios::binary | std::ios::ate);
+  if (!file) {
+    return {};
+  }
+  const size_t fileLength = file.tellg();
+  file.seekg(0);
+
+  // The length is checked against the file's before it's allocated
+  ProgramCacheHeader header;
+  if (!file.read((char*) &header, sizeof(header))
+      || header.magic != kProgramCacheMagic
+      || header.version != kProgramCacheVersion
+      || header.length > fileLength - sizeof(header)) {
+    warn << "ignoring malformed program cache entry " << key << "\n";
+    return {};
+  }
+
+  vector<char> binary(header.length);
+  if (!file.read(binary.data(), binary.size())) {
+    warn << "ignoring truncated program cache entry " << key << "\n";
+    return {};
+  }
+
+  GLuint program = glCreateProgram();
+  glProgramBinary(program, header.format, binary.data(), (GLsizei) binary.size());
+
+  // The driver is allowed to reject binaries at any time (eg. after an update
+  // that kept the same version string), in which case we recompile.
+  GLint status = GL_FALSE;
+  glGetProgramiv(program, GL_LINK_STATUS, &status);
+  if (hasErrors() || status != GL_TRUE) {
+    warn << "driver rejected program cache entry " << key << "\n";
+    glDeleteProgram(program);
+    return {};
+  }
+
+  cout << "loaded program " << program << " from the program cache (" << key << ")\n";
+  return program;
+}
+
+void ProgramCache::store(const string& key, GLuint program) {
+  if (!supportsProgramBinaries()) {
+    return;
+  }
+
+  GLint length = 0;
+  glGetProgramiv(program, GL_PROGRAM_BINARY_LENGTH, &length);
+  if (length <= 0) {
+    return;
+  }
+
+  vector<char> binary(length);
+  GLenum format;
+  glGetProgramBinary(program, length, &length, &format, binary.data());
+  if (hasErrors()) {
+    warn << "failed to read back program binary\n";
+    return;
+  }
+
+  // Write to a temporary file first, so a crash never leaves a half-written entry.
+  const fs::path path = cacheDirectory() / (key + ".bin");
+  const fs::path tempPath = cacheDirectory() / (key + ".tmp");
+  {
+    std::ofstream file(tempPath, std::ios::binary | std::ios::trunc);
+    ProgramCacheHeader header = { kProgramCacheMagic, kProgramCacheVersion, format, (uint32_t) length };
+    file.write((const char*) &header, sizeof(header));
+    file.write(binary.data(), length);
+    if (!file) {
+      warn << "failed to write program cache entry " << key << "\n";
+      return;
+    }
+  }
+
+  std::error_code error;
+  fs::rename(tempPath, path, error);
+  if (error) {
+    warn << "failed to write program cache entry " << key << ": " << error.message() << "\n";
+  }
+}
+
+#else
+#endif
@@ -0,0 +1,19 @@
+#ifndef PROGRAM_CACHE_H
+#define PROGRAM_CACHE_H
+
+#include "support.h"
+
+// A disk cache of linked shader program binaries (via glProgramBinary). Only
+// used in the native build -- WebGL doesn't expose program binaries.
+//
+// Entries live in a sub-directory named after the driver (vendor, renderer and
+// version strings), so updating the driver or switching GPUs automatically
+// invalidates everything that was cached before.
+namespace ProgramCache {
+  string key(const char* vert, int vertLength, const char* frag, int fragLength);
+
+  optional<GLuint> load(const string& key);
+  void store(const string& key, GLuint program);
+}
+
+#endif
@@ -1,34 +1,97 @@
 #include "renderable.h"
 
 #include "bsp.h"
+#include "cooked_map.h"
 #include "gl_helpers.h"
 #include "resource_manager.h"
 #include "scenario.h"
 #include "scenario_bsp.h"
+#include "texture_compression.h"
 #include "hitscan.h"
+#include "occlusion.h"
+#include "area_portals.h"
 #include "pprint.hpp"
 #include "assert.h"
 
-RenderableBSP::RenderableBSP(ResourcePtr<const BSPMap> mapPtr): _map(mapPtr) {
+#include <chrono>
+#include <cmath>
+#include <tuple>
+
+// The size textures are first loaded at (see ResourceManager::wantTextureSize)
+static const int kBaseTextureSize = 64;
+static const int kTextureResidencyInterval = 30; // Frames
+
+RenderableBSP::RenderableBSP(ResourcePtr<const BSPMap> mapPtr, CookedMapHandle cookedMap, RenderableBSPOptions options)
+  : _map(mapPtr), _cookedMapHandle(cookedMap), _options(options) {
   assert(_map);
 
   const BSP::texture_t* textures = _map->textures();
   const int numTextures = _map->numTextures();
 
-  int textureResourceId = 100;
-
+  vector<LoadResource> requests;
   for (int textureIndex = 0; textureIndex < numTextures; textureIndex ++) {
     const BSP::texture_t* texture = textures + textureIndex;
     
-    _textureResourceIds[string(texture->name)] = textureResourceId;
-    ResourceManager::getInstance()->loadResource(this, {
+    const TextureHandle handle = ResourceManager::getInstance()->newTexture();
+    _textures.push_back(handle);
+    requests.push_back({
       string("./data/") + string(texture->name),
       ResourceType::IMAGE_FILE,
-      textureResourceId
+      handle.id(),
+      kBaseTextureSize
     });
+  }
+  ResourceManager::getInstance()->loadResources(this, requests, LoadPriority::DEFERRED);
+}
+
+void RenderableBSP::stopDeferringTextures() {
+  for (const TextureHandle& texture : _textures) {
+    ResourceManager::getInstance()->setPriority(texture.id(), LoadPriority::MAP);
+  }
+  ResourceManager::getInstance()->sendQueuedRequests();
+}
+
+void RenderableBSP::prioritizeTexturesVisibleFrom(const glm::vec3& origin, float angle) {
+  const BSPMap* map = _map.get();
+  const BSP::leaf_t* leaves = map->leaves();
+  const int cluster = leaves[map->findLeaf(origin)].cluster;
+
+  const float radians = glm::radians(angle);
+  const glm::mat4 view = glm::lookAt(origin, origin + glm::vec3(cos(radians), sin(radians), 0), glm::vec3(0, 0, 1));
+  const glm::mat4 projection = glm::perspective(glm::radians(90.0f), 4.0f / 3.0f, 1.0f, 10000.0f);
+  const Frustum frustum = Frustum::fromViewProjection(projection * view);
+
+  // The best priority of any leaf a texture is used in
+  vector<LoadPriority> priorities(_textures.size(), LoadPriority::MAP);
+  for (int leafIndex = 0; leafIndex < map->numLeaves(); leafIndex ++) {
+    const BSP::leaf_t* leaf = leaves + leafIndex;
+    if (leaf->cluster < 0 || !map->isClusterVisible(cluster, leaf->cluster)) {
+      continue;
+    }
+
+    int planeMask = Frustum::kAllPlanes;
+    const bool inView = frustum.intersects(glm::vec3(leaf->mins[0], leaf->mins[1], leaf->mins[2]), glm::vec3(leaf->maxs[0], leaf->maxs[1], leaf->maxs[2]), planeMask);
+    const LoadPriority priority = inView ? LoadPriority::VISIBLE : LoadPriority::NEARBY;
+
+    for (int i = 0; i < leaf->n_leaffaces; i ++) {
+      const int faceIndex = map->leaffaces()[leaf->leafface + i].face;
+      const int textureIndex = map->faces()[faceIndex].texture;
+      if (textureIndex >= 0 && textureIndex < (int) priorities.size()) {
+        priorities[textureIndex] = std::min(priorities[textureIndex], priority);
+      }
+    }
+  }
 
-    textureResourceId ++;
+  int numVisible = 0;
+  int numNearby = 0;
+  for (int textureIndex = 0; textureIndex < (int) _textures.size(); textureIndex ++) {
+    numVisible += priorities[textureIndex] == LoadPriority::VISIBLE;
+    numNearby += priorities[textureIndex] == LoadPriority::NEARBY;
+    ResourceManager::getInstance()->setPriority(_textures[textureIndex].id(), priorities[textureIndex]);
   }
+  ResourceManager::getInstance()->sendQueuedRequests();
+  cout << "from the spawn point: " << numVisible << " textures in view, " << numNearby << " more in the PVS, "
+    << (_textures.size() - numVisible - numNearby) << " elsewhere\n";
 }
 
 
@@ -46,291 +109,434 @@ bool RenderableBSP::finishLoading() {
   // map->printFaces();
   // map->printMeshverts();
 
-  { // Load lightmaps
-    const BSP::lightmap_t* lightmaps = map->lightmaps();
-    const int numLightmaps = map->numLightmaps();
-    for (int i = 0; i < numLightmaps; i ++) {
-      const BSP::lightmap_t* lightmap = lightmaps + i;
-      optional<GLuint> textureId = GLHelpers::loadTexture(lightmap, 128, 128, GL_RGB, GL_RGB, GL_UNSIGNED_BYTE);
-      if (textureId) {
-        _lightmapTextures[i] = *textureId;
-      } else {
-        cerr << "failed to load lightmap " << i << "\n";
-        return false;
-      }
+  ResourcePtr<const CookedMap> loadedCookedMap = ResourceManager::getInstance()->getCookedMap(_cookedMapHandle);
+  if (loadedCookedMap && !loadedCookedMap->matches(map)) {
+    cout << "cooked map is out of date, ignoring it\n";
+  } else if (loadedCookedMap) {
+    _cookedMap = loadedCookedMap;
+  }
+  if (!_cookedMap) {
+    cout << "no cooked map, cooking one in memory\n";
+    auto* bytes = new vector<char>(Cooked::cook(map));
+    const size_t length = bytes->size();
+    _cookedMap = ResourcePtr<const CookedMap>((const CookedMap*) bytes->data(), [bytes](const CookedMap*) {
+      delete bytes;
+    });
+    ResourceManager::getInstance()->storeCookedMapInCache(_map, _cookedMap, length);
+  }
+  const CookedMap* cookedMap = _cookedMap.get();
+
+  { // All the lightmaps were packed into one texture. Compressed if we can,
+    // at a quarter the size (RGBM, so the shader decodes it as rgb * a --
+    // which is a no-op for the uncompressed RGB one).
+    optional<GLuint> textureId;
+    if (GLHelpers::compressedFormats().s3tc) {
+      textureId = GLHelpers::loadCompressedTexture(
+        cookedMap->compressedLightmapAtlas(), cookedMap->compressedLightmapAtlasEntry()->length,
+        cookedMap->lightmapAtlasWidth, cookedMap->lightmapAtlasHeight,
+        TextureCompression::glInternalFormat(TextureCompression::BC3));
+    }
+    if (!textureId) {
+      textureId = GLHelpers::loadTexture(
+        cookedMap->lightmapAtlas(), cookedMap->lightmapAtlasWidth, cookedMap->lightmapAtlasHeight,
+        GL_RGB, GL_RGB, GL_UNSIGNED_BYTE);
     }
-
-    unsigned char white[] = { 255, 255, 255, 255 };
-    optional<GLuint> textureId = GLHelpers::loadTexture(
-        &white[0], 1, 1, GL_RGBA8, GL_RGBA, GL_UNSIGNED_BYTE);
     if (textureId) {
-      _fallbackLightmapTexture = *textureId;
+      _lightmapAtlas = *textureId;
     } else {
-      cerr << "failed to create fallback lightmap\n";
+      cerr << "failed to load the lightmap atlas\n";
       return false;
     }
   }
 
-  {
-    const int numFaces = map->numFaces();
-    for (int faceIndex = 0; faceIndex < numFaces; faceIndex ++) {
-      optional<RenderableFace> face = RenderableFace::generate(map, faceIndex);
-      if (face) {
-        _renderableFaces.push_back(*face);
+  { // Upload the world's geometry as it was cooked
+    const Cooked::face_t* cookedFaces = cookedMap->faces();
+    for (int i = 0; i < cookedMap->numFaces(); i ++) {
+      const Cooked::face_t* cookedFace = cookedFaces + i;
+
+      RenderableFace face;
+      face.faceIndex = cookedFace->face;
+      face.firstIndex = cookedFace->firstIndex;
+      face.numIndices = cookedFace->numIndices;
+      face.mins = glm::vec3(cookedFace->mins[0], cookedFace->mins[1], cookedFace->mins[2]);
+      face.maxs = glm::vec3(cookedFace->maxs[0], cookedFace->maxs[1], cookedFace->maxs[2]);
+      if (cookedFace->texture >= 0) {
+        face.texture = _textures[cookedFace->texture];
+        face.transparent = isTransparent(cookedFace->texture);
       }
-    }
-  }
-
-  return true;
-}
 
-struct TesselatedPatch {
-  vector<BSP::vertex_t> vertices;
-  vector<int> indices;
-};
-
-static TesselatedPatch tesselatedPatch(int L, const vector<BSP::vertex_t>& controls) {
-  // The body of this method is borrowed from: http://graphics.cs.brown.edu/games/quake/quake3.html#RenderingFaces
-  // Thank you, Morgan McGuire!
+      _renderableFaces.push_back(face);
+    }
+    _visibleFaces.resize(_renderableFaces.size(), true);
 
-  TesselatedPatch result;
+    const int numVertices = cookedMap->numVertices();
+    glGenBuffers(1, &(_vertices.buffer));
+    glBindBuffer(GL_ARRAY_BUFFER, _vertices.buffer);
+    glBufferData(GL_ARRAY_BUFFER, sizeof(Cooked::vertex_t) * numVertices, cookedMap->vertices(), GL_STATIC_DRAW);
+    _vertices.stride = sizeof(Cooked::vertex_t);
 
-  // The number of vertices along a side is 1 + num edges
-  const int L1 = L + 1;
-  result.vertices.resize(L1 * L1);
+    _colors = GLHelpers::generateRandomColorsVBO(numVertices);
 
-  // 0 1 2
-  // 3 4 5
-  // 6 7 8
+    glGenBuffers(1, &(_elements.buffer));
+    glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, _elements.buffer);
+    glBufferData(GL_ELEMENT_ARRAY_BUFFER, sizeof(uint32_t) * cookedMap->numIndices(), cookedMap->indices(), GL_STATIC_DRAW);
+    _elements.count = cookedMap->numIndices();
 
-  for (int col = 0; col <= L; ++col) { // Fill in the first row
-    double a = (double)col / L;
-    double b = 1 - a;
+    if (hasErrors()) {
+      cerr << "failed to upload world geometry\n";
+      return false;
+    }
 
-    result.vertices[col] =
-        controls[0] * (b * b) + 
-        controls[3] * (2 * b * a) +
-        controls[6] * (a * a);
+    _worldDrawList.cluster = -1;
+    _worldDrawList.area = -1;
+    _worldDrawList.areaPortalsVersion = -1;
+    _worldDrawList.elements = _elements;
+    const Cooked::batch_t* batches = cookedMap->batches();
+    for (int i = 0; i < cookedMap->numBatches(); i ++) {
+      if (batches[i].texture < 0) {
+        continue;
+      }
+      _worldDrawList.batches.push_back({
+        _textures[batches[i].texture],
+        isTransparent(batches[i].texture),
+        batches[i].firstIndex,
+        batches[i].numIndices,
+        glm::vec3(INFINITY),
+        glm::vec3(-INFINITY)
+      });
+    }
   }
 
-  for (int row = 1; row <= L; ++row) { // Fill in each next row
-    double a = (double)row / L;
-    double b = 1.0 - a;
-
-    BSP::vertex_t temp[3];
-    const auto helper = [&controls, a, b](int controlRow) {
-      return
-        controls[controlRow * 3 + 0] * (b * b) + 
-        controls[controlRow * 3 + 1] * (2 * b * a) +
-        controls[controlRow * 3 + 2] * (a * a);
-    };
-    temp[0] = helper(0);
-    temp[1] = helper(1);
-    temp[2] = helper(2);
+  { // Set up the bounds used for frustum culling
+    _renderableIndexForFace.resize(map->numFaces(), -1);
+    for (int i = 0; i < (int) _renderableFaces.size(); i ++) {
+      const RenderableFace& renderableFace = _renderableFaces[i];
+      _renderableIndexForFace[renderableFace.faceIndex] = i;
+      _faceBounds.add(renderableFace.mins, renderableFace.maxs);
+    }
 
-    for(int col = 0; col <= L; ++col) {
-      double a = (double)col / L;
-      double b = 1.0 - a;
+    // The cooked batches cover every face with their texture
+    for (ClusterBatch& batch : _worldDrawList.batches) {
+      for (const RenderableFace& renderableFace : _renderableFaces) {
+        if (renderableFace.texture == batch.texture) {
+          batch.mins = glm::min(batch.mins, renderableFace.mins);
+          batch.maxs = glm::max(batch.maxs, renderableFace.maxs);
+        }
+      }
+    }
+    setBatchBounds(_worldDrawList);
+    _faceCullFrame.resize(_renderableFaces.size(), 0);
+
+    // Sampled along each face's first edge, which is enough to tell how much
+    // detail a texture needs at a distance
+    const Cooked::face_t* cookedFaces = cookedMap->faces();
+    const Cooked::vertex_t* vertices = cookedMap->vertices();
+    const uint32_t* indices = cookedMap->indices();
+    _textureRepeatsPerUnit.resize(_textures.size(), 0);
+    for (int i = 0; i < cookedMap->numFaces(); i ++) {
+      const Cooked::face_t* cookedFace = cookedFaces + i;
+      if (cookedFace->texture < 0 || cookedFace->numIndices < 2) {
+        continue;
+      }
+      const Cooked::vertex_t& a = vertices[indices[cookedFace->firstIndex]];
+      const Cooked::vertex_t& b = vertices[indices[cookedFace->firstIndex + 1]];
+      const float length = glm::length(
+        glm::vec3(b.position[0], b.position[1], b.position[2]) -
+        glm::vec3(a.position[0], a.position[1], a.position[2]));
+      if (length > 0) {
+        const float texcoordLength = glm::length(
+          glm::vec2(b.texcoord[0], b.texcoord[1]) -
+          glm::vec2(a.texcoord[0], a.texcoord[1]));
+        float& repeats = _textureRepeatsPerUnit[cookedFace->texture];
+        repeats = std::max(repeats, texcoordLength / length);
+      }
+    }
 
-      result.vertices[row * L1 + col]=
-          temp[0] * (b * b) + 
-          temp[1] * (2 * b * a) +
-          temp[2] * (a * a);
+    for (int textureIndex = 0; textureIndex < (int) _textures.size(); textureIndex ++) {
+      if (ResourceManager::getInstance()->isLoading(_textures[textureIndex].id())) {
+        _streamingTextures.push_back(textureIndex);
+      }
     }
-  }
 
-  // Compute the indices
-  for (int row = 0; row < L; ++row) {
-    for(int col = 0; col < L; ++col)	{
-      result.indices.push_back((row + 0) * L1 + (col + 0));
-      result.indices.push_back((row + 1) * L1 + (col + 0));
-      result.indices.push_back((row + 1) * L1 + (col + 1));
+    const BSP::leaf_t* leaves = map->leaves();
+    for (int i = 0; i < map->numLeaves(); i ++) {
+      const BSP::leaf_t* leaf = leaves + i;
+      _leafBounds.add(
+        glm::vec3(leaf->mins[0], leaf->mins[1], leaf->mins[2]),
+        glm::vec3(leaf->maxs[0], leaf->maxs[1], leaf->maxs[2]));
+    }
 
-      result.indices.push_back((row + 0) * L1 + (col + 0));
-      result.indices.push_back((row + 1) * L1 + (col + 1));
-      result.indices.push_back((row + 0) * L1 + (col + 1));
+    vector<bool> inLeaf(map->numFaces(), false);
+    const BSP::leafface_t* leaffaces = map->leaffaces();
+    for (int i = 0; i < map->numLeaffaces(); i ++) {
+      inLeaf[leaffaces[i].face] = true;
+    }
+    for (int i = 0; i < (int) _renderableFaces.size(); i ++) {
+      if (!inLeaf[_renderableFaces[i].faceIndex]) {
+        _facesOutsideLeaves.push_back(i);
+      }
     }
   }
 
-  return result;
-}
-
-static TesselatedPatch untesselatedPatch(const vector<BSP::vertex_t>& controlPoints) {
-  // 0 1 2
-  // 3 4 5
-  // 6 7 8
-
-  assert(controlPoints.size() == 9);
-
-  TesselatedPatch untesselated;
-  untesselated.vertices.insert(untesselated.vertices.end(), begin(controlPoints), end(controlPoints));
-
-  untesselated.indices.push_back(0);
-  untesselated.indices.push_back(1);
-  untesselated.indices.push_back(3);
-
-  untesselated.indices.push_back(1);
-  untesselated.indices.push_back(3);
-  untesselated.indices.push_back(4);
-
-  untesselated.indices.push_back(1);
-  untesselated.indices.push_back(2);
-  untesselated.indices.push_back(4);
-
-  untesselated.indices.push_back(2);
-  untesselated.indices.push_back(4);
-  untesselated.indices.push_back(5);
+  if (_options.occlusionCulling) {
+    const BSP::face_t* faces = map->faces();
+    _occlusionCuller = make_shared<OcclusionCuller>(OcclusionCuller::findOccluders(map, [&](int faceIndex) {
+      const int textureIndex = faces[faceIndex].texture;
+      return textureIndex < 0 || textureIndex >= map->numTextures() || !isTransparent(textureIndex);
+    }));
+  }
 
-  untesselated.indices.push_back(3 + 0);
-  untesselated.indices.push_back(3 + 1);
-  untesselated.indices.push_back(3 + 3);
+  return true;
+}
 
-  untesselated.indices.push_back(3 + 1);
-  untesselated.indices.push_back(3 + 3);
-  untesselated.indices.push_back(3 + 4);
+bool RenderableBSP::isTransparent(int textureIndex) {
+  optional<RenderableTextureOptions> textureOptions = ResourceManager::getInstance()->getTextureOptions(_textures[textureIndex]);
+  return textureOptions ? textureOptions->surfaceParamTrans : false;
+}
 
-  untesselated.indices.push_back(3 + 1);
-  untesselated.indices.push_back(3 + 2);
-  untesselated.indices.push_back(3 + 4);
+// Textures (and with them, which surfaces are transparent) keep arriving after
+// the world has been built. Draw lists refer to textures by handle, so only the
+// transparency of what's already been built needs patching.
+void RenderableBSP::updateStreamedTextures() {
+  if (_streamingTextures.empty()) {
+    return;
+  }
 
-  untesselated.indices.push_back(3 + 2);
-  untesselated.indices.push_back(3 + 4);
-  untesselated.indices.push_back(3 + 5);
+  auto resourceManager = ResourceManager::getInstance();
+  for (int i = 0; i < (int) _streamingTextures.size(); ) {
+    const int textureIndex = _streamingTextures[i];
+    const TextureHandle texture = _textures[textureIndex];
+    if (resourceManager->isLoading(texture.id())) {
+      i ++;
+      continue;
+    }
+    _streamingTextures[i] = _streamingTextures.back();
+    _streamingTextures.pop_back();
 
-  return untesselated;
+    if (!isTransparent(textureIndex)) {
+      continue; // As it was assumed to be
+    }
+    for (RenderableFace& face : _renderableFaces) {
+      if (face.texture == texture) {
+        face.transparent = true;
+      }
+    }
+    for (ClusterBatch& batch : _worldDrawList.batches) {
+      if (batch.texture == texture) {
+        batch.transparent = true;
+      }
+    }
+    for (ClusterDrawList& drawList : _clusterDrawLists) {
+      for (ClusterBatch& batch : drawList.batches) {
+        if (batch.texture == texture) {
+          batch.transparent = true;
+        }
+      }
+    }
+  }
 }
 
-static TesselatedPatch tesselatedFace(const BSPMap* map, const BSP::face_t* face) {
-  assert(face->type == (int) BSP::FaceType::PATCH);
-
-  const BSP::vertex_t* faceVertices = map->vertices() + face->vertex;
-
-  int numVerticesWidth = face->size[0];
-  int numVerticesHeight = face->size[1];
+void RenderableBSP::updateTextureResidency(const glm::mat4& viewProjection, const glm::vec3& cameraLocation, float pixelsPerUnit) {
+  if (_residencyFrame ++ % kTextureResidencyInterval != 0) {
+    return;
+  }
 
-  assert(numVerticesWidth * numVerticesHeight == face->n_vertices);
+  const BSPMap* map = _map.get();
+  const BSP::leaf_t* leaves = map->leaves();
+  const BSP::leafface_t* leaffaces = map->leaffaces();
+  const BSP::face_t* faces = map->faces();
+  const Frustum frustum = Frustum::fromViewProjection(viewProjection);
 
-  int numRows = (numVerticesHeight - 1) / 2;
-  int numCols  = (numVerticesWidth - 1) / 2;
+  // The closest any of each texture's faces in view gets
+  _textureDistances.assign(_textures.size(), INFINITY);
+  for (int leafIndex = 0; leafIndex < map->numLeaves(); leafIndex ++) {
+    const BSP::leaf_t* leaf = leaves + leafIndex;
+    if (leaf->cluster < 0 || !map->isClusterVisible(_cameraCluster, leaf->cluster)) {
+      continue;
+    }
+    const glm::vec3 mins(leaf->mins[0], leaf->mins[1], leaf->mins[2]);
+    const glm::vec3 maxs(leaf->maxs[0], leaf->maxs[1], leaf->maxs[2]);
+    int planeMask = Frustum::kAllPlanes;
+    if (!frustum.intersects(mins, maxs, planeMask)) {
+      continue;
+    }
 
-  int tesselationLevel = 7;
+    // To the closest point of the leaf, so the camera's own leaf is at 1
+    const float distance = std::max(1.0f, glm::distance(cameraLocation, glm::clamp(cameraLocation, mins, maxs)));
+    for (int i = 0; i < leaf->n_leaffaces; i ++) {
+      const int textureIndex = faces[leaffaces[leaf->leafface + i].face].texture;
+      if (textureIndex >= 0 && textureIndex < (int) _textures.size()) {
+        _textureDistances[textureIndex] = std::min(_textureDistances[textureIndex], distance);
+      }
+    }
+  }
 
-  vector<TesselatedPatch> allPatches;
+  for (int textureIndex = 0; textureIndex < (int) _textures.size(); textureIndex ++) {
+    const float distance = _textureDistances[textureIndex];
+    const float repeats = _textureRepeatsPerUnit[textureIndex];
+    if (distance == INFINITY || repeats <= 0) {
+      continue;
+    }
+    // Pixels per unit on the face, over how many times the texture repeats
+    // in a unit, is how many texels across the texture needs
+    ResourceManager::getInstance()->wantTextureSize(_textures[textureIndex], (int) ceil(pixelsPerUnit / distance / repeats));
+  }
+}
 
-  for (int row = 0; row < numRows; row ++) {
-    for (int col = 0; col < numCols; col ++) {
-      const BSP::vertex_t* patchVertices = faceVertices + row * 2 * numVerticesWidth + col * 2;
+void RenderableBSP::cullNode(int nodeIndex, int planeMask, const Frustum& frustum, const AreaPortals& areaPortals) {
+  const BSPMap* map = _map.get();
 
-      vector<BSP::vertex_t> controlPoints; // this seems readable to me!
-      controlPoints.resize(9);
-      controlPoints[0] = patchVertices[0 * numVerticesWidth + 0];
-      controlPoints[1] = patchVertices[0 * numVerticesWidth + 1];
-      controlPoints[2] = patchVertices[0 * numVerticesWidth + 2];
-      controlPoints[3] = patchVertices[1 * numVerticesWidth + 0];
-      controlPoints[4] = patchVertices[1 * numVerticesWidth + 1];
-      controlPoints[5] = patchVertices[1 * numVerticesWidth + 2];
-      controlPoints[6] = patchVertices[2 * numVerticesWidth + 0];
-      controlPoints[7] = patchVertices[2 * numVerticesWidth + 1];
-      controlPoints[8] = patchVertices[2 * numVerticesWidth + 2];
+  if (nodeIndex < 0) {
+    const int leafIndex = -(nodeIndex + 1);
+    const BSP::leaf_t* leaf = map->leaves() + leafIndex;
+    if (leaf->cluster < 0) {
+      return; // Outside the map
+    }
+    if (!areaPortals.areasConnected(_cameraArea, leaf->area)) {
+      return; // Behind a closed door
+    }
+    if (!map->isClusterVisible(_cameraCluster, leaf->cluster)) {
+      return;
+    }
 
-      // allPatches.push_back(untesselatedPatch(controlPoints));
-      allPatches.push_back(tesselatedPatch(tesselationLevel, controlPoints));
+    if (planeMask == 0) {
+      _insideLeaves.push_back(leafIndex);
+    } else {
+      _intersectingLeaves.push_back(leafIndex);
     }
+    return;
   }
 
-  TesselatedPatch result;
-
-  for (const TesselatedPatch& patch : allPatches) {
-    int startingVertexIndex = result.vertices.size();
-    result.vertices.insert(result.vertices.end(), patch.vertices.begin(), patch.vertices.end());
-    for (int index : patch.indices) {
-      result.indices.push_back(startingVertexIndex + index);
+  const BSP::node_t* node = map->nodes() + nodeIndex;
+  if (planeMask != 0) {
+    const glm::vec3 mins(node->mins[0], node->mins[1], node->mins[2]);
+    const glm::vec3 maxs(node->maxs[0], node->maxs[1], node->maxs[2]);
+    if (!frustum.intersects(mins, maxs, planeMask)) {
+      return;
     }
   }
 
-  return result;
+  cullNode(node->children[0], planeMask, frustum, areaPortals);
+  cullNode(node->children[1], planeMask, frustum, areaPortals);
 }
 
-optional<RenderableFace> RenderableFace::generate(const BSPMap* map, int faceIndex) {
-  const BSP::face_t* faces = map->faces();
-  const BSP::face_t* face = faces + faceIndex;
-
-  if (face->type == (int) BSP::FaceType::POLYGON || face->type == (int) BSP::FaceType::MESH) {
-    const BSP::vertex_t* vertices = map->vertices();
-    const BSP::meshvert_t* meshverts = map->meshverts();
-
-    RenderableFace result;
-    result.faceIndex = faceIndex;
+void RenderableBSP::cull(const glm::mat4& viewProjection, const glm::vec3& cameraLocation, const AreaPortals& areaPortals) {
+  const BSPMap* map = _map.get();
+  const auto start = chrono::steady_clock::now();
+
+  updateStreamedTextures();
+
+  const BSP::leaf_t* cameraLeaf = map->leaves() + map->findLeaf(cameraLocation);
+  _cameraCluster = cameraLeaf->cluster;
+  _cameraArea = cameraLeaf->area;
+
+  if (_options.submission == WorldSubmission::CLUSTER_BATCHES) {
+    // Builds the draw list if we just moved into a new cluster (or a door
+    // opened or closed), then culls its batches. Everything is visible from
+    // outside the map, which the cooked batches already cover.
+    _currentDrawList = _cameraCluster < 0
+      ? &_worldDrawList
+      : &clusterDrawList(_cameraCluster, _cameraArea, areaPortals);
+    cullClusterBatches(viewProjection);
+    return;
+  }
 
-    VBO& verticesVBO = result.vertices;
-    VBO& colorsVBO = result.colors;
-    EBO& elementsEBO = result.elements;
+  const Frustum frustum = Frustum::fromViewProjection(viewProjection);
 
-    // Load vertices
-    glGenBuffers(1, &(verticesVBO.buffer));
-    glBindBuffer(GL_ARRAY_BUFFER, verticesVBO.buffer);
-    glBufferData(
-      GL_ARRAY_BUFFER,
-      sizeof(BSP::vertex_t) * face->n_vertices,
-      &((vertices + face->vertex)->position),
-      GL_STATIC_DRAW);
+  _cullFrame ++;
+  _insideLeaves.clear();
+  _intersectingLeaves.clear();
+  _candidateFaces.clear();
+  _frustumVisibleFaces.clear();
 
-    verticesVBO.stride = sizeof(BSP::vertex_t);
+  // Walk the BSP tree, skipping whole subtrees outside the frustum. Leaves
+  // that are only partially inside get their own box tested below.
+  if (map->numNodes() > 0) {
+    cullNode(0, Frustum::kAllPlanes, frustum, areaPortals);
+  }
+  frustum.cull(_leafBounds, _intersectingLeaves, _insideLeaves);
+
+  const BSP::leaf_t* leaves = map->leaves();
+  const BSP::leafface_t* leaffaces = map->leaffaces();
+  for (int leafIndex : _insideLeaves) {
+    const BSP::leaf_t* leaf = leaves + leafIndex;
+    for (int i = 0; i < leaf->n_leaffaces; i ++) {
+      const int renderableIndex = _renderableIndexForFace[leaffaces[leaf->leafface + i].face];
+      if (renderableIndex < 0 || _faceCullFrame[renderableIndex] == _cullFrame) {
+        continue;
+      }
+      _faceCullFrame[renderableIndex] = _cullFrame;
+      _candidateFaces.push_back(renderableIndex);
+    }
+  }
+  _candidateFaces.insert(_candidateFaces.end(), _facesOutsideLeaves.begin(), _facesOutsideLeaves.end());
 
-    // Load colors
-    colorsVBO = GLHelpers::generateRandomColorsVBO(face->n_vertices);
+  frustum.cull(_faceBounds, _candidateFaces, _frustumVisibleFaces);
 
-    // Load EBO
-    glGenBuffers(1, &(elementsEBO.buffer));
-    glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, elementsEBO.buffer);
-    glBufferData(GL_ELEMENT_ARRAY_BUFFER,
-      sizeof(GLuint) * face->n_meshverts,
-      meshverts + face->meshvert,
-      GL_STATIC_DRAW);
-    elementsEBO.count = face->n_meshverts;
+  _cullingStats.faces = _renderableFaces.size();
+  _cullingStats.frustumVisible = _frustumVisibleFaces.size();
+  _cullingStats.frustumMilliseconds = chrono::duration<double, milli>(chrono::steady_clock::now() - start).count();
 
-    return result;
+  if (_occlusionCuller) {
+    _occlusionCuller->update(viewProjection);
   }
 
-  if (face->type == (int) BSP::FaceType::PATCH) {
-    RenderableFace result;
-    result.faceIndex = faceIndex;
-
-    VBO& verticesVBO = result.vertices;
-    VBO& colorsVBO = result.colors;
-    EBO& elementsEBO = result.elements;
-
-    TesselatedPatch tesselation = tesselatedFace(map, face);
+  std::fill(_visibleFaces.begin(), _visibleFaces.end(), false);
+  _cullingStats.drawn = 0;
+  for (int renderableIndex : _frustumVisibleFaces) {
+    if (_occlusionCuller && !_occlusionCuller->isVisible(_faceBounds.mins(renderableIndex), _faceBounds.maxs(renderableIndex))) {
+      continue;
+    }
+    _visibleFaces[renderableIndex] = true;
+    _cullingStats.drawn ++;
+  }
 
-    // cout << "num vertices " << tesselation.vertices.size() << " num elements " << tesselation.indices.size() << "\n";
+  static int printLimiter = 0;
+  if (printLimiter ++ % 100 == 0) {
+    cout << "frustum: " << _cullingStats.frustumVisible << " / " << _cullingStats.faces << " faces visible"
+         << " in " << _cullingStats.frustumMilliseconds << "ms\n";
 
-    // Load vertices
-    glGenBuffers(1, &(verticesVBO.buffer));
-    glBindBuffer(GL_ARRAY_BUFFER, verticesVBO.buffer);
-    glBufferData(
-      GL_ARRAY_BUFFER,
-      sizeof(BSP::vertex_t) * tesselation.vertices.size(),
-      &(tesselation.vertices.data()->position),
-      GL_STATIC_DRAW);
+    if (_occlusionCuller) {
+      const OcclusionStats& stats = _occlusionCuller->stats();
+      cout << "occlusion: culled " << stats.culled << " / " << stats.tested << " faces"
+           << ", rasterized " << stats.rasterized << " / " << stats.occluders << " occluders"
+           << " in " << stats.milliseconds << "ms\n";
+    }
+  }
+}
 
-    verticesVBO.stride = sizeof(BSP::vertex_t);
+// Only the batches are tested, every frame, even while the draw list stays the same
+void RenderableBSP::cullClusterBatches(const glm::mat4& viewProjection) {
+  const auto start = chrono::steady_clock::now();
+  const ClusterDrawList& drawList = *_currentDrawList;
+  const Frustum frustum = Frustum::fromViewProjection(viewProjection);
+  _frustumVisibleBatches.clear();
+  frustum.cull(drawList.bounds, drawList.allBatches, _frustumVisibleBatches);
 
-    // Load colors
-    colorsVBO = GLHelpers::generateRandomColorsVBO(tesselation.vertices.size());
+  _cullingStats.faces = drawList.batches.size();
+  _cullingStats.frustumVisible = _frustumVisibleBatches.size();
+  _cullingStats.frustumMilliseconds = chrono::duration<double, milli>(chrono::steady_clock::now() - start).count();
 
-    // Load EBO
-    glGenBuffers(1, &(elementsEBO.buffer));
-    glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, elementsEBO.buffer);
-    glBufferData(GL_ELEMENT_ARRAY_BUFFER,
-      sizeof(GLuint) * tesselation.indices.size(),
-      tesselation.indices.data(),
-      GL_STATIC_DRAW);
-    elementsEBO.count = tesselation.indices.size();
+  if (_occlusionCuller) {
+    _occlusionCuller->update(viewProjection);
+  }
 
-    return result;
+  _visibleBatches.clear();
+  for (int batchIndex : _frustumVisibleBatches) {
+    const ClusterBatch& batch = drawList.batches[batchIndex];
+    if (_occlusionCuller && !_occlusionCuller->isVisible(batch.mins, batch.maxs)) {
+      continue;
+    }
+    _visibleBatches.push_back(batchIndex);
   }
+  _cullingStats.drawn = _visibleBatches.size();
+}
 
-  return {};
+void RenderableBSP::bindTexture(const SceneShaderParameters& inputs, TextureHandle texture) {
+  optional<GLuint> textureId = ResourceManager::getInstance()->getTexture(texture);
+  glActiveTexture(GL_TEXTURE0);
+  glBindTexture(GL_TEXTURE_2D, textureId ? *textureId : ResourceManager::getInstance()->getPlaceholderTexture());
+  glUniform1i(inputs.unifTexture, 0);
 }
 
 void RenderableBSP::render(const SceneShaderParameters& inputs, RenderMode mode, const optional<HitScanResult>& result) {
@@ -340,98 +546,249 @@ void RenderableBSP::render(const SceneShaderParameters& inputs, RenderMode mode,
     return;
   }
 
-  const BSP::face_t* faces = map->faces();
-  const int numFaces = map->numFaces();
+  // Bind vertices
+  glBindBuffer(GL_ARRAY_BUFFER, _vertices.buffer);
+  glVertexAttribPointer(
+    inputs.inPosition, 3, GL_FLOAT, GL_FALSE,
+    _vertices.stride /* stride */,
+    (void*) 0 /* offset */);
+
+  // Bind texture coordinates
+  glVertexAttribPointer(
+    inputs.inTextureCoords, 2, GL_FLOAT, GL_FALSE,
+    _vertices.stride /* stride */,
+    (void*) offsetof(Cooked::vertex_t, texcoord) /* offset */);
+
+  // Bind lightmap coordinates (normalized shorts)
+  glVertexAttribPointer(
+    inputs.inLightmapCoords, 2, GL_UNSIGNED_SHORT, GL_TRUE,
+    _vertices.stride /* stride */,
+    (void*) offsetof(Cooked::vertex_t, lmcoord) /* offset */);
+
+  // Bind colors
+  glBindBuffer(GL_ARRAY_BUFFER, _colors.buffer);
+  glVertexAttribPointer(
+    inputs.inColor, 3, GL_FLOAT, GL_FALSE,
+    _colors.stride /* stride */,
+    (void*) 0 /* offset */);
+
+  glUniform1f(inputs.unifAlpha, mode == RenderMode::TRANSPARENCY ? 0.9 : 1);
+
+  // Every face's lightmap is in the atlas
+  glActiveTexture(GL_TEXTURE1);
+  glBindTexture(GL_TEXTURE_2D, _lightmapAtlas);
+  glUniform1i(inputs.unifLightmapTexture, 1);
+
+  if (_options.submission == WorldSubmission::CLUSTER_BATCHES) {
+    renderClusterBatches(inputs, mode, result);
+  } else {
+    renderFaces(inputs, mode, result);
+  }
+}
 
-  const BSP::texture_t* textures = map->textures();
-  const int numTextures = map->numTextures();
+void RenderableBSP::renderFaces(const SceneShaderParameters& inputs, RenderMode mode, const optional<HitScanResult>& result) {
+  const BSP::face_t* faces = _map->faces();
 
-  for (const RenderableFace& renderableFace : _renderableFaces) {
+  glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, _elements.buffer);
+
+  for (int renderableIndex = 0; renderableIndex < (int) _renderableFaces.size(); renderableIndex ++) {
+    if (!_visibleFaces[renderableIndex]) {
+      continue;
+    }
+
+    const RenderableFace& renderableFace = _renderableFaces[renderableIndex];
     const BSP::face_t* face = faces + renderableFace.faceIndex;
     // if (face->type != (int) BSP::FaceType::PATCH) {
     //   continue;
     // }
 
-    const VBO& verticesVBO = renderableFace.vertices;
-    const VBO& colorsVBO = renderableFace.colors;
-    const EBO& elementsEBO = renderableFace.elements;
-
-    // Bind the texture
-    int textureOffset = face->texture;
-    if (textureOffset < 0 || textureOffset >= numTextures) {
+    if (!renderableFace.texture) {
       continue;
     }
 
-    const BSP::texture_t* texture = textures + textureOffset;
-    const int textureResourceId = _textureResourceIds[string(texture->name)];
-
-    optional<RenderableTextureOptions> textureOptions = ResourceManager::getInstance()->getTextureOptions(textureResourceId);
-    bool isTransparent = textureOptions ? textureOptions->surfaceParamTrans : false;
-    if (mode == RenderMode::SOLID && isTransparent) {
+    if (mode == RenderMode::SOLID && renderableFace.transparent) {
       continue;
-    } else if (mode == RenderMode::TRANSPARENCY && !isTransparent) {
+    } else if (mode == RenderMode::TRANSPARENCY && !renderableFace.transparent) {
       continue;
     }
-    glUniform1f(inputs.unifAlpha, isTransparent ? 0.9 : 1);
 
-    optional<GLuint> textureId = ResourceManager::getInstance()->getTexture(textureResourceId);
-    if (textureId) {
-      glActiveTexture(GL_TEXTURE0);
-      glBindTexture(GL_TEXTURE_2D, *textureId);
-      glUniform1i(inputs.unifTexture, 0);
-    }
+    bindTexture(inputs, renderableFace.texture);
 
     if (result && result->face == face) {
       glUniform1i(inputs.unifHighlight, 1);
 
       static int printLimiter = 0;
       if (result && printLimiter ++ % 100 == 0) {
-        cout << "current face: " << *face << ", " << *texture << "\n";
+        cout << "current face: " << *face << ", " << *(_map->textures() + face->texture) << "\n";
       }
     } else {
       glUniform1i(inputs.unifHighlight, 0);
     }
 
-    // Bind the lightmap
-    int lightmapIndex = face->lm_index;
-    if (const GLuint* textureId = getValue(_lightmapTextures, lightmapIndex)) {
-      glActiveTexture(GL_TEXTURE1);
-      glBindTexture(GL_TEXTURE_2D, *textureId);
-      glUniform1i(inputs.unifLightmapTexture, 1);
-    } else {
-      glActiveTexture(GL_TEXTURE1);
-      glBindTexture(GL_TEXTURE_2D, _fallbackLightmapTexture);
-      glUniform1i(inputs.unifLightmapTexture, 1);
-    }
-
-    // Bind vertices
-    glBindBuffer(GL_ARRAY_BUFFER, verticesVBO.buffer);
-    glVertexAttribPointer(
-      inputs.inPosition, 3, GL_FLOAT, GL_FALSE,
-      verticesVBO.stride /* stride */,
-      (void*) 0 /* offset */);
-
-    // Bind texture coordinates
-    glVertexAttribPointer(
-      inputs.inTextureCoords, 2, GL_FLOAT, GL_FALSE,
-      verticesVBO.stride /* stride */,
-      (void*) offsetof(BSP::vertex_t, texcoord) /* offset */);
-
-    // Bind lightmap coordinates
-    glVertexAttribPointer(
-      inputs.inLightmapCoords, 2, GL_FLOAT, GL_FALSE,
-      verticesVBO.stride /* stride */,
-      (void*) offsetof(BSP::vertex_t, lmcoord) /* offset */);
-
-    // Bind colors
-    glBindBuffer(GL_ARRAY_BUFFER, colorsVBO.buffer);
-    glVertexAttribPointer(
-      inputs.inColor, 3, GL_FLOAT, GL_FALSE,
-      colorsVBO.stride /* stride */,
-      (void*) 0 /* offset */);
-
     // Render elements
-    glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, elementsEBO.buffer);
-    glDrawElements(GL_TRIANGLES, elementsEBO.count, GL_UNSIGNED_INT, 0);
+    glDrawElements(
+      GL_TRIANGLES, renderableFace.numIndices, GL_UNSIGNED_INT,
+      (void*) (sizeof(GLuint) * renderableFace.firstIndex));
+  }
+}
+
+void RenderableBSP::renderClusterBatches(const SceneShaderParameters& inputs, RenderMode mode, const optional<HitScanResult>& result) {
+  if (!_currentDrawList) {
+    return;
+  }
+
+  const ClusterDrawList& drawList = *_currentDrawList;
+  const bool transparent = mode == RenderMode::TRANSPARENCY;
+
+  glUniform1i(inputs.unifHighlight, 0);
+  glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, drawList.elements.buffer);
+
+  for (int batchIndex : _visibleBatches) {
+    const ClusterBatch& batch = drawList.batches[batchIndex];
+    if (batch.transparent != transparent) {
+      continue;
+    }
+
+    bindTexture(inputs, batch.texture);
+    glDrawElements(
+      GL_TRIANGLES, batch.numIndices, GL_UNSIGNED_INT,
+      (void*) (sizeof(GLuint) * batch.firstIndex));
+  }
+
+  // The batches can't highlight a single face, so draw it again on top
+  if (result) {
+    const int faceIndex = result->face - _map->faces();
+    const int renderableIndex = _renderableIndexForFace[faceIndex];
+    if (renderableIndex >= 0) {
+      const RenderableFace& renderableFace = _renderableFaces[renderableIndex];
+      if (renderableFace.texture && renderableFace.transparent == transparent) {
+        bindTexture(inputs, renderableFace.texture);
+        glUniform1i(inputs.unifHighlight, 1);
+        glDepthFunc(GL_LEQUAL);
+
+        glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, _elements.buffer);
+        glDrawElements(
+          GL_TRIANGLES, renderableFace.numIndices, GL_UNSIGNED_INT,
+          (void*) (sizeof(GLuint) * renderableFace.firstIndex));
+
+        glDepthFunc(GL_LESS);
+        glUniform1i(inputs.unifHighlight, 0);
+      }
+    }
+  }
+}
+
+RenderableBSP::ClusterDrawList& RenderableBSP::clusterDrawList(int cluster, int area, const AreaPortals& areaPortals) {
+  for (auto it = _clusterDrawLists.begin(); it != _clusterDrawLists.end(); it ++) {
+    if (it->cluster == cluster && it->area == area && it->areaPortalsVersion == areaPortals.version()) {
+      // Move it to the front, so the least recently used is always at the back
+      _clusterDrawLists.splice(_clusterDrawLists.begin(), _clusterDrawLists, it);
+      return _clusterDrawLists.front();
+    }
+  }
+
+  if ((int) _clusterDrawLists.size() >= kMaxCachedClusters) {
+    glDeleteBuffers(1, &_clusterDrawLists.back().elements.buffer);
+    _clusterDrawLists.pop_back();
+  }
+
+  _clusterDrawLists.push_front(buildClusterDrawList(cluster, area, areaPortals));
+  return _clusterDrawLists.front();
+}
+
+RenderableBSP::ClusterDrawList RenderableBSP::buildClusterDrawList(int cluster, int area, const AreaPortals& areaPortals) {
+  const BSPMap* map = _map.get();
+  const uint32_t* worldIndices = _cookedMap->indices();
+  const BSP::leaf_t* leaves = map->leaves();
+  const BSP::leafface_t* leaffaces = map->leaffaces();
+
+  // Everything the cluster can see. A negative cluster (outside the map) sees everything.
+  vector<bool> potentiallyVisible(_renderableFaces.size(), false);
+  for (int leafIndex = 0; leafIndex < map->numLeaves(); leafIndex ++) {
+    const BSP::leaf_t* leaf = leaves + leafIndex;
+    if (leaf->cluster < 0 || !areaPortals.areasConnected(area, leaf->area) || !map->isClusterVisible(cluster, leaf->cluster)) {
+      continue;
+    }
+    for (int i = 0; i < leaf->n_leaffaces; i ++) {
+      const int renderableIndex = _renderableIndexForFace[leaffaces[leaf->leafface + i].face];
+      if (renderableIndex >= 0) {
+        potentiallyVisible[renderableIndex] = true;
+      }
+    }
+  }
+  for (int renderableIndex : _facesOutsideLeaves) {
+    potentiallyVisible[renderableIndex] = true;
+  }
+
+  vector<int> visibleFaces;
+  for (int i = 0; i < (int) _renderableFaces.size(); i ++) {
+    if (potentiallyVisible[i] && _renderableFaces[i].texture) {
+      visibleFaces.push_back(i);
+    }
   }
-}
\ No newline at end of file
+
+  // One batch per texture in each cell, so most of them are off screen
+  const auto cellOf = [&](int renderableIndex) {
+    const RenderableFace& renderableFace = _renderableFaces[renderableIndex];
+    const glm::vec3 cell = glm::floor((renderableFace.mins + renderableFace.maxs) * 0.5f / kBatchCellSize);
+    return std::make_tuple((int) cell.x, (int) cell.y, (int) cell.z);
+  };
+  vector<std::tuple<int, int, int>> cells(_renderableFaces.size());
+  for (int renderableIndex : visibleFaces) {
+    cells[renderableIndex] = cellOf(renderableIndex);
+  }
+  const auto batchKey = [&](int renderableIndex) {
+    const RenderableFace& renderableFace = _renderableFaces[renderableIndex];
+    return std::make_tuple(renderableFace.transparent, renderableFace.texture, cells[renderableIndex]);
+  };
+  std::stable_sort(visibleFaces.begin(), visibleFaces.end(), [&](int a, int b) {
+    return batchKey(a) < batchKey(b);
+  });
+
+  ClusterDrawList result;
+  result.cluster = cluster;
+  result.area = area;
+  result.areaPortalsVersion = areaPortals.version();
+
+  vector<GLuint> indices;
+  for (int i = 0; i < (int) visibleFaces.size(); i ++) {
+    const int renderableIndex = visibleFaces[i];
+    const RenderableFace& renderableFace = _renderableFaces[renderableIndex];
+
+    if (i == 0 || batchKey(renderableIndex) != batchKey(visibleFaces[i - 1])) {
+      result.batches.push_back({
+        renderableFace.texture,
+        renderableFace.transparent,
+        (int) indices.size(),
+        0,
+        renderableFace.mins,
+        renderableFace.maxs
+      });
+    }
+    ClusterBatch& batch = result.batches.back();
+    batch.mins = glm::min(batch.mins, renderableFace.mins);
+    batch.maxs = glm::max(batch.maxs, renderableFace.maxs);
+
+    // The per-face ranges in _elements already point into the shared vertex buffer
+    indices.insert(
+      indices.end(),
+      worldIndices + renderableFace.firstIndex,
+      worldIndices + renderableFace.firstIndex + renderableFace.numIndices);
+    result.batches.back().numIndices += renderableFace.numIndices;
+  }
+
+  glGenBuffers(1, &(result.elements.buffer));
+  glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, result.elements.buffer);
+  glBufferData(GL_ELEMENT_ARRAY_BUFFER, sizeof(GLuint) * indices.size(), indices.data(), GL_STATIC_DRAW);
+  result.elements.count = indices.size();
+  setBatchBounds(result);
+
+  return result;
+}
+
+void RenderableBSP::setBatchBounds(ClusterDrawList& drawList) {
+  for (int i = 0; i < (int) drawList.batches.size(); i ++) {
+    drawList.bounds.add(drawList.batches[i].mins, drawList.batches[i].maxs);
+    drawList.allBatches.push_back(i);
+  }
+}
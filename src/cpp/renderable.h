@@ -4,6 +4,9 @@
 #include "support.h"
 #include "gl_helpers.h"
 #include "resources.h"
+#include "frustum.h"
+
+#include <list>
 
 namespace BSP {
   struct header_t;
@@ -11,15 +14,40 @@ namespace BSP {
 }
 using BSPMap = BSP::header_t;
 
+namespace Cooked {
+  struct header_t;
+}
+using CookedMap = Cooked::header_t;
+
 struct SceneShaderParameters;
 struct HitScanResult;
+struct OcclusionCuller;
+struct AreaPortals;
 
+// All faces share one vertex buffer and one element buffer (see RenderableBSP),
+// so a face is just a range of indices into the latter. Built from the cooked
+// map's Cooked::face_t.
 struct RenderableFace {
-  static optional<RenderableFace> generate(const BSPMap* map, int faceIndex);
   int faceIndex; // auto* face = map->faces() + faceIndex
-  VBO vertices;
-  VBO colors;
-  EBO elements;
+  int firstIndex;
+  int numIndices;
+
+  // Null if the face has no valid texture. Textures stream in after the map
+  // has loaded, so `transparent` is only known once this one has.
+  TextureHandle texture;
+  bool transparent = false;
+
+  // Bounding box of the (tesselated) geometry
+  glm::vec3 mins;
+  glm::vec3 maxs;
+};
+
+// Counts batches rather than faces with WorldSubmission::CLUSTER_BATCHES
+struct CullingStats {
+  int faces = 0;
+  int frustumVisible = 0; // Faces left after frustum culling...
+  int drawn = 0; // ... and after occlusion culling
+  double frustumMilliseconds = 0;
 };
 
 enum class RenderMode {
@@ -27,21 +55,139 @@ enum class RenderMode {
   TRANSPARENCY
 };
 
+enum class WorldSubmission {
+  // Frustum (and optionally occlusion) cull every face, every frame.
+  PER_FACE,
+  // Draw precomputed batches of everything the camera's PVS cluster can see,
+  // split up by texture and by region of the map. Nothing is done per face
+  // while the camera stays in the same cluster, only per batch.
+  CLUSTER_BATCHES
+};
+
+struct RenderableBSPOptions {
+  WorldSubmission submission = WorldSubmission::PER_FACE;
+  bool occlusionCulling = false; // Of faces, or of batches
+};
+
 struct RenderableBSP : IHasResources {
-  RenderableBSP(ResourcePtr<const BSPMap> map);
+  // Only needs the map's textures lump, so it can be made (and start fetching
+  // textures) while the rest of the map is still streaming in. The caller has
+  // to make it wait for the rest (see ResourceManager::waitForResource).
+  //
+  // If there's no cooked map in `cookedMap` by then (or it's stale), the map
+  // is cooked in memory.
+  RenderableBSP(ResourcePtr<const BSPMap> map, CookedMapHandle cookedMap, RenderableBSPOptions options = {});
+
+  // Finishes loading as soon as the map has; until its textures arrive, faces
+  // are drawn with a placeholder.
+  //
+  // Textures aren't fetched until one of these is called (they're DEFERRED),
+  // so none go out ahead of the ones that can be seen first. Sends the ones on
+  // faces in view of `origin` (looking `angle` degrees around z) first, then
+  // the ones anywhere in its PVS, then the rest. Needs the map's planes,
+  // nodes, leaves, leaffaces, faces and visdata.
+  void prioritizeTexturesVisibleFrom(const glm::vec3& origin, float angle);
+  // Or sends them all in map order, eg. if there's no spawn point
+  void stopDeferringTextures();
 
+  // Decides which faces to draw this frame. Call once per frame, before render.
+  // Leaves in areas that can't be reached from the camera (eg. behind closed
+  // doors) are dropped before anything else.
+  void cull(const glm::mat4& viewProjection, const glm::vec3& cameraLocation, const AreaPortals& areaPortals);
   void render(const SceneShaderParameters& inputs, RenderMode mode, const optional<HitScanResult>& hitScanResult);
 
+  // Textures start out small and stream in more detail as it's needed. Asks
+  // for enough for each texture in view to have about a texel per pixel on
+  // its closest face. `pixelsPerUnit` is how many pixels tall something one
+  // unit tall and one unit away is. Only does anything every few frames.
+  void updateTextureResidency(const glm::mat4& viewProjection, const glm::vec3& cameraLocation, float pixelsPerUnit);
+
 private:
   bool finishLoading() override;
+  bool isTransparent(int textureIndex);
+  void updateStreamedTextures();
+  void cullNode(int nodeIndex, int planeMask, const Frustum& frustum, const AreaPortals& areaPortals);
+  void cullClusterBatches(const glm::mat4& viewProjection);
+
+  void bindTexture(const SceneShaderParameters& inputs, TextureHandle texture);
+  void renderFaces(const SceneShaderParameters& inputs, RenderMode mode, const optional<HitScanResult>& hitScanResult);
+  void renderClusterBatches(const SceneShaderParameters& inputs, RenderMode mode, const optional<HitScanResult>& hitScanResult);
 
   ResourcePtr<const BSPMap> _map;
-  unordered_map<string, int> _textureResourceIds;
+  CookedMapHandle _cookedMapHandle;
+  ResourcePtr<const CookedMap> _cookedMap = nullptr;
+  RenderableBSPOptions _options;
+  vector<TextureHandle> _textures; // One per BSP texture
+  vector<int> _streamingTextures; // Indices of the ones still loading
+  vector<float> _textureRepeatsPerUnit; // Most times a texture repeats per world unit on any face
+  vector<float> _textureDistances; // Scratch space for updateTextureResidency
+  int _residencyFrame = 0;
+
+  GLuint _lightmapAtlas;
 
-  unordered_map<int, GLuint> _lightmapTextures;
-  GLuint _fallbackLightmapTexture;
+  // The whole world's geometry
+  VBO _vertices;
+  VBO _colors;
+  EBO _elements;
 
   vector<RenderableFace> _renderableFaces;
+  vector<bool> _visibleFaces; // One per renderable face
+
+  // For frustum culling. Boxes are indexed by renderable face / leaf index.
+  BoundingBoxes _faceBounds;
+  BoundingBoxes _leafBounds;
+  vector<int> _renderableIndexForFace; // -1 if the face isn't renderable
+  vector<int> _facesOutsideLeaves; // Renderable faces no leaf refers to (eg. brush models)
+
+  // Scratch space for cull(), kept around to avoid allocating every frame
+  int _cameraCluster = -1;
+  int _cameraArea = -1;
+  int _cullFrame = 0;
+  vector<int> _faceCullFrame;
+  vector<int> _insideLeaves;
+  vector<int> _intersectingLeaves;
+  vector<int> _candidateFaces;
+  vector<int> _frustumVisibleFaces;
+  CullingStats _cullingStats;
+
+  shared_ptr<OcclusionCuller> _occlusionCuller = nullptr;
+
+  // For WorldSubmission::CLUSTER_BATCHES. Each cluster gets its own element
+  // buffer with the indices of every face it can see, sorted into one range per
+  // texture and kBatchCellSize cell of the map, so batches can be frustum
+  // culled. Opening or closing a door changes what a cluster can see, so lists
+  // are also keyed on the area portal state.
+  static constexpr float kBatchCellSize = 512;
+  struct ClusterBatch {
+    TextureHandle texture;
+    bool transparent;
+    int firstIndex;
+    int numIndices;
+    glm::vec3 mins;
+    glm::vec3 maxs;
+  };
+  struct ClusterDrawList {
+    int cluster;
+    int area;
+    int areaPortalsVersion;
+    EBO elements;
+    vector<ClusterBatch> batches;
+    BoundingBoxes bounds; // One per batch
+    vector<int> allBatches; // 0 to batches.size() - 1, for Frustum::cull
+  };
+  static void setBatchBounds(ClusterDrawList& drawList);
+  vector<int> _frustumVisibleBatches; // In _currentDrawList
+  vector<int> _visibleBatches;
+  static const int kMaxCachedClusters = 8;
+  std::list<ClusterDrawList> _clusterDrawLists; // Most recently used first
+
+  ClusterDrawList& clusterDrawList(int cluster, int area, const AreaPortals& areaPortals);
+  ClusterDrawList buildClusterDrawList(int cluster, int area, const AreaPortals& areaPortals);
+  ClusterDrawList* _currentDrawList = nullptr;
+
+  // The cooked map's per-texture batches, drawn as they are when the camera
+  // is outside the map and can see everything.
+  ClusterDrawList _worldDrawList;
 };
 
-#endif
\ No newline at end of file
+#endif
@@ -0,0 +1,122 @@
+#ifndef RESOURCE_HANDLE_H
+#define RESOURCE_HANDLE_H
+
+#include "support.h"
+
+#include <cassert>
+
+// Part of every handle's ID, so IDs of different kinds never collide.
+enum class ResourceKind : uint32_t {
+  NONE,
+  SHADER_PROGRAM,
+  TEXTURE,
+  MAP,
+  COOKED_MAP,
+  ARCHIVE,
+  TEXTURE_MANIFEST
+};
+
+// Refers to a resource in ResourceManager: an index into the dense storage for
+// its kind, plus the generation of that slot. Releasing a slot bumps its
+// generation, so a handle to an unloaded resource never reaches whatever
+// reuses the slot -- lookups through it just fail.
+//
+// Packs into a non-negative int, which is what's passed to and from JS as a
+// message's `resourceID`.
+template <ResourceKind Kind>
+struct ResourceHandle {
+  static const int kIndexBits = 18;
+  static const int kKindBits = 3;
+  static const int kGenerationBits = 10; // Wraps after 1023 reuses of a slot
+
+  uint32_t index = 0;
+  uint32_t generation = 0; // Never used by a slot, so a default handle is null
+
+  ResourceHandle() {}
+  ResourceHandle(uint32_t index, uint32_t generation) : index(index), generation(generation) {}
+
+  // Null if `id` isn't a handle of this kind.
+  static ResourceHandle fromID(int id) {
+    const uint32_t bits = (uint32_t) id;
+    if (id < 0 || ((bits >> kIndexBits) & ((1u << kKindBits) - 1)) != (uint32_t) Kind) {
+      return {};
+    }
+    return ResourceHandle(bits & ((1u << kIndexBits) - 1), bits >> (kIndexBits + kKindBits));
+  }
+
+  int id() const {
+    return (int) (index | ((uint32_t) Kind << kIndexBits) | (generation << (kIndexBits + kKindBits)));
+  }
+
+  explicit operator bool() const { return generation != 0; }
+
+  bool operator==(const ResourceHandle& other) const {
+    return index == other.index && generation == other.generation;
+  }
+  bool operator!=(const ResourceHandle& other) const { return !(*this == other); }
+  bool operator<(const ResourceHandle& other) const { return id() < other.id(); }
+};
+
+// The kind of resource a handle's ID refers to.
+inline ResourceKind resourceKindOf(int id) {
+  using Bits = ResourceHandle<ResourceKind::NONE>;
+  return id < 0 ? ResourceKind::NONE : (ResourceKind) (((uint32_t) id >> Bits::kIndexBits) & ((1u << Bits::kKindBits) - 1));
+}
+
+using ShaderHandle = ResourceHandle<ResourceKind::SHADER_PROGRAM>;
+using TextureHandle = ResourceHandle<ResourceKind::TEXTURE>;
+using MapHandle = ResourceHandle<ResourceKind::MAP>;
+using CookedMapHandle = ResourceHandle<ResourceKind::COOKED_MAP>;
+using ArchiveHandle = ResourceHandle<ResourceKind::ARCHIVE>;
+using TextureManifestHandle = ResourceHandle<ResourceKind::TEXTURE_MANIFEST>;
+
+// Dense storage for one kind of resource: the values sit in one array in slot
+// order, so a lookup is a bounds check, a generation check and an index.
+template <ResourceKind Kind, typename T>
+struct ResourceSlots {
+  using Handle = ResourceHandle<Kind>;
+
+  // The slot starts out with a default constructed value.
+  Handle allocate() {
+    uint32_t index;
+    if (_freeSlots.size()) {
+      index = _freeSlots.back();
+      _freeSlots.pop_back();
+    } else {
+      index = _values.size();
+      assert(index < (1u << Handle::kIndexBits));
+      _values.emplace_back();
+      _generations.push_back(1);
+    }
+    return Handle(index, _generations[index]);
+  }
+
+  bool isLive(Handle handle) const {
+    return handle && handle.index < _generations.size() && _generations[handle.index] == handle.generation;
+  }
+
+  // Null if the handle is null or stale.
+  T* get(Handle handle) {
+    return isLive(handle) ? &_values[handle.index] : nullptr;
+  }
+  const T* get(Handle handle) const {
+    return isLive(handle) ? &_values[handle.index] : nullptr;
+  }
+
+  // Handles to the slot go stale, and it can be reused.
+  void release(Handle handle) {
+    if (!isLive(handle)) {
+      return;
+    }
+    _values[handle.index] = T();
+    _generations[handle.index] = _generations[handle.index] % ((1u << Handle::kGenerationBits) - 1) + 1;
+    _freeSlots.push_back(handle.index);
+  }
+
+private:
+  vector<T> _values;
+  vector<uint32_t> _generations;
+  vector<uint32_t> _freeSlots;
+};
+
+#endif
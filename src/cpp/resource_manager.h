@@ -2,49 +2,406 @@
 #define RESOURCE_MANAGER_H
 
 #include "resources.h"
+#include "archive.h"
 #include "bindings.h"
+#include "compressed_file.h"
+#include "image_decoder.h"
+#include "texture_manifest.h"
+#include "texture_uploader.h"
+#include "worker_pool.h"
+
+#include <list>
+#include <map>
 
 struct ResourceManager : IMessageHandler {
 public:
   static shared_ptr<ResourceManager> getInstance();
-  static int nextID();
+
+  // Handles for resources that are about to be loaded. Pass `handle.id()` as
+  // the resourceID of the LoadResource/LoadShaders message.
+  ShaderHandle newShaderProgram();
+  TextureHandle newTexture();
+  MapHandle newMap();
+  CookedMapHandle newCookedMap();
+  // Loading an ARCHIVE_FILE mounts it for as long as it's loaded: IMAGE_FILEs
+  // in it (by their path from the directory it's in) are read from it rather
+  // than as loose files. The last one loaded is searched first.
+  ArchiveHandle newArchive();
+  // IMAGE_FILEs are resolved through the last TEXTURE_MANIFEST_FILE loaded:
+  // to the file to load, and their shader's options. Textures that aren't in
+  // it are missing, without asking JS.
+  TextureManifestHandle newTextureManifest();
 
   LoadingState think();
 
   void addResourceLoader(IHasResources* loader);
   void removeResourceLoader(IHasResources* loader);
 
+  // Loaders made by `makeLoaders` -- eg. the next map's scenario, made while
+  // the current one is being played -- load in the background. Whatever
+  // they ask for queues behind everything else (as OTHER_MAPS), at any
+  // priority, though they still wait for what they asked for as CRITICAL.
+  // They don't count towards think()'s LoadingState. The loaders they make
+  // once they've finished loading (or as their map streams in) are
+  // background loaders too.
+  void preload(std::function<void()> makeLoaders);
+  // Background loaders stop being background ones, and what they asked for
+  // moves back up to the priority it was asked for, eg. once they're what's
+  // being played.
+  void promotePreloaded();
+  // LOADING until every background loader has finished loading, then DONE,
+  // or FAILED if any of them failed to
+  LoadingState preloadState() const;
+
   bool hasOutstandingResources() const;
 
-  void loadResource(IHasResources* loader, const LoadResource& message);
+  void loadResource(IHasResources* loader, const LoadResource& message, LoadPriority priority = LoadPriority::CRITICAL);
+  // The same, but crosses over to JS once for all of them.
+  void loadResources(IHasResources* loader, const vector<LoadResource>& messages, LoadPriority priority = LoadPriority::CRITICAL);
+
+  // Moves a request that hasn't been sent yet up (or down) the queue. Doesn't
+  // send anything itself, so a batch can be reordered before sendQueuedRequests.
+  void setPriority(int resourceID, LoadPriority priority);
+  // Fills the free request slots from the front of the queue, stopping at
+  // DEFERRED requests
+  void sendQueuedRequests();
+  void setMaxRequestsInFlight(int maxRequests);
+
+  // Holds `loader` back (ie. doesn't call its finishLoading) until the
+  // resource has loaded, even though another loader asked for it.
+  void waitForResource(IHasResources* loader, int resourceID);
+
+  // Asking for something another loader already has (or is loading) --
+  // eg. the textures two maps have in common -- shares it: the new handle
+  // refers to the same resource, which lasts as long as either references
+  // it. Handles are resolved through this wherever they're used.
+  int resolve(int resourceID) const;
+
   void loadShaders(IHasResources* loader, const LoadShaders& message);
 
   void handleMessageFromWeb(const LoadedTexture& message);
+  void handleMessageFromWeb(const LoadedCompressedTexture& message);
+  void handleMessageFromWeb(const LoadedImageFile& message);
   void handleMessageFromWeb(const MissingTexture& message);
+  void handleMessageFromWeb(const LoadedTextures& message);
+  void handleMessageFromWeb(const LoadingBSP& message);
   void handleMessageFromWeb(const LoadedBSP& message);
+  void handleMessageFromWeb(const LoadedCookedMap& message);
+  void handleMessageFromWeb(const MissingCookedMap& message);
   void handleMessageFromWeb(const LoadedShaders& message);
-  void handleMessageFromWeb(const LoadedTextureOptions& message);
+  void handleMessageFromWeb(const LoadedArchiveRange& message);
+  void handleMessageFromWeb(const LoadedTextureManifest& message);
+  void handleMessageFromWeb(const SetImageUploads& message);
+
+  // Everything a loader asks for is referenced by it until it's destroyed, so
+  // a scenario's resources (and its renderables') last exactly as long as it
+  // does. Unreferenced resources are kept in case they're asked for again
+  // (eg. by the next scenario, or when maps rotate back) for as long as they
+  // fit in the budget, least recently used going first.
+  void setMemoryBudget(size_t gpuBytes, size_t cpuBytes);
+
+  // Textures are uploaded from think(), spending at most this much per frame
+  // (see TextureUploader).
+  void setTextureUploadBudget(double milliseconds, size_t bytes);
 
-  // TODO add a way to clear the resources after use
+  // How images get from the browser onto the GPU. Requests already sent
+  // finish the way they started, so this can be switched at any time.
+  enum class ImageUploads {
+    // JS hands over the file, which is decoded here (see ImageDecoder) and
+    // uploaded by the TextureUploader. The default.
+    DECODE,
+    // Web only: JS decodes it to an ImageBitmap and uploads that straight
+    // into a texture made for it here, so the pixels never pass through wasm
+    // memory. Decoding & uploading happen on the browser's main thread,
+    // outside the upload budget.
+    FROM_BROWSER
+  };
+  void setImageUploads(ImageUploads uploads);
 
-  optional<GLuint> getShaderProgram(int resourceID);
-  optional<GLuint> getTexture(int resourceID);
-  optional<RenderableTextureOptions> getTextureOptions(int resourceID);
-  ResourcePtr<const BSPMap> getMap();
+  // Textures loaded with a maxSize (see LoadResource) start out that small,
+  // and stream in more detail while they're wanted: `size` is how many
+  // texels across would do, eg. for the closest of its faces in view. Call it
+  // every so often for what can be seen. Detail that hasn't been wanted for a
+  // while is dropped again once the GPU budget runs out.
+  void wantTextureSize(TextureHandle handle, int size);
+
+  // Frees the GL objects right away, referenced or not. Existing handles to
+  // them go stale. A handle sharing another's resource (see resolve()) only
+  // lets go of it.
+  void unloadShaderProgram(ShaderHandle handle);
+  void unloadTexture(TextureHandle handle);
+
+  // True until it's loaded, missing or failed
+  bool isLoading(int resourceID) const;
+
+  optional<GLuint> getShaderProgram(ShaderHandle handle);
+  optional<GLuint> getTexture(TextureHandle handle);
+  // Shared by everything drawn before (or without) its texture
+  GLuint getPlaceholderTexture();
+  optional<RenderableTextureOptions> getTextureOptions(TextureHandle handle);
+  // Null until it's finished loading
+  ResourcePtr<const BSPMap> getMap(MapHandle handle);
+
+  // Maps stream in, so parts of them can be used long before the rest has
+  // arrived. The callback gets the (partially loaded) map as soon as `lump`
+  // is complete -- right away, if it already is. Only that lump, and the
+  // header, can be read until the map has finished loading. Any number of
+  // maps can be streaming in at once, eg. the next one while this one plays.
+  void whenMapLumpLoaded(MapHandle handle, BSP::Lump lump, std::function<void(ResourcePtr<const BSPMap>)> callback);
+  // Once all of `lumps` are.
+  void whenMapLumpsLoaded(MapHandle handle, const vector<BSP::Lump>& lumps, std::function<void(ResourcePtr<const BSPMap>)> callback);
+  // May be null. A COOKED_MAP_FILE is for the BSP_FILE asked for before it.
+  ResourcePtr<const CookedMap> getCookedMap(CookedMapHandle handle);
+  // Maps without a cooked file are cooked in memory (see RenderableBSP), and
+  // kept in the AssetCache so that's only done once. Both are held on to
+  // until they've been stored.
+  void storeCookedMapInCache(ResourcePtr<const BSPMap> map, ResourcePtr<const CookedMap> cookedMap, size_t length);
 
 private:
-  unordered_map<int, GLuint> _shaderPrograms = {};
-  unordered_map<int, GLuint> _textures = {};
+  // False if there's nothing to ask JS for, ie. it's already loaded.
+  bool startLoading(IHasResources* loader, const LoadResource& message, LoadPriority priority);
+
+  bool _preloading = false; // See preload()
+  bool isPreloading(IHasResources* loader) const;
+  void withPreloading(bool preloading, std::function<void()> callback);
+  // Requests held back as OTHER_MAPS for background loaders, by resourceID,
+  // with the priority they were asked for
+  unordered_map<int, LoadPriority> _preloadedRequests;
+  // What only background loaders wait for, which think() leaves out
+  unordered_set<int> _preloadedResources;
+
+  // Requests waiting for a slot, by priority then in the order they were made
+  using RequestOrder = pair<LoadPriority, int>;
+  std::map<RequestOrder, LoadResource> _queuedRequests;
+  unordered_map<int, RequestOrder> _queuedRequestOrder; // By resourceID
+  int _nextRequestSequence = 0;
+  unordered_set<int> _requestsInFlight;
+  int _maxRequestsInFlight = 32;
+  bool _holdQueuedRequests = false; // While handling a batch of results
+
+  void queueRequest(const LoadResource& message, LoadPriority priority);
+  // Where a background loader's request waits: behind everything else, unless
+  // it's deferred
+  static LoadPriority preloadPriority(LoadPriority priority);
+
+#ifndef __EMSCRIPTEN__
+  void loadMappedBSP(const LoadResource& message);
+  // False if there's no file
+  bool loadMappedCookedMap(const LoadResource& message);
+  void loadMappedArchive(const LoadResource& message);
+  void loadMappedTextureManifest(const LoadResource& message);
+#endif
+
+  struct ArchiveSlot {
+    string url;
+    string root; // What its paths are relative to, eg. "data/"
+    Archive::Directory directory;
+    ResourcePtr<const char> file; // Natively, the whole archive, mapped
+    size_t fileLength = 0;
+  };
+  ResourceSlots<ResourceKind::ARCHIVE, ArchiveSlot> _archives;
+  vector<int> _mountedArchives; // Searched from the back
+  // Archive directories and texture manifests still loading. Queued
+  // IMAGE_FILEs wait for them, since they say where each one is.
+  unordered_set<int> _indexReads;
+  void mountArchive(int resourceID);
+  void readArchiveDirectory(const LoadedArchiveRange& message);
 
-  // Also called "texture shaders" -- these are loaded from the `data/scripts` directory
-  // and include information about how to render individual textures.
-  unordered_map<int, RenderableTextureOptions> _textureOptions = {};
+  // Requests for files found in an archive, by resourceID, until they're read
+  struct ArchiveRead {
+    int archiveID;
+    Archive::Entry entry;
+    string path; // For logging
+    bool compressed; // A .qtex, see TextureCompression
+  };
+  unordered_map<int, ArchiveRead> _archiveReads;
+  optional<ArchiveRead> findInArchives(const string& url) const;
+  // Points the request at the archive it's in, if it's in one
+  LoadResource fromArchive(LoadResource message);
+  void readArchiveEntry(const LoadedArchiveRange& message);
 
-  ResourcePtr<const BSPMap> _map = nullptr;
+  using TextureManifestPtr = ResourcePtr<const TextureManifest::header_t>;
+  ResourceSlots<ResourceKind::TEXTURE_MANIFEST, TextureManifestPtr> _textureManifests;
+  TextureManifestPtr _textureManifest = nullptr; // The one in use
+  int _textureManifestResourceID = -1;
+  void storeTextureManifest(int resourceID, TextureManifestPtr manifest, size_t length);
+  // Points the request at the file the manifest has for it, and sets the
+  // texture's options from its shader
+  LoadResource fromManifest(LoadResource message);
+  // Known not to be there, by the manifest and every archive
+  bool isMissingTexture(const LoadResource& message) const;
 
+  // Where a texture's read from: see fromManifest() and fromArchive()
+  LoadResource resolveTexture(const LoadResource& message);
+  // What's sent to JS for a request: resolveTexture() and withUploadTexture()
+  LoadResource toRequest(const LoadResource& message);
+
+  // 0 until loaded
+  ResourceSlots<ResourceKind::SHADER_PROGRAM, GLuint> _shaderPrograms;
+
+  struct TextureSlot {
+    GLuint texture = 0; // 0 until loaded
+
+    // Also called "texture shaders" -- these come from the `data/scripts` directory,
+    // by way of the texture manifest, and include information about how to render
+    // individual textures.
+    optional<RenderableTextureOptions> options;
+
+    int width = 0; // On the GPU
+    int height = 0;
+
+    // For textures that stream in their detail. The URL is empty otherwise.
+    string url;
+    int baseSize = 0; // What it starts out at, and shrinks back to
+    int fullSize = 0; // Larger side of the image at full resolution
+    int wantedSize = 0;
+    int wantedFrame = -1;
+    int requestedSize = 0; // 0 unless JS is loading a more detailed copy
+    bool compressed = false; // Loaded from a .qtex, see TextureCompression
+  };
+  ResourceSlots<ResourceKind::TEXTURE, TextureSlot> _textures;
+  GLuint _placeholderTexture = 0;
+  TextureUploader _textureUploader;
+  void finishTextureUpload(const TextureUploader::Finished& upload);
+
+  ImageUploads _imageUploads = ImageUploads::DECODE;
+  unordered_map<int, GLuint> _browserUploadTextures; // Sent with requests, by resourceID
+  // Gives an IMAGE_FILE request a texture to upload into, if they go
+  // FROM_BROWSER. Taken back when its result arrives, and deleted unless the
+  // browser did upload into it.
+  LoadResource withUploadTexture(LoadResource message);
+  optional<GLuint> takeUploadTexture(int resourceID);
+  void discardUploadTexture(int resourceID);
+
+  // Images are decoded off the main thread, and handed to the uploader (or
+  // back to JS, if they're in a format we don't handle) from think()
+  WorkerPool _imageDecoders;
+  struct ImageFile {
+    const char* data = nullptr;
+    size_t length = 0;
+    std::function<void()> release; // Unset if it couldn't be read
+    bool inArchive = false; // So the browser can't load it by its URL
+    optional<ImageDecoder::Image> image; // Once it's decoded, or found in the AssetCache
+  };
+  // `read` fills in the file, on one of the decoders' threads
+  void loadImageFile(int resourceID, const string& url, bool inArchive, std::function<void(ImageFile& file)> read);
+
+  // An AssetCache lookup, and what's made instead if it misses
+  struct AssetCacheJob {
+    string key; // Empty to skip the cache
+    void* entry = nullptr; // Packed, or null if it missed. Taken by `work`
+    size_t length = 0;
+    void* store = nullptr; // Packed by `work` (see AssetCache::pack), to be stored
+    size_t storeLength = 0;
+  };
+  // `key` and `work` run on the decoders' threads, `then` back on the main
+  // thread. Natively the entry's read & written on those threads too; on the
+  // web, IndexedDB is asked on the main thread in between. Without `lookUp`,
+  // the entry's only stored.
+  void withAssetCacheEntry(std::function<string()> key, std::function<void(AssetCacheJob& job)> work, std::function<void()> then, bool lookUp = true);
+
+  struct CachedImageHeader {
+    int width;
+    int height;
+    int fullWidth;
+    int fullHeight;
+  };
+  // From the cache entry, or the file if there isn't one (which is packed to
+  // be cached). Releases the file.
+  static void decodeImage(ImageFile& file, AssetCacheJob& job, int maxSize);
+  static optional<ImageDecoder::Image> cachedImage(void* data, size_t length);
+  void finishImageDecode(int resourceID, const string& url, int maxSize, bool inArchive, const optional<ImageDecoder::Image>& image);
+
+  static const int kMaxTextureLevelRequests = 4;
+  static const int kTextureResidencyFrames = 120; // Wanted within this long ago
+  int _frame = 0; // Counted by think()
+  bool _textureResidencyChanged = false;
+  unordered_set<int> _textureLevelRequests; // Textures JS is loading more detail for
+  void updateTextureResidency();
+  void shrinkTexture(int resourceID, int size);
+
+  // Loaded maps, including unreferenced ones that are still cached. See
+  // _mapDownloads for the ones that are still loading.
+  ResourceSlots<ResourceKind::MAP, ResourcePtr<const BSPMap>> _maps;
+  ResourceSlots<ResourceKind::COOKED_MAP, ResourcePtr<const CookedMap>> _cookedMaps;
+
+  struct ResourceRecord {
+    string key; // What was loaded, see cacheKey()
+    int references = 0;
+    size_t bytes = 0; // Counted against the budget once loaded
+  };
+  unordered_map<int, ResourceRecord> _resources;
+  std::list<int> _unreferenced; // Least recently used first
+  unordered_map<string, std::list<int>::iterator> _unreferencedByKey;
+  size_t _gpuBudget = 256 * 1024 * 1024;
+  size_t _cpuBudget = 128 * 1024 * 1024;
+  size_t _gpuBytes = 0;
+  size_t _cpuBytes = 0;
+
+  // False if it has to be loaded
+  bool retainResource(IHasResources* loader, int resourceID, const string& key, LoadPriority priority);
+  bool reuseUnreferenced(int resourceID, const string& key);
+  bool shareReferenced(IHasResources* loader, int resourceID, const string& key, LoadPriority priority);
+  unordered_map<string, int> _resourcesByKey; // What's shared, see resolve()
+  unordered_map<int, int> _sharedResources; // Handles sharing another's resource
+  void setResourceBytes(int resourceID, size_t bytes);
+  void releaseResource(int resourceID);
+  void cacheOrUnload(int resourceID);
+  void unloadResource(int resourceID);
+  void unloadOwnResource(int resourceID); // See unloadTexture()
+  // Leaves room for `gpuReserve` more bytes
+  void evictOverBudget(size_t gpuReserve = 0);
+
+  // Maps that are still downloading, by resourceID. Once they've finished,
+  // they're only in _maps.
+  struct MapDownload {
+    ResourcePtr<const BSPMap> map = nullptr; // From the first bytes on
+    int length = 0;
+    bool headerChecked = false;
+    bool failed = false; // Ignores the rest of it, until LoadedBSP arrives
+    bool preloading = false; // Its callbacks make background loaders
+    vector<bool> lumpsLoaded;
+    char* compressedMap = nullptr; // While it's being decompressed into `map`
+    CompressedFile::Decoder decoder;
+    unordered_map<int, vector<std::function<void(ResourcePtr<const BSPMap>)>>> lumpCallbacks;
+  };
+  std::map<int, MapDownload> _mapDownloads;
+  // Unloaded, but JS is still filling in their buffers
+  std::map<int, MapDownload> _abandonedMapDownloads;
+  void storeMap(int resourceID, ResourcePtr<const BSPMap> map, size_t length);
+  void abandonMapDownload(int resourceID);
+
+  // Takes the map's download buffer, which may be compressed
+  void receiveMapBytes(int resourceID, void* pointer, int loaded, int length);
+  void setMapBytesLoaded(int resourceID, int loaded, int total);
+  void failMap(int resourceID);
+
+  int _lastMapResourceID = -1; // The last BSP_FILE asked for
+  // COOKED_MAP_FILEs, until they're loaded, to the map they're for
+  unordered_map<int, int> _cookedMapMaps;
+  void storeCookedMap(int resourceID, ResourcePtr<const CookedMap> cookedMap, size_t length);
+  // Once the map's far enough along to know which one it is
+  void loadCachedCookedMap(int resourceID);
+
+  // Loaders are tracked by how many of their resources are still loading, so
+  // think() only has to look at the ones that just reached zero rather than
+  // at every loader and resource.
   enum class HasResourcesFinished { NO, YES, FAILED };
-  unordered_map<IHasResources*, HasResourcesFinished> _resourceLoaders;
-  unordered_map<int, IHasResources*> _loadingResources = {};
+  struct LoaderState {
+    HasResourcesFinished finished = HasResourcesFinished::NO;
+    int outstandingResources = 0; // Its entries in _loadingResources
+    vector<int> references; // Released when it's removed
+    bool preloading = false; // A background loader, see preload()
+  };
+  unordered_map<IHasResources*, LoaderState> _resourceLoaders;
+  vector<IHasResources*> _readyLoaders; // Outstanding resources reached 0
+  int _numUnfinishedLoaders = 0;
+  int _numFailedLoaders = 0;
+
+  void addLoadingResource(int resourceID, IHasResources* loader);
+  void doneLoadingResource(int resourceID); // Loaded, missing or failed
+  unordered_multimap<int, IHasResources*> _loadingResources = {}; // See waitForResource
+  unordered_set<int> _streamingResources; // Loading, but nothing waits for them
   unordered_set<int> _failedResources = {};
 
   static shared_ptr<ResourceManager> _instance;
@@ -3,6 +3,13 @@
 #include "resource_manager.h"
 #include "gl_helpers.h"
 #include "bsp.h"
+#include "cooked_map.h"
+#include "mapped_file.h"
+#include "asset_cache.h"
+#include "archive.h"
+#include "hash.h"
+
+#include <algorithm>
 
 IHasResources::IHasResources() {
   ResourceManager::getInstance()->addResourceLoader(this);
@@ -23,150 +30,1948 @@ shared_ptr<ResourceManager> ResourceManager::getInstance() {
   return _instance;
 }
 
-int ResourceManager::nextID() {
-  static int resourceID = 0;
-  return resourceID ++;
+ShaderHandle ResourceManager::newShaderProgram() {
+  return _shaderPrograms.allocate();
+}
+
+TextureHandle ResourceManager::newTexture() {
+  return _textures.allocate();
+}
+
+MapHandle ResourceManager::newMap() {
+  return _maps.allocate();
+}
+
+CookedMapHandle ResourceManager::newCookedMap() {
+  return _cookedMaps.allocate();
+}
+
+ArchiveHandle ResourceManager::newArchive() {
+  return _archives.allocate();
+}
+
+TextureManifestHandle ResourceManager::newTextureManifest() {
+  return _textureManifests.allocate();
 }
 
 void ResourceManager::addResourceLoader(IHasResources* loader) {
-  _resourceLoaders[loader] = HasResourcesFinished::NO;
+  LoaderState state;
+  state.preloading = _preloading;
+  _resourceLoaders[loader] = state;
+  if (!_preloading) {
+    _numUnfinishedLoaders ++;
+  }
+
+  // Finishes on the next think() unless it asks for something before then
+  _readyLoaders.push_back(loader);
 }
 
 void ResourceManager::removeResourceLoader(IHasResources* loader) {
-  _resourceLoaders.erase(loader);
+  const auto it = _resourceLoaders.find(loader);
+  if (it == _resourceLoaders.end()) {
+    return;
+  }
+  if (it->second.preloading) {
+    // Never counted, see preload()
+  } else if (it->second.finished == HasResourcesFinished::NO) {
+    _numUnfinishedLoaders --;
+  } else if (it->second.finished == HasResourcesFinished::FAILED) {
+    _numFailedLoaders --;
+  }
+  const vector<int> references = std::move(it->second.references);
+  _resourceLoaders.erase(it);
+
+  // The resources are still loading, but a later loader at the same address
+  // shouldn't be counted as waiting for them
+  for (auto& resource : _loadingResources) {
+    if (resource.second == loader) {
+      resource.second = nullptr;
+    }
+  }
+
+  for (int resourceID : references) {
+    releaseResource(resourceID);
+  }
+}
+
+void ResourceManager::preload(std::function<void()> makeLoaders) {
+  withPreloading(true, makeLoaders);
+}
+
+void ResourceManager::withPreloading(bool preloading, std::function<void()> callback) {
+  const bool wasPreloading = _preloading;
+  _preloading = preloading;
+  callback();
+  _preloading = wasPreloading;
+}
+
+bool ResourceManager::isPreloading(IHasResources* loader) const {
+  if (_preloading) {
+    return true;
+  }
+  const auto it = _resourceLoaders.find(loader);
+  return it != _resourceLoaders.end() && it->second.preloading;
+}
+
+void ResourceManager::promotePreloaded() {
+  for (auto& it : _resourceLoaders) {
+    LoaderState& state = it.second;
+    if (!state.preloading) {
+      continue;
+    }
+    state.preloading = false;
+    if (state.finished == HasResourcesFinished::NO) {
+      _numUnfinishedLoaders ++;
+    } else if (state.finished == HasResourcesFinished::FAILED) {
+      _numFailedLoaders ++;
+    }
+  }
+  _preloadedResources.clear();
+  for (auto& download : _mapDownloads) {
+    download.second.preloading = false;
+  }
+
+  // Back where they were asked for, in the order they were asked
+  const unordered_map<int, LoadPriority> preloaded = std::move(_preloadedRequests);
+  _preloadedRequests.clear();
+  vector<pair<int, LoadPriority>> promoted;
+  for (const auto& request : _queuedRequests) {
+    const auto it = preloaded.find(request.second.resourceID);
+    if (it != preloaded.end()) {
+      promoted.push_back(*it);
+    }
+  }
+  for (const auto& request : promoted) {
+    setPriority(request.first, request.second);
+  }
+}
+
+LoadingState ResourceManager::preloadState() const {
+  bool failed = false;
+  for (const auto& it : _resourceLoaders) {
+    if (!it.second.preloading) {
+      continue;
+    }
+    if (it.second.finished == HasResourcesFinished::NO) {
+      return LoadingState::LOADING;
+    }
+    failed = failed || it.second.finished == HasResourcesFinished::FAILED;
+  }
+  return failed ? LoadingState::FAILED : LoadingState::DONE;
 }
 
 bool ResourceManager::hasOutstandingResources() const {
   return _loadingResources.size() > 0 || _failedResources.size() > 0;
 }
 
-LoadingState ResourceManager::think() {
-  unordered_set<IHasResources*> incompleteLoaders;
-  for (const auto& it : _loadingResources) {
-    incompleteLoaders.insert(it.second);
+void ResourceManager::addLoadingResource(int resourceID, IHasResources* loader) {
+  const bool alreadyLoading = _loadingResources.count(resourceID) > 0;
+  _loadingResources.insert({ resourceID, loader });
+
+  const auto it = _resourceLoaders.find(loader);
+  if (it != _resourceLoaders.end()) {
+    it->second.outstandingResources ++;
+    if (!it->second.preloading) {
+      _preloadedResources.erase(resourceID); // Something in the foreground waits for it
+    } else if (!alreadyLoading) {
+      _preloadedResources.insert(resourceID);
+    }
   }
+}
 
-  for (auto& loaderAndResult : _resourceLoaders) {
-    if (incompleteLoaders.count(loaderAndResult.first)) {
-      // Still loading... let's wait
-      assert(loaderAndResult.second != HasResourcesFinished::YES);
+void ResourceManager::doneLoadingResource(int resourceID) {
+  const auto range = _loadingResources.equal_range(resourceID);
+  for (auto resource = range.first; resource != range.second; resource ++) {
+    const auto it = _resourceLoaders.find(resource->second);
+    if (it == _resourceLoaders.end()) {
       continue;
     }
-    if (loaderAndResult.second != HasResourcesFinished::NO) {
-      // Done -- either failed or finished
-      continue;
+    if (-- it->second.outstandingResources == 0 && it->second.finished == HasResourcesFinished::NO) {
+      _readyLoaders.push_back(resource->second);
     }
+  }
+  _loadingResources.erase(range.first, range.second);
+  _streamingResources.erase(resourceID);
+  if (_requestsInFlight.erase(resourceID)) {
+    sendQueuedRequests();
+  }
 
-    bool success = loaderAndResult.first->finishLoading();
-    loaderAndResult.second = success ? HasResourcesFinished::YES : HasResourcesFinished::FAILED;
+  const auto record = _resources.find(resourceID);
+  if (record != _resources.end() && record->second.references == 0) {
+    // Everything that asked for it went away while it was loading
+    cacheOrUnload(resourceID);
   }
+  evictOverBudget();
+}
 
-  for (auto& it : _resourceLoaders) {
-    if (it.second == HasResourcesFinished::NO) {
-      // At least one loader is still loading
-      return LoadingState::LOADING;
+// Loading the same thing again can reuse an unreferenced copy
+static string cacheKey(const LoadResource& message) {
+  const string key = to_string((int) message.resourceType) + ":" + message.url;
+  return message.maxSize ? key + "@" + to_string(message.maxSize) : key;
+}
+
+static string cacheKey(const LoadShaders& message) {
+  return "shaders:" + message.vertUrl + ":" + message.fragUrl;
+}
+
+static bool isOnGPU(int resourceID) {
+  const ResourceKind kind = resourceKindOf(resourceID);
+  return kind == ResourceKind::TEXTURE || kind == ResourceKind::SHADER_PROGRAM;
+}
+
+void ResourceManager::setMemoryBudget(size_t gpuBytes, size_t cpuBytes) {
+  _gpuBudget = gpuBytes;
+  _cpuBudget = cpuBytes;
+  evictOverBudget();
+}
+
+bool ResourceManager::retainResource(IHasResources* loader, int resourceID, const string& key, LoadPriority priority) {
+  if (shareReferenced(loader, resourceID, key, priority)) {
+    return true;
+  }
+
+  ResourceRecord& record = _resources[resourceID];
+  record.key = key;
+  record.references ++;
+  _resourcesByKey[key] = resourceID;
+
+  const auto it = _resourceLoaders.find(loader);
+  if (it != _resourceLoaders.end()) {
+    it->second.references.push_back(resourceID);
+  }
+
+  return reuseUnreferenced(resourceID, key);
+}
+
+bool ResourceManager::shareReferenced(IHasResources* loader, int resourceID, const string& key, LoadPriority priority) {
+  const auto existing = _resourcesByKey.find(key);
+  if (existing == _resourcesByKey.end() || existing->second == resourceID) {
+    return false;
+  }
+  const int sharedID = existing->second;
+  const auto record = _resources.find(sharedID);
+  if (record == _resources.end() || record->second.references == 0 || _failedResources.count(sharedID)) {
+    return false; // Cached (see reuseUnreferenced), or no good
+  }
+
+  // The new handle refers to it from now on, see resolve()
+  record->second.references ++;
+  _sharedResources[resourceID] = sharedID;
+  const auto it = _resourceLoaders.find(loader);
+  if (it != _resourceLoaders.end()) {
+    it->second.references.push_back(resourceID);
+  }
+  if (priority == LoadPriority::CRITICAL) {
+    waitForResource(loader, sharedID);
+  }
+
+  if (!isPreloading(loader)) {
+    // It's wanted now, not just for later
+    const auto preloaded = _preloadedRequests.find(sharedID);
+    if (preloaded != _preloadedRequests.end()) {
+      const LoadPriority wanted = std::min(preloaded->second, priority);
+      _preloadedRequests.erase(preloaded);
+      setPriority(sharedID, wanted);
+    } else {
+      const auto queued = _queuedRequestOrder.find(sharedID);
+      if (queued != _queuedRequestOrder.end() && priority < queued->second.first) {
+        setPriority(sharedID, priority);
+      }
+    }
+    const auto download = _mapDownloads.find(sharedID);
+    if (download != _mapDownloads.end()) {
+      download->second.preloading = false;
+    }
+  }
+
+  return true;
+}
+
+int ResourceManager::resolve(int resourceID) const {
+  const auto it = _sharedResources.find(resourceID);
+  return it == _sharedResources.end() ? resourceID : it->second;
+}
+
+bool ResourceManager::reuseUnreferenced(int resourceID, const string& key) {
+  const auto cached = _unreferencedByKey.find(key);
+  if (cached == _unreferencedByKey.end()) {
+    return false;
+  }
+  const int cachedID = *cached->second;
+
+  // Moves the loaded resource over to the new handle
+  bool reused = false;
+  switch (resourceKindOf(resourceID)) {
+    case ResourceKind::SHADER_PROGRAM: {
+      GLuint* from = _shaderPrograms.get(ShaderHandle::fromID(cachedID));
+      GLuint* to = _shaderPrograms.get(ShaderHandle::fromID(resourceID));
+      if (from && to) {
+        std::swap(*from, *to);
+        reused = true;
+      }
+      break;
+    }
+    case ResourceKind::TEXTURE: {
+      TextureSlot* from = _textures.get(TextureHandle::fromID(cachedID));
+      TextureSlot* to = _textures.get(TextureHandle::fromID(resourceID));
+      if (from && to) {
+        std::swap(*from, *to);
+        to->requestedSize = 0; // Anything in flight was for the old handle
+        reused = true;
+      }
+      break;
+    }
+    case ResourceKind::MAP: {
+      ResourcePtr<const BSPMap>* from = _maps.get(MapHandle::fromID(cachedID));
+      ResourcePtr<const BSPMap>* to = _maps.get(MapHandle::fromID(resourceID));
+      if (from && to) {
+        std::swap(*from, *to);
+        reused = true;
+      }
+      break;
+    }
+    case ResourceKind::COOKED_MAP: {
+      ResourcePtr<const CookedMap>* from = _cookedMaps.get(CookedMapHandle::fromID(cachedID));
+      ResourcePtr<const CookedMap>* to = _cookedMaps.get(CookedMapHandle::fromID(resourceID));
+      if (from && to) {
+        std::swap(*from, *to);
+        reused = true;
+      }
+      break;
+    }
+    case ResourceKind::ARCHIVE: {
+      ArchiveSlot* from = _archives.get(ArchiveHandle::fromID(cachedID));
+      ArchiveSlot* to = _archives.get(ArchiveHandle::fromID(resourceID));
+      if (from && to) {
+        std::swap(*from, *to);
+        reused = true;
+      }
+      break;
+    }
+    case ResourceKind::TEXTURE_MANIFEST: {
+      TextureManifestPtr* from = _textureManifests.get(TextureManifestHandle::fromID(cachedID));
+      TextureManifestPtr* to = _textureManifests.get(TextureManifestHandle::fromID(resourceID));
+      if (from && to) {
+        std::swap(*from, *to);
+        reused = true;
+      }
+      break;
+    }
+    default:
+      break;
+  }
+  if (!reused) {
+    return false;
+  }
+
+  const size_t bytes = _resources[cachedID].bytes;
+  setResourceBytes(cachedID, 0);
+  unloadResource(cachedID); // Only the (now empty) slot is left
+  setResourceBytes(resourceID, bytes);
+
+  if (resourceKindOf(resourceID) == ResourceKind::ARCHIVE) {
+    mountArchive(resourceID);
+  } else if (resourceKindOf(resourceID) == ResourceKind::TEXTURE_MANIFEST) {
+    _textureManifest = *_textureManifests.get(TextureManifestHandle::fromID(resourceID));
+    _textureManifestResourceID = resourceID;
+  }
+  return true;
+}
+
+void ResourceManager::setResourceBytes(int resourceID, size_t bytes) {
+  const auto record = _resources.find(resourceID);
+  if (record == _resources.end()) {
+    return;
+  }
+
+  size_t& total = isOnGPU(resourceID) ? _gpuBytes : _cpuBytes;
+  total = total - record->second.bytes + bytes;
+  record->second.bytes = bytes;
+}
+
+void ResourceManager::releaseResource(int resourceID) {
+  const auto shared = _sharedResources.find(resourceID);
+  if (shared != _sharedResources.end()) {
+    // Only its (empty) slot was ever this handle's
+    const int sharedID = shared->second;
+    _sharedResources.erase(shared);
+    unloadResource(resourceID);
+    releaseResource(sharedID);
+    return;
+  }
+
+  const auto record = _resources.find(resourceID);
+  if (record == _resources.end() || -- record->second.references > 0) {
+    return;
+  }
+  const auto queued = _queuedRequestOrder.find(resourceID);
+  if (queued != _queuedRequestOrder.end()) {
+    // Never sent, so there's nothing to wait for
+    _queuedRequests.erase(queued->second);
+    _queuedRequestOrder.erase(queued);
+    _preloadedRequests.erase(resourceID);
+    doneLoadingResource(resourceID);
+    return;
+  }
+  if (_loadingResources.count(resourceID)) {
+    return; // See doneLoadingResource
+  }
+
+  cacheOrUnload(resourceID);
+  evictOverBudget();
+}
+
+void ResourceManager::cacheOrUnload(int resourceID) {
+  const ResourceRecord& record = _resources.at(resourceID);
+  const bool loaded = record.bytes > 0 || getShaderProgram(ShaderHandle::fromID(resourceID));
+  if (!loaded || _failedResources.count(resourceID)) {
+    unloadResource(resourceID);
+    return;
+  }
+
+  // One unreferenced copy of anything is enough
+  const string key = record.key;
+  const auto existing = _unreferencedByKey.find(key);
+  if (existing != _unreferencedByKey.end()) {
+    if (*existing->second == resourceID) {
+      return; // Already cached
+    }
+    unloadResource(*existing->second);
+  }
+  _unreferencedByKey[key] = _unreferenced.insert(_unreferenced.end(), resourceID);
+}
+
+void ResourceManager::unloadResource(int resourceID) {
+  switch (resourceKindOf(resourceID)) {
+    case ResourceKind::SHADER_PROGRAM: {
+      const GLuint* program = _shaderPrograms.get(ShaderHandle::fromID(resourceID));
+      if (program && *program) {
+        glDeleteProgram(*program);
+      }
+      _shaderPrograms.release(ShaderHandle::fromID(resourceID));
+      break;
+    }
+    case ResourceKind::TEXTURE: {
+      const TextureSlot* slot = _textures.get(TextureHandle::fromID(resourceID));
+      if (slot && slot->texture) {
+        glDeleteTextures(1, &slot->texture);
+      }
+      _textures.release(TextureHandle::fromID(resourceID));
+      break;
+    }
+    case ResourceKind::MAP: {
+      _maps.release(MapHandle::fromID(resourceID));
+      abandonMapDownload(resourceID);
+      if (resourceID == _lastMapResourceID) {
+        _lastMapResourceID = -1;
+      }
+      break;
+    }
+    case ResourceKind::COOKED_MAP: {
+      _cookedMaps.release(CookedMapHandle::fromID(resourceID));
+      _cookedMapMaps.erase(resourceID);
+      break;
+    }
+    case ResourceKind::ARCHIVE: {
+      _archives.release(ArchiveHandle::fromID(resourceID));
+      _mountedArchives.erase(std::remove(_mountedArchives.begin(), _mountedArchives.end(), resourceID), _mountedArchives.end());
+      _indexReads.erase(resourceID);
+      break;
     }
-    if (it.second == HasResourcesFinished::FAILED) {
-      // At least one loader failed
-      return LoadingState::FAILED;
+    case ResourceKind::TEXTURE_MANIFEST: {
+      _textureManifests.release(TextureManifestHandle::fromID(resourceID));
+      _indexReads.erase(resourceID);
+      if (resourceID == _textureManifestResourceID) {
+        _textureManifest = nullptr;
+        _textureManifestResourceID = -1;
+      }
+      break;
     }
+    default:
+      break;
   }
 
-  if (hasOutstandingResources()) {
+  _preloadedResources.erase(resourceID);
+  _failedResources.erase(resourceID); // Nothing's left to fail
+  const auto record = _resources.find(resourceID);
+  if (record == _resources.end()) {
+    return;
+  }
+  setResourceBytes(resourceID, 0);
+  const auto byKey = _resourcesByKey.find(record->second.key);
+  if (byKey != _resourcesByKey.end() && byKey->second == resourceID) {
+    _resourcesByKey.erase(byKey);
+  }
+  const auto cached = _unreferencedByKey.find(record->second.key);
+  if (cached != _unreferencedByKey.end() && *cached->second == resourceID) {
+    _unreferenced.erase(cached->second);
+    _unreferencedByKey.erase(cached);
+  }
+  _resources.erase(record);
+}
+
+void ResourceManager::evictOverBudget(size_t gpuReserve) {
+  for (auto it = _unreferenced.begin(); it != _unreferenced.end() && (_gpuBytes + gpuReserve > _gpuBudget || _cpuBytes > _cpuBudget);) {
+    const int resourceID = *(it ++);
+    const bool overBudget = isOnGPU(resourceID) ? _gpuBytes + gpuReserve > _gpuBudget : _cpuBytes > _cpuBudget;
+    if (overBudget) {
+      unloadResource(resourceID);
+    }
+  }
+}
+
+LoadingState ResourceManager::think() {
+  _frame ++;
+
+  // Finished uploads free up request slots, so refill them once afterwards.
+  // Decoded images go into this frame's uploads.
+  _holdQueuedRequests = true;
+  _imageDecoders.finishJobs();
+  for (const TextureUploader::Finished& upload : _textureUploader.pump()) {
+    finishTextureUpload(upload);
+  }
+  _holdQueuedRequests = false;
+  sendQueuedRequests();
+
+  if (_textureResidencyChanged) {
+    updateTextureResidency();
+  }
+
+  // finishLoading() can add loaders, or ask for more resources
+  while (_readyLoaders.size()) {
+    const vector<IHasResources*> readyLoaders = std::move(_readyLoaders);
+    _readyLoaders.clear();
+
+    for (IHasResources* loader : readyLoaders) {
+      const auto it = _resourceLoaders.find(loader);
+      if (it == _resourceLoaders.end() || it->second.finished != HasResourcesFinished::NO || it->second.outstandingResources > 0) {
+        // Removed, already finished, or waiting on something again
+        continue;
+      }
+
+      // The loaders a background loader makes are background loaders too
+      const bool preloading = it->second.preloading;
+      bool success = false;
+      withPreloading(preloading, [&]() {
+        success = loader->finishLoading();
+      });
+      // finishLoading() may have added loaders, so look it up again
+      const auto finished = _resourceLoaders.find(loader);
+      if (finished == _resourceLoaders.end()) {
+        continue;
+      }
+      finished->second.finished = success ? HasResourcesFinished::YES : HasResourcesFinished::FAILED;
+      if (finished->second.preloading) {
+        continue; // See preloadState()
+      }
+      _numUnfinishedLoaders --;
+      if (!success) {
+        _numFailedLoaders ++;
+      }
+    }
+  }
+
+  if (_numFailedLoaders > 0) {
+    // At least one loader failed
+    return LoadingState::FAILED;
+  }
+  if (_numUnfinishedLoaders > 0) {
+    // At least one loader is still loading
     return LoadingState::LOADING;
   }
 
-  if (_failedResources.size()) {
+  // What only background loaders wait for doesn't hold anything up
+  size_t preloadedWaits = 0;
+  size_t preloadedFailures = 0;
+  for (int resourceID : _preloadedResources) {
+    if (!_streamingResources.count(resourceID)) {
+      preloadedWaits += _loadingResources.count(resourceID);
+    }
+    preloadedFailures += _failedResources.count(resourceID);
+  }
+
+  if (_loadingResources.size() > _streamingResources.size() + preloadedWaits) {
+    return LoadingState::LOADING;
+  }
+  if (_failedResources.size() > preloadedFailures) {
     return LoadingState::FAILED;
   }
+  if (_loadingResources.size() > preloadedWaits) {
+    return LoadingState::STREAMING;
+  }
 
   return LoadingState::DONE;
 }
 
 
-void ResourceManager::loadResource(IHasResources* loader, const LoadResource& message) {
-  MessageBindings::sendMessageToWeb(message);
-  _loadingResources[message.resourceID] = loader;
+void ResourceManager::loadResource(IHasResources* loader, const LoadResource& message, LoadPriority priority) {
+  loadResources(loader, { message }, priority);
 }
 
-void ResourceManager::loadShaders(IHasResources* loader, const LoadShaders& message) {
-  MessageBindings::sendMessageToWeb(message);
-  _loadingResources[message.resourceID] = loader;
+void ResourceManager::loadResources(IHasResources* loader, const vector<LoadResource>& messages, LoadPriority priority) {
+  const bool preloading = isPreloading(loader);
+  LoadResources critical;
+  for (const LoadResource& message : messages) {
+    if (!startLoading(loader, message, priority)) {
+      continue;
+    }
+
+    // Archives and manifests go first whatever they're for, since textures
+    // are found through them (see resolveTexture)
+    if (message.resourceType == ResourceType::ARCHIVE_FILE
+        || message.resourceType == ResourceType::TEXTURE_MANIFEST_FILE) {
+      critical.resources.push_back(message);
+    } else if (preloading) {
+      // Behind everything the current map wants, until promotePreloaded()
+      _preloadedRequests[message.resourceID] = priority;
+      queueRequest(message, preloadPriority(priority));
+    } else if (priority == LoadPriority::CRITICAL) {
+      critical.resources.push_back(message);
+    } else {
+      queueRequest(message, priority);
+    }
+  }
+
+  if (critical.resources.size() == 1) {
+    MessageBindings::sendMessageToWeb(toRequest(critical.resources[0]));
+  } else if (critical.resources.size()) {
+    for (LoadResource& request : critical.resources) {
+      request = toRequest(request);
+    }
+    MessageBindings::sendMessageToWeb(critical);
+  }
+  sendQueuedRequests();
 }
 
+void ResourceManager::queueRequest(const LoadResource& message, LoadPriority priority) {
+  const RequestOrder order = { priority, _nextRequestSequence ++ };
+  _queuedRequests[order] = message;
+  _queuedRequestOrder[message.resourceID] = order;
+}
 
-void ResourceManager::handleMessageFromWeb(const LoadedTexture& message) {
-  optional<GLuint> tex = GLHelpers::loadTexture(message.pointer, message.width, message.height);
-  free(message.pointer);
+void ResourceManager::setPriority(int resourceID, LoadPriority priority) {
+  resourceID = resolve(resourceID);
+  const auto preloaded = _preloadedRequests.find(resourceID);
+  if (preloaded != _preloadedRequests.end()) {
+    preloaded->second = priority; // Moves up to it once it's promoted
+    priority = preloadPriority(priority);
+  }
+
+  const auto it = _queuedRequestOrder.find(resourceID);
+  if (it == _queuedRequestOrder.end() || it->second.first == priority) {
+    return; // Already sent, or no change
+  }
+
+  const auto request = _queuedRequests.find(it->second);
+  const LoadResource message = request->second;
+  _queuedRequests.erase(request);
+  _queuedRequestOrder.erase(it);
+
+  if (priority == LoadPriority::CRITICAL) {
+    MessageBindings::sendMessageToWeb(toRequest(message));
+  } else {
+    queueRequest(message, priority);
+  }
+}
+
+LoadPriority ResourceManager::preloadPriority(LoadPriority priority) {
+  return priority == LoadPriority::DEFERRED ? LoadPriority::DEFERRED : LoadPriority::OTHER_MAPS;
+}
+
+void ResourceManager::setMaxRequestsInFlight(int maxRequests) {
+  _maxRequestsInFlight = maxRequests;
+  sendQueuedRequests();
+}
 
-  if (tex) {
-    cout << "adding texture for " << message.resourceID << "\n";
-    _textures[message.resourceID] = *tex;
-    _loadingResources.erase(message.resourceID);
+void ResourceManager::sendQueuedRequests() {
+  if (_holdQueuedRequests) {
     return;
   }
 
-  cerr << "error while loading texture\n";
-  _failedResources.insert(message.resourceID);
+  LoadResources batch;
+  while (_queuedRequests.size() && (int) _requestsInFlight.size() < _maxRequestsInFlight) {
+    const auto next = _queuedRequests.begin();
+    if (next->first.first == LoadPriority::DEFERRED) {
+      break;
+    }
+    if (_indexReads.size() && next->second.resourceType == ResourceType::IMAGE_FILE) {
+      break; // Until we know where it is
+    }
+    batch.resources.push_back(toRequest(next->second));
+    _requestsInFlight.insert(next->second.resourceID);
+    _queuedRequestOrder.erase(next->second.resourceID);
+    _preloadedRequests.erase(next->second.resourceID);
+    _queuedRequests.erase(next);
+  }
+
+  if (batch.resources.size()) {
+    MessageBindings::sendMessageToWeb(batch);
+  }
 }
 
-void ResourceManager::handleMessageFromWeb(const MissingTexture& message) {
+bool ResourceManager::startLoading(IHasResources* loader, const LoadResource& message, LoadPriority priority) {
+  const bool retained = retainResource(loader, message.resourceID, cacheKey(message), priority);
+  if (message.resourceType == ResourceType::BSP_FILE) {
+    _lastMapResourceID = resolve(message.resourceID);
+  }
+  if (retained) {
+    return false; // Still around from an earlier load, or shared
+  }
+
+  if (message.resourceType == ResourceType::COOKED_MAP_FILE) {
+    _cookedMapMaps[message.resourceID] = _lastMapResourceID;
+  }
+
+  if (message.resourceType == ResourceType::IMAGE_FILE && isMissingTexture(message)) {
     cout << "missing texture (not error) for " << message.resourceID << "\n";
-  _loadingResources.erase(message.resourceID);
+    return false;
+  }
+
+  if (message.resourceType == ResourceType::IMAGE_FILE && message.maxSize > 0) {
+    TextureSlot* slot = _textures.get(TextureHandle::fromID(message.resourceID));
+    if (slot) {
+      slot->url = message.url;
+      slot->baseSize = message.maxSize;
+    }
+  }
+
+  if (message.resourceType == ResourceType::ARCHIVE_FILE) {
+    ArchiveSlot* slot = _archives.get(ArchiveHandle::fromID(message.resourceID));
+    if (slot) {
+      slot->url = message.url;
+      // Its paths are relative to the directory it's in
+      const string url = message.url.rfind("./", 0) == 0 ? message.url.substr(2) : message.url;
+      slot->root = Archive::normalizePath(url.substr(0, url.rfind('/') + 1));
+    }
+#ifndef __EMSCRIPTEN__
+    loadMappedArchive(message);
+    return false;
+#else
+    _indexReads.insert(message.resourceID);
+#endif
+  }
+
+  if (message.resourceType == ResourceType::TEXTURE_MANIFEST_FILE) {
+#ifndef __EMSCRIPTEN__
+    loadMappedTextureManifest(message);
+    return false;
+#else
+    _indexReads.insert(message.resourceID);
+#endif
+  }
+
+#ifndef __EMSCRIPTEN__
+  // Natively we can skip the round trip through JS (on macOS, the webview and
+  // its base64 copy of the whole file) and map the file directly.
+  if (message.resourceType == ResourceType::BSP_FILE) {
+    loadMappedBSP(message);
+    return false;
+  }
+  if (message.resourceType == ResourceType::COOKED_MAP_FILE && loadMappedCookedMap(message)) {
+    return false;
+  }
+#endif
+
+  if (message.resourceType == ResourceType::BSP_FILE) {
+    _mapDownloads[message.resourceID].preloading = isPreloading(loader);
+  }
+
+  if (priority == LoadPriority::CRITICAL) {
+    addLoadingResource(message.resourceID, loader);
+  } else {
+    // Still referenced by `loader`, but it doesn't wait
+    addLoadingResource(message.resourceID, nullptr);
+    _streamingResources.insert(message.resourceID);
+  }
+
+#ifndef __EMSCRIPTEN__
+  if (message.resourceType == ResourceType::COOKED_MAP_FILE) {
+    // There's no file, so it's looked for in the asset cache instead
+    loadCachedCookedMap(message.resourceID);
+    return false;
+  }
+#endif
+  return true;
 }
 
-void ResourceManager::handleMessageFromWeb(const LoadedBSP& message) {
-  cout << "adding map for " << message.resourceID << "\n";
-  const auto pointer = (const BSPMap*) message.pointer;
-  _map = pointer;
-  _loadingResources.erase(message.resourceID);
+void ResourceManager::waitForResource(IHasResources* loader, int resourceID) {
+  resourceID = resolve(resourceID);
+  if (_loadingResources.count(resourceID)) {
+    addLoadingResource(resourceID, loader);
+  }
 }
 
-void ResourceManager::handleMessageFromWeb(const LoadedShaders& message) {
-  cout << "starting to compile shaders for " << message.resourceID << "\n";
-  optional<GLuint> shaderProgram = GLHelpers::compileShaderProgram((const char*) message.vertPointer, message.vertLength, (const char*) message.fragPointer, message.fragLength);
+#ifndef __EMSCRIPTEN__
+void ResourceManager::loadMappedBSP(const LoadResource& message) {
+  const optional<MappedFile::Mapping> mapping = MappedFile::map(message.url);
+  if (!mapping) {
+    _failedResources.insert(message.resourceID);
+    return;
+  }
 
-  free(message.vertPointer);
-  free(message.fragPointer);
+  const auto pointer = (const BSPMap*) mapping->data;
+  if (!pointer->isValid(mapping->length)) {
+    cerr << message.url << " isn't a valid BSP file\n";
+    MappedFile::unmap(*mapping);
+    _failedResources.insert(message.resourceID);
+    return;
+  }
 
-  if (shaderProgram) {
-    cout << "adding shader program for " << message.resourceID << "\n";
-    _shaderPrograms[message.resourceID] = *shaderProgram;
-    _loadingResources.erase(message.resourceID);
+  const MappedFile::Mapping unmapLater = *mapping;
+  storeMap(message.resourceID, ResourcePtr<const BSPMap>(pointer, [unmapLater](const BSPMap*) {
+    MappedFile::unmap(unmapLater);
+  }), mapping->length);
+}
+
+void ResourceManager::loadMappedArchive(const LoadResource& message) {
+  ArchiveSlot* slot = _archives.get(ArchiveHandle::fromID(message.resourceID));
+  const optional<MappedFile::Mapping> mapping = MappedFile::map(message.url, false);
+  if (!slot || !mapping) {
+    cout << "no archive at " << message.url << " (not error)\n";
     return;
   }
-  cerr << "failed to create shader program\n";
-  _failedResources.insert(message.resourceID);
+
+  // Entries are read straight out of the mapping as they're asked for
+  const MappedFile::Mapping unmapLater = *mapping;
+  slot->file = ResourcePtr<const char>((const char*) mapping->data, [unmapLater](const char*) {
+    MappedFile::unmap(unmapLater);
+  });
+  slot->fileLength = mapping->length;
+  if (!slot->directory.read(slot->file.get(), 0, slot->fileLength, slot->fileLength)) {
+    cerr << message.url << " isn't an archive we can read, ignoring it\n";
+    slot->file = nullptr;
+    return;
+  }
+  mountArchive(message.resourceID);
 }
 
-void ResourceManager::handleMessageFromWeb(const LoadedTextureOptions& message) {
-  _textureOptions[message.resourceID] = { message.surfaceParamTrans };
+void ResourceManager::loadMappedTextureManifest(const LoadResource& message) {
+  const optional<MappedFile::Mapping> mapping = MappedFile::map(message.url);
+  if (!mapping) {
+    cout << "no texture manifest at " << message.url << " (not error)\n";
+    return;
+  }
+
+  const auto pointer = (const TextureManifest::header_t*) mapping->data;
+  if (!pointer->isValid(mapping->length)) {
+    cerr << message.url << " isn't a valid texture manifest, ignoring it\n";
+    MappedFile::unmap(*mapping);
+    return;
+  }
+
+  const MappedFile::Mapping unmapLater = *mapping;
+  storeTextureManifest(message.resourceID, TextureManifestPtr(pointer, [unmapLater](const TextureManifest::header_t*) {
+    MappedFile::unmap(unmapLater);
+  }), mapping->length);
 }
 
-optional<GLuint> ResourceManager::getShaderProgram(int resourceID) {
-  if (_shaderPrograms.count(resourceID)) {
-    return _shaderPrograms.at(resourceID);
+bool ResourceManager::loadMappedCookedMap(const LoadResource& message) {
+  const optional<MappedFile::Mapping> mapping = MappedFile::map(message.url);
+  if (!mapping) {
+    return false; // Cooked in memory instead (see RenderableBSP::finishLoading)
   }
 
-  return {};
+  const auto pointer = (const CookedMap*) mapping->data;
+  if (!pointer->isValid(mapping->length)) {
+    cerr << message.url << " isn't a valid cooked map, ignoring it\n";
+    MappedFile::unmap(*mapping);
+    return true;
+  }
+
+  const MappedFile::Mapping unmapLater = *mapping;
+  storeCookedMap(message.resourceID, ResourcePtr<const CookedMap>(pointer, [unmapLater](const CookedMap*) {
+    MappedFile::unmap(unmapLater);
+  }), mapping->length);
+  return true;
 }
+#endif
 
-optional<GLuint> ResourceManager::getTexture(int resourceID) {
-  if (_textures.count(resourceID)) {
-    return _textures.at(resourceID);
+void ResourceManager::loadShaders(IHasResources* loader, const LoadShaders& message) {
+  if (retainResource(loader, message.resourceID, cacheKey(message), LoadPriority::CRITICAL)) {
+    return; // Still around from an earlier load, or shared
   }
 
-  return {};
+  MessageBindings::sendMessageToWeb(message);
+  addLoadingResource(message.resourceID, loader);
 }
 
-optional<RenderableTextureOptions> ResourceManager::getTextureOptions(int resourceID) {
-  if (_textureOptions.count(resourceID)) {
-    return _textureOptions.at(resourceID);
+
+void ResourceManager::handleMessageFromWeb(const LoadedTexture& message) {
+  TextureSlot* slot = _textures.get(TextureHandle::fromID(message.resourceID));
+  if (slot) {
+    slot->fullSize = std::max(
+      message.fullWidth ? message.fullWidth : message.width,
+      message.fullHeight ? message.fullHeight : message.height);
   }
 
-  return {};
+  // Still loading until think() has finished uploading it (or, if the browser
+  // uploaded it, made its mipmaps)
+  const optional<GLuint> uploaded = takeUploadTexture(message.resourceID);
+  if (!message.pointer) {
+    if (uploaded) {
+      _textureUploader.enqueueUploaded(message.resourceID, *uploaded, message.width, message.height);
+    } else {
+      finishTextureUpload({ message.resourceID, {}, 0, 0, 0 });
+    }
+    return;
+  }
+  if (uploaded) {
+    glDeleteTextures(1, &*uploaded);
+  }
+  _textureUploader.enqueue(message.resourceID, message.pointer, message.width, message.height);
+}
+
+void ResourceManager::handleMessageFromWeb(const LoadedCompressedTexture& message) {
+  discardUploadTexture(message.resourceID);
+  const auto* file = (const TextureCompression::header_t*) message.pointer;
+  if (!file->isValid(message.length)) {
+    cerr << "invalid compressed texture for " << message.resourceID << "\n";
+    free(message.pointer);
+    finishTextureUpload({ message.resourceID, {}, 0, 0, 0 });
+    return;
+  }
+
+  // Only the levels that fit what was asked for are uploaded
+  int maxSize = 0;
+  TextureSlot* slot = _textures.get(TextureHandle::fromID(message.resourceID));
+  if (slot) {
+    slot->fullSize = std::max(file->width, file->height);
+    slot->compressed = true;
+    maxSize = slot->requestedSize ? slot->requestedSize : slot->baseSize;
+  }
+
+  _textureUploader.enqueueCompressed(message.resourceID, message.pointer, maxSize);
+}
+
+void ResourceManager::handleMessageFromWeb(const LoadedImageFile& message) {
+  void* pointer = message.pointer;
+  const int length = message.length;
+  const string url = message.url;
+  loadImageFile(message.resourceID, url, false, [pointer, length, url](ImageFile& file) {
+#ifndef __EMSCRIPTEN__
+    if (!pointer) {
+      // Straight from disk, rather than through the webview
+      const optional<MappedFile::Mapping> mapping = MappedFile::map(url, false);
+      if (mapping) {
+        file.data = (const char*) mapping->data;
+        file.length = mapping->length;
+        const MappedFile::Mapping unmapLater = *mapping;
+        file.release = [unmapLater]() { MappedFile::unmap(unmapLater); };
+      }
+      return;
+    }
+#endif
+    file.data = (const char*) pointer;
+    file.length = length;
+    file.release = [pointer]() { free(pointer); };
+  });
+}
+
+void ResourceManager::loadImageFile(int resourceID, const string& url, bool inArchive, std::function<void(ImageFile& file)> read) {
+  discardUploadTexture(resourceID);
+
+  // Scaled down to what was asked for while it's decoded
+  int maxSize = 0;
+  const TextureSlot* slot = _textures.get(TextureHandle::fromID(resourceID));
+  if (slot) {
+    maxSize = slot->requestedSize ? slot->requestedSize : slot->baseSize;
+  }
+
+  const auto file = std::make_shared<ImageFile>();
+  file->inArchive = inArchive;
+
+  // The file's read and hashed off the main thread too, then looked up in the
+  // asset cache, which has it already decoded if it's been seen before
+  withAssetCacheEntry([file, read, maxSize]() -> string {
+    read(*file);
+    if (!file->release) {
+      return ""; // Nothing to look up
+    }
+    return AssetCache::key("image", Hash::xxh64(file->data, file->length), maxSize);
+  }, [file, maxSize](AssetCacheJob& job) {
+    decodeImage(*file, job, maxSize);
+  }, [this, resourceID, url, maxSize, file]() {
+    finishImageDecode(resourceID, url, maxSize, file->inArchive, file->image);
+  });
+}
+
+void ResourceManager::withAssetCacheEntry(std::function<string()> key, std::function<void(AssetCacheJob& job)> work, std::function<void()> then, bool lookUp) {
+  const auto job = std::make_shared<AssetCacheJob>();
+#ifdef __APPLE__
+  // Natively the cache is files, read & written on the same thread
+  _imageDecoders.run([job, key, work, lookUp]() {
+    job->key = key();
+    if (job->key.size() && lookUp) {
+      AssetCache::load(job->key, [job](void* entry, size_t length) {
+        job->entry = entry;
+        job->length = length;
+      });
+    }
+    work(*job);
+    if (job->store) {
+      AssetCache::store(job->key, job->store, job->storeLength);
+    }
+  }, then);
+#else
+  // IndexedDB is only on the main thread, so it's asked in between
+  _imageDecoders.run([job, key]() {
+    job->key = key();
+  }, [this, job, work, then, lookUp]() {
+    const auto afterLoad = [this, job, work, then](void* entry, size_t length) {
+      job->entry = entry;
+      job->length = length;
+      _imageDecoders.run([job, work]() {
+        work(*job);
+      }, [job, then]() {
+        if (job->store) {
+          AssetCache::store(job->key, job->store, job->storeLength);
+        }
+        then();
+      });
+    };
+    if (job->key.size() && lookUp) {
+      AssetCache::load(job->key, afterLoad);
+    } else {
+      afterLoad(nullptr, 0);
+    }
+  });
+#endif
+}
+
+void ResourceManager::decodeImage(ImageFile& file, AssetCacheJob& job, int maxSize) {
+  if (!file.release) {
+    return; // Couldn't be read
+  }
+
+  if (job.entry && AssetCache::unpack(job.key, job.entry, job.length)) {
+    file.image = cachedImage(job.entry, job.length);
+    if (!file.image) {
+      free(job.entry);
+    }
+  }
+
+  if (!file.image) {
+    file.image = ImageDecoder::decode(file.data, file.length, maxSize);
+    if (file.image) {
+      const CachedImageHeader header = { file.image->width, file.image->height, file.image->fullWidth, file.image->fullHeight };
+      job.store = AssetCache::pack({
+        { &header, sizeof(header) },
+        { file.image->pixels, (size_t) file.image->width * file.image->height * 4 }
+      }, job.storeLength);
+    }
+  }
+  file.release();
+}
+
+// Decoded images are kept in the asset cache as this, then their pixels
+optional<ImageDecoder::Image> ResourceManager::cachedImage(void* data, size_t length) {
+  CachedImageHeader header;
+  if (!data || length < sizeof(header)) {
+    return {};
+  }
+  memcpy(&header, data, sizeof(header));
+  if (header.width <= 0 || header.height <= 0
+      || length != sizeof(header) + (size_t) header.width * header.height * 4) {
+    return {};
+  }
+  // Taken over by the uploader, like any other decoded image
+  memmove(data, (char*) data + sizeof(header), length - sizeof(header));
+  return ImageDecoder::Image { data, header.width, header.height, header.fullWidth, header.fullHeight };
+}
+
+void ResourceManager::setImageUploads(ImageUploads uploads) {
+#ifdef __APPLE__
+  if (uploads == ImageUploads::FROM_BROWSER) {
+    warn << "images can only be uploaded from the browser in the web build\n";
+    return;
+  }
+#endif
+  _imageUploads = uploads;
+}
+
+void ResourceManager::handleMessageFromWeb(const SetImageUploads& message) {
+  cout << "images are " << (message.fromBrowser ? "uploaded by the browser" : "decoded here") << "\n";
+  setImageUploads(message.fromBrowser ? ImageUploads::FROM_BROWSER : ImageUploads::DECODE);
+}
+
+LoadResource ResourceManager::withUploadTexture(LoadResource message) {
+  if (_imageUploads != ImageUploads::FROM_BROWSER || message.resourceType != ResourceType::IMAGE_FILE || message.archive.size()) {
+    return message;
+  }
+  discardUploadTexture(message.resourceID); // From an earlier request for it
+
+  // Just the name: the browser's upload gives it its storage
+  GLuint texture;
+  glGenTextures(1, &texture);
+  _browserUploadTextures[message.resourceID] = texture;
+  message.texture = texture;
+  return message;
+}
+
+optional<GLuint> ResourceManager::takeUploadTexture(int resourceID) {
+  const auto it = _browserUploadTextures.find(resourceID);
+  if (it == _browserUploadTextures.end()) {
+    return {};
+  }
+  const GLuint texture = it->second;
+  _browserUploadTextures.erase(it);
+  return texture;
+}
+
+void ResourceManager::discardUploadTexture(int resourceID) {
+  const optional<GLuint> texture = takeUploadTexture(resourceID);
+  if (texture) {
+    glDeleteTextures(1, &*texture);
+  }
+}
+
+LoadResource ResourceManager::toRequest(const LoadResource& message) {
+  return withUploadTexture(resolveTexture(message));
+}
+
+LoadResource ResourceManager::resolveTexture(const LoadResource& message) {
+  return fromArchive(fromManifest(message));
+}
+
+optional<ResourceManager::ArchiveRead> ResourceManager::findInArchives(const string& messageURL) const {
+  const string url = Archive::normalizePath(messageURL.rfind("./", 0) == 0 ? messageURL.substr(2) : messageURL);
+  for (auto it = _mountedArchives.rbegin(); it != _mountedArchives.rend(); it ++) {
+    const ArchiveSlot* archive = _archives.get(ArchiveHandle::fromID(*it));
+    if (!archive || url.compare(0, archive->root.size(), archive->root) != 0) {
+      continue;
+    }
+
+    // Tried in the same order as TextureManifest::file(): a GPU compressed
+    // copy if we can use one, then the image as named, or with each
+    // extension Quake's textures come in.
+    const string path = url.substr(archive->root.size());
+    const size_t extension = path.rfind('.');
+    const string withoutExtension = extension != string::npos && path.find('/', extension) == string::npos
+      ? path.substr(0, extension)
+      : path;
+    const string candidates[] = { withoutExtension + ".qtex", path, path + ".jpg", path + ".png", path + ".tga" };
+    for (int i = GLHelpers::compressedFormats().s3tc ? 0 : 1; i < 5; i ++) {
+      const Archive::Entry* entry = archive->directory.find(candidates[i]);
+      if (entry) {
+        return ArchiveRead { *it, *entry, archive->url + "/" + candidates[i], i == 0 };
+      }
+    }
+  }
+  return {};
+}
+
+LoadResource ResourceManager::fromArchive(LoadResource message) {
+  if (message.resourceType != ResourceType::IMAGE_FILE || message.decodeInBrowser || _mountedArchives.empty()) {
+    return message;
+  }
+
+  const optional<ArchiveRead> read = findInArchives(message.url);
+  if (!read) {
+    return message;
+  }
+  _archiveReads[message.resourceID] = *read;
+  const ArchiveSlot* archive = _archives.get(ArchiveHandle::fromID(read->archiveID));
+  const Archive::Range range = read->entry.range();
+  message.archive = archive->url;
+  message.offset = (int) range.offset;
+  message.length = (int) range.length;
+  return message;
+}
+
+LoadResource ResourceManager::fromManifest(LoadResource message) {
+  if (message.resourceType != ResourceType::IMAGE_FILE || message.decodeInBrowser || !_textureManifest) {
+    return message;
+  }
+
+  const TextureManifest::entry_t* entry = _textureManifest->find(message.url);
+  if (!entry) {
+    return message; // It may still be in an archive
+  }
+  TextureSlot* slot = _textures.get(TextureHandle::fromID(message.resourceID));
+  if (slot && entry->surfaceParms) {
+    slot->options = RenderableTextureOptions { (entry->surfaceParms & TextureManifest::TRANS) != 0 };
+  }
+  const optional<string> file = _textureManifest->file(entry, message.url, GLHelpers::compressedFormats().s3tc);
+  if (file) {
+    message.url = *file;
+  }
+  return message;
+}
+
+bool ResourceManager::isMissingTexture(const LoadResource& message) const {
+  if (!_textureManifest || _indexReads.size() || message.decodeInBrowser) {
+    return false; // Can't tell yet
+  }
+  const TextureManifest::entry_t* entry = _textureManifest->find(message.url);
+  if (entry && _textureManifest->file(entry, message.url, GLHelpers::compressedFormats().s3tc)) {
+    return false;
+  }
+  return !findInArchives(message.url);
+}
+
+void ResourceManager::storeTextureManifest(int resourceID, TextureManifestPtr manifest, size_t length) {
+  TextureManifestPtr* slot = _textureManifests.get(TextureManifestHandle::fromID(resourceID));
+  if (!slot) {
+    return;
+  }
+  cout << "loaded texture manifest of " << manifest->numEntries() << " textures\n";
+  *slot = manifest;
+  _textureManifest = manifest;
+  _textureManifestResourceID = resourceID;
+  setResourceBytes(resourceID, length);
+}
+
+void ResourceManager::handleMessageFromWeb(const LoadedTextureManifest& message) {
+  if (!_indexReads.erase(message.resourceID)) {
+    free(message.pointer); // Unloaded while it was being read
+    return;
+  }
+
+  const auto pointer = (const TextureManifest::header_t*) message.pointer;
+  if (!pointer) {
+    cout << "no texture manifest for " << message.resourceID << " (not error)\n";
+  } else if (!pointer->isValid(message.length)) {
+    cerr << "invalid texture manifest for " << message.resourceID << ", ignoring it\n";
+    free(message.pointer);
+  } else {
+    storeTextureManifest(message.resourceID, pointer, message.length);
+  }
+  doneLoadingResource(message.resourceID);
+  sendQueuedRequests(); // The textures that were waiting for it
+}
+
+void ResourceManager::mountArchive(int resourceID) {
+  const ArchiveSlot* archive = _archives.get(ArchiveHandle::fromID(resourceID));
+  if (!archive) {
+    return;
+  }
+  cout << "mounted " << archive->url << " (" << archive->directory.numEntries() << " files)\n";
+  _mountedArchives.push_back(resourceID);
+  setResourceBytes(resourceID, archive->directory.bytes());
+}
+
+void ResourceManager::handleMessageFromWeb(const LoadedArchiveRange& message) {
+  if (resourceKindOf(message.resourceID) == ResourceKind::ARCHIVE) {
+    readArchiveDirectory(message);
+  } else {
+    readArchiveEntry(message);
+  }
+}
+
+void ResourceManager::readArchiveDirectory(const LoadedArchiveRange& message) {
+  ArchiveSlot* archive = _archives.get(ArchiveHandle::fromID(message.resourceID));
+  if (!archive || !_indexReads.count(message.resourceID)) {
+    free(message.pointer); // Unloaded while it was being read
+    return;
+  }
+
+  bool read = false;
+  if (message.pointer) {
+    read = archive->directory.read((const char*) message.pointer, message.offset, message.length, message.fileLength);
+    free(message.pointer);
+    if (!read && !archive->directory.failed()) {
+      // The central directory's bigger than what we read of the end
+      const Archive::Range needed = archive->directory.needed();
+      MessageBindings::sendMessageToWeb(LoadResource {
+        archive->url,
+        ResourceType::ARCHIVE_FILE,
+        message.resourceID,
+        0, false, 0, "",
+        (int) needed.offset,
+        (int) needed.length
+      });
+      return;
+    }
+  }
+
+  if (read) {
+    mountArchive(message.resourceID);
+  } else {
+    cout << "no archive at " << archive->url << " (not error)\n";
+  }
+  _indexReads.erase(message.resourceID);
+  doneLoadingResource(message.resourceID);
+  sendQueuedRequests(); // The textures that were waiting for it
+}
+
+void ResourceManager::readArchiveEntry(const LoadedArchiveRange& message) {
+  const auto it = _archiveReads.find(message.resourceID);
+  if (it == _archiveReads.end()) {
+    free(message.pointer);
+    return;
+  }
+  const ArchiveRead read = it->second;
+  _archiveReads.erase(it);
+
+  // Natively, it's a slice of the mapped archive
+  ResourcePtr<const char> bytes;
+  size_t offset = 0;
+  size_t length = 0;
+#ifndef __EMSCRIPTEN__
+  const ArchiveSlot* archive = _archives.get(ArchiveHandle::fromID(read.archiveID));
+  if (archive && archive->file) {
+    bytes = archive->file;
+    length = archive->fileLength;
+  }
+#else
+  bytes = ResourcePtr<const char>((const char*) message.pointer);
+  offset = message.offset;
+  length = message.length;
+#endif
+  if (!bytes) {
+    cerr << "couldn't read " << read.path << "\n";
+    finishTextureUpload({ message.resourceID, {}, 0, 0, 0 });
+    return;
+  }
+
+  const int resourceID = message.resourceID;
+  if (read.compressed) {
+    const auto contents = std::make_shared<optional<pair<char*, size_t>>>();
+    _imageDecoders.run([read, bytes, offset, length, contents]() {
+      *contents = Archive::extract(read.entry, bytes.get(), offset, length);
+    }, [this, resourceID, read, contents]() {
+      if (!*contents) {
+        cerr << read.path << " is corrupt\n";
+        finishTextureUpload({ resourceID, {}, 0, 0, 0 });
+        return;
+      }
+      handleMessageFromWeb(LoadedCompressedTexture { resourceID, (*contents)->first, (int) (*contents)->second });
+    });
+    return;
+  }
+
+  loadImageFile(resourceID, read.path, true, [read, bytes, offset, length](ImageFile& file) {
+    const optional<pair<char*, size_t>> contents = Archive::extract(read.entry, bytes.get(), offset, length);
+    if (contents) {
+      char* pointer = contents->first;
+      file.data = pointer;
+      file.length = contents->second;
+      file.release = [pointer]() { free(pointer); };
+    }
+  });
+}
+
+void ResourceManager::finishImageDecode(int resourceID, const string& url, int maxSize, bool inArchive, const optional<ImageDecoder::Image>& image) {
+  TextureSlot* slot = _textures.get(TextureHandle::fromID(resourceID));
+  if (image) {
+    if (slot) {
+      slot->fullSize = std::max(image->fullWidth, image->fullHeight);
+    }
+    // Still loading until think() has finished uploading it
+    _textureUploader.enqueue(resourceID, image->pixels, image->width, image->height);
+    return;
+  }
+
+  if (slot && !inArchive) {
+    // Corrupt, or a format we don't handle (eg. progressive JPEG), so the
+    // browser has a go instead. It can't read from archives itself.
+    MessageBindings::sendMessageToWeb(withUploadTexture(LoadResource { url, ResourceType::IMAGE_FILE, resourceID, maxSize, true }));
+    return;
+  }
+  finishTextureUpload({ resourceID, {}, 0, 0, 0 });
+}
+
+void ResourceManager::finishTextureUpload(const TextureUploader::Finished& upload) {
+  if (_textureLevelRequests.erase(upload.resourceID)) {
+    // A more detailed copy of one that's already loaded. If it didn't work
+    // out, the one we have will do.
+    TextureSlot* slot = _textures.get(TextureHandle::fromID(upload.resourceID));
+    if (slot) {
+      slot->requestedSize = 0;
+    }
+    if (upload.texture && slot && slot->texture) {
+      glDeleteTextures(1, &slot->texture);
+      slot->texture = *upload.texture;
+      slot->width = upload.width;
+      slot->height = upload.height;
+      setResourceBytes(upload.resourceID, upload.bytes);
+      evictOverBudget();
+    } else if (upload.texture) {
+      glDeleteTextures(1, &*upload.texture);
+    }
+    _textureResidencyChanged = true;
+    return;
+  }
+
+  if (upload.texture) {
+    TextureSlot* slot = _textures.get(TextureHandle::fromID(upload.resourceID));
+    if (slot) {
+      cout << "adding texture for " << upload.resourceID << "\n";
+      slot->texture = *upload.texture;
+      slot->width = upload.width;
+      slot->height = upload.height;
+      setResourceBytes(upload.resourceID, upload.bytes);
+    } else {
+      // Unloaded while it was loading
+      glDeleteTextures(1, &*upload.texture);
+    }
+    doneLoadingResource(upload.resourceID);
+    return;
+  }
+
+  cerr << "error while loading texture\n";
+  if (_streamingResources.count(upload.resourceID)) {
+    // Nothing's waiting for it, so it just keeps its placeholder
+    doneLoadingResource(upload.resourceID);
+    return;
+  }
+  _failedResources.insert(upload.resourceID);
+}
+
+void ResourceManager::setTextureUploadBudget(double milliseconds, size_t bytes) {
+  _textureUploader.setBudget(milliseconds, bytes);
+}
+
+void ResourceManager::wantTextureSize(TextureHandle handle, int size) {
+  TextureSlot* slot = _textures.get(TextureHandle::fromID(resolve(handle.id())));
+  if (!slot || slot->url.empty()) {
+    return;
+  }
+  slot->wantedSize = size;
+  slot->wantedFrame = _frame;
+  _textureResidencyChanged = true;
+}
+
+void ResourceManager::updateTextureResidency() {
+  _textureResidencyChanged = false;
+
+  // Loaded textures that stream their detail, least recently wanted first
+  vector<int> streamed;
+  for (const auto& resource : _resources) {
+    const TextureSlot* slot = _textures.get(TextureHandle::fromID(resource.first));
+    if (slot && slot->texture && slot->url.size()) {
+      streamed.push_back(resource.first);
+    }
+  }
+  std::sort(streamed.begin(), streamed.end(), [this](int a, int b) {
+    return _textures.get(TextureHandle::fromID(a))->wantedFrame < _textures.get(TextureHandle::fromID(b))->wantedFrame;
+  });
+
+  // What's wanted, most recently first, and how much more room it needs.
+  // Sizes go up in powers of two from the base size.
+  vector<pair<int, int>> upgrades;
+  size_t upgradeBytes = 0;
+  for (auto it = streamed.rbegin(); it != streamed.rend(); it ++) {
+    if ((int) (_textureLevelRequests.size() + upgrades.size()) >= kMaxTextureLevelRequests) {
+      break;
+    }
+    const TextureSlot* slot = _textures.get(TextureHandle::fromID(*it));
+    if (_frame - slot->wantedFrame >= kTextureResidencyFrames) {
+      break;
+    }
+    if (slot->requestedSize) {
+      continue;
+    }
+
+    int size = slot->baseSize;
+    while (size < slot->wantedSize && size < slot->fullSize) {
+      size *= 2;
+    }
+    size = std::min(size, slot->fullSize);
+    const int residentSize = std::max(slot->width, slot->height);
+    if (size <= residentSize) {
+      continue;
+    }
+
+    upgrades.push_back({ *it, size });
+    const double scale = (double) size / residentSize;
+    upgradeBytes += _resources[*it].bytes * (scale * scale - 1);
+  }
+
+  // Make room: cached textures go first, then detail nobody's wanted lately
+  evictOverBudget(upgradeBytes);
+  for (int resourceID : streamed) {
+    if (_gpuBytes + upgradeBytes <= _gpuBudget) {
+      break;
+    }
+    const TextureSlot* slot = _textures.get(TextureHandle::fromID(resourceID));
+    if (_frame - slot->wantedFrame < kTextureResidencyFrames) {
+      break;
+    }
+    shrinkTexture(resourceID, slot->baseSize);
+  }
+
+  size_t committedBytes = 0;
+  for (const auto& upgrade : upgrades) {
+    TextureSlot* slot = _textures.get(TextureHandle::fromID(upgrade.first));
+    const double scale = (double) upgrade.second / std::max(slot->width, slot->height);
+    const size_t bytes = _resources[upgrade.first].bytes * (scale * scale - 1);
+    if (_gpuBytes + committedBytes + bytes > _gpuBudget) {
+      continue; // Doesn't fit, even with everything else dropped
+    }
+    committedBytes += bytes;
+
+    slot->requestedSize = upgrade.second;
+    _textureLevelRequests.insert(upgrade.first);
+    MessageBindings::sendMessageToWeb(toRequest(LoadResource {
+      slot->url,
+      ResourceType::IMAGE_FILE,
+      upgrade.first,
+      upgrade.second
+    }));
+  }
+}
+
+void ResourceManager::shrinkTexture(int resourceID, int size) {
+  TextureSlot* slot = _textures.get(TextureHandle::fromID(resourceID));
+  int level = 0;
+  while ((std::max(slot->width, slot->height) >> level) > size) {
+    level ++;
+  }
+  if (level == 0) {
+    return;
+  }
+
+  if (slot->compressed) {
+    // Compressed textures can't be copied on the GPU, so JS loads it again
+    // and only the smaller levels are uploaded. Same as asking for more detail.
+    if (!slot->requestedSize) {
+      slot->requestedSize = size;
+      _textureLevelRequests.insert(resourceID);
+      MessageBindings::sendMessageToWeb(resolveTexture(LoadResource { slot->url, ResourceType::IMAGE_FILE, resourceID, size }));
+    }
+    return;
+  }
+
+  const optional<GLuint> smaller = TextureUploader::shrink(slot->texture, slot->width, slot->height, level);
+  if (!smaller) {
+    return;
+  }
+  glDeleteTextures(1, &slot->texture);
+  slot->texture = *smaller;
+  slot->width = std::max(1, slot->width >> level);
+  slot->height = std::max(1, slot->height >> level);
+  setResourceBytes(resourceID, (size_t) slot->width * slot->height * 4 * 4 / 3);
+}
+
+void ResourceManager::handleMessageFromWeb(const MissingTexture& message) {
+  discardUploadTexture(message.resourceID);
+  _archiveReads.erase(message.resourceID); // Failed before the read came back
+  if (_textureLevelRequests.erase(message.resourceID)) {
+    // Keep what we have, and stop asking
+    TextureSlot* slot = _textures.get(TextureHandle::fromID(message.resourceID));
+    if (slot) {
+      slot->requestedSize = 0;
+      slot->fullSize = std::max(slot->width, slot->height);
+    }
+    return;
+  }
+  cout << "missing texture (not error) for " << message.resourceID << "\n";
+  doneLoadingResource(message.resourceID);
+}
+
+void ResourceManager::handleMessageFromWeb(const LoadedTextures& message) {
+  // Refills the free slots with one message, rather than one per result
+  _holdQueuedRequests = true;
+  for (const LoadedTexture& loaded : message.loaded) {
+    handleMessageFromWeb(loaded);
+  }
+  for (const LoadedCompressedTexture& compressed : message.compressed) {
+    handleMessageFromWeb(compressed);
+  }
+  for (const LoadedImageFile& file : message.files) {
+    handleMessageFromWeb(file);
+  }
+  for (const MissingTexture& missing : message.missing) {
+    handleMessageFromWeb(missing);
+  }
+  for (const LoadedArchiveRange& range : message.ranges) {
+    handleMessageFromWeb(range);
+  }
+  _holdQueuedRequests = false;
+  sendQueuedRequests();
+}
+
+void ResourceManager::handleMessageFromWeb(const LoadingBSP& message) {
+  receiveMapBytes(message.resourceID, message.pointer, message.loaded, message.length);
+}
+
+void ResourceManager::handleMessageFromWeb(const LoadedBSP& message) {
+  const auto abandoned = _abandonedMapDownloads.find(message.resourceID);
+  if (abandoned != _abandonedMapDownloads.end()) {
+    // Unloaded while it was downloading. Its buffer is freed here, unless it
+    // already went with the rest of the map.
+    if (!abandoned->second.map && !abandoned->second.compressedMap) {
+      free(message.pointer);
+    }
+    free(abandoned->second.compressedMap);
+    _abandonedMapDownloads.erase(abandoned);
+    doneLoadingResource(message.resourceID);
+    return;
+  }
+  if (!_mapDownloads.count(message.resourceID)) {
+    free(message.pointer);
+    doneLoadingResource(message.resourceID);
+    return;
+  }
+
+  receiveMapBytes(message.resourceID, message.pointer, message.length, message.length);
+  const auto it = _mapDownloads.find(message.resourceID);
+  if (it == _mapDownloads.end()) {
+    handleMessageFromWeb(message); // Unloaded by one of its callbacks
+    return;
+  }
+  MapDownload download = std::move(it->second);
+  _mapDownloads.erase(it);
+
+  if (!download.map && !download.compressedMap) {
+    free(message.pointer); // Failed before it was ours
+  } else if (!download.failed && download.lumpsLoaded.size()) {
+    cout << "adding map for " << message.resourceID << "\n";
+    storeMap(message.resourceID, download.map, download.length);
+  }
+  free(download.compressedMap);
+  doneLoadingResource(message.resourceID);
+}
+
+void ResourceManager::abandonMapDownload(int resourceID) {
+  const auto it = _mapDownloads.find(resourceID);
+  if (it == _mapDownloads.end()) {
+    return;
+  }
+  if (it->second.map || it->second.compressedMap) {
+    // JS is still writing into its buffer, see handleMessageFromWeb(LoadedBSP)
+    it->second.lumpCallbacks.clear();
+    _abandonedMapDownloads[resourceID] = std::move(it->second);
+  }
+  _mapDownloads.erase(it);
+}
+
+void ResourceManager::storeMap(int resourceID, ResourcePtr<const BSPMap> map, size_t length) {
+  ResourcePtr<const BSPMap>* slot = _maps.get(MapHandle::fromID(resourceID));
+  if (slot) {
+    *slot = map;
+    setResourceBytes(resourceID, length);
+  }
+}
+
+void ResourceManager::storeCookedMap(int resourceID, ResourcePtr<const CookedMap> cookedMap, size_t length) {
+  _cookedMapMaps.erase(resourceID);
+
+  ResourcePtr<const CookedMap>* slot = _cookedMaps.get(CookedMapHandle::fromID(resourceID));
+  if (slot) {
+    *slot = cookedMap;
+    setResourceBytes(resourceID, length);
+  }
+}
+
+void ResourceManager::receiveMapBytes(int resourceID, void* pointer, int loaded, int length) {
+  const auto it = _mapDownloads.find(resourceID);
+  if (it == _mapDownloads.end() || it->second.failed) {
+    return; // See handleMessageFromWeb(LoadedBSP)
+  }
+  MapDownload& download = it->second;
+
+  if (!download.map && !download.compressedMap) {
+    if (loaded < 4 && loaded < length) {
+      return; // Can't tell if it's compressed yet
+    }
+
+    if (CompressedFile::isCompressed(pointer, loaded)) {
+      // Decompressed into its own buffer as the chunks arrive
+      download.compressedMap = (char*) pointer;
+    } else {
+      // The whole buffer is allocated up front, we own it from now on
+      download.map = (const BSPMap*) pointer;
+    }
+  }
+
+  if (!download.compressedMap) {
+    setMapBytesLoaded(resourceID, loaded, length);
+    return;
+  }
+
+  if (!download.map) {
+    if (!download.decoder.readHeader(download.compressedMap, loaded)) {
+      if (download.decoder.failed() || loaded == length) {
+        cerr << "map " << resourceID << " isn't a valid compressed file\n";
+        failMap(resourceID);
+      }
+      return;
+    }
+    download.map = (const BSPMap*) malloc(std::max(download.decoder.length(), 1));
+  }
+
+  const int decoded = download.decoder.decode(download.compressedMap, loaded, (char*) download.map.get());
+  if (decoded < 0) {
+    cerr << "map " << resourceID << " is corrupt\n";
+    failMap(resourceID);
+    return;
+  }
+  setMapBytesLoaded(resourceID, decoded, download.decoder.length());
+}
+
+void ResourceManager::failMap(int resourceID) {
+  const auto it = _mapDownloads.find(resourceID);
+  if (it != _mapDownloads.end()) {
+    it->second.failed = true;
+    it->second.lumpCallbacks.clear();
+  }
+  _failedResources.insert(resourceID);
+  doneLoadingResource(resourceID);
+}
+
+void ResourceManager::setMapBytesLoaded(int resourceID, int loaded, int total) {
+  MapDownload& download = _mapDownloads.at(resourceID);
+  if (!download.headerChecked) {
+    if (loaded < (int) sizeof(BSPMap) && loaded < total) {
+      return;
+    }
+
+    download.headerChecked = true;
+    if (!download.map->isValid(total)) {
+      cerr << "map " << resourceID << " isn't a valid BSP file\n";
+      failMap(resourceID);
+      return;
+    }
+    download.length = total;
+    download.lumpsLoaded.assign(BSP::kNumLumps, false);
+  }
+
+  // Lumps are dispatched in the order they complete, which is the order
+  // they're laid out in the file. The callbacks run once they've all been
+  // collected, since they can start (or unload) maps themselves.
+  vector<std::function<void(ResourcePtr<const BSPMap>)>> callbacks;
+  for (int lump = 0; lump < (int) download.lumpsLoaded.size(); lump ++) {
+    const BSP::direntry_t& entry = download.map->direntries[lump];
+    if (download.lumpsLoaded[lump] || entry.offset + entry.length > loaded) {
+      continue;
+    }
+
+    download.lumpsLoaded[lump] = true;
+
+    const auto lumpCallbacks = download.lumpCallbacks.find(lump);
+    if (lumpCallbacks != download.lumpCallbacks.end()) {
+      callbacks.insert(callbacks.end(), lumpCallbacks->second.begin(), lumpCallbacks->second.end());
+      download.lumpCallbacks.erase(lumpCallbacks);
+    }
+  }
+
+  const ResourcePtr<const BSPMap> map = download.map;
+  withPreloading(download.preloading, [&]() {
+    for (const auto& callback : callbacks) {
+      callback(map);
+    }
+  });
+}
+
+void ResourceManager::whenMapLumpLoaded(MapHandle handle, BSP::Lump lump, std::function<void(ResourcePtr<const BSPMap>)> callback) {
+  const int resourceID = resolve(handle.id());
+  const ResourcePtr<const BSPMap> loaded = getMap(MapHandle::fromID(resourceID));
+  if (loaded) {
+    callback(loaded);
+    return;
+  }
+
+  const auto it = _mapDownloads.find(resourceID);
+  if (it == _mapDownloads.end() || it->second.failed) {
+    return; // Never will be
+  }
+  MapDownload& download = it->second;
+  const int lumpIndex = (int) lump;
+  if (lumpIndex < (int) download.lumpsLoaded.size() && download.lumpsLoaded[lumpIndex]) {
+    const ResourcePtr<const BSPMap> map = download.map;
+    callback(map);
+    return;
+  }
+
+  download.lumpCallbacks[lumpIndex].push_back(callback);
+}
+
+void ResourceManager::whenMapLumpsLoaded(MapHandle handle, const vector<BSP::Lump>& lumps, std::function<void(ResourcePtr<const BSPMap>)> callback) {
+  const auto remaining = make_shared<int>(lumps.size());
+  for (BSP::Lump lump : lumps) {
+    whenMapLumpLoaded(handle, lump, [remaining, callback](ResourcePtr<const BSPMap> map) {
+      if (-- (*remaining) == 0) {
+        callback(map);
+      }
+    });
+  }
+}
+
+void ResourceManager::handleMessageFromWeb(const LoadedCookedMap& message) {
+  if (!_cookedMaps.get(CookedMapHandle::fromID(message.resourceID))) {
+    free(message.pointer); // Unloaded while it was downloading
+    doneLoadingResource(message.resourceID);
+    return;
+  }
+
+  void* data = message.pointer;
+  int length = message.length;
+  if (CompressedFile::isCompressed(data, length)) {
+    // Small enough to decompress in one go
+    const auto decompressed = CompressedFile::decompress(data, length);
+    free(data);
+    if (!decompressed) {
+      cerr << "corrupt cooked map for " << message.resourceID << ", ignoring it\n";
+      doneLoadingResource(message.resourceID);
+      return;
+    }
+    data = decompressed->first;
+    length = decompressed->second;
+  }
+
+  const auto pointer = (const CookedMap*) data;
+  if (pointer->isValid(length)) {
+    cout << "adding cooked map for " << message.resourceID << "\n";
+    storeCookedMap(message.resourceID, pointer, length);
+  } else {
+    cerr << "invalid cooked map for " << message.resourceID << ", ignoring it\n";
+    free(data);
+  }
+  doneLoadingResource(message.resourceID);
+}
+
+void ResourceManager::handleMessageFromWeb(const MissingCookedMap& message) {
+  loadCachedCookedMap(message.resourceID);
+}
+
+// Keyed on what it was cooked from (the whole map), so it's only ever the
+// right one for it. Hashed off the main thread (see withAssetCacheEntry),
+// since maps are megabytes.
+static string cookedMapCacheKey(const BSPMap* map) {
+  return AssetCache::key("cooked", Cooked::sourceHash(map), Cooked::kVersion);
+}
+
+void ResourceManager::loadCachedCookedMap(int resourceID) {
+  const auto it = _cookedMapMaps.find(resourceID);
+  if (it == _cookedMapMaps.end() || it->second < 0) {
+    cerr << "no map for cooked map " << resourceID << "\n";
+    doneLoadingResource(resourceID);
+    return;
+  }
+
+  // Needs the whole map, to hash it
+  vector<BSP::Lump> lumps;
+  for (int lump = 0; lump < BSP::kNumLumps; lump ++) {
+    lumps.push_back((BSP::Lump) lump);
+  }
+  whenMapLumpsLoaded(MapHandle::fromID(it->second), lumps, [this, resourceID](ResourcePtr<const BSPMap> map) {
+    const auto cookedMap = std::make_shared<ResourcePtr<const CookedMap>>();
+    const auto length = std::make_shared<size_t>(0);
+    withAssetCacheEntry([map]() {
+      return cookedMapCacheKey(map.get());
+    }, [cookedMap, length](AssetCacheJob& job) {
+      if (!job.entry || !AssetCache::unpack(job.key, job.entry, job.length)) {
+        return;
+      }
+      const auto pointer = (const CookedMap*) job.entry;
+      if (!pointer->isValid(job.length)) {
+        free(job.entry);
+        return;
+      }
+      *cookedMap = ResourcePtr<const CookedMap>(pointer);
+      *length = job.length;
+    }, [this, resourceID, cookedMap, length]() {
+      if (*cookedMap && _cookedMaps.get(CookedMapHandle::fromID(resourceID))) {
+        cout << "adding cooked map for " << resourceID << " from the asset cache\n";
+        storeCookedMap(resourceID, *cookedMap, *length);
+      }
+      doneLoadingResource(resourceID);
+    });
+  });
+}
+
+void ResourceManager::storeCookedMapInCache(ResourcePtr<const BSPMap> map, ResourcePtr<const CookedMap> cookedMap, size_t length) {
+  withAssetCacheEntry([map]() {
+    return cookedMapCacheKey(map.get());
+  }, [cookedMap, length](AssetCacheJob& job) {
+    job.store = AssetCache::pack({ { cookedMap.get(), length } }, job.storeLength);
+  }, []() {}, false);
+}
+
+void ResourceManager::handleMessageFromWeb(const LoadedShaders& message) {
+  cout << "starting to compile shaders for " << message.resourceID << "\n";
+  optional<GLuint> shaderProgram = GLHelpers::compileShaderProgram((const char*) message.vertPointer, message.vertLength, (const char*) message.fragPointer, message.fragLength);
+
+  free(message.vertPointer);
+  free(message.fragPointer);
+
+  if (shaderProgram) {
+    GLuint* slot = _shaderPrograms.get(ShaderHandle::fromID(message.resourceID));
+    if (slot) {
+      cout << "adding shader program for " << message.resourceID << "\n";
+      *slot = *shaderProgram;
+    } else {
+      // Unloaded while it was loading
+      glDeleteProgram(*shaderProgram);
+    }
+    doneLoadingResource(message.resourceID);
+    return;
+  }
+  cerr << "failed to create shader program\n";
+  _failedResources.insert(message.resourceID);
+}
+
+void ResourceManager::unloadShaderProgram(ShaderHandle handle) {
+  unloadOwnResource(handle.id());
+}
+
+void ResourceManager::unloadTexture(TextureHandle handle) {
+  unloadOwnResource(handle.id());
+}
+
+void ResourceManager::unloadOwnResource(int resourceID) {
+  if (_sharedResources.count(resourceID)) {
+    // What it shares is still another loader's, eg. the other map's
+    releaseResource(resourceID);
+    return;
+  }
+  unloadResource(resourceID);
+}
+
+optional<GLuint> ResourceManager::getShaderProgram(ShaderHandle handle) {
+  const GLuint* program = _shaderPrograms.get(ShaderHandle::fromID(resolve(handle.id())));
+  if (program && *program) {
+    return *program;
+  }
+
+  return {};
+}
+
+bool ResourceManager::isLoading(int resourceID) const {
+  return _loadingResources.count(resolve(resourceID)) > 0;
+}
+
+GLuint ResourceManager::getPlaceholderTexture() {
+  if (!_placeholderTexture) {
+    // A grey checkerboard, so untextured surfaces still show their shape
+    const int kSize = 8;
+    uint32_t pixels[kSize * kSize];
+    for (int y = 0; y < kSize; y ++) {
+      for (int x = 0; x < kSize; x ++) {
+        pixels[y * kSize + x] = ((x + y) % 2) ? 0xff808080 : 0xffa0a0a0;
+      }
+    }
+    _placeholderTexture = GLHelpers::loadTexture(pixels, kSize, kSize).value_or(0);
+  }
+  return _placeholderTexture;
+}
+
+optional<GLuint> ResourceManager::getTexture(TextureHandle handle) {
+  const TextureSlot* slot = _textures.get(TextureHandle::fromID(resolve(handle.id())));
+  if (slot && slot->texture) {
+    return slot->texture;
+  }
+
+  return {};
+}
+
+optional<RenderableTextureOptions> ResourceManager::getTextureOptions(TextureHandle handle) {
+  const TextureSlot* slot = _textures.get(TextureHandle::fromID(resolve(handle.id())));
+  if (slot) {
+    return slot->options;
+  }
+
+  return {};
+}
+
+ResourcePtr<const BSPMap> ResourceManager::getMap(MapHandle handle) {
+  const ResourcePtr<const BSPMap>* slot = _maps.get(MapHandle::fromID(resolve(handle.id())));
+  return slot ? *slot : nullptr;
 }
 
-ResourcePtr<const BSPMap> ResourceManager::getMap() {
-  return _map;
+ResourcePtr<const CookedMap> ResourceManager::getCookedMap(CookedMapHandle handle) {
+  const ResourcePtr<const CookedMap>* slot = _cookedMaps.get(CookedMapHandle::fromID(resolve(handle.id())));
+  return slot ? *slot : nullptr;
 }
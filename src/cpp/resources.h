@@ -3,13 +3,21 @@
 
 #include "support.h"
 #include "texture.h"
+#include "resource_handle.h"
 
 namespace BSP {
   struct header_t;
+  enum class Lump : int;
 };
 
 using BSPMap = BSP::header_t;
 
+namespace Cooked {
+  struct header_t;
+};
+
+using CookedMap = Cooked::header_t;
+
 struct RenderableTextureOptions;
 struct ResourceManager;
 
@@ -22,8 +30,24 @@ private:
   virtual bool finishLoading() = 0;
 };
 
+// Requests are sent to JS in this order. CRITICAL ones go right away, the rest
+// wait for a free slot (see ResourceManager::setMaxRequestsInFlight).
+//
+// Only CRITICAL resources hold up the loader that asked for them. The rest
+// stream in after it's finished, so it has to cope with them not being there
+// yet (eg. by drawing a placeholder texture).
+enum class LoadPriority {
+  CRITICAL, // Can't start without it, eg. the map itself
+  VISIBLE, // Seen from where the player starts
+  NEARBY, // In the starting PVS, but not in view
+  MAP, // The rest of the current map
+  OTHER_MAPS, // Preloading for later
+  DEFERRED // Not sent until it's moved up, eg. once the spawn point's PVS is known
+};
+
 enum class LoadingState {
   LOADING,
+  STREAMING, // Every loader has finished, but some resources are still coming
   DONE,
   FAILED
 };
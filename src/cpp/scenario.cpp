@@ -14,11 +14,11 @@ TextureRenderer::TextureRenderer(TextureRendererMode mode) {
   }
 
   cout << "starting to load TextureRenderer\n";
-  _shaderResourceID = ResourceManager::nextID();
+  _shaderHandle = ResourceManager::getInstance()->newShaderProgram();
   ResourceManager::getInstance()->loadShaders(this, {
     "./src/glsl/test.vert",
     "./src/glsl/test.frag",
-    _shaderResourceID
+    _shaderHandle.id()
   });
 }
 
@@ -54,14 +54,14 @@ bool TextureRenderer::finishLoading() {
 
   ////////////////////////////////////////////////////////////////////////////
   // Get the test shader program
-  optional<GLuint> shaderProgram = ResourceManager::getInstance()->getShaderProgram(_shaderResourceID);
+  optional<GLuint> shaderProgram = ResourceManager::getInstance()->getShaderProgram(_shaderHandle);
   if (!shaderProgram) {
     cerr << "failed to load shader program in TextureRenderer::load\n";
     return false;
   }
 
-  // Use the program...
-  glLinkProgram(*shaderProgram);
+  // Use the program... (it's already linked by GLHelpers::compileShaderProgram, and
+  // relinking a program that was loaded from a binary would clear it)
   glUseProgram(*shaderProgram);
   
   if (hasErrors()) {
@@ -87,7 +87,7 @@ bool TextureRenderer::finishLoading() {
 }
 
 void TextureRenderer::render(vector<GLuint> textureIDs) {
-  optional<GLuint> shaderProgram = ResourceManager::getInstance()->getShaderProgram(_shaderResourceID);
+  optional<GLuint> shaderProgram = ResourceManager::getInstance()->getShaderProgram(_shaderHandle);
   if (!shaderProgram) {
     cerr << "failed to load shader program in TextureRenderer::render\n";
     return;
@@ -192,11 +192,11 @@ void TestScenario::render() {
 }
 
 PopTartScenario::PopTartScenario() {
-  _textureResourceID = ResourceManager::nextID();
+  _textureHandle = ResourceManager::getInstance()->newTexture();
   ResourceManager::getInstance()->loadResource(this, {
     "./data/textures/poptart.jpg",
     ResourceType::IMAGE_FILE,
-    _textureResourceID
+    _textureHandle.id()
   });
 
   cout << "starting PopTartScenario\n";
@@ -208,7 +208,7 @@ bool PopTartScenario::finishLoading() {
 }
 
 void PopTartScenario::render() {
-  optional<GLuint> textureId = ResourceManager::getInstance()->getTexture(_textureResourceID);
+  optional<GLuint> textureId = ResourceManager::getInstance()->getTexture(_textureHandle);
   if (textureId) {
     _renderer->render({*textureId});
   }
@@ -24,7 +24,7 @@ struct TextureRenderer : IHasResources {
 private:
   bool finishLoading() override;
 
-  int _shaderResourceID;
+  ShaderHandle _shaderHandle;
 
   GLuint _vao;
   GLuint _vbo;
@@ -68,7 +68,7 @@ public:
 private:
   bool finishLoading() override;
 
-  int _textureResourceID;
+  TextureHandle _textureHandle;
   shared_ptr<TextureRenderer> _renderer = nullptr;
 };
 
@@ -5,33 +5,91 @@
 #include "renderable.h"
 #include "bsp.h"
 #include "hitscan.h"
+#include "area_portals.h"
 
-BSPScenario::BSPScenario() {
+BSPScenario::BSPScenario(const string& mapName) {
   // Create a VAO for the attribute configuration
   // ... I'm honestly not 100% sure how to use VAOs most effectively.
   GLuint vao;
   glGenVertexArrays(1, &vao);
   glBindVertexArray(vao);
 
-  _bspResourceID = ResourceManager::nextID();
+  // Made by `make pack_textures`, if it's been run. The textures in it are
+  // read from it, rather than one file each.
+  _archiveHandle = ResourceManager::getInstance()->newArchive();
   ResourceManager::getInstance()->loadResource(this, {
-    "./data/aerowalk.bsp",
+    "./data/pak0.pk3",
+    ResourceType::ARCHIVE_FILE,
+    _archiveHandle.id()
+  });
+
+  // Made by generate_manifests.py: which files each texture has, and what its
+  // shader says, so textures are resolved without asking for what isn't there
+  _textureManifestHandle = ResourceManager::getInstance()->newTextureManifest();
+  ResourceManager::getInstance()->loadResource(this, {
+    "./data/textures_manifest.bin",
+    ResourceType::TEXTURE_MANIFEST_FILE,
+    _textureManifestHandle.id()
+  });
+
+  _mapHandle = ResourceManager::getInstance()->newMap();
+  ResourceManager::getInstance()->loadResource(this, {
+    "./data/" + mapName + ".bsp",
     ResourceType::BSP_FILE,
-    _bspResourceID
+    _mapHandle.id()
+  });
+
+  // Made by the cook tool (see cooked_map.h), if it's been run
+  _cookedMapHandle = ResourceManager::getInstance()->newCookedMap();
+  ResourceManager::getInstance()->loadResource(this, {
+    "./data/" + mapName + ".cooked",
+    ResourceType::COOKED_MAP_FILE,
+    _cookedMapHandle.id()
+  });
+
+  // Start fetching the map's textures as soon as we know what they are, while
+  // the rest of the map is still downloading
+  ResourceManager::getInstance()->whenMapLumpLoaded(_mapHandle, BSP::Lump::TEXTURES, [this](ResourcePtr<const BSPMap> map) {
+    // The renderable map registers itself with the ResourceManager and owns it's own
+    // loading flow.
+    _renderableMap = make_shared<RenderableBSP>(map, _cookedMapHandle, RenderableBSPOptions {
+      WorldSubmission::CLUSTER_BATCHES,
+      false /* occlusion culling */
+    });
+    ResourceManager::getInstance()->waitForResource(_renderableMap.get(), _mapHandle.id());
+    ResourceManager::getInstance()->waitForResource(_renderableMap.get(), _cookedMapHandle.id());
   });
 
-  _sceneShaderResourceID = ResourceManager::nextID();
+  // They're held back until we know what can be seen from where the player
+  // starts, then fetched in that order. Visdata is the last lump, so this
+  // waits for the whole map.
+  ResourceManager::getInstance()->whenMapLumpsLoaded(_mapHandle, {
+    BSP::Lump::TEXTURES, BSP::Lump::ENTITIES, BSP::Lump::PLANES, BSP::Lump::NODES,
+    BSP::Lump::LEAVES, BSP::Lump::LEAFFACES, BSP::Lump::FACES, BSP::Lump::VISDATA
+  }, [this](ResourcePtr<const BSPMap> map) {
+    _spawnPoint = map->findSpawnPoint();
+    if (!_renderableMap) {
+      return;
+    }
+    if (_spawnPoint) {
+      _renderableMap->prioritizeTexturesVisibleFrom(_spawnPoint->origin, _spawnPoint->angle);
+    } else {
+      _renderableMap->stopDeferringTextures();
+    }
+  });
+
+  _sceneShaderHandle = ResourceManager::getInstance()->newShaderProgram();
   ResourceManager::getInstance()->loadShaders(this, {
     "./src/glsl/render_scene.vert",
     "./src/glsl/render_scene.frag",
-    _sceneShaderResourceID
+    _sceneShaderHandle.id()
   });
 
-  _poptartResourceID = ResourceManager::nextID();
+  _poptartHandle = ResourceManager::getInstance()->newTexture();
   ResourceManager::getInstance()->loadResource(this, {
     "./data/textures/poptart.jpg",
     ResourceType::IMAGE_FILE,
-    _poptartResourceID
+    _poptartHandle.id()
   });
 
   // The compositing renderer registers itself with the ResourceManager and owns it's own
@@ -40,15 +98,18 @@ BSPScenario::BSPScenario() {
 }
 
 bool BSPScenario::finishLoading() {
-  ResourcePtr<const BSPMap> mapResource = ResourceManager::getInstance()->getMap();
+  ResourcePtr<const BSPMap> mapResource = ResourceManager::getInstance()->getMap(_mapHandle);
   if (!mapResource.get()) {
     cerr << "map failed to load\n";
     return false;
   }
 
-  // The renderable map registers itself with the ResourceManager and owns it's own
-  // loading flow.
-  _renderableMap = make_shared<RenderableBSP>(mapResource);
+  _areaPortals = make_shared<AreaPortals>(mapResource.get());
+
+  // Found once the map's lumps were in, which is before now
+  if (_spawnPoint) {
+    _camera.location = _spawnPoint->origin;
+  }
   
   // Create a VAO for the attribute configuration
   glGenVertexArrays(1, &_vao);
@@ -62,10 +123,9 @@ bool BSPScenario::finishLoading() {
   cout << "screen size: " << screenWidth << ", " << screenHeight << "\n";
 
   // Load the shader
-  _sceneShader = *ResourceManager::getInstance()->getShaderProgram(_sceneShaderResourceID);
+  _sceneShader = *ResourceManager::getInstance()->getShaderProgram(_sceneShaderHandle);
 
-  // Use the program...
-  glLinkProgram(_sceneShader);
+  // Use the program... (it's already linked by GLHelpers::compileShaderProgram)
   glUseProgram(_sceneShader);
 
   // Bind the inputs
@@ -160,12 +220,12 @@ void BSPScenario::think(glm::vec2 dir, double pitch, double yaw) {
 }
 
 void BSPScenario::render() {
-  ResourcePtr<const BSPMap> mapResource = ResourceManager::getInstance()->getMap();
+  ResourcePtr<const BSPMap> mapResource = ResourceManager::getInstance()->getMap(_mapHandle);
   const BSPMap* map = mapResource.get();
 
   //////////////////////////////////////////////////////////////////////////////
 
-  optional<GLuint> sceneShaderID = ResourceManager::getInstance()->getShaderProgram(_sceneShaderResourceID);
+  optional<GLuint> sceneShaderID = ResourceManager::getInstance()->getShaderProgram(_sceneShaderHandle);
   if (!sceneShaderID) {
     cerr << "failed to load shader program\n";
     return;
@@ -178,6 +238,21 @@ void BSPScenario::render() {
 
    optional<HitScanResult> result = HitScan::findFaceIndex(map, _camera.location, _camera.forward());
 
+   // Camera transform
+   glm::mat4 cameraTransform = glm::lookAt(
+     _camera.location, // location of camera
+     _camera.location + _camera.forward(), // look at
+     glm::vec3(0,0,1)  // camera up vector
+   );
+
+   // And projection transform
+   const float fieldOfView = glm::radians(86.0f);
+   glm::mat4 projectionTransform = glm::perspective(fieldOfView, 1200.0f / 800.0f, 5.0f, 1500.0f);
+
+   // Figure out what's visible once, for both the solid & translucent passes
+   _renderableMap->cull(projectionTransform * cameraTransform, _camera.location, *_areaPortals);
+   _renderableMap->updateTextureResidency(projectionTransform * cameraTransform, _camera.location, 800.0f / (2 * tan(fieldOfView / 2)));
+
    // Render all the solid geometry in the map to the scene-FBO
    {
      glUseProgram(_sceneShader);
@@ -191,17 +266,7 @@ void BSPScenario::render() {
      glClearColor(0.6, 0.2, 0.6, 1.0);
      glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
 
-     // Update camera transform
-     glm::mat4 cameraTransform = glm::lookAt(
-       _camera.location, // location of camera
-       _camera.location + _camera.forward(), // look at
-       glm::vec3(0,0,1)  // camera up vector
-     );
-
      glUniformMatrix4fv(_sceneShaderParams.unifCameraTransform, 1, GL_FALSE, glm::value_ptr(cameraTransform));
-
-     // And projection transform
-     glm::mat4 projectionTransform = glm::perspective(glm::radians(86.0f), 1200.0f / 800.0f, 5.0f, 1500.0f);
      glUniformMatrix4fv(_sceneShaderParams.unifProjTransform, 1, GL_FALSE, glm::value_ptr(projectionTransform));
 
      _renderableMap->render(_sceneShaderParams, RenderMode::SOLID, result);
@@ -227,5 +292,5 @@ void BSPScenario::render() {
   glBindFramebuffer(GL_FRAMEBUFFER, 0);
    _compositingRenderer->render({_sceneTexture, _effectsTexture});
   // _compositingRenderer->render({_sceneTexture});
-  // _compositingRenderer->render({*ResourceManager::getInstance()->getTexture(_poptartResourceID)});
+  // _compositingRenderer->render({*ResourceManager::getInstance()->getTexture(_poptartHandle)});
 }
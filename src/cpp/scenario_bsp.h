@@ -2,6 +2,7 @@
 #define SCENARIO_BSP_H
 
 #include "scenario.h"
+#include "bsp.h"
 
 struct Camera {
 public:
@@ -15,6 +16,7 @@ public:
 };
 
 struct RenderableBSP;
+struct AreaPortals;
 
 struct SceneShaderParameters {
   GLuint inPosition;
@@ -33,18 +35,28 @@ struct SceneShaderParameters {
 
 struct BSPScenario : IScenario {
 public:
-  BSPScenario();
+  // Plays data/<mapName>.bsp
+  BSPScenario(const string& mapName = "aerowalk");
   void think(glm::vec2 dir, double pitch, double yaw) override;
   void render() override;
 
+  // Which parts of the map are connected, given which doors are open. Shared
+  // with gameplay code so closed doors cut simulation & networking too.
+  shared_ptr<AreaPortals> areaPortals() const { return _areaPortals; }
+
 private:
   bool finishLoading() override;
 
-  int _bspResourceID;
-  int _sceneShaderResourceID;
+  MapHandle _mapHandle;
+  CookedMapHandle _cookedMapHandle;
+  ArchiveHandle _archiveHandle;
+  TextureManifestHandle _textureManifestHandle;
+  ShaderHandle _sceneShaderHandle;
 
   shared_ptr<TextureRenderer> _compositingRenderer = nullptr;
   shared_ptr<RenderableBSP> _renderableMap = nullptr;
+  shared_ptr<AreaPortals> _areaPortals = nullptr;
+  optional<BSP::header_t::spawn_point_t> _spawnPoint;
 
   unordered_map<int, GLuint> _lightmapTextures;
   GLuint _fallbackLightmapTexture;
@@ -73,7 +85,7 @@ private:
   GLuint _screenShader;
   
   // For testing
-  int _poptartResourceID;
+  TextureHandle _poptartHandle;
 
   Camera _camera;
 };
@@ -0,0 +1,54 @@
+#ifndef SIMD_H
+#define SIMD_H
+
+#include <stdint.h>
+#include <string.h>
+
+// 4-wide float/int vectors using the GCC/Clang vector extensions. These lower to
+// wasm SIMD (with -msimd128), SSE or NEON depending on the target, and fall back
+// to scalar code everywhere else.
+typedef float float4 __attribute__((vector_size(16)));
+typedef int32_t int4 __attribute__((vector_size(16)));
+
+namespace SIMD {
+  inline float4 splat(float value) { return float4{ value, value, value, value }; }
+
+  inline float4 load(const float* pointer) {
+    float4 result;
+    memcpy(&result, pointer, sizeof(result));
+    return result;
+  }
+
+  inline void store(float* pointer, float4 value) {
+    memcpy(pointer, &value, sizeof(value));
+  }
+
+  // Comparisons on float4 produce an int4 with every bit set in lanes where the
+  // comparison was true.
+  inline float4 select(int4 mask, float4 a, float4 b) {
+    int4 result = (mask & (int4) a) | (~mask & (int4) b);
+    return (float4) result;
+  }
+
+  inline float4 min(float4 a, float4 b) { return select(a < b, a, b); }
+  inline float4 max(float4 a, float4 b) { return select(a > b, a, b); }
+
+  inline bool any(int4 mask) { return (mask[0] | mask[1] | mask[2] | mask[3]) != 0; }
+  inline bool all(int4 mask) { return (mask[0] & mask[1] & mask[2] & mask[3]) != 0; }
+
+  inline int4 splat(int32_t value) { return int4{ value, value, value, value }; }
+
+  inline int4 select(int4 mask, int4 a, int4 b) { return (mask & a) | (~mask & b); }
+  inline int4 clamp(int4 v, int32_t low, int32_t high) {
+    v = select(v < splat(low), splat(low), v);
+    return select(v > splat(high), splat(high), v);
+  }
+
+  inline float horizontalMax(float4 v) {
+    float a = v[0] > v[1] ? v[0] : v[1];
+    float b = v[2] > v[3] ? v[2] : v[3];
+    return a > b ? a : b;
+  }
+}
+
+#endif
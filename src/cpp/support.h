@@ -1,6 +1,12 @@
 #ifndef SUPPORT_H
 #define SUPPORT_H
 
+// The offline cooker (see src/cook) is built with -DCOOK, natively and without
+// a window or GL context, so it only gets the GL types.
+#ifdef COOK
+typedef unsigned int GLenum;
+#else
+
 #ifdef __APPLE__
 #else
 #include <emscripten.h>
@@ -22,6 +28,8 @@
 // #include <SDL2/SDL.h>
 #include <GLFW/glfw3.h>
 
+#endif
+
 #include <stdlib.h>
 #include <iostream>
 #include <functional>
@@ -47,48 +55,38 @@ const V* getValue(const std::unordered_map<K, V>& map, K key) {
 
 using namespace std;
 
+// Shared ownership of a resource the web side (or the native loader) handed us.
+// By default the memory came from malloc; resources that live elsewhere (eg. a
+// memory-mapped file) pass their own release function, which runs once the
+// last copy goes away. Copying, moving and assigning (including assigning
+// nullptr) all drop the reference they replace.
 template<typename T>
 struct ResourcePtr {
-  ResourcePtr(T* pointer): _pointer(pointer) {
-    if (_pointer != nullptr) {
-      _counter = std::make_shared<int>(0);
-      (*_counter) ++;
-    }
-  }
-  
-  ResourcePtr(const ResourcePtr<T>& other) {
-    if (other._pointer != nullptr) {
-      _pointer = other._pointer;
-      _counter = other._counter;
-      (*_counter)++;
-    }
-  }
-  
-  void operator=(const ResourcePtr<T>& other) {
-    if (other._pointer != nullptr) {
-      _pointer = other._pointer;
-      _counter = other._counter;
-      (*_counter)++;
-    }
-  }
+  using Release = std::function<void(T*)>;
 
-  operator bool() const { return !!_pointer; }
-  T* get() { return _pointer; }
-  T& operator*() { return *_pointer; }
-  T* operator->() { return _pointer; }
-
-  ~ResourcePtr() {
-    if (_pointer != nullptr) {
-      (*_counter) --;
-      if (*_counter == 0) {
-        free((void*) _pointer);
-      }
+  ResourcePtr() {}
+  ResourcePtr(std::nullptr_t) {}
+  ResourcePtr(T* pointer, Release release = [](T* pointer) { free((void*) pointer); }) {
+    if (pointer != nullptr) {
+      _shared = shared_ptr<T>(pointer, std::move(release));
     }
   }
 
+  ResourcePtr(const ResourcePtr<T>& other) = default;
+  ResourcePtr(ResourcePtr<T>&& other) = default;
+  ResourcePtr<T>& operator=(const ResourcePtr<T>& other) = default;
+  ResourcePtr<T>& operator=(ResourcePtr<T>&& other) = default;
+
+  operator bool() const { return !!_shared; }
+  T* get() const { return _shared.get(); }
+  T& operator*() const { return *_shared; }
+  T* operator->() const { return _shared.get(); }
+
+  // How many ResourcePtrs share the resource (0 if null)
+  long useCount() const { return _shared.use_count(); }
+
 private:
-  T* _pointer = nullptr;
-  shared_ptr<int> _counter = nullptr;
+  shared_ptr<T> _shared;
 };
 
 #endif
@@ -0,0 +1,277 @@
+#include "texture_compression.h"
+#include "image_decoder.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+
+using namespace TextureCompression;
+
+bool header_t::isValid(size_t length) const {
+  if (length < sizeof(header_t) || strncmp(magic, "QTEX", 4) != 0 || version != kVersion) {
+    return false;
+  }
+  if ((format != BC1 && format != BC3) || width <= 0 || height <= 0 || numLevels <= 0 || numLevels > kMaxLevels) {
+    return false;
+  }
+
+  for (int level = 0; level < numLevels; level ++) {
+    const level_t& entry = levels[level];
+    if (entry.offset < 0 || (size_t) entry.offset + (size_t) entry.length > length) {
+      return false;
+    }
+    if ((size_t) entry.length != compressedLength((Format) format, levelWidth(level), levelHeight(level))) {
+      return false;
+    }
+  }
+  return true;
+}
+
+int TextureCompression::blockBytes(Format format) {
+  return format == BC1 ? 8 : 16;
+}
+
+size_t TextureCompression::compressedLength(Format format, int width, int height) {
+  return (size_t) ((width + 3) / 4) * ((height + 3) / 4) * blockBytes(format);
+}
+
+GLenum TextureCompression::glInternalFormat(Format format) {
+  return format == BC1 ? GL_COMPRESSED_RGB_S3TC_DXT1_EXT : GL_COMPRESSED_RGBA_S3TC_DXT5_EXT;
+}
+
+// A 4x4 block of RGBA pixels. Blocks hanging off the edge repeat the last
+// row / column.
+static void readBlock(const unsigned char* rgba, int width, int height, int blockX, int blockY, unsigned char block[16][4]) {
+  for (int y = 0; y < 4; y ++) {
+    for (int x = 0; x < 4; x ++) {
+      const int sourceX = std::min(blockX * 4 + x, width - 1);
+      const int sourceY = std::min(blockY * 4 + y, height - 1);
+      memcpy(block[y * 4 + x], rgba + ((size_t) sourceY * width + sourceX) * 4, 4);
+    }
+  }
+}
+
+static uint16_t to565(const int color[3]) {
+  return (uint16_t) (((color[0] * 31 + 127) / 255) << 11 | ((color[1] * 63 + 127) / 255) << 5 | ((color[2] * 31 + 127) / 255));
+}
+
+static void from565(uint16_t packed, int color[3]) {
+  const int r = (packed >> 11) & 31;
+  const int g = (packed >> 5) & 63;
+  const int b = packed & 31;
+  color[0] = (r << 3) | (r >> 2);
+  color[1] = (g << 2) | (g >> 4);
+  color[2] = (b << 3) | (b >> 2);
+}
+
+static void writeLittleEndian(char* destination, uint64_t value, int bytes) {
+  for (int i = 0; i < bytes; i ++) {
+    destination[i] = (char) ((value >> (i * 8)) & 0xff);
+  }
+}
+
+// Endpoints are the corners of the colors' bounding box, pulled in a little
+// so the in-between colors land closer to the pixels (see van Waveren's
+// "Real-Time DXT Compression"). Always in 4 color mode.
+static void encodeColorBlock(const unsigned char block[16][4], char* destination) {
+  int mins[3] = { 255, 255, 255 };
+  int maxs[3] = { 0, 0, 0 };
+  for (int i = 0; i < 16; i ++) {
+    for (int channel = 0; channel < 3; channel ++) {
+      mins[channel] = std::min(mins[channel], (int) block[i][channel]);
+      maxs[channel] = std::max(maxs[channel], (int) block[i][channel]);
+    }
+  }
+  for (int channel = 0; channel < 3; channel ++) {
+    const int inset = (maxs[channel] - mins[channel]) / 16;
+    mins[channel] += inset;
+    maxs[channel] -= inset;
+  }
+
+  // The box has two ends along any of its diagonals. Channels that go down as
+  // the widest one goes up are flipped, so the ends follow the colors.
+  int widest = 0;
+  int means[3] = { 0, 0, 0 };
+  for (int channel = 0; channel < 3; channel ++) {
+    if (maxs[channel] - mins[channel] > maxs[widest] - mins[widest]) {
+      widest = channel;
+    }
+    for (int i = 0; i < 16; i ++) {
+      means[channel] += block[i][channel];
+    }
+    means[channel] /= 16;
+  }
+  for (int channel = 0; channel < 3; channel ++) {
+    int covariance = 0;
+    for (int i = 0; i < 16; i ++) {
+      covariance += (block[i][channel] - means[channel]) * (block[i][widest] - means[widest]);
+    }
+    if (covariance < 0) {
+      std::swap(mins[channel], maxs[channel]);
+    }
+  }
+
+  uint16_t color0 = to565(maxs);
+  uint16_t color1 = to565(mins);
+  if (color0 < color1) {
+    std::swap(color0, color1);
+  }
+
+  uint32_t indices = 0;
+  if (color0 != color1) {
+    int palette[4][3];
+    from565(color0, palette[0]);
+    from565(color1, palette[1]);
+    for (int channel = 0; channel < 3; channel ++) {
+      palette[2][channel] = (2 * palette[0][channel] + palette[1][channel]) / 3;
+      palette[3][channel] = (palette[0][channel] + 2 * palette[1][channel]) / 3;
+    }
+
+    for (int i = 0; i < 16; i ++) {
+      int best = 0;
+      int bestDistance = INT32_MAX;
+      for (int candidate = 0; candidate < 4; candidate ++) {
+        int distance = 0;
+        for (int channel = 0; channel < 3; channel ++) {
+          const int difference = block[i][channel] - palette[candidate][channel];
+          distance += difference * difference;
+        }
+        if (distance < bestDistance) {
+          best = candidate;
+          bestDistance = distance;
+        }
+      }
+      indices |= (uint32_t) best << (i * 2);
+    }
+  }
+
+  writeLittleEndian(destination, color0, 2);
+  writeLittleEndian(destination + 2, color1, 2);
+  writeLittleEndian(destination + 4, indices, 4);
+}
+
+// 8 alpha values between the block's lowest and highest
+static void encodeAlphaBlock(const unsigned char block[16][4], char* destination) {
+  int alpha0 = 0;
+  int alpha1 = 255;
+  for (int i = 0; i < 16; i ++) {
+    alpha0 = std::max(alpha0, (int) block[i][3]);
+    alpha1 = std::min(alpha1, (int) block[i][3]);
+  }
+
+  uint64_t indices = 0;
+  if (alpha0 != alpha1) {
+    int palette[8] = { alpha0, alpha1 };
+    for (int i = 1; i < 7; i ++) {
+      palette[i + 1] = ((7 - i) * alpha0 + i * alpha1) / 7;
+    }
+
+    for (int i = 0; i < 16; i ++) {
+      int best = 0;
+      for (int candidate = 1; candidate < 8; candidate ++) {
+        if (abs(block[i][3] - palette[candidate]) < abs(block[i][3] - palette[best])) {
+          best = candidate;
+        }
+      }
+      indices |= (uint64_t) best << (i * 3);
+    }
+  }
+
+  destination[0] = (char) alpha0;
+  destination[1] = (char) alpha1;
+  writeLittleEndian(destination + 2, indices, 6);
+}
+
+void TextureCompression::encodeBC1(const unsigned char* rgba, int width, int height, char* destination) {
+  unsigned char block[16][4];
+  for (int blockY = 0; blockY < (height + 3) / 4; blockY ++) {
+    for (int blockX = 0; blockX < (width + 3) / 4; blockX ++) {
+      readBlock(rgba, width, height, blockX, blockY, block);
+      encodeColorBlock(block, destination);
+      destination += 8;
+    }
+  }
+}
+
+void TextureCompression::encodeBC3(const unsigned char* rgba, int width, int height, char* destination) {
+  unsigned char block[16][4];
+  for (int blockY = 0; blockY < (height + 3) / 4; blockY ++) {
+    for (int blockX = 0; blockX < (width + 3) / 4; blockX ++) {
+      readBlock(rgba, width, height, blockX, blockY, block);
+      encodeAlphaBlock(block, destination);
+      encodeColorBlock(block, destination + 8);
+      destination += 16;
+    }
+  }
+}
+
+static vector<char> writeFile(Format format, const vector<vector<unsigned char>>& levels, int width, int height) {
+  header_t header;
+  memset(&header, 0, sizeof(header));
+  memcpy(header.magic, "QTEX", 4);
+  header.version = kVersion;
+  header.format = format;
+  header.width = width;
+  header.height = height;
+  header.numLevels = levels.size();
+
+  vector<char> file(sizeof(header_t));
+  for (int level = 0; level < header.numLevels; level ++) {
+    const int levelWidth = header.levelWidth(level);
+    const int levelHeight = header.levelHeight(level);
+    header.levels[level].offset = file.size();
+    header.levels[level].length = compressedLength(format, levelWidth, levelHeight);
+    file.resize(file.size() + header.levels[level].length);
+
+    char* destination = file.data() + header.levels[level].offset;
+    if (format == BC1) {
+      encodeBC1(levels[level].data(), levelWidth, levelHeight, destination);
+    } else {
+      encodeBC3(levels[level].data(), levelWidth, levelHeight, destination);
+    }
+  }
+  memcpy(file.data(), &header, sizeof(header));
+  return file;
+}
+
+vector<char> TextureCompression::compress(const unsigned char* rgba, int width, int height) {
+  const size_t numPixels = (size_t) width * height;
+  Format format = BC1;
+  for (size_t i = 0; i < numPixels; i ++) {
+    if (rgba[i * 4 + 3] != 255) {
+      format = BC3;
+      break;
+    }
+  }
+
+  vector<vector<unsigned char>> levels;
+  levels.emplace_back(rgba, rgba + numPixels * 4);
+  const int numLevels = std::min(kMaxLevels, 1 + (int) floor(log2(std::max(width, height))));
+  for (int level = 1; level < numLevels; level ++) {
+    const int previousWidth = std::max(1, width >> (level - 1));
+    const int previousHeight = std::max(1, height >> (level - 1));
+    vector<unsigned char> half((size_t) std::max(1, previousWidth / 2) * std::max(1, previousHeight / 2) * 4);
+    ImageDecoder::halve(levels.back().data(), previousWidth, previousHeight, half.data());
+    levels.push_back(std::move(half));
+  }
+
+  return writeFile(format, levels, width, height);
+}
+
+vector<char> TextureCompression::encodeRGBM(const unsigned char* rgb, int width, int height) {
+  const size_t numPixels = (size_t) width * height;
+  vector<unsigned char> rgbm(numPixels * 4);
+  for (size_t i = 0; i < numPixels; i ++) {
+    const unsigned char* source = rgb + i * 3;
+    const int brightest = std::max({ 1, (int) source[0], (int) source[1], (int) source[2] });
+    for (int channel = 0; channel < 3; channel ++) {
+      rgbm[i * 4 + channel] = (unsigned char) std::min(255, (source[channel] * 255 + brightest / 2) / brightest);
+    }
+    rgbm[i * 4 + 3] = (unsigned char) brightest;
+  }
+
+  vector<char> blocks(compressedLength(BC3, width, height));
+  encodeBC3(rgbm.data(), width, height, blocks.data());
+  return blocks;
+}
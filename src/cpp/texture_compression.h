@@ -0,0 +1,80 @@
+#ifndef TEXTURE_COMPRESSION_H
+#define TEXTURE_COMPRESSION_H
+
+#include "support.h"
+
+// Not in every platform's headers (they come with the S3TC extensions)
+#ifndef GL_COMPRESSED_RGB_S3TC_DXT1_EXT
+#define GL_COMPRESSED_RGB_S3TC_DXT1_EXT 0x83F0
+#endif
+#ifndef GL_COMPRESSED_RGBA_S3TC_DXT5_EXT
+#define GL_COMPRESSED_RGBA_S3TC_DXT5_EXT 0x83F3
+#endif
+
+// Block-compressed (S3TC) textures, which stay compressed on the GPU: 4x less
+// memory and upload bandwidth than RGBA8 for textures with transparency, 8x
+// for those without. Encoding is too slow to do on load, so textures are
+// transcoded offline by the cook tool, mip chain and all:
+//
+//   make compress_textures
+//
+// writes a .qtex next to each texture, which is used instead of the image if
+// the context supports S3TC (see GLHelpers::compressedFormats). The layout is:
+//
+//   header_t, every mip level's blocks (largest first)...
+namespace TextureCompression {
+  const int kVersion = 1;
+  const int kMaxLevels = 16;
+
+  enum Format {
+    BC1 = 1, // aka DXT1: RGB, 8 bytes per 4x4 block
+    BC3 = 3, // aka DXT5: RGBA, 16 bytes per 4x4 block
+  };
+
+  struct level_t {
+    int offset;
+    int length;
+  };
+
+  struct header_t {
+    char magic[4]; // "QTEX"
+    int version;
+    int format; // Format
+    int width; // Of level 0
+    int height;
+    int numLevels;
+    level_t levels[kMaxLevels];
+
+    bool isValid(size_t length) const;
+
+    int levelWidth(int level) const { return std::max(1, width >> level); }
+    int levelHeight(int level) const { return std::max(1, height >> level); }
+    const char* levelData(int level) const {
+      return (const char*) this + levels[level].offset;
+    }
+  };
+
+  int blockBytes(Format format);
+  size_t compressedLength(Format format, int width, int height);
+  GLenum glInternalFormat(Format format);
+
+  // `rgba` is width x height pixels; neither needs to be a multiple of 4.
+  // `destination` needs compressedLength() bytes.
+  void encodeBC1(const unsigned char* rgba, int width, int height, char* destination);
+  void encodeBC3(const unsigned char* rgba, int width, int height, char* destination);
+
+  // A whole .qtex file: every mip level, in BC1 unless any pixel is
+  // transparent.
+  vector<char> compress(const unsigned char* rgba, int width, int height);
+
+  // For lightmaps: RGB (0-255) as BC3 "RGBM" -- the color divided by its
+  // brightest channel, which goes in alpha. Decoded as rgb * a. Alpha blocks
+  // keep more precision than color blocks, so dark, subtle lighting survives.
+  // The color part is still 5:6:5, though: a red or blue step is 8/255 of the
+  // brightest channel. On smooth lightmaps that comes back within 4/255 (0.5
+  // on average); noisy ones (every block full of unrelated colors) do far
+  // worse, as with any BC1 color block.
+  vector<char> encodeRGBM(const unsigned char* rgb, int width, int height);
+}
+
+#endif
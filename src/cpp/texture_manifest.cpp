@@ -0,0 +1,117 @@
+#include "texture_manifest.h"
+
+#include "archive.h"
+
+#include <cstring>
+
+using namespace TextureManifest;
+
+size_t TextureManifest::keyStart(const string& path) {
+  const string normalized = Archive::normalizePath(path);
+  size_t start = 0;
+  if (normalized.compare(start, 2, "./") == 0) {
+    start += 2;
+  }
+  if (normalized.compare(start, 5, "data/") == 0) {
+    start += 5;
+  }
+  return start;
+}
+
+string TextureManifest::key(const string& path) {
+  string result = Archive::normalizePath(path).substr(keyStart(path));
+  const size_t extension = result.rfind('.');
+  if (extension != string::npos && result.find('/', extension) == string::npos) {
+    result.resize(extension);
+  }
+  return result;
+}
+
+uint32_t TextureManifest::hash(const string& key) {
+  uint32_t hash = 2166136261u;
+  for (const char c : key) {
+    hash ^= (unsigned char) c;
+    hash *= 16777619u;
+  }
+  return hash;
+}
+
+bool header_t::isValid(size_t length) const {
+  if (length < sizeof(header_t) || strncmp(magic, "QMAN", 4) != 0 || version != kVersion) {
+    return false;
+  }
+
+  for (const BSP::direntry_t& entry : direntries) {
+    if (entry.offset < 0 || entry.length < 0 || entry.offset % 4 != 0
+        || (size_t) entry.offset + (size_t) entry.length > length) {
+      return false;
+    }
+  }
+
+  const int stringsLength = stringsEntry()->length;
+  if (numBuckets == 0 || (numBuckets & (numBuckets - 1)) != 0
+      || (uint64_t) bucketsEntry()->length != (uint64_t) numBuckets * sizeof(bucket_t) // Wraps in wasm's size_t
+      || entriesEntry()->length % sizeof(entry_t) != 0
+      || (uint32_t) numEntries() >= numBuckets
+      || stringsLength == 0 || strings()[stringsLength - 1] != '\0') {
+    return false;
+  }
+
+  for (uint32_t i = 0; i < numBuckets; i ++) {
+    if (buckets()[i].entry < -1 || buckets()[i].entry >= numEntries()) {
+      return false;
+    }
+  }
+  for (int i = 0; i < numEntries(); i ++) {
+    const entry_t& entry = entries()[i];
+    if (entry.name < 0 || entry.name >= stringsLength) {
+      return false;
+    }
+    for (const int file : entry.files) {
+      if (file < -1 || file >= stringsLength) {
+        return false;
+      }
+    }
+  }
+  return true;
+}
+
+const entry_t* header_t::find(const string& path) const {
+  const string key = TextureManifest::key(path);
+  const uint32_t hash = TextureManifest::hash(key);
+  const uint32_t mask = numBuckets - 1;
+  for (uint32_t probe = 0; probe < numBuckets; probe ++) {
+    const bucket_t& bucket = buckets()[(hash + probe) & mask];
+    if (bucket.entry < 0) {
+      return nullptr;
+    }
+    if (bucket.hash == hash && key == strings() + entries()[bucket.entry].name) {
+      return entries() + bucket.entry;
+    }
+  }
+  return nullptr;
+}
+
+optional<string> header_t::file(const entry_t* entry, const string& path, bool s3tc) const {
+  const string root = path.substr(0, keyStart(path));
+  const size_t extension = path.rfind('.');
+  const string asked = extension != string::npos && path.find('/', extension) == string::npos
+    ? Archive::normalizePath(path.substr(extension))
+    : "";
+
+  if (s3tc && entry->files[QTEX] >= 0) {
+    return root + (strings() + entry->files[QTEX]);
+  }
+  const pair<File, const char*> images[] = { { JPG, ".jpg" }, { PNG, ".png" }, { TGA, ".tga" } };
+  for (const auto& image : images) {
+    if (entry->files[image.first] >= 0 && asked == image.second) {
+      return root + (strings() + entry->files[image.first]);
+    }
+  }
+  for (const auto& image : images) {
+    if (entry->files[image.first] >= 0) {
+      return root + (strings() + entry->files[image.first]);
+    }
+  }
+  return {};
+}
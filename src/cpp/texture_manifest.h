@@ -0,0 +1,100 @@
+#ifndef TEXTURE_MANIFEST_H
+#define TEXTURE_MANIFEST_H
+
+#include "support.h"
+#include "bsp.h"
+
+// Which texture files there are, and what their shader scripts say, compiled
+// ahead of time by generate_manifests.py into data/textures_manifest.bin:
+//
+//   python3 generate_manifests.py
+//
+// Like a cooked map, it's read straight from memory. Textures are found
+// through an open addressed hash table of their paths, so resolving a BSP's
+// texture name to the file to load and its shader is one probe, usually
+// without touching anything but the bucket and the entry. Of the shader
+// scripts, only what C++ uses is kept: whether a shader is `surfaceparm trans`.
+namespace TextureManifest {
+  const int kVersion = 2;
+
+  // The files a texture can have, by extension
+  enum File {
+    JPG,
+    PNG,
+    TGA,
+    QTEX, // GPU compressed, see TextureCompression
+    kNumFiles
+  };
+
+  // Its shader's `surfaceparm`s, the ones we use
+  enum SurfaceParm : uint32_t {
+    TRANS = 1 << 0
+  };
+
+  struct bucket_t {
+    uint32_t hash; // See hash()
+    int entry; // Index into entries(), or -1 if the bucket's empty
+  };
+
+  struct entry_t {
+    int name; // Offset into strings() of its key()
+    // Offsets into strings() of its files' paths, relative to data/ and named
+    // as they are on disk (which key() isn't), by File. -1 for those it
+    // doesn't have.
+    int files[kNumFiles];
+    uint32_t surfaceParms; // SurfaceParm flags. 0 without a shader.
+  };
+
+  struct header_t {
+    char magic[4]; // "QMAN"
+    int version;
+    uint32_t numBuckets; // A power of two, more than there are entries
+    BSP::direntry_t direntries[3];
+
+    // Checks every offset and index in it too, so lookups don't have to
+    bool isValid(size_t length) const;
+
+    // By a texture's path as a BSP (or a shader) names it: with or without an
+    // extension, and relative to data/ or not. Null if there's no such
+    // texture, or shader.
+    const entry_t* find(const string& path) const;
+
+    // Where to load the texture from: one of its files, under whatever `path`
+    // is relative to (eg. "./data/") -- the GPU compressed one if `s3tc`, then
+    // the one it was asked for by, then a JPEG, PNG or TGA. Nothing if there
+    // isn't a file we can use.
+    optional<string> file(const entry_t* entry, const string& path, bool s3tc) const;
+
+    const BSP::direntry_t* bucketsEntry() const { return direntries + 0; }
+    const bucket_t* buckets() const {
+      return (const bucket_t*) ((char*) this + bucketsEntry()->offset);
+    }
+
+    const BSP::direntry_t* entriesEntry() const { return direntries + 1; }
+    int numEntries() const {
+      return entriesEntry()->length / sizeof(entry_t);
+    }
+    const entry_t* entries() const {
+      return (const entry_t*) ((char*) this + entriesEntry()->offset);
+    }
+
+    // Null terminated strings, one after the other
+    const BSP::direntry_t* stringsEntry() const { return direntries + 2; }
+    const char* strings() const {
+      return (const char*) this + stringsEntry()->offset;
+    }
+  };
+
+  // What textures are looked up by: the path relative to data/, lower case,
+  // without an extension. eg. "textures/base_wall/metal" for
+  // "./data/textures/base_wall/Metal.jpg".
+  string key(const string& path);
+
+  // How much of the start of `path` key() drops, eg. 7 for "./data/"
+  size_t keyStart(const string& path);
+
+  // FNV-1a, which generate_manifests.py has to match
+  uint32_t hash(const string& key);
+}
+
+#endif
@@ -0,0 +1,281 @@
+#include "texture_uploader.h"
+
+#include "gl_helpers.h"
+
+#include <chrono>
+#include <cmath>
+
+TextureUploader::~TextureUploader() {
+  for (Upload& upload : _uploads) {
+    free(upload.pixels);
+  }
+}
+
+void TextureUploader::enqueue(int resourceID, void* pixels, int width, int height) {
+  Upload upload = { resourceID, pixels, width, height };
+  upload.queuedBytes = (size_t) width * height * 4;
+  upload.gpuBytes = upload.queuedBytes * 4 / 3; // Plus a third for the mipmaps
+  _uploads.push_back(upload);
+  _queuedBytes += upload.queuedBytes;
+}
+
+void TextureUploader::enqueueCompressed(int resourceID, void* file, int maxSize) {
+  const auto* header = (const TextureCompression::header_t*) file;
+  int firstLevel = 0;
+  while (maxSize > 0 && firstLevel < header->numLevels - 1
+      && std::max(header->levelWidth(firstLevel), header->levelHeight(firstLevel)) > maxSize) {
+    firstLevel ++;
+  }
+
+  Upload upload = { resourceID, file, header->levelWidth(firstLevel), header->levelHeight(firstLevel) };
+  upload.compressed = true;
+  upload.firstLevel = firstLevel;
+  upload.queuedBytes = 0;
+  for (int level = firstLevel; level < header->numLevels; level ++) {
+    upload.queuedBytes += header->levels[level].length;
+  }
+  upload.gpuBytes = upload.queuedBytes;
+  _uploads.push_back(upload);
+  _queuedBytes += upload.queuedBytes;
+}
+
+// Every texture gets a full set of mipmaps, one way or another
+static void setSampling() {
+  glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_REPEAT);
+  glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_REPEAT);
+  glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
+  glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+}
+
+void TextureUploader::enqueueUploaded(int resourceID, GLuint texture, int width, int height) {
+  glBindTexture(GL_TEXTURE_2D, texture);
+  setSampling();
+
+  Upload upload = { resourceID, nullptr, width, height, texture };
+  upload.queuedBytes = 0;
+  upload.gpuBytes = (size_t) width * height * 4 * 4 / 3;
+  _mipmaps.push_back(upload);
+}
+
+void TextureUploader::setBudget(double milliseconds, size_t bytes) {
+  _budgetMilliseconds = milliseconds;
+  _budgetBytes = bytes;
+}
+
+// `levels` mip levels (0 for all of them), left bound. GL errors are left for
+// the caller to check.
+static optional<GLuint> allocateStorage(int width, int height, int levels = 0,
+    optional<TextureCompression::Format> compressed = {}) {
+  if (width <= 0 || height <= 0) {
+    warn << "can't allocate a " << width << "x" << height << " texture\n";
+    return {};
+  }
+
+  GLuint texture;
+  glGenTextures(1, &texture);
+  glBindTexture(GL_TEXTURE_2D, texture);
+
+  if (!levels) {
+    levels = 1 + (int) floor(log2(std::max(width, height)));
+  }
+  const GLenum internalFormat = compressed ? TextureCompression::glInternalFormat(*compressed) : GL_RGBA8;
+#ifdef __APPLE__
+  // Core in GL 4.2, but macOS stops at 4.1
+  if (!GLEW_ARB_texture_storage) {
+    for (int level = 0; level < levels; level ++) {
+      const int levelWidth = std::max(1, width >> level);
+      const int levelHeight = std::max(1, height >> level);
+      if (compressed) {
+        glCompressedTexImage2D(GL_TEXTURE_2D, level, internalFormat, levelWidth, levelHeight,
+          0, TextureCompression::compressedLength(*compressed, levelWidth, levelHeight), nullptr);
+      } else {
+        glTexImage2D(GL_TEXTURE_2D, level, internalFormat, levelWidth, levelHeight,
+          0, GL_RGBA, GL_UNSIGNED_BYTE, nullptr);
+      }
+    }
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAX_LEVEL, levels - 1);
+  } else
+#endif
+  glTexStorage2D(GL_TEXTURE_2D, levels, internalFormat, width, height);
+
+  setSampling();
+  return texture;
+}
+
+bool TextureUploader::allocate(Upload& upload) {
+  const optional<GLuint> texture = upload.compressed
+    ? allocateStorage(upload.width, upload.height, upload.file()->numLevels - upload.firstLevel,
+        (TextureCompression::Format) upload.file()->format)
+    : allocateStorage(upload.width, upload.height);
+  upload.texture = texture.value_or(0);
+  return texture.has_value();
+}
+
+optional<GLuint> TextureUploader::shrink(GLuint texture, int width, int height, int level) {
+  const int levelWidth = std::max(1, width >> level);
+  const int levelHeight = std::max(1, height >> level);
+  const optional<GLuint> smaller = allocateStorage(levelWidth, levelHeight);
+  if (!smaller) {
+    return {};
+  }
+
+  // Copies the level over by reading it as a framebuffer
+  GLint previousFramebuffer;
+  glGetIntegerv(GL_FRAMEBUFFER_BINDING, &previousFramebuffer);
+  GLuint framebuffer;
+  glGenFramebuffers(1, &framebuffer);
+  glBindFramebuffer(GL_FRAMEBUFFER, framebuffer);
+  glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, texture, level);
+
+  glBindTexture(GL_TEXTURE_2D, *smaller);
+  glCopyTexSubImage2D(GL_TEXTURE_2D, 0, 0, 0, 0, 0, levelWidth, levelHeight);
+  glGenerateMipmap(GL_TEXTURE_2D);
+
+  glBindFramebuffer(GL_FRAMEBUFFER, previousFramebuffer);
+  glDeleteFramebuffers(1, &framebuffer);
+
+  if (hasErrors()) {
+    warn << "failed to shrink texture " << texture << "\n";
+    glDeleteTextures(1, &*smaller);
+    return {};
+  }
+  return smaller;
+}
+
+size_t TextureUploader::uploadRows(Upload& upload, size_t maxBytes) {
+  const size_t rowBytes = (size_t) upload.width * 4;
+  const int rows = std::min(upload.height - upload.uploadedRows, (int) std::max((size_t) 1, maxBytes / rowBytes));
+  const size_t bytes = rows * rowBytes;
+
+  // Straight from our memory: the driver copies it once either way, and
+  // WebGL has no way to fill a buffer without another copy
+  glBindTexture(GL_TEXTURE_2D, upload.texture);
+  glTexSubImage2D(GL_TEXTURE_2D, 0, 0, upload.uploadedRows, upload.width, rows, GL_RGBA, GL_UNSIGNED_BYTE,
+    (const char*) upload.pixels + upload.uploadedRows * rowBytes);
+
+  upload.uploadedRows += rows;
+  upload.queuedBytes -= bytes;
+  _queuedBytes -= bytes;
+  return bytes;
+}
+
+// A whole level at a time: they're already a quarter (or less) of the size
+size_t TextureUploader::uploadLevel(Upload& upload) {
+  const TextureCompression::header_t* file = upload.file();
+  const int level = upload.firstLevel + upload.uploadedLevels;
+  const size_t bytes = file->levels[level].length;
+
+  glBindTexture(GL_TEXTURE_2D, upload.texture);
+  glCompressedTexSubImage2D(GL_TEXTURE_2D, upload.uploadedLevels, 0, 0,
+    file->levelWidth(level), file->levelHeight(level),
+    TextureCompression::glInternalFormat((TextureCompression::Format) file->format), bytes, file->levelData(level));
+
+  upload.uploadedLevels ++;
+  upload.queuedBytes -= bytes;
+  _queuedBytes -= bytes;
+  return bytes;
+}
+
+void TextureUploader::fail(Upload& upload, vector<Finished>& finished) {
+  _queuedBytes -= upload.queuedBytes;
+  free(upload.pixels);
+  if (upload.texture) {
+    glDeleteTextures(1, &upload.texture);
+  }
+  finished.push_back({ upload.resourceID, {}, upload.width, upload.height, 0 });
+}
+
+vector<TextureUploader::Finished> TextureUploader::pump() {
+  vector<Finished> finished;
+  if (_uploads.empty() && _mipmaps.empty()) {
+    return finished;
+  }
+
+  const auto start = chrono::steady_clock::now();
+  const auto milliseconds = [&start]() {
+    return chrono::duration<double, milli>(chrono::steady_clock::now() - start).count();
+  };
+  size_t bytes = 0;
+  const auto hasBudget = [&]() {
+    return bytes == 0 || (bytes < _budgetBytes && milliseconds() < _budgetMilliseconds);
+  };
+
+  // glGetError stalls until the GPU catches up, so whether anything failed is
+  // only asked once, at the end. Until then, these are the textures whose
+  // GL calls were all made this frame.
+  vector<Upload> mipmapped;
+  vector<Upload> uploaded;
+  bool startedFront = false; // Part of _uploads.front() was uploaded
+
+  // Only textures uploaded on earlier frames, so a texture's upload and its
+  // mipmaps never land on the same frame
+  const int numMipmaps = _mipmaps.size();
+  for (int i = 0; i < numMipmaps && hasBudget(); i ++) {
+    Upload upload = _mipmaps.front();
+    _mipmaps.pop_front();
+
+    glBindTexture(GL_TEXTURE_2D, upload.texture);
+    glGenerateMipmap(GL_TEXTURE_2D);
+    bytes += (size_t) upload.width * upload.height * 4 / 3;
+    mipmapped.push_back(upload);
+  }
+
+  while (_uploads.size() && hasBudget()) {
+    Upload& upload = _uploads.front();
+    if (!upload.texture && !allocate(upload)) {
+      fail(upload, finished);
+      _uploads.pop_front();
+      continue;
+    }
+    startedFront = true;
+
+    if (upload.compressed) {
+      bytes += uploadLevel(upload);
+      if (upload.uploadedLevels < upload.file()->numLevels - upload.firstLevel) {
+        continue;
+      }
+    } else {
+      bytes += uploadRows(upload, bytes < _budgetBytes ? _budgetBytes - bytes : 0);
+      if (upload.uploadedRows < upload.height) {
+        continue;
+      }
+    }
+
+    // GL has its own copy now
+    free(upload.pixels);
+    upload.pixels = nullptr;
+    // Compressed ones come with their mipmaps, so they're done
+    (upload.compressed ? mipmapped : uploaded).push_back(upload);
+    _uploads.pop_front();
+    startedFront = false;
+  }
+
+  if (hasErrors()) {
+    warn << "failed to upload textures, dropping the " << mipmapped.size() + uploaded.size() + startedFront
+      << " worked on this frame\n";
+    for (const vector<Upload>* uploads : { &mipmapped, &uploaded }) {
+      for (Upload upload : *uploads) {
+        fail(upload, finished);
+      }
+    }
+    if (startedFront) {
+      fail(_uploads.front(), finished);
+      _uploads.pop_front();
+    }
+  } else {
+    for (const Upload& upload : mipmapped) {
+      finished.push_back({ upload.resourceID, upload.texture, upload.width, upload.height, upload.gpuBytes });
+    }
+    for (const Upload& upload : uploaded) {
+      _mipmaps.push_back(upload);
+    }
+  }
+
+  static int printLimiter = 0;
+  if (printLimiter ++ % 100 == 0) {
+    cout << "texture uploads: " << queueDepth() << " queued (" << _queuedBytes / 1024 << " KB not yet on the GPU), "
+      << bytes / 1024 << " KB in " << milliseconds() << " ms this frame\n";
+  }
+
+  return finished;
+}
@@ -0,0 +1,94 @@
+#ifndef TEXTURE_UPLOADER_H
+#define TEXTURE_UPLOADER_H
+
+#include "support.h"
+#include "texture_compression.h"
+
+#include <deque>
+
+// Gets textures onto the GPU a little at a time, so a burst of them arriving
+// at once doesn't stall a frame. Each pump() spends at most a time and byte
+// budget:
+//
+//   1. Storage for every mip level is allocated up front (glTexStorage2D).
+//   2. The pixels are copied into level 0 straight from memory, a band of rows
+//      at a time, so a big texture can span frames.
+//   3. Mipmaps are generated on a later frame than the upload finished on.
+//
+// GL errors are checked once per pump(); if there were any, every texture
+// worked on that frame is dropped.
+//
+// Block-compressed textures (see TextureCompression) come with their mipmaps,
+// and are uploaded a level at a time instead. A texture is only handed back
+// once all of that's done.
+struct TextureUploader {
+  struct Finished {
+    int resourceID;
+    optional<GLuint> texture; // Unset if it couldn't be uploaded
+    int width;
+    int height;
+    size_t bytes; // On the GPU, mipmaps included
+  };
+
+  ~TextureUploader();
+
+  // Takes `pixels` (RGBA, from malloc), which are freed once they've been
+  // copied to the GPU.
+  void enqueue(int resourceID, void* pixels, int width, int height);
+
+  // Takes a whole .qtex `file` (from malloc, already checked with isValid),
+  // and uploads the levels that fit in `maxSize`, if it isn't 0.
+  void enqueueCompressed(int resourceID, void* file, int maxSize);
+
+  // A texture the browser has already uploaded level 0 of (see
+  // ResourceManager::ImageUploads), which only needs its mipmaps made.
+  void enqueueUploaded(int resourceID, GLuint texture, int width, int height);
+
+  // Always makes some progress, even if that overruns the budget.
+  vector<Finished> pump();
+
+  void setBudget(double milliseconds, size_t bytes);
+
+  // A copy of one of `texture`'s mip levels (with mipmaps of its own), made on
+  // the GPU. The original is left alone.
+  static optional<GLuint> shrink(GLuint texture, int width, int height, int level);
+
+  int queueDepth() const { return _uploads.size() + _mipmaps.size(); }
+  size_t queuedBytes() const { return _queuedBytes; }
+
+private:
+  struct Upload {
+    int resourceID;
+    void* pixels; // Or the .qtex file, if `compressed`
+    int width;
+    int height;
+    GLuint texture = 0; // 0 until storage is allocated
+    int uploadedRows = 0;
+    size_t queuedBytes; // Not yet copied to the GPU
+    size_t gpuBytes; // Once it's all there, mipmaps included
+
+    // The file's levels from `firstLevel` on are uploaded, one per step
+    bool compressed = false;
+    int firstLevel = 0;
+    int uploadedLevels = 0;
+
+    // Until it's all been uploaded
+    const TextureCompression::header_t* file() const {
+      return (const TextureCompression::header_t*) pixels;
+    }
+  };
+
+  bool allocate(Upload& upload);
+  size_t uploadRows(Upload& upload, size_t maxBytes);
+  size_t uploadLevel(Upload& upload);
+  void fail(Upload& upload, vector<Finished>& finished);
+
+  std::deque<Upload> _uploads; // First come, first served
+  std::deque<Upload> _mipmaps; // Uploaded, waiting for mipmaps
+  size_t _queuedBytes = 0; // Pixels not yet copied to the GPU
+
+  double _budgetMilliseconds = 4;
+  size_t _budgetBytes = 4 * 1024 * 1024;
+};
+
+#endif
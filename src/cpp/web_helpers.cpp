@@ -16,10 +16,19 @@ void MemoryHelpers::destroyBuffer(unsigned long address) {
   void* pointer = (void*) address;
   free(pointer);
 }
+
+// For images the browser uploads itself (see ResourceManager::ImageUploads):
+// our GL context, and the WebGLTexture behind one of our texture names
+EM_JS(void, exposeGLToWeb, (), {
+  Module['glContext'] = function() { return GLctx; };
+  Module['glTexture'] = function(name) { return GL.textures[name]; };
+});
+
 EMSCRIPTEN_BINDINGS(my_module) {
   emscripten::function("sendMessageToCPP", &MessageBindings::sendMessageToCPP);
   emscripten::function("createBuffer", &MemoryHelpers::createBuffer, emscripten::allow_raw_pointers());
   emscripten::function("destroyBuffer", &MemoryHelpers::destroyBuffer, emscripten::allow_raw_pointers());
+  exposeGLToWeb();
 }
 
 json MemoryHelpers::cppToJsonPointer(void* pointer) {
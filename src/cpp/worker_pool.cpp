@@ -0,0 +1,95 @@
+#include "worker_pool.h"
+
+#include <algorithm>
+
+int WorkerPool::defaultThreads() {
+#ifdef __APPLE__
+  // Leave a core for the main thread
+  return std::max(1, std::min(4, (int) std::thread::hardware_concurrency() - 1));
+#else
+  // Fits in the pthread pool the module starts with (PTHREAD_POOL_SIZE)
+  return 3;
+#endif
+}
+
+#ifdef WORKER_POOL_THREADS
+
+WorkerPool::WorkerPool(int numThreads) {
+  for (int i = 0; i < numThreads; i ++) {
+    _threads.emplace_back([this]() { workerMain(); });
+  }
+}
+
+WorkerPool::~WorkerPool() {
+  {
+    std::lock_guard<std::mutex> lock(_mutex);
+    _stopping = true;
+  }
+  _jobQueued.notify_all();
+  for (std::thread& thread : _threads) {
+    thread.join();
+  }
+}
+
+void WorkerPool::run(std::function<void()> work, std::function<void()> then) {
+  {
+    std::lock_guard<std::mutex> lock(_mutex);
+    _queued.push_back({ std::move(work), std::move(then) });
+  }
+  _pendingJobs ++;
+  _jobQueued.notify_one();
+}
+
+void WorkerPool::finishJobs() {
+  std::deque<Job> finished;
+  {
+    std::lock_guard<std::mutex> lock(_mutex);
+    finished.swap(_finished);
+  }
+  // Outside the lock, since `then` may queue more jobs
+  for (Job& job : finished) {
+    _pendingJobs --;
+    job.then();
+  }
+}
+
+void WorkerPool::workerMain() {
+  std::unique_lock<std::mutex> lock(_mutex);
+  while (true) {
+    _jobQueued.wait(lock, [this]() { return _stopping || _queued.size(); });
+    if (_stopping) {
+      return;
+    }
+    Job job = std::move(_queued.front());
+    _queued.pop_front();
+
+    lock.unlock();
+    job.work();
+    lock.lock();
+    _finished.push_back(std::move(job));
+  }
+}
+
+#else
+
+WorkerPool::WorkerPool(int numThreads) {}
+
+WorkerPool::~WorkerPool() {}
+
+void WorkerPool::run(std::function<void()> work, std::function<void()> then) {
+  _queued.push_back({ std::move(work), std::move(then) });
+  _pendingJobs ++;
+}
+
+void WorkerPool::finishJobs() {
+  if (_queued.empty()) {
+    return;
+  }
+  Job job = std::move(_queued.front());
+  _queued.pop_front();
+  _pendingJobs --;
+  job.work();
+  job.then();
+}
+
+#endif
@@ -0,0 +1,56 @@
+#ifndef WORKER_POOL_H
+#define WORKER_POOL_H
+
+#include "support.h"
+
+#include <condition_variable>
+#include <deque>
+#include <mutex>
+#include <thread>
+
+// Natively, and in web builds made with pthreads (see THREADS in the Makefile)
+#if defined(__APPLE__) || defined(__EMSCRIPTEN_PTHREADS__)
+#define WORKER_POOL_THREADS 1
+#endif
+
+// Runs jobs off the main thread, eg. decoding images (see ImageDecoder). Each
+// job's `work` runs on one of the pool's threads, and its `then` back on the
+// main thread from finishJobs(), so only `then` may touch GL or anything else
+// the main thread owns.
+//
+// Without threads, finishJobs() does one job's work itself instead, so a
+// burst of them is still spread over frames.
+struct WorkerPool {
+  explicit WorkerPool(int numThreads = defaultThreads());
+  ~WorkerPool(); // Jobs that haven't finished are dropped
+
+  void run(std::function<void()> work, std::function<void()> then);
+
+  // Calls `then` for every job that's finished since the last call
+  void finishJobs();
+
+  int pendingJobs() const { return _pendingJobs; }
+
+  static int defaultThreads();
+
+private:
+  struct Job {
+    std::function<void()> work;
+    std::function<void()> then;
+  };
+
+  std::deque<Job> _queued;
+  int _pendingJobs = 0; // Queued or finished, but not handed back yet
+
+#ifdef WORKER_POOL_THREADS
+  void workerMain();
+
+  std::deque<Job> _finished;
+  std::mutex _mutex; // Guards both queues, and _stopping
+  std::condition_variable _jobQueued;
+  vector<std::thread> _threads;
+  bool _stopping = false;
+#endif
+};
+
+#endif
@@ -13,7 +13,9 @@ uniform bool unifHighlight;
 out lowp vec4 outColor;
 
 void main() {
-  lowp vec4 light = texture(unifLightmapTexture, intermLightmapCoords);
+  // RGBM (the alpha is 1 for uncompressed lightmaps)
+  lowp vec4 encodedLight = texture(unifLightmapTexture, intermLightmapCoords);
+  lowp vec4 light = vec4(encodedLight.rgb * encodedLight.a, 1.0);
   lowp vec4 color = texture(unifTexture, intermTextureCoords);
   if (unifAlpha > 0.99f) {
     outColor = vec4(0.15, 0.15, 0.15, 0.15) + color * light * 4.0;
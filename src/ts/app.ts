@@ -1,5 +1,4 @@
-import { parseMessage, LoadResource, Message, ResourceType, LoadShaders } from './bindings'
-import { isEmpty } from './helper'
+import { parseMessage, LoadResource, LoadResources, Message, ResourceType, LoadShaders, LoadedTextures } from './bindings'
 
 (function () {
   window.createImageBitmap = window.createImageBitmap  || createImageBitmapForSafari;
@@ -29,8 +28,8 @@ import { isEmpty } from './helper'
 
 async function loadFile(src: string) {
   const blob = await fetch(src).then(resp => resp.blob())
-  const pointer = await window.Module.createBuffer(blob.size)
   const buffer = await blob.arrayBuffer()
+  const pointer = await window.Module.createBuffer(blob.size)
 
   const data = new Uint8ClampedArray(buffer)
   window.Module.HEAP8.set(data, pointer)
@@ -41,149 +40,370 @@ async function loadFile(src: string) {
   }
 }
 
+// The first of `urls` that exists, eg. a compressed version of a file before
+// the file itself
+async function fetchFirst(urls: string[]) {
+  for (const url of urls) {
+    const resp = await fetch(url).catch(() => undefined)
+    if (resp && resp.ok) {
+      return resp
+    }
+  }
+  return undefined
+}
+
+// `length` bytes from `offset` into an archive (see archive.h), or if `length`
+// is 0, the end of it, and where the bytes it got start. Servers that ignore
+// the Range header would send the whole archive for every read, so anything
+// but a 206 is a failure: for the end, C++ doesn't mount the archive, and
+// reads loose files instead.
+const kArchiveTailLength = 22 + 0xffff
+async function loadRange(url: string, offset: number, length: number) {
+  const failed = { pointer: 0, offset: 0, length: 0, fileLength: 0 }
+  const range = length ? `bytes=${offset}-${offset + length - 1}` : `bytes=-${kArchiveTailLength}`
+  const resp = await fetch(url, { headers: { Range: range } }).catch(() => undefined)
+  // eg. "bytes 100-199/1000"
+  const contentRange = resp?.status == 206 ? resp.headers.get('Content-Range')?.match(/(\d+)-\d+\/(\d+)/) : undefined
+  if (!resp || !contentRange) {
+    resp?.body?.cancel()
+    return failed
+  }
+
+  // The body can still fail partway, eg. if the connection drops
+  const buffer = await resp.arrayBuffer().catch(() => undefined)
+  if (!buffer) {
+    return failed
+  }
+  const pointer = await window.Module.createBuffer(buffer.byteLength)
+  window.Module.HEAP8.set(new Uint8Array(buffer), pointer)
+  return {
+    pointer,
+    offset: Number(contentRange[1]),
+    length: buffer.byteLength,
+    fileLength: Number(contentRange[2])
+  }
+}
+
+// Copies the file into wasm memory as it downloads, instead of waiting for all
+// of it. `onProgress` is called after every chunk with the number of bytes
+// filled in so far. Falls back to loading it in one go if the size isn't known
+// up front (eg. the response is compressed).
+async function streamFile(resp: Response, onProgress: (pointer: number, loaded: number, length: number) => void) {
+  const encoding = resp.headers.get('Content-Encoding')
+  const length = Number(resp.headers.get('Content-Length'))
+  if (!resp.body || !length || (encoding && encoding != 'identity')) {
+    const blob = await resp.blob()
+    const pointer = await window.Module.createBuffer(blob.size)
+    window.Module.HEAP8.set(new Uint8ClampedArray(await blob.arrayBuffer()), pointer)
+    return { pointer, length: blob.size }
+  }
+
+  const pointer = await window.Module.createBuffer(length)
+  const reader = resp.body.getReader()
+  let loaded = 0
+  while (true) {
+    const { done, value } = await reader.read()
+    if (done) {
+      break
+    }
+    if (loaded + value.length > length) {
+      throw new Error(`${resp.url} is longer than its Content-Length`)
+    }
+
+    // HEAP8 is replaced when wasm memory grows, so look it up every time
+    window.Module.HEAP8.set(value, pointer + loaded)
+    loaded += value.length
+    onProgress(pointer, loaded, length)
+  }
+
+  return { pointer, length }
+}
+
+// Scaled down so neither side is over `maxSize`, unless that's 0
 const imageCanvas = document.createElement('canvas');
-async function loadImage(src: string) {
+async function loadImage(src: string, maxSize: number = 0) {
   const imgBlob = await fetch(src).then(resp => resp.blob());
   const imageBitmap = await createImageBitmap(imgBlob);
+  const scale = maxSize > 0 ? Math.min(1, maxSize / Math.max(imageBitmap.width, imageBitmap.height)) : 1
+  const width = Math.max(1, Math.floor(imageBitmap.width * scale))
+  const height = Math.max(1, Math.floor(imageBitmap.height * scale))
 
-  // Make canvas same size as image
-  imageCanvas.width = imageBitmap.width;
-  imageCanvas.height = imageBitmap.height;
+  // Make canvas the size we want the image to be
+  imageCanvas.width = width;
+  imageCanvas.height = height;
 
   // Draw image onto imageCanvas
   const ctx = imageCanvas.getContext('2d') as CanvasRenderingContext2D;
-  ctx.drawImage(imageBitmap, 0, 0);
+  ctx.imageSmoothingQuality = 'high';
+  ctx.drawImage(imageBitmap, 0, 0, width, height);
 
   // Get image data
-  const image = ctx.getImageData(0, 0, imageBitmap.width, imageBitmap.height);
+  const image = ctx.getImageData(0, 0, width, height);
 
   const pointer = await window.Module.createBuffer(image.width * image.height * 4)
   window.Module.HEAP8.set(image.data, pointer)
-  return { pointer, width: image.width, height: image.height }
-}
-
-// Looks like: [
-//   ["qer_editorimage", "textures/proto2/beam_blue.tga"],
-//   ["surfaceparm", "trans"],
-//   ["surfaceparm", "nomarks"],
-//   ["surfaceparm", "nonsolid"],
-//   ["surfaceparm", "nolightmap"],
-//   ["qer_trans", ".6"],
-//   ["cull", "none"],
-//   [
-//     ["map", "textures/proto2/beam_blue.tga"],
-//     ["blendfunc", "add"]
-//   ]
-// ]
-type RawTextureOptions = Array<any>
-
-type TextureManifest = { textures: {[key: string]: boolean}, shaders: {[key: string]: RawTextureOptions} }
-let _textureManifest: TextureManifest = { textures: {}, shaders: {} }
-async function getTextureManifest() {
-  if (!isEmpty(_textureManifest.textures)) {
-    return _textureManifest
-  }
-  _textureManifest = await fetch('./data/textures_manifest.json')
-    .then(resp => resp.json()) as TextureManifest
-
-  return _textureManifest
-}
-
-function findTextureInManifest(url: string, manifest: TextureManifest): string | undefined {
-  url = url.replace(/^(\.\/)/,"")
-  if (url in manifest.textures) {
-    return url
+  return {
+    pointer,
+    width: image.width,
+    height: image.height,
+    fullWidth: imageBitmap.width,
+    fullHeight: imageBitmap.height
   }
-  
-  if ((url + '.jpg') in manifest.textures) {
-    return url + '.jpg'
+}
+
+// Decoded by the browser and uploaded straight into `texture`, a texture C++
+// made for it (see ResourceManager::ImageUploads), so the pixels never pass
+// through wasm memory. Scaled down like loadImage's.
+async function uploadImage(src: string, texture: number, maxSize: number = 0) {
+  const imgBlob = await fetch(src).then(resp => resp.blob());
+  const options: ImageBitmapOptions = { premultiplyAlpha: 'none', colorSpaceConversion: 'none' }
+  let imageBitmap = await createImageBitmap(imgBlob, options);
+  const fullWidth = imageBitmap.width
+  const fullHeight = imageBitmap.height
+  const scale = maxSize > 0 ? Math.min(1, maxSize / Math.max(fullWidth, fullHeight)) : 1
+  if (scale < 1) {
+    imageBitmap.close()
+    imageBitmap = await createImageBitmap(imgBlob, {
+      ...options,
+      resizeWidth: Math.max(1, Math.floor(fullWidth * scale)),
+      resizeHeight: Math.max(1, Math.floor(fullHeight * scale)),
+      resizeQuality: 'high'
+    });
   }
-  
-  if ((url + '.png') in manifest.textures) {
-    return url + '.png'
+
+  const gl = window.Module.glContext()
+  const target = window.Module.glTexture(texture)
+  if (!target) {
+    imageBitmap.close()
+    throw new Error(`no texture ${texture} to upload ${src} into`)
   }
 
-  return undefined
+  // Leaves the bindings the way C++ had them. A bound unpack buffer would be
+  // read from instead of the image.
+  const previousTexture = gl.getParameter(gl.TEXTURE_BINDING_2D)
+  const previousUnpackBuffer = gl.getParameter(gl.PIXEL_UNPACK_BUFFER_BINDING)
+  gl.bindBuffer(gl.PIXEL_UNPACK_BUFFER, null)
+  gl.bindTexture(gl.TEXTURE_2D, target)
+  gl.texImage2D(gl.TEXTURE_2D, 0, gl.RGBA8, imageBitmap.width, imageBitmap.height, 0, gl.RGBA, gl.UNSIGNED_BYTE, imageBitmap)
+  gl.bindTexture(gl.TEXTURE_2D, previousTexture)
+  gl.bindBuffer(gl.PIXEL_UNPACK_BUFFER, previousUnpackBuffer)
+
+  const { width, height } = imageBitmap
+  imageBitmap.close()
+  return {
+    pointer: 0,
+    width,
+    height,
+    fullWidth,
+    fullHeight
+  }
 }
 
-type TextureOptions = {
-  surfaceParamTrans?: boolean
+// C++ resolves textures to the file to load through the texture manifest (see
+// texture_manifest.h), so `url` usually has the right extension. Until it's
+// loaded, or without one, we try each extension Quake's textures come in.
+async function findTexture(url: string): Promise<string | undefined> {
+  if (/\.[A-z]+$/.test(url)) {
+    return url
+  }
+  for (const extension of ['.jpg', '.png', '.tga']) {
+    const resp = await fetch(url + extension, { method: 'HEAD' }).catch(() => undefined)
+    if (resp && resp.ok) {
+      return url + extension
+    }
+  }
+  return undefined
 }
 
-function findTextureOptions(url: string, manifest: TextureManifest) : TextureOptions | undefined {
-  url = url.replace(/^.*data\//,"")
-  url = url.replace(/\.[A-z]+$/,"")
+// Texture results are collected and sent to C++ together, about once a frame,
+// rather than crossing over once (or twice) per texture.
+const kTextureBatchMs = 16
+let pendingTextures: LoadedTextures | undefined
+function queueTextureResult(update: (batch: LoadedTextures) => void) {
+  if (!pendingTextures) {
+    pendingTextures = { type: 'LoadedTextures', loaded: [], compressed: [], files: [], missing: [], ranges: [] }
+    setTimeout(() => {
+      const batch = pendingTextures as LoadedTextures
+      pendingTextures = undefined
+      sendMessageFromWeb(batch)
+    }, kTextureBatchMs)
+  }
+  update(pendingTextures)
+}
 
-  let rawShader
-  if (url in manifest.shaders) {
-    rawShader = manifest.shaders[url]
+// Whatever goes wrong (a failed fetch, an image the browser can't decode), C++
+// hears back, or it would wait on the texture forever, and keep one of its
+// request slots taken.
+async function loadTexture(message: LoadResource) {
+  try {
+    await fetchTexture(message)
+  } catch (error) {
+    console.warn(`couldn't load ${message.url}`, error)
+    queueTextureResult(batch => batch.missing.push({
+      type: 'MissingTexture',
+      resourceID: message.resourceID
+    }))
   }
-  
-  if ((url + '.jpg') in manifest.shaders) {
-    rawShader = manifest.shaders[(url + '.jpg')]
+}
+
+async function fetchTexture(message: LoadResource) {
+  if (message.decodeInBrowser) {
+    // One C++ couldn't decode, by the URL it was found at
+    const image = message.texture
+      ? await uploadImage(message.url, message.texture, message.maxSize)
+      : await loadImage(message.url, message.maxSize)
+    queueTextureResult(batch => batch.loaded.push({
+      type: 'LoadedTexture',
+      resourceID: message.resourceID,
+      pointer: image.pointer,
+      width: image.width,
+      height: image.height,
+      fullWidth: image.fullWidth,
+      fullHeight: image.fullHeight
+    }))
+    return
   }
-  
-  if ((url + '.png') in manifest.shaders) {
-    rawShader = manifest.shaders[(url + '.png')]
+
+  if (message.archive) {
+    // C++ found it in an archive, and just needs it read. Natively, C++ reads
+    // it itself.
+    const range = window?.isOSX
+      ? { pointer: 0, offset: 0, length: 0, fileLength: 0 }
+      : await loadRange(message.archive, message.offset, message.length)
+    queueTextureResult(batch => batch.ranges.push({
+      type: 'LoadedArchiveRange',
+      resourceID: message.resourceID,
+      ...range
+    }))
+    return
   }
 
-  if (!rawShader) {
-    return undefined
+  const textureUrl = await findTexture(message.url)
+  if (!textureUrl) {
+    queueTextureResult(batch => batch.missing.push({
+      type: 'MissingTexture',
+      resourceID: message.resourceID
+    }))
+    return
   }
 
-  const result: TextureOptions = {}
-  for (const line of rawShader) {
-    if (line[0] == 'surfaceparm' && line[1] == 'trans') {
-      result['surfaceParamTrans'] = true
+  // GPU compressed textures (which C++ only resolves to if it can use them)
+  // come with every level, and C++ picks the ones that fit `maxSize`.
+  // Images are handed over still encoded, and decoded (and scaled down to
+  // `maxSize`) by C++ off the main thread. Natively, C++ reads the file itself.
+  // If C++ gave us a texture, we upload the image into it ourselves instead,
+  // unless it's one the browser can't decode (eg. .tga).
+  const compressed = textureUrl.endsWith('.qtex') ? await loadFile(textureUrl) : undefined
+  const uploaded = compressed || !message.texture
+    ? undefined
+    : await uploadImage(textureUrl, message.texture, message.maxSize).catch(() => undefined)
+  const file = compressed || uploaded || window?.isOSX ? undefined : await loadFile(textureUrl)
+  queueTextureResult(batch => {
+    if (compressed) {
+      batch.compressed.push({
+        type: 'LoadedCompressedTexture',
+        resourceID: message.resourceID,
+        pointer: compressed.pointer,
+        length: compressed.length
+      })
+    } else if (uploaded) {
+      batch.loaded.push({
+        type: 'LoadedTexture',
+        resourceID: message.resourceID,
+        ...uploaded
+      })
+    } else {
+      batch.files.push({
+        type: 'LoadedImageFile',
+        resourceID: message.resourceID,
+        url: textureUrl,
+        pointer: file ? file.pointer : 0,
+        length: file ? file.length : 0
+      })
     }
-  }
+  })
+}
 
-  return result;
+async function loadResources(message: LoadResources) {
+  await Promise.all(message.resources.map(resource => loadResource(resource)))
 }
 
 async function loadResource(message: LoadResource) {
   console.warn('loading resource', message)
   switch (message.resourceType) {
     case ResourceType.BSP_FILE: {
-      const { pointer } = await loadFile(message.url)
+      // Maps compressed by `make compress_maps` are decompressed by C++ as
+      // they stream in
+      const resp = await fetchFirst([message.url + '.qz', message.url])
+      if (!resp) {
+        throw new Error(`couldn't load ${message.url}`)
+      }
+
+      const { pointer, length } = await streamFile(resp, (pointer, loaded, length) => {
+        sendMessageFromWeb({
+          type: 'LoadingBSP',
+          resourceID: message.resourceID,
+          pointer: pointer,
+          loaded: loaded,
+          length: length
+        })
+      })
       sendMessageFromWeb({
         type: 'LoadedBSP',
         resourceID: message.resourceID,
-        pointer: pointer
+        pointer: pointer,
+        length: length
       })
 
       break
     }
-    case ResourceType.IMAGE_FILE: {
-      const textureManifest = await getTextureManifest()
-      const textureUrl = findTextureInManifest(message.url, textureManifest)
-      if (textureUrl) {
-        const image = await loadImage(textureUrl)
-        sendMessageFromWeb({
-          type: 'LoadedTexture',
-          resourceID: message.resourceID,
-          pointer: image.pointer,
-          width: image.width,
-          height: image.height
-        })
-        const shaderForTexture = findTextureOptions(textureUrl, textureManifest)
-        if (shaderForTexture) {
-          console.warn('shader for', textureUrl, '=>', shaderForTexture)
-          sendMessageFromWeb({
-            type: 'LoadedTextureOptions',
-            resourceID: message.resourceID,
-            surfaceParamTrans: shaderForTexture.surfaceParamTrans === true
-          })
-        }
-
-      } else {
+    case ResourceType.COOKED_MAP_FILE: {
+      // Optional: without one, the map is cooked in memory after loading
+      const resp = await fetchFirst([message.url + '.qz', message.url])
+      if (!resp) {
         sendMessageFromWeb({
-          type: 'MissingTexture',
-          resourceID: message.resourceID,
+          type: 'MissingCookedMap',
+          resourceID: message.resourceID
         })
+        break
       }
+
+      const { pointer, length } = await streamFile(resp, () => {})
+      sendMessageFromWeb({
+        type: 'LoadedCookedMap',
+        resourceID: message.resourceID,
+        pointer: pointer,
+        length: length
+      })
+
+      break
+    }
+    case ResourceType.IMAGE_FILE: {
+      await loadTexture(message)
+      break
+    }
+    case ResourceType.TEXTURE_MANIFEST_FILE: {
+      // Optional: without one, textures are looked for by URL
+      const resp = await fetchFirst([message.url])
+      const { pointer, length } = resp ? await streamFile(resp, () => {}) : { pointer: 0, length: 0 }
+      sendMessageFromWeb({
+        type: 'LoadedTextureManifest',
+        resourceID: message.resourceID,
+        pointer: pointer,
+        length: length
+      })
       break
-    }    
+    }
+    case ResourceType.ARCHIVE_FILE: {
+      // Its central directory, which C++ reads the rest of the archive by
+      const range = await loadRange(message.url, message.offset, message.length)
+      sendMessageFromWeb({
+        type: 'LoadedArchiveRange',
+        resourceID: message.resourceID,
+        ...range
+      })
+      break
+    }
   }
 }
 
@@ -204,9 +424,30 @@ function sendMessageFromWeb(message: Message) {
   window.Module.sendMessageToCPP(JSON.stringify(message))
 }
 
+// Options set in the page's URL, eg. ?imageUploads=browser to have the
+// browser decode & upload images (see ResourceManager::ImageUploads)
+function sendUrlOptions() {
+  const params = new URLSearchParams(window.location.search)
+  const imageUploads = params.get('imageUploads')
+  if (imageUploads) {
+    sendMessageFromWeb({
+      type: 'SetImageUploads',
+      fromBrowser: imageUploads === 'browser'
+    })
+  }
+}
+
 // Setup bindings
+let sentUrlOptions = false
 window.MessageHandler = {
   handleMessageFromCPP: (json: string) => {
+    // C++ is up once it sends us something. Not sent from inside its call,
+    // but before the map's textures are asked for (see LoadPriority::DEFERRED).
+    if (!sentUrlOptions) {
+      sentUrlOptions = true
+      Promise.resolve().then(sendUrlOptions)
+    }
+
     const message = parseMessage(json)
     console.log('CPP => TS w/', message)
     switch (message.type) {
@@ -214,6 +455,10 @@ window.MessageHandler = {
         loadResource(message)
         break
       }
+      case 'LoadResources': {
+        loadResources(message)
+        break
+      }
       case 'LoadShaders': {
         loadShaders(message)
         break
@@ -1,6 +1,9 @@
 export enum ResourceType {
   BSP_FILE,
   IMAGE_FILE,
+  COOKED_MAP_FILE,
+  ARCHIVE_FILE,
+  TEXTURE_MANIFEST_FILE,
   UNKNOWN
 };
 export interface TestMessage {
@@ -14,11 +17,25 @@ export interface TestPointer {
 export interface OSXReady {
   type: 'OSXReady'
 }
+export interface SetImageUploads {
+  type: 'SetImageUploads'
+  fromBrowser: boolean;
+}
 export interface LoadResource {
   type: 'LoadResource'
   url: string;
   resourceType: ResourceType;
   resourceID: number;
+  maxSize: number;
+  decodeInBrowser: boolean;
+  texture: number;
+  archive: string;
+  offset: number;
+  length: number;
+}
+export interface LoadResources {
+  type: 'LoadResources'
+  resources: LoadResource[];
 }
 export interface LoadShaders {
   type: 'LoadShaders'
@@ -40,35 +57,94 @@ export interface LoadedTexture {
   pointer: any;
   width: number;
   height: number;
+  fullWidth: number;
+  fullHeight: number;
+}
+export interface LoadedCompressedTexture {
+  type: 'LoadedCompressedTexture'
+  resourceID: number;
+  pointer: any;
+  length: number;
+}
+export interface LoadedImageFile {
+  type: 'LoadedImageFile'
+  resourceID: number;
+  url: string;
+  pointer: any;
+  length: number;
+}
+export interface LoadedArchiveRange {
+  type: 'LoadedArchiveRange'
+  resourceID: number;
+  pointer: any;
+  offset: number;
+  length: number;
+  fileLength: number;
 }
 export interface MissingTexture {
   type: 'MissingTexture'
   resourceID: number;
 }
+export interface LoadingBSP {
+  type: 'LoadingBSP'
+  resourceID: number;
+  pointer: any;
+  loaded: number;
+  length: number;
+}
 export interface LoadedBSP {
   type: 'LoadedBSP'
   resourceID: number;
   pointer: any;
+  length: number;
 }
-export interface LoadedTextureOptions {
-  type: 'LoadedTextureOptions'
+export interface LoadedCookedMap {
+  type: 'LoadedCookedMap'
   resourceID: number;
-  surfaceParamTrans: boolean;
+  pointer: any;
+  length: number;
+}
+export interface MissingCookedMap {
+  type: 'MissingCookedMap'
+  resourceID: number;
+}
+export interface LoadedTextureManifest {
+  type: 'LoadedTextureManifest'
+  resourceID: number;
+  pointer: any;
+  length: number;
+}
+export interface LoadedTextures {
+  type: 'LoadedTextures'
+  loaded: LoadedTexture[];
+  compressed: LoadedCompressedTexture[];
+  files: LoadedImageFile[];
+  missing: MissingTexture[];
+  ranges: LoadedArchiveRange[];
 }
-export type Message = { type: 'Unknown' }  | TestMessage  | TestPointer  | OSXReady  | LoadResource  | LoadShaders  | LoadedShaders  | LoadedTexture  | MissingTexture  | LoadedBSP  | LoadedTextureOptions 
+export type Message = { type: 'Unknown' }  | TestMessage  | TestPointer  | OSXReady  | SetImageUploads  | LoadResource  | LoadResources  | LoadShaders  | LoadedShaders  | LoadedTexture  | LoadedCompressedTexture  | LoadedImageFile  | LoadedArchiveRange  | MissingTexture  | LoadingBSP  | LoadedBSP  | LoadedCookedMap  | MissingCookedMap  | LoadedTextureManifest  | LoadedTextures 
 export function parseMessage(json: string): Message {
   const val = JSON.parse(json)
   switch (val.type) {
     case 'TestMessage': return val as TestMessage
     case 'TestPointer': return val as TestPointer
     case 'OSXReady': return val as OSXReady
+    case 'SetImageUploads': return val as SetImageUploads
     case 'LoadResource': return val as LoadResource
+    case 'LoadResources': return val as LoadResources
     case 'LoadShaders': return val as LoadShaders
     case 'LoadedShaders': return val as LoadedShaders
     case 'LoadedTexture': return val as LoadedTexture
+    case 'LoadedCompressedTexture': return val as LoadedCompressedTexture
+    case 'LoadedImageFile': return val as LoadedImageFile
+    case 'LoadedArchiveRange': return val as LoadedArchiveRange
     case 'MissingTexture': return val as MissingTexture
+    case 'LoadingBSP': return val as LoadingBSP
     case 'LoadedBSP': return val as LoadedBSP
-    case 'LoadedTextureOptions': return val as LoadedTextureOptions
+    case 'LoadedCookedMap': return val as LoadedCookedMap
+    case 'MissingCookedMap': return val as MissingCookedMap
+    case 'LoadedTextureManifest': return val as LoadedTextureManifest
+    case 'LoadedTextures': return val as LoadedTextures
   }
   return { type: 'Unknown' }
 }
\ No newline at end of file
@@ -1,6 +1,8 @@
 declare var Module: {
   sendMessageToCPP: (s: string) => void
   createBuffer: (bytes: number) => Promise<any>
+  glContext: () => WebGL2RenderingContext
+  glTexture: (name: number) => WebGLTexture | null
 } & EmscriptenModule
 
 interface MessageHandler {
@@ -0,0 +1,47 @@
+# Writes a GPU compressed .qtex next to every texture in data/textures (see
+# src/cpp/texture_compression.h), using the cook tool. It reads TGA, PNG and
+# (non-progressive) JPEG itself; anything it can't is converted to a TGA first,
+# which needs Pillow.
+#
+#   make compress_textures
+
+import os, subprocess, sys, tempfile
+
+COOK = './output/cook'
+IMAGE_EXTENSIONS = ('.tga', '.jpg', '.jpeg', '.png')
+
+try:
+  from PIL import Image
+except ImportError:
+  Image = None
+  print('Pillow isn\'t installed, so images the cook tool can\'t read will be skipped')
+
+written = 0
+skipped = 0
+
+for subdir, dirs, files in os.walk('data/textures'):
+  for file in files:
+    name, extension = os.path.splitext(file)
+    if extension.lower() not in IMAGE_EXTENSIONS:
+      continue
+
+    source = os.path.join(subdir, file)
+    destination = os.path.join(subdir, name + '.qtex')
+    if os.path.exists(destination) and os.path.getmtime(destination) >= os.path.getmtime(source):
+      continue
+
+    result = subprocess.run([COOK, '--texture', source, destination])
+    if result.returncode != 0 and extension.lower() != '.tga':
+      if not Image:
+        skipped += 1
+        continue
+      with tempfile.NamedTemporaryFile(suffix='.tga') as converted:
+        Image.open(source).convert('RGBA').save(converted.name)
+        result = subprocess.run([COOK, '--texture', converted.name, destination])
+
+    if result.returncode != 0:
+      print('couldn\'t compress', source, file=sys.stderr)
+    else:
+      written += 1
+
+print('compressed', written, 'textures,', skipped, 'skipped')